@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Pool of threads running the user callbacks of a convenience layer client.
+   Work items are posted either to one of lane_count ordered lanes or to the parallel lane. Items of an
+   ordered lane run one at a time, in the order they were posted; items of the parallel lane run as soon
+   as any thread of the pool is free. A slow item therefore only delays the items posted after it to the
+   same ordered lane. callback_dispatcher_destroy runs every item still queued before returning. */
+
+#ifndef IOTHUB_CLIENT_DISPATCHER_H
+#define IOTHUB_CLIENT_DISPATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define CALLBACK_DISPATCHER_PARALLEL_LANE SIZE_MAX
+
+typedef struct CALLBACK_DISPATCHER_TAG* CALLBACK_DISPATCHER_HANDLE;
+
+typedef void(*CALLBACK_DISPATCHER_WORK)(void* context);
+
+MOCKABLE_FUNCTION(, CALLBACK_DISPATCHER_HANDLE, callback_dispatcher_create, size_t, thread_count, size_t, lane_count);
+MOCKABLE_FUNCTION(, void, callback_dispatcher_destroy, CALLBACK_DISPATCHER_HANDLE, dispatcher);
+MOCKABLE_FUNCTION(, int, callback_dispatcher_post, CALLBACK_DISPATCHER_HANDLE, dispatcher, size_t, lane, CALLBACK_DISPATCHER_WORK, work, void*, context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_DISPATCHER_H */
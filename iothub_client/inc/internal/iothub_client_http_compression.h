@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* gzip (RFC 1952) compression of HTTP request bodies, built on zlib.
+   Only available when the SDK is built with use_http_compression. */
+
+#ifndef IOTHUB_CLIENT_HTTP_COMPRESSION_H
+#define IOTHUB_CLIENT_HTTP_COMPRESSION_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* value of the Content-Encoding header of the bodies produced by http_compression_gzip */
+#define HTTP_COMPRESSION_CONTENT_ENCODING "gzip"
+
+/* returns a new buffer holding the gzip stream of the size bytes at source, NULL on failure */
+MOCKABLE_FUNCTION(, BUFFER_HANDLE, http_compression_gzip, const unsigned char*, source, size_t, size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_HTTP_COMPRESSION_H */
@@ -0,0 +1,52 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Table of the publishes waiting for their acknowledgement, indexed by their 16 bits MQTT packet id.
+   Entries are intrusive (INFLIGHT_TABLE_ENTRY is embedded in the owner's structure) and are hashed on the
+   low bits of the packet id. Packet ids are handed out sequentially, so they spread evenly over the buckets
+   and adding, finding or removing an entry costs O(1) whatever the number of publishes in flight.
+   The first INFLIGHT_TABLE_INLINE_BUCKETS buckets live in the table itself, memory is only allocated once
+   more publishes than that are in flight, then the bucket array doubles when it holds as many entries as
+   it has buckets and never shrinks. The table points into itself, it must not be moved once initialized. */
+
+#ifndef IOTHUB_CLIENT_INFLIGHT_TABLE_H
+#define IOTHUB_CLIENT_INFLIGHT_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define INFLIGHT_TABLE_INLINE_BUCKETS   16
+#define INFLIGHT_TABLE_MAX_BUCKETS      ((size_t)UINT16_MAX + 1)
+
+typedef struct INFLIGHT_TABLE_ENTRY_TAG
+{
+    struct INFLIGHT_TABLE_ENTRY_TAG* next;
+    uint16_t packet_id;
+} INFLIGHT_TABLE_ENTRY;
+
+typedef struct INFLIGHT_TABLE_TAG
+{
+    INFLIGHT_TABLE_ENTRY** buckets;     /* inline_buckets until the table first grows */
+    size_t bucket_count;                /* always a power of 2 */
+    size_t count;                       /* number of entries in the table */
+    INFLIGHT_TABLE_ENTRY* inline_buckets[INFLIGHT_TABLE_INLINE_BUCKETS];
+} INFLIGHT_TABLE;
+
+MOCKABLE_FUNCTION(, void, inflight_table_init, INFLIGHT_TABLE*, inflight_table);
+MOCKABLE_FUNCTION(, void, inflight_table_deinit, INFLIGHT_TABLE*, inflight_table);
+MOCKABLE_FUNCTION(, int, inflight_table_add, INFLIGHT_TABLE*, inflight_table, INFLIGHT_TABLE_ENTRY*, entry, uint16_t, packet_id);
+MOCKABLE_FUNCTION(, INFLIGHT_TABLE_ENTRY*, inflight_table_find, const INFLIGHT_TABLE*, inflight_table, uint16_t, packet_id);
+MOCKABLE_FUNCTION(, INFLIGHT_TABLE_ENTRY*, inflight_table_remove, INFLIGHT_TABLE*, inflight_table, uint16_t, packet_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_INFLIGHT_TABLE_H */
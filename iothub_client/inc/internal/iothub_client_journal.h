@@ -0,0 +1,43 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Append-only, memory-mapped record journal.
+   Records are appended to fixed-size segment files mapped in memory and numbered with consecutive
+   sequence numbers starting at 1. Acknowledged records are flagged in place, the lowest sequence number
+   not acknowledged yet (the checkpoint) is persisted in a separate index file, and segments whose records
+   are all acknowledged are deleted. Writes are flushed to storage every sync_batch appends and on
+   message_journal_sync, so durability costs one msync per batch instead of one per record.
+   Opening a directory that already holds a journal recovers the records that were not acknowledged,
+   a torn record at the tail of a segment (e.g. power loss) ends the recovery of that segment.
+   This module relies on POSIX file mapping and is only built with the use_store_and_forward option.
+   It is not thread-safe, it is owned by a single IoTHubClient_LL instance. */
+
+#ifndef IOTHUB_CLIENT_JOURNAL_H
+#define IOTHUB_CLIENT_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct MESSAGE_JOURNAL_TAG* MESSAGE_JOURNAL_HANDLE;
+
+typedef void(*MESSAGE_JOURNAL_ON_PENDING_RECORD)(uint64_t sequence, const unsigned char* data, size_t size, void* context);
+
+MOCKABLE_FUNCTION(, MESSAGE_JOURNAL_HANDLE, message_journal_open, const char*, directory, size_t, segment_size, size_t, sync_batch);
+MOCKABLE_FUNCTION(, void, message_journal_close, MESSAGE_JOURNAL_HANDLE, journal);
+MOCKABLE_FUNCTION(, int, message_journal_append, MESSAGE_JOURNAL_HANDLE, journal, const unsigned char*, data, size_t, size, uint64_t*, sequence);
+MOCKABLE_FUNCTION(, int, message_journal_read, MESSAGE_JOURNAL_HANDLE, journal, uint64_t, sequence, const unsigned char**, data, size_t*, size);
+MOCKABLE_FUNCTION(, void, message_journal_acknowledge, MESSAGE_JOURNAL_HANDLE, journal, uint64_t, sequence);
+MOCKABLE_FUNCTION(, int, message_journal_for_each_pending, MESSAGE_JOURNAL_HANDLE, journal, MESSAGE_JOURNAL_ON_PENDING_RECORD, on_pending_record, void*, context);
+MOCKABLE_FUNCTION(, int, message_journal_sync, MESSAGE_JOURNAL_HANDLE, journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_JOURNAL_H */
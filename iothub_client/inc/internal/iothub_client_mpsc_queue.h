@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Lock-free multi-producer/single-consumer queue of intrusive nodes.
+   Any number of threads can push concurrently without taking a lock (a compare-and-swap on the queue head),
+   a single consumer takes everything pushed so far at once, in push order. Nodes are owned by the caller:
+   the queue never allocates or frees them, MPSC_QUEUE_NODE is meant to be the first member of the caller's record.
+   On compilers without atomic intrinsics the queue falls back to a private lock, which is still never held
+   for longer than a pointer swap. */
+
+#ifndef IOTHUB_CLIENT_MPSC_QUEUE_H
+#define IOTHUB_CLIENT_MPSC_QUEUE_H
+
+#include <stdbool.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct MPSC_QUEUE_NODE_TAG
+{
+    struct MPSC_QUEUE_NODE_TAG* next;
+} MPSC_QUEUE_NODE;
+
+typedef struct MPSC_QUEUE_TAG* MPSC_QUEUE_HANDLE;
+
+MOCKABLE_FUNCTION(, MPSC_QUEUE_HANDLE, mpsc_queue_create);
+MOCKABLE_FUNCTION(, void, mpsc_queue_destroy, MPSC_QUEUE_HANDLE, queue);
+/* was_empty (optional) tells the producer whether it made the queue non empty, that is whether the consumer may be waiting for it */
+MOCKABLE_FUNCTION(, int, mpsc_queue_push, MPSC_QUEUE_HANDLE, queue, MPSC_QUEUE_NODE*, node, bool*, was_empty);
+MOCKABLE_FUNCTION(, MPSC_QUEUE_NODE*, mpsc_queue_take_all, MPSC_QUEUE_HANDLE, queue);
+MOCKABLE_FUNCTION(, bool, mpsc_queue_is_empty, MPSC_QUEUE_HANDLE, queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_MPSC_QUEUE_H */
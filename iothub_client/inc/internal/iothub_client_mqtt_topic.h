@@ -0,0 +1,61 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Reusable buffer the MQTT transport writes its publish topics into.
+   The buffer starts with a fixed prefix (for example "devices/{id}/messages/events/") that is written
+   once, mqtt_topic_buffer_reset truncates the topic back to it before the properties of the next message
+   are appended. The storage only grows, so once it has reached the size of the longest topic, building
+   a topic does not allocate. URL encoding is done in place through a lookup table and produces the
+   same output as URL_EncodeString.
+   The same buffer type serves as the scratch space the transport decodes the properties of incoming topics
+   into: the topic is walked in place and only the property being handed to the message is copied out. */
+
+#ifndef IOTHUB_CLIENT_MQTT_TOPIC_H
+#define IOTHUB_CLIENT_MQTT_TOPIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct MQTT_TOPIC_BUFFER_TAG
+{
+    char* topic;            /* always '\0' terminated once mqtt_topic_buffer_init succeeded */
+    size_t length;          /* length of topic, without the terminator */
+    size_t capacity;        /* bytes allocated for topic */
+    size_t prefix_length;   /* length kept by mqtt_topic_buffer_reset */
+} MQTT_TOPIC_BUFFER;
+
+/* A property of a received topic, pointing into the topic itself (not '\0' terminated) */
+typedef struct MQTT_TOPIC_PROPERTY_TAG
+{
+    const char* name;
+    size_t name_length;
+    const char* value;
+    size_t value_length;
+} MQTT_TOPIC_PROPERTY;
+
+/* name and value of a property once copied in the scratch buffer, valid until the buffer is next used */
+typedef struct MQTT_TOPIC_DECODED_PROPERTY_TAG
+{
+    const char* name;
+    const char* value;
+} MQTT_TOPIC_DECODED_PROPERTY;
+
+MOCKABLE_FUNCTION(, int, mqtt_topic_buffer_init, MQTT_TOPIC_BUFFER*, topic_buffer, const char*, prefix_begin, const char*, device_id, const char*, prefix_end);
+MOCKABLE_FUNCTION(, void, mqtt_topic_buffer_deinit, MQTT_TOPIC_BUFFER*, topic_buffer);
+MOCKABLE_FUNCTION(, void, mqtt_topic_buffer_reset, MQTT_TOPIC_BUFFER*, topic_buffer);
+MOCKABLE_FUNCTION(, int, mqtt_topic_buffer_append_property, MQTT_TOPIC_BUFFER*, topic_buffer, const char*, name, const char*, value, bool, url_encode);
+MOCKABLE_FUNCTION(, int, mqtt_topic_buffer_append_system_property, MQTT_TOPIC_BUFFER*, topic_buffer, const char*, name, const char*, value, bool, url_encode);
+MOCKABLE_FUNCTION(, int, mqtt_topic_buffer_append_url_encoded, MQTT_TOPIC_BUFFER*, topic_buffer, const char*, text);
+MOCKABLE_FUNCTION(, int, mqtt_topic_buffer_decode_property, MQTT_TOPIC_BUFFER*, scratch, const MQTT_TOPIC_PROPERTY*, property, bool, decode_name, bool, decode_value, MQTT_TOPIC_DECODED_PROPERTY*, decoded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_MQTT_TOPIC_H */
@@ -54,6 +54,11 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     void* context; 
     DLIST_ENTRY entry;
     tickcounter_ms_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
+    size_t message_size; /* body size accounted in the send queue of the IOTHUBCLIENT_LL, only measured when OPTION_SEND_QUEUE_MAX_BYTES is set */
+    IOTHUB_MESSAGE_PRIORITY priority; /* waitingToSend is kept ordered by priority, so the transports draining it from the head send the higher priorities first */
+#ifdef USE_STORE_AND_FORWARD
+    uint64_t journal_sequence; /* sequence number of the message in the store of the IOTHUBCLIENT_LL, 0 if it is not stored */
+#endif
 }IOTHUB_MESSAGE_LIST;
 
 typedef struct IOTHUB_DEVICE_TWIN_TAG
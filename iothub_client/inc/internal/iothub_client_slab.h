@@ -0,0 +1,33 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Fixed-size record allocator.
+   Records are carved out of blocks of items_per_block records and recycled through a free list, so a
+   steady stream of allocate/free pairs (one per telemetry message) stops hitting the heap once the
+   slab has grown to the peak number of records in flight. Blocks are only returned to the heap by
+   slab_allocator_destroy. The allocator is not thread-safe, it is meant to be owned by a single
+   IoTHubClient_LL instance (or its transport) and used under the same serialization as the owner. */
+
+#ifndef IOTHUB_CLIENT_SLAB_H
+#define IOTHUB_CLIENT_SLAB_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct SLAB_ALLOCATOR_TAG* SLAB_ALLOCATOR_HANDLE;
+
+MOCKABLE_FUNCTION(, SLAB_ALLOCATOR_HANDLE, slab_allocator_create, size_t, item_size, size_t, items_per_block);
+MOCKABLE_FUNCTION(, void, slab_allocator_destroy, SLAB_ALLOCATOR_HANDLE, slab_allocator);
+MOCKABLE_FUNCTION(, void*, slab_allocator_alloc, SLAB_ALLOCATOR_HANDLE, slab_allocator);
+MOCKABLE_FUNCTION(, void, slab_allocator_free, SLAB_ALLOCATOR_HANDLE, slab_allocator, void*, item);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_SLAB_H */
@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Durable storage of the telemetry messages accepted by IoTHubClient_LL and not yet confirmed.
+   Messages (body, message id, correlation id, content type/encoding and application properties)
+   are serialized to a message journal (iothub_client_journal.h) and removed once the transport
+   confirms (or gives up on) them; the ones still pending when the client is destroyed are loaded
+   back by the next client opened on the same directory. Only built with the use_store_and_forward option. */
+
+#ifndef IOTHUB_CLIENT_STORE_AND_FORWARD_H
+#define IOTHUB_CLIENT_STORE_AND_FORWARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct STORE_AND_FORWARD_TAG* STORE_AND_FORWARD_HANDLE;
+
+typedef void(*STORE_AND_FORWARD_ON_PENDING_MESSAGE)(uint64_t sequence, void* context);
+
+MOCKABLE_FUNCTION(, STORE_AND_FORWARD_HANDLE, store_and_forward_create, const char*, directory, size_t, segment_size, size_t, sync_batch);
+MOCKABLE_FUNCTION(, void, store_and_forward_destroy, STORE_AND_FORWARD_HANDLE, store);
+MOCKABLE_FUNCTION(, int, store_and_forward_save, STORE_AND_FORWARD_HANDLE, store, IOTHUB_MESSAGE_HANDLE, message, uint64_t*, sequence);
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, store_and_forward_load, STORE_AND_FORWARD_HANDLE, store, uint64_t, sequence);
+MOCKABLE_FUNCTION(, void, store_and_forward_remove, STORE_AND_FORWARD_HANDLE, store, uint64_t, sequence);
+MOCKABLE_FUNCTION(, int, store_and_forward_get_pending, STORE_AND_FORWARD_HANDLE, store, STORE_AND_FORWARD_ON_PENDING_MESSAGE, on_pending_message, void*, context);
+MOCKABLE_FUNCTION(, int, store_and_forward_flush, STORE_AND_FORWARD_HANDLE, store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_STORE_AND_FORWARD_H */
@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Hierarchical timer wheel with millisecond resolution.
+   Timers are intrusive (TIMER_WHEEL_ENTRY is embedded in the owner's structure), so starting or
+   cancelling a timer never allocates and costs O(1). timer_wheel_process only visits the slots
+   that became due since it was last called, its cost does not depend on the number of armed timers.
+   The wheel does not read the clock itself, callers pass the current time taken from their own
+   TICK_COUNTER_HANDLE. */
+
+#ifndef IOTHUB_CLIENT_TIMER_WHEEL_H
+#define IOTHUB_CLIENT_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TIMER_WHEEL_LEVELS          4
+#define TIMER_WHEEL_SLOT_BITS       6
+#define TIMER_WHEEL_SLOTS           (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef void(*ON_TIMER_WHEEL_EXPIRED)(void* context);
+
+typedef struct TIMER_WHEEL_ENTRY_TAG
+{
+    struct TIMER_WHEEL_ENTRY_TAG* next;
+    struct TIMER_WHEEL_ENTRY_TAG** prev_next; /* NULL when the timer is not armed */
+    tickcounter_ms_t expires_at;
+    ON_TIMER_WHEEL_EXPIRED on_expired;
+    void* context;
+} TIMER_WHEEL_ENTRY;
+
+typedef struct TIMER_WHEEL_TAG
+{
+    TIMER_WHEEL_ENTRY* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    tickcounter_ms_t current_ms; /* every timer due before current_ms has already fired */
+    size_t armed_count;
+} TIMER_WHEEL;
+
+MOCKABLE_FUNCTION(, void, timer_wheel_init, TIMER_WHEEL*, timer_wheel);
+MOCKABLE_FUNCTION(, void, timer_wheel_deinit, TIMER_WHEEL*, timer_wheel);
+MOCKABLE_FUNCTION(, void, timer_wheel_entry_init, TIMER_WHEEL_ENTRY*, timer, ON_TIMER_WHEEL_EXPIRED, on_expired, void*, context);
+MOCKABLE_FUNCTION(, int, timer_wheel_start, TIMER_WHEEL*, timer_wheel, TIMER_WHEEL_ENTRY*, timer, tickcounter_ms_t, now_ms, tickcounter_ms_t, timeout_ms);
+MOCKABLE_FUNCTION(, void, timer_wheel_cancel, TIMER_WHEEL*, timer_wheel, TIMER_WHEEL_ENTRY*, timer);
+MOCKABLE_FUNCTION(, bool, timer_wheel_is_armed, const TIMER_WHEEL_ENTRY*, timer);
+MOCKABLE_FUNCTION(, size_t, timer_wheel_process, TIMER_WHEEL*, timer_wheel, tickcounter_ms_t, now_ms);
+MOCKABLE_FUNCTION(, bool, timer_wheel_get_next_due, const TIMER_WHEEL*, timer_wheel, tickcounter_ms_t*, due_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_TIMER_WHEEL_H */
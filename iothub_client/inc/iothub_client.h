@@ -126,6 +126,61 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Asynchronous call to send the message specified by @p eventMessageHandle,
+    * 			without making a copy of it.
+    *
+    * 			Unlike ::IoTHubClient_SendEventAsync, the message is not cloned: on success the
+    * 			client takes ownership of @p eventMessageHandle and destroys it once the
+    * 			delivery has been confirmed (or has failed). The caller must not use or
+    * 			destroy the handle after a successful call, including from within
+    * 			@p eventConfirmationCallback. On failure the caller keeps ownership.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandle		   	The handle to an IoT Hub message.
+    * @param	eventConfirmationCallback  	The callback specified by the device for receiving
+    * 										confirmation of the delivery of the IoT Hub message.
+    * 										The user can specify a @c NULL value here to
+    * 										indicate that no callback is required.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubClient_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventAsync_TakeOwnership, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
+    /**
+    * @brief	Asynchronous call to send the @p eventMessageCount messages of @p eventMessageHandles
+    * 			with a single confirmation for all of them.
+    *
+    * 			The messages are cloned and queued in order, as ::IoTHubClient_SendEventAsync
+    * 			does, so the transport sends them together: in a single batch over HTTP and AMQP,
+    * 			back to back over MQTT. The caller keeps ownership of the handles.
+    * 			@p eventConfirmationCallback is invoked once, after every message of the batch was
+    * 			completed, with IOTHUB_CLIENT_CONFIRMATION_OK if all of them were delivered, otherwise
+    * 			with the result of the first message that was not. If the call fails, none of
+    * 			the messages of the batch is sent and the callback is not invoked.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandles		   	Array of @p eventMessageCount IoT Hub message handles.
+    * @param	eventMessageCount		   	Number of messages in @p eventMessageHandles, at least 1.
+    * @param	eventConfirmationCallback  	The callback specified by the device for receiving
+    * 										confirmation of the delivery of the batch.
+    * 										The user can specify a @c NULL value here to
+    * 										indicate that no callback is required.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubClient_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventBatchAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE*, eventMessageHandles, size_t, eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief	This function returns the current sending status for IoTHubClient.
     *
@@ -174,6 +229,26 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetConnectionStatusCallback, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK, connectionStatusCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Sets up the callback invoked when the number of messages queued by
+    * 			IoTHubClient_SendEventAsync and not yet confirmed crosses the watermarks
+    * 			set with the @c OPTION_SEND_QUEUE_HIGH_WATERMARK and
+    * 			@c OPTION_SEND_QUEUE_LOW_WATERMARK options, so producers can throttle.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	watermarkCallback		   	The callback specified by the device for receiving
+    * 										the watermark notifications. A @c NULL value stops the
+    * 										notifications.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubClient_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SetSendQueueWatermarkCallback, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK, watermarkCallback, void*, userContextCallback);
+
     /**
     * @brief	Sets up the connection status callback to be invoked representing the status of
     * the connection to IOT Hub. This is a blocking call.
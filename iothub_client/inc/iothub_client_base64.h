@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/* Base64 encoding and decoding into caller-provided memory.
+   Besides the portable implementation there are vectorized ones (SSE4.1 and AVX2 on x86/x64,
+   NEON on ARM64). The fastest implementation supported by the build and by the CPU is picked
+   the first time the module is used; iothub_base64_set_implementation can force another one
+   (used by the unit tests and by the benchmark). Every implementation produces exactly the same
+   output. Encoding always pads with '=', decoding only handles complete groups of 4 characters,
+   callers deal with the padded tail themselves as the grammars they implement differ. */
+
+#ifndef IOTHUB_CLIENT_BASE64_H
+#define IOTHUB_CLIENT_BASE64_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define IOTHUB_BASE64_ALPHABET_VALUES \
+    IOTHUB_BASE64_ALPHABET_STANDARD, /* RFC 4648 section 4, '+' and '/' */ \
+    IOTHUB_BASE64_ALPHABET_URL /* RFC 4648 section 5, '-' and '_' */
+
+DEFINE_ENUM(IOTHUB_BASE64_ALPHABET, IOTHUB_BASE64_ALPHABET_VALUES);
+
+#define IOTHUB_BASE64_IMPLEMENTATION_VALUES \
+    IOTHUB_BASE64_IMPLEMENTATION_SCALAR, \
+    IOTHUB_BASE64_IMPLEMENTATION_SSE41, \
+    IOTHUB_BASE64_IMPLEMENTATION_AVX2, \
+    IOTHUB_BASE64_IMPLEMENTATION_NEON
+
+DEFINE_ENUM(IOTHUB_BASE64_IMPLEMENTATION, IOTHUB_BASE64_IMPLEMENTATION_VALUES);
+
+/* number of characters produced by iothub_base64_encode for size bytes (no '\0' is written) */
+#define IOTHUB_BASE64_ENCODED_LENGTH(size) (4 * (((size) + 2) / 3))
+
+/* encodes size bytes from source into destination, which must have room for IOTHUB_BASE64_ENCODED_LENGTH(size) characters.
+   Returns the number of characters written. */
+MOCKABLE_FUNCTION(, size_t, iothub_base64_encode, char*, destination, const unsigned char*, source, size_t, size, IOTHUB_BASE64_ALPHABET, alphabet);
+
+/* decodes the longest prefix of source made of complete groups of 4 characters of the alphabet ('=' is not part of it)
+   into destination, which must have room for 3 * (source_size / 4) bytes. Returns the number of characters consumed,
+   the number of bytes written is 3 / 4 of that. */
+MOCKABLE_FUNCTION(, size_t, iothub_base64_decode_groups, unsigned char*, destination, const char*, source, size_t, source_size, IOTHUB_BASE64_ALPHABET, alphabet);
+
+MOCKABLE_FUNCTION(, IOTHUB_BASE64_IMPLEMENTATION, iothub_base64_get_implementation);
+
+/* returns 0 and uses implementation from then on if the build and the CPU support it, a non-zero value otherwise */
+MOCKABLE_FUNCTION(, int, iothub_base64_set_implementation, IOTHUB_BASE64_IMPLEMENTATION, implementation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_BASE64_H */
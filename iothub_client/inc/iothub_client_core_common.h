@@ -29,7 +29,8 @@ extern "C"
     IOTHUB_CLIENT_INVALID_ARG,            \
     IOTHUB_CLIENT_ERROR,                  \
     IOTHUB_CLIENT_INVALID_SIZE,           \
-    IOTHUB_CLIENT_INDEFINITE_TIME
+    IOTHUB_CLIENT_INDEFINITE_TIME,        \
+    IOTHUB_CLIENT_QUEUE_FULL
 
     /** @brief Enumeration specifying the status of calls to various APIs in this module.
     */
@@ -133,6 +134,32 @@ extern "C"
     */
     DEFINE_ENUM(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES);
 
+#define IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY_VALUES     \
+    IOTHUB_CLIENT_SEND_QUEUE_REJECT,                    \
+    IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST,               \
+    IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST
+
+    /** @brief Enumeration specifying what the client does with a message sent while the
+    *		   send queue is at one of its limits (see @c OPTION_SEND_QUEUE_MAX_MESSAGES and
+    *		   @c OPTION_SEND_QUEUE_MAX_BYTES).
+    *		   - REJECT: the send fails with @c IOTHUB_CLIENT_QUEUE_FULL, the caller keeps the message.
+    *		   - DROP_OLDEST: the oldest message not yet handed to the transport is dropped to make room.
+    *		     If every queued message is already in flight, the send fails with @c IOTHUB_CLIENT_QUEUE_FULL.
+    *		   - DROP_NEWEST: the send succeeds but the new message is dropped.
+    *		   Dropped messages get their confirmation callback invoked with
+    *		   @c IOTHUB_CLIENT_CONFIRMATION_ERROR from the next DoWork.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY, IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY_VALUES);
+
+#define IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_VALUES   \
+    IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK,        \
+    IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK
+
+    /** @brief Enumeration passed to the send queue watermark callback to indicate which
+    *		   watermark the number of queued messages has crossed.
+    */
+    DEFINE_ENUM(IOTHUB_CLIENT_SEND_QUEUE_WATERMARK, IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_VALUES);
+
 #define TRANSPORT_TYPE_VALUES \
     TRANSPORT_LL, /*LL comes from "LowLevel" */ \
     TRANSPORT_THREADED
@@ -147,6 +174,7 @@ extern "C"
 
     typedef void(*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback);
     typedef void(*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback);
+    typedef void(*IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK)(IOTHUB_CLIENT_SEND_QUEUE_WATERMARK watermark, size_t queuedMessages, size_t queuedBytes, void* userContextCallback);
     typedef IOTHUBMESSAGE_DISPOSITION_RESULT (*IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)(IOTHUB_MESSAGE_HANDLE message, void* userContextCallback);
 
     typedef void(*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payLoad, size_t size, void* userContextCallback);
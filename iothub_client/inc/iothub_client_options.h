@@ -33,6 +33,20 @@ extern "C"
     static STATIC_VAR_UNUSED const char* OPTION_CBS_REQUEST_TIMEOUT = "cbs_request_timeout";
 
     static STATIC_VAR_UNUSED const char* OPTION_MIN_POLLING_TIME = "MinimumPollingTime";
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_POLLING_TIME = "MaximumPollingTime";
+    /*
+    * @brief Number of keep-alive connections (passed as size_t*) the HTTP transport keeps to the hub. With more than one, the devices
+    *        sharing the transport are spread over the connections and their requests run concurrently during DoWork, the callbacks of
+    *        a device being then invoked from a thread of the transport. The default is 1. Can only be set once, before any other
+    *        option of the connection (e.g. TrustedCerts, proxy_data, x509certificate), only valid for the HTTP transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_CONNECTION_COUNT = "HttpConnectionCount";
+    /*
+    * @brief Size in bytes (passed as size_t*) from which the batches of the HTTP transport (OPTION_BATCHING) are sent gzipped, with
+    *        "Content-Encoding: gzip". A batch is only sent compressed when that makes it smaller. The default, 0, never compresses.
+    *        Requires the SDK to be built with use_http_compression (zlib), only valid for the HTTP transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_COMPRESSION_THRESHOLD = "HttpCompressionThreshold";
     static STATIC_VAR_UNUSED const char* OPTION_BATCHING = "Batching";
 
     static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_TIMEOUT = "messageTimeout";
@@ -44,6 +58,43 @@ extern "C"
     */
     static STATIC_VAR_UNUSED const char* OPTION_AUTO_URL_ENCODE_DECODE = "auto_url_encode_decode";
     /*
+    * @brief Maximum number of telemetry messages (passed as size_t*) published and waiting for their PUBACK. Once reached, the next
+    *        messages stay queued until acknowledgements come back. The default, 0, allows up to half of the 65535 MQTT packet ids,
+    *        which is also the largest value accepted. Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_IN_FLIGHT_MESSAGES = "max_in_flight_messages";
+    /*
+    * @brief Maximum number of queued telemetry messages (passed as size_t*) published by a single DoWork call, the others are
+    *        published by the next calls. Resends of messages already in flight are not counted. The default, 0, does not limit them.
+    *        Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_PUBLISHES_PER_DOWORK = "max_publishes_per_dowork";
+    /*
+    * @brief Publishes the telemetry messages (passed as bool*) at QoS 0 unless IoTHubMessage_SetDelivery says otherwise. They are
+    *        not acknowledged by the service nor resent, their confirmation callback is called with IOTHUB_CLIENT_CONFIRMATION_OK
+    *        once they are written to the connection, so they can be lost. Off by default. Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_TELEMETRY_AT_MOST_ONCE = "telemetry_at_most_once";
+    /*
+    * @brief Resumes the session kept by the service across reconnections (passed as bool*). When the CONNACK reports the session
+    *        is present, the topics already subscribed in it are not subscribed again and the telemetry messages waiting for their
+    *        PUBACK are resent right away with their packet id. Off by default. Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_PERSISTENT_SESSION = "persistent_session";
+    /*
+    * @brief Drains the connection before it is replaced to refresh the sas token (passed as bool*). Telemetry is held back and the
+    *        connection is kept until the messages waiting for their PUBACK are acknowledged, or for up to
+    *        OPTION_SAS_TOKEN_REFRESH_DRAIN_TIMEOUT, so they are not resent on the new connection. Off by default. Only valid for
+    *        use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SAS_TOKEN_REFRESH_DRAIN = "sas_token_refresh_drain";
+    /*
+    * @brief Longest time in milliseconds (passed as size_t*) the connection is drained before the sas token is refreshed. The drain
+    *        also ends once the oldest message waiting for its PUBACK is due for a resend. The default is 2000. Only valid for use
+    *        with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SAS_TOKEN_REFRESH_DRAIN_TIMEOUT = "sas_token_refresh_drain_timeout";
+    /*
     * @brief Informs the service of what is the maximum period the client will wait for a keep-alive message from the service.
     *        The service must send keep-alives before this timeout is reached, otherwise the client will trigger its re-connection logic.
     *        Setting this option to a low value results in more aggressive/responsive re-connection by the client.
@@ -66,6 +117,88 @@ extern "C"
     //diagnostic sampling percentage value, [0-100]
     static STATIC_VAR_UNUSED const char* OPTION_DIAGNOSTIC_SAMPLING_PERCENTAGE = "diag_sampling_percentage";
 
+    /*
+    * @brief Maximum time (in milliseconds, passed as unsigned int*) the convenience layer worker thread sleeps when it has nothing to send.
+    *        The worker thread is woken up immediately when new work is queued (e.g. IoTHubClient_SendEventAsync) and runs every
+    *        millisecond while telemetry is in flight, so this value only bounds how often an idle client polls the transport.
+    *        Valid range is [1-100], default is 10. Only valid for the convenience layer (IoTHubClient_* / IoTHubDeviceClient_*) APIs.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_DO_WORK_FREQUENCY_IN_MS = "do_work_freq_ms";
+
+    /*
+    * @brief Number of threads (passed as size_t*) of a pool running the user callbacks instead of the convenience layer worker thread,
+    *        so a slow callback does not hold back DoWork or the other callbacks. Callbacks of the same type (e.g. send confirmations,
+    *        C2D messages) are still delivered one at a time and in order, device method callbacks run in parallel with each other.
+    *        The default, 0, runs every callback on the worker thread. Can only be set once, only valid for the convenience layer APIs.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_CALLBACK_DISPATCHER_THREADS = "callback_dispatcher_threads";
+
+    /*
+    * @brief When set to true (passed as bool*), IoTHubClient_SendEventAsync no longer waits for the lock held by the worker thread
+    *        during DoWork: messages are pushed to a lock free queue that the worker thread drains before each DoWork.
+    *        Errors found when the worker thread hands a message to the transport are then reported through the send confirmation
+    *        callback with IOTHUB_CLIENT_CONFIRMATION_ERROR. Set it before the first message is sent or callback is set (it
+    *        fails once the worker thread runs); it cannot be disabled afterwards. Not supported when the transport is shared, only valid for the convenience layer APIs.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_LOCK_FREE_SUBMISSION = "lock_free_submission";
+
+    /*
+    * @brief Number of records (passed as size_t*) the client allocates at once for the bookkeeping of messages being sent.
+    *        When set, the per-message list nodes of the client and of the MQTT transport are taken from, and returned to,
+    *        per-client pools that only grow by blocks of this many records and release their memory when the client is destroyed.
+    *        This removes most of the malloc/free traffic of long running, high throughput clients. The default, 0, allocates
+    *        every record individually. Can only be changed while no message is waiting to be sent.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_RECORD_POOL_SIZE = "message_record_pool_size";
+
+    /*
+    * @brief Maximum number of messages (passed as size_t*) accepted by SendEventAsync and not yet confirmed, including the ones in flight.
+    *        Once reached, new messages are handled according to OPTION_SEND_QUEUE_SHED_POLICY. The default, 0, does not limit the queue.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_QUEUE_MAX_MESSAGES = "send_queue_max_messages";
+    /*
+    * @brief Maximum number of body bytes (passed as size_t*) of the messages accepted by SendEventAsync and not yet confirmed.
+    *        Once reached, new messages are handled according to OPTION_SEND_QUEUE_SHED_POLICY. The default, 0, does not limit the queue.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_QUEUE_MAX_BYTES = "send_queue_max_bytes";
+    /*
+    * @brief What to do with a message sent while the send queue is full (passed as IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY*).
+    *        The default is IOTHUB_CLIENT_SEND_QUEUE_REJECT, SendEventAsync returns IOTHUB_CLIENT_QUEUE_FULL.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_QUEUE_SHED_POLICY = "send_queue_shed_policy";
+    /*
+    * @brief Number of queued messages (passed as size_t*) at which the send queue watermark callback is invoked with
+    *        IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK. The default, 0, disables the watermark callbacks.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_QUEUE_HIGH_WATERMARK = "send_queue_high_watermark";
+    /*
+    * @brief Number of queued messages (passed as size_t*) at or below which the send queue watermark callback is invoked with
+    *        IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK, once the high watermark has been reached. The default is 0. Setting a low
+    *        watermark greater than a non-zero high watermark fails with IOTHUB_CLIENT_INVALID_ARG.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SEND_QUEUE_LOW_WATERMARK = "send_queue_low_watermark";
+
+    /*
+    * @brief Directory (passed as const char*) of a durable store for the telemetry messages. Every message accepted by SendEventAsync is
+    *        appended to a memory-mapped journal in that directory and removed once completed, so the messages not sent yet survive
+    *        a restart: they are sent again (without confirmation callback) by the next client opening the same directory.
+    *        With a store, messages that do not fit in the send queue (OPTION_SEND_QUEUE_MAX_MESSAGES / _MAX_BYTES) are kept in the
+    *        journal only instead of being shed, and loaded back as the queue drains. Delivery is at-least-once.
+    *        Can only be set while no message is pending, an empty string closes the store.
+    *        Requires the SDK to be built with use_store_and_forward (POSIX platforms only).
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_STORE_AND_FORWARD_PATH = "store_and_forward_path";
+    /*
+    * @brief Size in bytes (passed as size_t*) of the journal segment files of the store, the largest message must fit in one.
+    *        Applies to the next OPTION_STORE_AND_FORWARD_PATH, the default is 1 MB.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_STORE_AND_FORWARD_SEGMENT_SIZE = "store_and_forward_segment_size";
+    /*
+    * @brief Number of messages (passed as size_t*) after which the journal is flushed to storage. The journal is always flushed at the
+    *        end of every DoWork, the default, 0, only flushes it there. Applies to the next OPTION_STORE_AND_FORWARD_PATH.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_STORE_AND_FORWARD_SYNC_BATCH = "store_and_forward_sync_batch";
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,90 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_reactor.h
+*	@brief Drives many IoTHubClient_LL instances from a single thread (Linux only).
+*
+*	@details Instead of a loop calling IoTHubClient_LL_DoWork on every client,
+*			 the reactor waits with epoll and only calls DoWork on a client when
+*			 its descriptor is readable, when it was signaled ready (for
+*			 instance after IoTHubClient_LL_SendEventAsync) or when its poll
+*			 interval elapsed. Poll intervals are kept in a timer wheel, so the
+*			 cost of a pass does not depend on the number of idle clients.
+*			 Except for IoTHubClientReactor_SignalClientReady, the functions of a
+*			 reactor must be called from the thread that runs it, and never from
+*			 within a callback of one of its clients.
+*/
+
+#ifndef IOTHUB_CLIENT_REACTOR_H
+#define IOTHUB_CLIENT_REACTOR_H
+
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_client_core_ll.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR     (-1)
+
+typedef struct CLIENT_REACTOR_TAG* CLIENT_REACTOR_HANDLE;
+typedef struct CLIENT_REACTOR_REGISTRATION_TAG* CLIENT_REACTOR_REGISTRATION_HANDLE;
+
+    /**
+    * @brief	Creates a reactor with no client.
+    *
+    * @return	A non-NULL @c CLIENT_REACTOR_HANDLE on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, CLIENT_REACTOR_HANDLE, IoTHubClientReactor_Create);
+
+    /**
+    * @brief	Removes every client still registered and destroys the reactor.
+    *			The clients themselves are not destroyed.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClientReactor_Destroy, CLIENT_REACTOR_HANDLE, reactor);
+
+    /**
+    * @brief	Registers @p client to be driven by @p reactor.
+    *
+    * @param	reactor			The reactor.
+    * @param	client			The client whose DoWork is called by the reactor.
+    * @param	descriptor		A descriptor whose readiness calls for DoWork (typically the
+    *							socket of a custom xio), or IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR.
+    * @param	pollIntervalMs	Longest time between two DoWork calls, so the transport can
+    *							keep its connection alive and time out; 0 to only call DoWork
+    *							on readiness.
+    *
+    * @return	A non-NULL @c CLIENT_REACTOR_REGISTRATION_HANDLE on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, CLIENT_REACTOR_REGISTRATION_HANDLE, IoTHubClientReactor_AddClient, CLIENT_REACTOR_HANDLE, reactor, IOTHUB_CLIENT_CORE_LL_HANDLE, client, int, descriptor, tickcounter_ms_t, pollIntervalMs);
+
+    /**
+    * @brief	Stops driving the client of @p registration. Must be called before
+    *			the client is destroyed.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubClientReactor_RemoveClient, CLIENT_REACTOR_HANDLE, reactor, CLIENT_REACTOR_REGISTRATION_HANDLE, registration);
+
+    /**
+    * @brief	Asks for DoWork to be called on the client of @p registration during the
+    *			next pass, waking the reactor up if it is waiting. May be called from
+    *			any thread.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClientReactor_SignalClientReady, CLIENT_REACTOR_HANDLE, reactor, CLIENT_REACTOR_REGISTRATION_HANDLE, registration);
+
+    /**
+    * @brief	Waits at most @p maxWaitMs for a client to need work, then calls DoWork
+    *			once on every client that does.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClientReactor_RunOnce, CLIENT_REACTOR_HANDLE, reactor, tickcounter_ms_t, maxWaitMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_CLIENT_REACTOR_H */
@@ -42,6 +42,31 @@ IOTHUBMESSAGE_UNKNOWN \
 */
 DEFINE_ENUM(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+#define IOTHUB_MESSAGE_PRIORITY_VALUES \
+    IOTHUB_MESSAGE_PRIORITY_NORMAL, \
+    IOTHUB_MESSAGE_PRIORITY_HIGH, \
+    IOTHUB_MESSAGE_PRIORITY_CRITICAL \
+
+/** @brief Enumeration specifying the send priority of a message. Messages of
+*          a higher priority are sent ahead of the messages of lower priority
+*          already waiting to be sent, messages of the same priority are sent
+*          in order.
+*/
+DEFINE_ENUM(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
+#define IOTHUB_MESSAGE_DELIVERY_VALUES \
+    IOTHUB_MESSAGE_DELIVERY_DEFAULT, \
+    IOTHUB_MESSAGE_DELIVERY_AT_LEAST_ONCE, \
+    IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE \
+
+/** @brief Enumeration specifying how a message is delivered. Messages sent
+*          at most once are not acknowledged by the service nor resent, their
+*          confirmation callback is called once they are written to the
+*          connection. Only the MQTT transports honor it, the default being
+*          at least once unless the "telemetry_at_most_once" option is set.
+*/
+DEFINE_ENUM(IOTHUB_MESSAGE_DELIVERY, IOTHUB_MESSAGE_DELIVERY_VALUES);
+
 typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
 
 /** @brief diagnostic related data*/
@@ -242,6 +267,50 @@ MOCKABLE_FUNCTION(, const char*, IoTHubMessage_GetCorrelationId, IOTHUB_MESSAGE_
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, correlationId);
 
+/**
+* @brief   Sets the send priority of the message, messages are created with
+*          @c IOTHUB_MESSAGE_PRIORITY_NORMAL.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   priority The priority of the message.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the priority was set successfully
+*          or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority);
+
+/**
+* @brief   Gets the send priority of the message.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  The priority of the message, @c IOTHUB_MESSAGE_PRIORITY_NORMAL if
+*          iotHubMessageHandle is NULL.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
+/**
+* @brief   Sets how the message is delivered, messages are created with
+*          @c IOTHUB_MESSAGE_DELIVERY_DEFAULT.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   delivery The delivery of the message.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the delivery was set successfully
+*          or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetDelivery, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_DELIVERY, delivery);
+
+/**
+* @brief   Gets how the message is delivered.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  The delivery of the message, @c IOTHUB_MESSAGE_DELIVERY_DEFAULT if
+*          iotHubMessageHandle is NULL.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_DELIVERY, IoTHubMessage_GetDelivery, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 /**
 * @brief   Gets the DiagnosticData from the IOTHUB_MESSAGE_HANDLE. CAUTION: SDK user should not call it directly, it is for internal use only.
 *
@@ -0,0 +1,109 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_transport_pool.h
+*	@brief Spreads the devices of a gateway over several shared transports.
+*
+*	@details A shared transport created by IoTHubTransport_Create is one
+*			 connection driven by one worker thread. A transport pool owns
+*			 several of them, each with its own connection, worker thread
+*			 and lock, and hands out the least loaded connected one to each
+*			 new IoTHubClient_CreateWithTransport call.
+*/
+
+#ifndef IOTHUB_TRANSPORT_POOL_H
+#define IOTHUB_TRANSPORT_POOL_H
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_transport_ll.h"
+#include "iothub_client_core_common.h"
+
+typedef struct TRANSPORT_POOL_TAG* TRANSPORT_POOL_HANDLE;
+
+    /**
+    * @brief	Creates @p transportCount shared transports to the same IoT Hub.
+    *
+    * @param	protocol		Function pointer for protocol implementation
+    * @param	iotHubName		The IoT Hub name to which the devices are connecting
+    * @param	iotHubSuffix	The suffix part of the IoT Hub uri (e.g., private.azure-devices-int.net)
+    * @param	transportCount	Number of connections in the pool, usually the number of cores
+    *
+    * @return	A non-NULL @c TRANSPORT_POOL_HANDLE on success and @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, TRANSPORT_POOL_HANDLE, IoTHubTransportPool_Create, IOTHUB_CLIENT_TRANSPORT_PROVIDER, protocol, const char*, iotHubName, const char*, iotHubSuffix, size_t, transportCount);
+
+    /**
+    * @brief	Destroys every transport of the pool. All the clients created with
+    *			a transport of the pool must have been destroyed before.
+    */
+    MOCKABLE_FUNCTION(, void, IoTHubTransportPool_Destroy, TRANSPORT_POOL_HANDLE, transportPool);
+
+    /**
+    * @brief	Picks the transport a new device shall use, to be passed to
+    *			IoTHubClient_CreateWithTransport.
+    *
+    * @details	The transport with the fewest devices among the ones not reported
+    *			as disconnected is returned; if they are all disconnected, the
+    *			one with the fewest devices. The device is counted on that
+    *			transport until IoTHubTransportPool_ReleaseTransport is called.
+    *
+    * @return	A @c TRANSPORT_HANDLE owned by the pool, or @c NULL on failure.
+    */
+    MOCKABLE_FUNCTION(, TRANSPORT_HANDLE, IoTHubTransportPool_GetTransport, TRANSPORT_POOL_HANDLE, transportPool);
+
+    /**
+    * @brief	Stops counting a device on @p transportHandle, once its client was destroyed.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubTransportPool_ReleaseTransport, TRANSPORT_POOL_HANDLE, transportPool, TRANSPORT_HANDLE, transportHandle);
+
+    /**
+    * @brief	Reports the connection status of @p transportHandle, typically from
+    *			the connection status callback of one of its clients.
+    *
+    * @details	A transport reported as IOTHUB_CLIENT_CONNECTION_AUTHENTICATED is
+    *			handed out again. One reported with the reason
+    *			IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR
+    *			or IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED is not handed out by
+    *			IoTHubTransportPool_GetTransport until then. The other reasons
+    *			concern the reporting device only and do not change the status
+    *			of the shared connection.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubTransportPool_SetConnectionStatus, TRANSPORT_POOL_HANDLE, transportPool, TRANSPORT_HANDLE, transportHandle, IOTHUB_CLIENT_CONNECTION_STATUS, connectionStatus, IOTHUB_CLIENT_CONNECTION_STATUS_REASON, reason);
+
+    /**
+    * @brief	Picks new transports for @p deviceCount devices of @p failedTransport.
+    *
+    * @details	Each device is moved to the connected transport with the fewest
+    *			devices, other than @p failedTransport, and counted there. The
+    *			application then destroys the clients of those devices and creates
+    *			them again with IoTHubClient_CreateWithTransport on the transports
+    *			stored in @p newTransports, without calling
+    *			IoTHubTransportPool_ReleaseTransport for them.
+    *
+    * @param	transportPool	The pool @p failedTransport belongs to.
+    * @param	failedTransport	The transport whose devices are moved.
+    * @param	newTransports	Array of @p deviceCount entries receiving the new transports.
+    * @param	deviceCount		Number of devices to move, at most the devices of @p failedTransport.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success, IOTHUB_CLIENT_ERROR if no other transport
+    *			is connected, or another error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubTransportPool_RelocateDevices, TRANSPORT_POOL_HANDLE, transportPool, TRANSPORT_HANDLE, failedTransport, TRANSPORT_HANDLE*, newTransports, size_t, deviceCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_TRANSPORT_POOL_H */
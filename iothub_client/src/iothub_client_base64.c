@@ -0,0 +1,555 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "iothub_client_base64.h"
+
+DEFINE_ENUM_STRINGS(IOTHUB_BASE64_IMPLEMENTATION, IOTHUB_BASE64_IMPLEMENTATION_VALUES);
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BASE64_X86
+#define BASE64_TARGET(features)
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))))
+#include <immintrin.h>
+#define BASE64_X86
+/*the vector kernels are compiled for their instruction set only, the rest of the SDK keeps the flags of the build*/
+#define BASE64_TARGET(features) __attribute__((target(features)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BASE64_NEON
+#endif
+
+/*everything needed to encode and decode one alphabet. The vector kernels validate characters with lut_lo/lut_hi
+(a character is part of the alphabet when lut_lo[low nibble] & lut_hi[high nibble] is 0) and turn them into values by
+adding lut_roll[high nibble], corrected by special_roll for special_character which does not share the offset of its row*/
+typedef struct BASE64_ALPHABET_TABLES_TAG
+{
+    char encode[64];
+    unsigned char decode[128]; /*0xFF for the characters outside of the alphabet*/
+    signed char lut_lo[16];
+    signed char lut_hi[16];
+    signed char lut_roll[16];
+    char special_character;
+    signed char special_roll;
+} BASE64_ALPHABET_TABLES;
+
+static const BASE64_ALPHABET_TABLES base64_standard =
+{
+    { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+      'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+      'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+      'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/' },
+    {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+        0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+        0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    },
+    { 0x0B, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x07, 0x15, 0x17, 0x17, 0x17, 0x15 },
+    { 0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x10, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 },
+    { 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 },
+    '/', -3
+};
+
+static const BASE64_ALPHABET_TABLES base64_url =
+{
+    { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+      'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+      'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+      'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '-', '_' },
+    {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF,
+        0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+        0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+        0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    },
+    { 0x0B, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x07, 0x37, 0x37, 0x35, 0x37, 0x27 },
+    { 0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x20, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 },
+    { 0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 },
+    '_', 33
+};
+
+/*a kernel processes as much of the input as it can in whole vectors and returns how much it consumed, the caller finishes with the scalar code*/
+typedef size_t(*BASE64_ENCODE_KERNEL)(char* destination, const unsigned char* source, size_t size, const BASE64_ALPHABET_TABLES* tables);
+typedef size_t(*BASE64_DECODE_KERNEL)(unsigned char* destination, const char* source, size_t source_size, const BASE64_ALPHABET_TABLES* tables);
+
+typedef struct BASE64_KERNELS_TAG
+{
+    IOTHUB_BASE64_IMPLEMENTATION implementation;
+    BASE64_ENCODE_KERNEL encode;
+    BASE64_DECODE_KERNEL decode;
+} BASE64_KERNELS;
+
+static size_t encode_scalar(char* destination, const unsigned char* source, size_t size, const BASE64_ALPHABET_TABLES* tables)
+{
+    size_t i;
+    for (i = 0; size - i >= 3; i += 3)
+    {
+        *destination++ = tables->encode[source[i] >> 2];
+        *destination++ = tables->encode[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = tables->encode[((source[i + 1] & 0x0F) << 2) | (source[i + 2] >> 6)];
+        *destination++ = tables->encode[source[i + 2] & 0x3F];
+    }
+    return i;
+}
+
+static size_t decode_scalar(unsigned char* destination, const char* source, size_t source_size, const BASE64_ALPHABET_TABLES* tables)
+{
+    size_t i;
+    for (i = 0; source_size - i >= 4; i += 4)
+    {
+        const unsigned char* group = (const unsigned char*)source + i;
+        unsigned char v0, v1, v2, v3;
+        if ((group[0] >= 128) || (group[1] >= 128) || (group[2] >= 128) || (group[3] >= 128) ||
+            ((v0 = tables->decode[group[0]]) == 0xFF) ||
+            ((v1 = tables->decode[group[1]]) == 0xFF) ||
+            ((v2 = tables->decode[group[2]]) == 0xFF) ||
+            ((v3 = tables->decode[group[3]]) == 0xFF))
+        {
+            break;
+        }
+        else
+        {
+            *destination++ = (unsigned char)((v0 << 2) | (v1 >> 4));
+            *destination++ = (unsigned char)((v1 << 4) | (v2 >> 2));
+            *destination++ = (unsigned char)((v2 << 6) | v3);
+        }
+    }
+    return i;
+}
+
+static const BASE64_KERNELS scalar_kernels = { IOTHUB_BASE64_IMPLEMENTATION_SCALAR, encode_scalar, decode_scalar };
+
+#ifdef BASE64_X86
+
+/*the SSE4.1 and AVX2 kernels follow W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions"*/
+
+BASE64_TARGET("sse4.1")
+static __m128i sse41_encode_12_bytes(__m128i input, __m128i shift_lut)
+{
+    /*spread bytes a b c of every 3 byte group as b a c b, then isolate the 4 sextets in the 4 bytes*/
+    __m128i in = _mm_shuffle_epi8(input, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t0, t1);
+
+    /*0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12; shift_lut holds what to add for each*/
+    __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    reduced = _mm_or_si128(reduced, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(shift_lut, reduced));
+}
+
+BASE64_TARGET("sse4.1")
+static __m128i sse41_make_shift_lut(const BASE64_ALPHABET_TABLES* tables)
+{
+    return _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        (char)(tables->encode[62] - 62), (char)(tables->encode[63] - 63), 'A', 0, 0);
+}
+
+BASE64_TARGET("sse4.1")
+static size_t encode_sse41(char* destination, const unsigned char* source, size_t size, const BASE64_ALPHABET_TABLES* tables)
+{
+    __m128i shift_lut = sse41_make_shift_lut(tables);
+    size_t i;
+    /*16 bytes are loaded to encode 12*/
+    for (i = 0; size - i >= 16; i += 12)
+    {
+        __m128i encoded = sse41_encode_12_bytes(_mm_loadu_si128((const __m128i*)(source + i)), shift_lut);
+        _mm_storeu_si128((__m128i*)destination, encoded);
+        destination += 16;
+    }
+    return i;
+}
+
+/*returns 0 when all 16 characters belong to the alphabet and replaces them with their values*/
+BASE64_TARGET("sse4.1")
+static int sse41_decode_16_characters(__m128i* characters, const BASE64_ALPHABET_TABLES* tables)
+{
+    int result;
+    __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(*characters, 4), nibble_mask);
+    __m128i lo_nibbles = _mm_and_si128(*characters, nibble_mask);
+    __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)tables->lut_hi), hi_nibbles);
+    __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)tables->lut_lo), lo_nibbles);
+    if (!_mm_testz_si128(lo, hi))
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        __m128i roll = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)tables->lut_roll), hi_nibbles);
+        __m128i is_special = _mm_cmpeq_epi8(*characters, _mm_set1_epi8(tables->special_character));
+        roll = _mm_add_epi8(roll, _mm_and_si128(is_special, _mm_set1_epi8(tables->special_roll)));
+        *characters = _mm_add_epi8(*characters, roll);
+        result = 0;
+    }
+    return result;
+}
+
+BASE64_TARGET("sse4.1")
+static __m128i sse41_pack_16_values(__m128i values)
+{
+    /*4 sextets per 32 bits -> 24 bits per 32 bits -> 12 contiguous bytes*/
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET("sse4.1")
+static size_t decode_sse41(unsigned char* destination, const char* source, size_t source_size, const BASE64_ALPHABET_TABLES* tables)
+{
+    size_t i;
+    /*16 bytes are stored for 12 decoded ones, at least 24 characters left guarantee the destination has room for them*/
+    for (i = 0; source_size - i >= 24; i += 16)
+    {
+        __m128i characters = _mm_loadu_si128((const __m128i*)(source + i));
+        if (sse41_decode_16_characters(&characters, tables) != 0)
+        {
+            break;
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i*)destination, sse41_pack_16_values(characters));
+            destination += 12;
+        }
+    }
+    return i;
+}
+
+static const BASE64_KERNELS sse41_kernels = { IOTHUB_BASE64_IMPLEMENTATION_SSE41, encode_sse41, decode_sse41 };
+
+BASE64_TARGET("avx2")
+static size_t encode_avx2(char* destination, const unsigned char* source, size_t size, const BASE64_ALPHABET_TABLES* tables)
+{
+    __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        (char)(tables->encode[62] - 62), (char)(tables->encode[63] - 63), 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        (char)(tables->encode[62] - 62), (char)(tables->encode[63] - 63), 'A', 0, 0);
+    size_t i;
+    /*each 128 bit lane encodes 12 bytes, the second lane is loaded from source + 12 so 28 bytes are read to encode 24*/
+    for (i = 0; size - i >= 28; i += 24)
+    {
+        __m256i input = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(source + i))),
+            _mm_loadu_si128((const __m128i*)(source + i + 12)), 1);
+        __m256i in = _mm256_shuffle_epi8(input, _mm256_set_epi8(
+            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+        __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)destination, _mm256_add_epi8(indices, _mm256_shuffle_epi8(shift_lut, reduced)));
+        destination += 32;
+    }
+    return i;
+}
+
+BASE64_TARGET("avx2")
+static size_t decode_avx2(unsigned char* destination, const char* source, size_t source_size, const BASE64_ALPHABET_TABLES* tables)
+{
+    __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->lut_lo));
+    __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->lut_hi));
+    __m256i lut_roll = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables->lut_roll));
+    __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    size_t i;
+    /*32 bytes are stored for 24 decoded ones, at least 44 characters left guarantee the destination has room for them*/
+    for (i = 0; source_size - i >= 44; i += 32)
+    {
+        __m256i characters = _mm256_loadu_si256((const __m256i*)(source + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(characters, 4), nibble_mask);
+        __m256i lo_nibbles = _mm256_and_si256(characters, nibble_mask);
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo_nibbles), _mm256_shuffle_epi8(lut_hi, hi_nibbles)))
+        {
+            break;
+        }
+        else
+        {
+            __m256i roll = _mm256_shuffle_epi8(lut_roll, hi_nibbles);
+            __m256i is_special = _mm256_cmpeq_epi8(characters, _mm256_set1_epi8(tables->special_character));
+            __m256i values = _mm256_add_epi8(characters, _mm256_add_epi8(roll, _mm256_and_si256(is_special, _mm256_set1_epi8(tables->special_roll))));
+            __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+            merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+            _mm256_storeu_si256((__m256i*)destination, merged);
+            destination += 24;
+        }
+    }
+    return i;
+}
+
+static const BASE64_KERNELS avx2_kernels = { IOTHUB_BASE64_IMPLEMENTATION_AVX2, encode_avx2, decode_avx2 };
+
+static int cpu_supports(IOTHUB_BASE64_IMPLEMENTATION implementation)
+{
+    int result;
+#if defined(_MSC_VER)
+    int info[4];
+    int features[4];
+    __cpuid(info, 0);
+    __cpuid(features, 1);
+    if (implementation == IOTHUB_BASE64_IMPLEMENTATION_SSE41)
+    {
+        result = ((features[2] & (1 << 19)) != 0);
+    }
+    else if (info[0] < 7)
+    {
+        result = 0;
+    }
+    else
+    {
+        /*AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0 bits 1 and 2)*/
+        __cpuidex(info, 7, 0);
+        result = ((info[1] & (1 << 5)) != 0) &&
+            ((features[2] & (1 << 27)) != 0) &&
+            ((_xgetbv(0) & 0x6) == 0x6);
+    }
+#else
+    __builtin_cpu_init();
+    if (implementation == IOTHUB_BASE64_IMPLEMENTATION_SSE41)
+    {
+        result = __builtin_cpu_supports("sse4.1");
+    }
+    else
+    {
+        result = __builtin_cpu_supports("avx2");
+    }
+#endif
+    return result;
+}
+
+#endif /*BASE64_X86*/
+
+#ifdef BASE64_NEON
+
+static size_t encode_neon(char* destination, const unsigned char* source, size_t size, const BASE64_ALPHABET_TABLES* tables)
+{
+    uint8x16x4_t lut;
+    uint8x16_t mask_03 = vdupq_n_u8(0x03);
+    uint8x16_t mask_0f = vdupq_n_u8(0x0F);
+    uint8x16_t mask_3f = vdupq_n_u8(0x3F);
+    size_t i;
+    lut.val[0] = vld1q_u8((const uint8_t*)tables->encode);
+    lut.val[1] = vld1q_u8((const uint8_t*)tables->encode + 16);
+    lut.val[2] = vld1q_u8((const uint8_t*)tables->encode + 32);
+    lut.val[3] = vld1q_u8((const uint8_t*)tables->encode + 48);
+    /*48 bytes, deinterleaved in a, b and c, become 64 characters*/
+    for (i = 0; size - i >= 48; i += 48)
+    {
+        uint8x16x3_t in = vld3q_u8(source + i);
+        uint8x16x4_t out;
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0], mask_03), 4), vshrq_n_u8(in.val[1], 4));
+        out.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1], mask_0f), 2), vshrq_n_u8(in.val[2], 6));
+        out.val[3] = vandq_u8(in.val[2], mask_3f);
+        out.val[0] = vqtbl4q_u8(lut, out.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, out.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, out.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, out.val[3]);
+        vst4q_u8((uint8_t*)destination, out);
+        destination += 64;
+    }
+    return i;
+}
+
+static size_t decode_neon(unsigned char* destination, const char* source, size_t source_size, const BASE64_ALPHABET_TABLES* tables)
+{
+    /*characters 0..63 are looked up in lut_low, 64..127 in lut_high (indexed by c ^ 0x40); out of range lookups give 0,
+    so the invalid ones are the characters with bit 7 set and the ones that translate to 0xFF*/
+    uint8x16x4_t lut_low;
+    uint8x16x4_t lut_high;
+    uint8x16_t bit_6 = vdupq_n_u8(0x40);
+    size_t i;
+    lut_low.val[0] = vld1q_u8(tables->decode);
+    lut_low.val[1] = vld1q_u8(tables->decode + 16);
+    lut_low.val[2] = vld1q_u8(tables->decode + 32);
+    lut_low.val[3] = vld1q_u8(tables->decode + 48);
+    lut_high.val[0] = vld1q_u8(tables->decode + 64);
+    lut_high.val[1] = vld1q_u8(tables->decode + 80);
+    lut_high.val[2] = vld1q_u8(tables->decode + 96);
+    lut_high.val[3] = vld1q_u8(tables->decode + 112);
+    for (i = 0; source_size - i >= 64; i += 64)
+    {
+        uint8x16x4_t in = vld4q_u8((const uint8_t*)source + i);
+        uint8x16_t errors = vdupq_n_u8(0);
+        uint8x16x3_t out;
+        int k;
+        for (k = 0; k < 4; k++)
+        {
+            uint8x16_t value = vorrq_u8(vqtbl4q_u8(lut_low, in.val[k]), vqtbl4q_u8(lut_high, veorq_u8(in.val[k], bit_6)));
+            errors = vorrq_u8(errors, vorrq_u8(value, in.val[k]));
+            in.val[k] = value;
+        }
+
+        if ((vmaxvq_u8(errors) & 0x80) != 0)
+        {
+            break;
+        }
+        else
+        {
+            out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+            out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+            out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+            vst3q_u8(destination, out);
+            destination += 48;
+        }
+    }
+    return i;
+}
+
+static const BASE64_KERNELS neon_kernels = { IOTHUB_BASE64_IMPLEMENTATION_NEON, encode_neon, decode_neon };
+
+#endif /*BASE64_NEON*/
+
+/*NULL until the first use. Concurrent first uses all store the same pointer*/
+static const BASE64_KERNELS* selected_kernels = NULL;
+
+static const BASE64_KERNELS* get_supported_kernels(IOTHUB_BASE64_IMPLEMENTATION implementation)
+{
+    const BASE64_KERNELS* result;
+    switch (implementation)
+    {
+    case IOTHUB_BASE64_IMPLEMENTATION_SCALAR:
+        result = &scalar_kernels;
+        break;
+#ifdef BASE64_X86
+    case IOTHUB_BASE64_IMPLEMENTATION_SSE41:
+        result = cpu_supports(implementation) ? &sse41_kernels : NULL;
+        break;
+    case IOTHUB_BASE64_IMPLEMENTATION_AVX2:
+        result = cpu_supports(implementation) ? &avx2_kernels : NULL;
+        break;
+#endif
+#ifdef BASE64_NEON
+    case IOTHUB_BASE64_IMPLEMENTATION_NEON:
+        result = &neon_kernels;
+        break;
+#endif
+    default:
+        result = NULL;
+        break;
+    }
+    return result;
+}
+
+static const BASE64_KERNELS* get_kernels(void)
+{
+    const BASE64_KERNELS* result = selected_kernels;
+    if (result == NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_009: [ When no implementation was selected yet, the first one supported by the build and the CPU among `IOTHUB_BASE64_IMPLEMENTATION_AVX2`, `IOTHUB_BASE64_IMPLEMENTATION_SSE41`, `IOTHUB_BASE64_IMPLEMENTATION_NEON` and `IOTHUB_BASE64_IMPLEMENTATION_SCALAR` shall be selected. ] */
+        if (((result = get_supported_kernels(IOTHUB_BASE64_IMPLEMENTATION_AVX2)) == NULL) &&
+            ((result = get_supported_kernels(IOTHUB_BASE64_IMPLEMENTATION_SSE41)) == NULL) &&
+            ((result = get_supported_kernels(IOTHUB_BASE64_IMPLEMENTATION_NEON)) == NULL))
+        {
+            result = &scalar_kernels;
+        }
+        selected_kernels = result;
+    }
+    return result;
+}
+
+size_t iothub_base64_encode(char* destination, const unsigned char* source, size_t size, IOTHUB_BASE64_ALPHABET alphabet)
+{
+    size_t result;
+    if ((destination == NULL) || ((source == NULL) && (size != 0)) ||
+        ((alphabet != IOTHUB_BASE64_ALPHABET_STANDARD) && (alphabet != IOTHUB_BASE64_ALPHABET_URL)))
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_001: [ If `destination` is NULL, or `source` is NULL while `size` is not 0, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_encode` shall write nothing and return 0. ] */
+        LogError("invalid arguments destination=%p, source=%p, size=%lu, alphabet=%d", destination, source, (unsigned long)size, alphabet);
+        result = 0;
+    }
+    else
+    {
+        const BASE64_ALPHABET_TABLES* tables = (alphabet == IOTHUB_BASE64_ALPHABET_URL) ? &base64_url : &base64_standard;
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_003: [ `iothub_base64_encode` shall encode with the selected implementation as many bytes as it handles and shall encode the remaining bytes one group of 3 at a time. ] */
+        size_t encoded = get_kernels()->encode(destination, source, size, tables);
+        char* current = destination + (encoded / 3) * 4;
+        encoded += encode_scalar(current, source + encoded, size - encoded, tables);
+        current = destination + (encoded / 3) * 4;
+
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_002: [ `iothub_base64_encode` shall write to `destination` the `IOTHUB_BASE64_ENCODED_LENGTH(size)` characters encoding `source` with `alphabet`, padded with '=', and return that number of characters. ] */
+        if (size - encoded == 1)
+        {
+            *current++ = tables->encode[source[encoded] >> 2];
+            *current++ = tables->encode[(source[encoded] & 0x03) << 4];
+            *current++ = '=';
+            *current++ = '=';
+        }
+        else if (size - encoded == 2)
+        {
+            *current++ = tables->encode[source[encoded] >> 2];
+            *current++ = tables->encode[((source[encoded] & 0x03) << 4) | (source[encoded + 1] >> 4)];
+            *current++ = tables->encode[(source[encoded + 1] & 0x0F) << 2];
+            *current++ = '=';
+        }
+        result = (size_t)(current - destination);
+    }
+    return result;
+}
+
+size_t iothub_base64_decode_groups(unsigned char* destination, const char* source, size_t source_size, IOTHUB_BASE64_ALPHABET alphabet)
+{
+    size_t result;
+    if ((destination == NULL) || (source == NULL) ||
+        ((alphabet != IOTHUB_BASE64_ALPHABET_STANDARD) && (alphabet != IOTHUB_BASE64_ALPHABET_URL)))
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_004: [ If `destination` or `source` is NULL, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_decode_groups` shall write nothing and return 0. ] */
+        LogError("invalid arguments destination=%p, source=%p, alphabet=%d", destination, source, alphabet);
+        result = 0;
+    }
+    else
+    {
+        const BASE64_ALPHABET_TABLES* tables = (alphabet == IOTHUB_BASE64_ALPHABET_URL) ? &base64_url : &base64_standard;
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_006: [ `iothub_base64_decode_groups` shall decode with the selected implementation as many characters as it handles and shall decode the remaining characters one group of 4 at a time. ] */
+        result = get_kernels()->decode(destination, source, source_size, tables);
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_005: [ `iothub_base64_decode_groups` shall decode groups of 4 characters from `source` for as long as the 4 characters belong to `alphabet`, write the 3 bytes of every group to `destination` and return the number of characters decoded. ] */
+        result += decode_scalar(destination + (result / 4) * 3, source + result, source_size - result, tables);
+    }
+    return result;
+}
+
+IOTHUB_BASE64_IMPLEMENTATION iothub_base64_get_implementation(void)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_007: [ `iothub_base64_get_implementation` shall return the implementation used by `iothub_base64_encode` and `iothub_base64_decode_groups`. ] */
+    return get_kernels()->implementation;
+}
+
+int iothub_base64_set_implementation(IOTHUB_BASE64_IMPLEMENTATION implementation)
+{
+    int result;
+    const BASE64_KERNELS* kernels = get_supported_kernels(implementation);
+    if (kernels == NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_008: [ If `implementation` is not compiled in or not supported by the CPU, `iothub_base64_set_implementation` shall fail and return a non-zero value, keeping the current implementation. ] */
+        LogError("base64 implementation %s is not available", ENUM_TO_STRING(IOTHUB_BASE64_IMPLEMENTATION, implementation));
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_BASE64_10_010: [ Otherwise `iothub_base64_set_implementation` shall use `implementation` from then on and return 0. ] */
+        selected_kernels = kernels;
+        result = 0;
+    }
+    return result;
+}
@@ -7,19 +7,28 @@
 
 #include <signal.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_core.h"
 #include "iothub_client_core_ll.h"
+#include "iothub_client_options.h"
 #include "internal/iothubtransport.h"
 #include "internal/iothub_client_private.h"
 #include "internal/iothubtransport.h"
+#include "internal/iothub_client_dispatcher.h"
+#include "internal/iothub_client_mpsc_queue.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 
+#define DO_WORK_FREQ_DEFAULT_IN_MS      10
+#define DO_WORK_FREQ_MAXIMUM_IN_MS      100
+#define DO_WORK_FREQ_BUSY_IN_MS         1
+
 struct IOTHUB_QUEUE_CONTEXT_TAG;
 
 typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
@@ -28,21 +37,30 @@ typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
     TRANSPORT_HANDLE TransportHandle;
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
+    LOCK_HANDLE WakeLockHandle; /*guards WakeRequested and ThreadCondition, never held across IoTHubClientCore_LL_DoWork*/
+    COND_HANDLE ThreadCondition;
     sig_atomic_t StopThread;
+    int WakeRequested;
+    unsigned int do_work_freq_ms;
 #ifndef DONT_USE_UPLOADTOBLOB
     SINGLYLINKEDLIST_HANDLE savedDataToBeCleaned; /*list containing UPLOADTOBLOB_SAVED_DATA*/
 #endif
     int created_with_transport_handle;
     VECTOR_HANDLE saved_user_callback_list;
+    CALLBACK_DISPATCHER_HANDLE callback_dispatcher;
+    MPSC_QUEUE_HANDLE submission_queue; /*SUBMITTED_EVENT records pushed by SendEventAsync without taking LockHandle, only set before the worker thread starts*/
+    bool readyQueued; /*true while in the shared transport's ready set, only touched by the transport under its ready lock*/
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback;
     IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback;
     IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback;
     IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback;
+    IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK send_queue_watermark_callback;
     IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback;
     IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback;
     IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback;
     struct IOTHUB_QUEUE_CONTEXT_TAG* devicetwin_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* connection_status_user_context;
+    struct IOTHUB_QUEUE_CONTEXT_TAG* send_queue_watermark_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* message_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* method_user_context;
 } IOTHUB_CLIENT_CORE_INSTANCE;
@@ -82,7 +100,8 @@ typedef struct UPLOADTOBLOB_THREAD_INFO_TAG
     CALLBACK_TYPE_CONNECTION_STATUS,    \
     CALLBACK_TYPE_DEVICE_METHOD,        \
     CALLBACK_TYPE_INBOUD_DEVICE_METHOD, \
-    CALLBACK_TYPE_MESSAGE
+    CALLBACK_TYPE_MESSAGE,              \
+    CALLBACK_TYPE_SEND_QUEUE_WATERMARK
 
 DEFINE_ENUM(USER_CALLBACK_TYPE, USER_CALLBACK_TYPE_VALUES)
 DEFINE_ENUM_STRINGS(USER_CALLBACK_TYPE, USER_CALLBACK_TYPE_VALUES)
@@ -110,6 +129,13 @@ typedef struct CONNECTION_STATUS_CALLBACK_INFO_TAG
     IOTHUB_CLIENT_CONNECTION_STATUS_REASON status_reason;
 } CONNECTION_STATUS_CALLBACK_INFO;
 
+typedef struct SEND_QUEUE_WATERMARK_CALLBACK_INFO_TAG
+{
+    IOTHUB_CLIENT_SEND_QUEUE_WATERMARK watermark;
+    size_t queued_messages;
+    size_t queued_bytes;
+} SEND_QUEUE_WATERMARK_CALLBACK_INFO;
+
 typedef struct METHOD_CALLBACK_INFO_TAG
 {
     STRING_HANDLE method_name;
@@ -127,6 +153,7 @@ typedef struct USER_CALLBACK_INFO_TAG
         EVENT_CONFIRM_CALLBACK_INFO event_confirm_cb_info;
         REPORTED_STATE_CALLBACK_INFO reported_state_cb_info;
         CONNECTION_STATUS_CALLBACK_INFO connection_status_cb_info;
+        SEND_QUEUE_WATERMARK_CALLBACK_INFO send_queue_watermark_cb_info;
         METHOD_CALLBACK_INFO method_cb_info;
         MESSAGE_CALLBACK_INFO* message_cb_info;
     } iothub_callback;
@@ -138,6 +165,40 @@ typedef struct IOTHUB_QUEUE_CONTEXT_TAG
     void* userContextCallback;
 } IOTHUB_QUEUE_CONTEXT;
 
+/* A message accepted by SendEventAsync with lock free submission, waiting for the worker thread to hand it to IoTHubClient_LL */
+typedef struct SUBMITTED_EVENT_TAG
+{
+    MPSC_QUEUE_NODE node; /*must be the first member*/
+    IOTHUB_MESSAGE_HANDLE message;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    IOTHUB_QUEUE_CONTEXT* queue_context; /*only when there is a callback*/
+    void* userContextCallback;
+} SUBMITTED_EVENT;
+
+/* The user callbacks registered when a batch of queued callbacks was taken from saved_user_callback_list */
+typedef struct USER_CALLBACKS_TAG
+{
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback;
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback;
+    IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK send_queue_watermark_callback;
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback;
+    IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback;
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback;
+    IOTHUB_CLIENT_CORE_HANDLE message_user_context_handle;
+    IOTHUB_CLIENT_CORE_HANDLE method_user_context_handle;
+} USER_CALLBACKS;
+
+typedef struct DISPATCHED_USER_CALLBACK_TAG
+{
+    USER_CALLBACKS callbacks;
+    USER_CALLBACK_INFO queued_cb;
+} DISPATCHED_USER_CALLBACK;
+
+/* one ordered dispatcher lane per callback type, the method ones use the parallel lane */
+#define USER_CALLBACK_DISPATCHER_LANES ((size_t)CALLBACK_TYPE_SEND_QUEUE_WATERMARK + 1)
+
 /*used by unittests only*/
 const size_t IoTHubClientCore_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_CORE_INSTANCE, StopThread);
 
@@ -195,6 +256,28 @@ static void garbageCollectorImpl(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstan
 }
 #endif
 
+/* Queues a user callback for the worker thread. A client on a shared transport is only visited by the multiplexed worker while in its ready set. */
+static int queue_user_callback(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, const USER_CALLBACK_INFO* queue_cb_info)
+{
+    int result;
+
+    if (VECTOR_push_back(iotHubClientInstance->saved_user_callback_list, queue_cb_info, 1) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (iotHubClientInstance->TransportHandle != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_10_067: [ With a shared transport, queuing a user callback shall put the client in the transport's ready set by calling IoTHubTransport_SignalClientReady, so the multiplexed worker thread visits it. ]*/
+            IoTHubTransport_SignalClientReady(iotHubClientInstance->TransportHandle, iotHubClientInstance, &iotHubClientInstance->readyQueued);
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
 static bool iothub_ll_message_callback(MESSAGE_CALLBACK_INFO* messageData, void* userContextCallback)
 {
     bool result;
@@ -210,7 +293,7 @@ static bool iothub_ll_message_callback(MESSAGE_CALLBACK_INFO* messageData, void*
         queue_cb_info.type = CALLBACK_TYPE_MESSAGE;
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.message_cb_info = messageData;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) == 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) == 0)
         {
             result = true;
         }
@@ -246,7 +329,7 @@ static int make_method_calback_queue_context(USER_CALLBACK_INFO* queue_cb_info,
         }
         else
         {
-            if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, queue_cb_info, 1) == 0)
+            if (queue_user_callback(queue_context->iotHubClientHandle, queue_cb_info) == 0)
             {
                 result = 0;
             }
@@ -325,13 +408,31 @@ static void iothub_ll_connection_status_callback(IOTHUB_CLIENT_CONNECTION_STATUS
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.connection_status_cb_info.status_reason = reason;
         queue_cb_info.iothub_callback.connection_status_cb_info.connection_status = result;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("connection status callback vector push failed.");
         }
     }
 }
 
+static void iothub_ll_send_queue_watermark_callback(IOTHUB_CLIENT_SEND_QUEUE_WATERMARK watermark, size_t queuedMessages, size_t queuedBytes, void* userContextCallback)
+{
+    IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
+    if (queue_context != NULL)
+    {
+        USER_CALLBACK_INFO queue_cb_info;
+        queue_cb_info.type = CALLBACK_TYPE_SEND_QUEUE_WATERMARK;
+        queue_cb_info.userContextCallback = queue_context->userContextCallback;
+        queue_cb_info.iothub_callback.send_queue_watermark_cb_info.watermark = watermark;
+        queue_cb_info.iothub_callback.send_queue_watermark_cb_info.queued_messages = queuedMessages;
+        queue_cb_info.iothub_callback.send_queue_watermark_cb_info.queued_bytes = queuedBytes;
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
+        {
+            LogError("send queue watermark callback vector push failed.");
+        }
+    }
+}
+
 static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
 {
     IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
@@ -341,7 +442,7 @@ static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT r
         queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = result;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("event confirm callback vector push failed.");
         }
@@ -358,7 +459,7 @@ static void iothub_ll_reported_state_callback(int status_code, void* userContext
         queue_cb_info.type = CALLBACK_TYPE_REPORTED_STATE;
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.reported_state_cb_info.status_code = status_code;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("reported state callback vector push failed.");
         }
@@ -401,7 +502,7 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
         }
         if (push_to_vector == 0)
         {
-            if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+            if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
             {
                 if (queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad != NULL)
                 {
@@ -417,20 +518,165 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
     }
 }
 
+static void invoke_user_callback(const USER_CALLBACKS* callbacks, USER_CALLBACK_INFO* queued_cb)
+{
+    switch (queued_cb->type)
+    {
+    case CALLBACK_TYPE_DEVICE_TWIN:
+    {
+        if (callbacks->desired_state_callback)
+        {
+            callbacks->desired_state_callback(queued_cb->iothub_callback.dev_twin_cb_info.update_state, queued_cb->iothub_callback.dev_twin_cb_info.payLoad, queued_cb->iothub_callback.dev_twin_cb_info.size, queued_cb->userContextCallback);
+        }
+
+        if (queued_cb->iothub_callback.dev_twin_cb_info.payLoad)
+        {
+            free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
+        }
+        break;
+    }
+    case CALLBACK_TYPE_EVENT_CONFIRM:
+        if (callbacks->event_confirm_callback)
+        {
+            callbacks->event_confirm_callback(queued_cb->iothub_callback.event_confirm_cb_info.confirm_result, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_REPORTED_STATE:
+        if (callbacks->reported_state_callback)
+        {
+            callbacks->reported_state_callback(queued_cb->iothub_callback.reported_state_cb_info.status_code, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_CONNECTION_STATUS:
+        if (callbacks->connection_status_callback)
+        {
+            callbacks->connection_status_callback(queued_cb->iothub_callback.connection_status_cb_info.connection_status, queued_cb->iothub_callback.connection_status_cb_info.status_reason, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_SEND_QUEUE_WATERMARK:
+        if (callbacks->send_queue_watermark_callback)
+        {
+            callbacks->send_queue_watermark_callback(queued_cb->iothub_callback.send_queue_watermark_cb_info.watermark, queued_cb->iothub_callback.send_queue_watermark_cb_info.queued_messages, queued_cb->iothub_callback.send_queue_watermark_cb_info.queued_bytes, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_DEVICE_METHOD:
+        if (callbacks->device_method_callback)
+        {
+            const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
+            const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
+            size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+
+            unsigned char* payload_resp = NULL;
+            size_t response_size = 0;
+            int status = callbacks->device_method_callback(method_name, payload, payload_len, &payload_resp, &response_size, queued_cb->userContextCallback);
+
+            if (payload_resp && (response_size > 0))
+            {
+                IOTHUB_CLIENT_RESULT result = IoTHubClientCore_DeviceMethodResponse(callbacks->method_user_context_handle, queued_cb->iothub_callback.method_cb_info.method_id, (const unsigned char*)payload_resp, response_size, status);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
+                }
+            }
+
+            BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
+            STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+
+            if (payload_resp)
+            {
+                free(payload_resp);
+            }
+        }
+        break;
+    case CALLBACK_TYPE_INBOUD_DEVICE_METHOD:
+        if (callbacks->inbound_device_method_callback)
+        {
+            const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
+            const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
+            size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+
+            callbacks->inbound_device_method_callback(method_name, payload, payload_len, queued_cb->iothub_callback.method_cb_info.method_id, queued_cb->userContextCallback);
+
+            BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
+            STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+        }
+        break;
+    case CALLBACK_TYPE_MESSAGE:
+        if (callbacks->message_callback)
+        {
+            IOTHUBMESSAGE_DISPOSITION_RESULT disposition = callbacks->message_callback(queued_cb->iothub_callback.message_cb_info->messageHandle, queued_cb->userContextCallback);
+
+            if (Lock(callbacks->message_user_context_handle->LockHandle) == LOCK_OK)
+            {
+                IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(callbacks->message_user_context_handle->IoTHubClientLLHandle, queued_cb->iothub_callback.message_cb_info, disposition);
+                (void)Unlock(callbacks->message_user_context_handle->LockHandle);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_SendMessageDisposition failed");
+                }
+            }
+            else
+            {
+                LogError("Lock failed");
+            }
+        }
+        break;
+    default:
+        LogError("Invalid callback type '%s'", ENUM_TO_STRING(USER_CALLBACK_TYPE, queued_cb->type));
+        break;
+    }
+}
+
+static void dispatched_user_callback_work(void* context)
+{
+    DISPATCHED_USER_CALLBACK* dispatched_cb = (DISPATCHED_USER_CALLBACK*)context;
+    invoke_user_callback(&dispatched_cb->callbacks, &dispatched_cb->queued_cb);
+    free(dispatched_cb);
+}
+
+static int post_user_callback(CALLBACK_DISPATCHER_HANDLE callback_dispatcher, const USER_CALLBACKS* callbacks, const USER_CALLBACK_INFO* queued_cb)
+{
+    int result;
+    DISPATCHED_USER_CALLBACK* dispatched_cb = (DISPATCHED_USER_CALLBACK*)malloc(sizeof(DISPATCHED_USER_CALLBACK));
+
+    if (dispatched_cb == NULL)
+    {
+        LogError("Failed allocating the dispatched callback");
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Method invocations are independent of each other and run in parallel, every other type of callback is delivered in order */
+        size_t lane = ((queued_cb->type == CALLBACK_TYPE_DEVICE_METHOD) || (queued_cb->type == CALLBACK_TYPE_INBOUD_DEVICE_METHOD)) ?
+            CALLBACK_DISPATCHER_PARALLEL_LANE : (size_t)queued_cb->type;
+
+        dispatched_cb->callbacks = *callbacks;
+        dispatched_cb->queued_cb = *queued_cb;
+
+        if (callback_dispatcher_post(callback_dispatcher, lane, dispatched_user_callback_work, dispatched_cb) != 0)
+        {
+            LogError("callback_dispatcher_post failed");
+            free(dispatched_cb);
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
 static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, VECTOR_HANDLE call_backs)
 {
     size_t callbacks_length = VECTOR_size(call_backs);
     size_t index;
 
-    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback = NULL;
-    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback = NULL;
-    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback = NULL;
-    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback = NULL;
-    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback = NULL;
-    IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback = NULL;
-    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback = NULL;
-    IOTHUB_CLIENT_CORE_HANDLE message_user_context_handle = NULL;
-    IOTHUB_CLIENT_CORE_HANDLE method_user_context_handle = NULL;
+    USER_CALLBACKS callbacks;
+    CALLBACK_DISPATCHER_HANDLE callback_dispatcher = NULL;
+
+    memset(&callbacks, 0, sizeof(USER_CALLBACKS));
 
     // Make a local copy of these callbacks, as we don't run with a lock held and iotHubClientInstance may change mid-run.
     if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
@@ -439,21 +685,23 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
     }
     else
     {
-        desired_state_callback = iotHubClientInstance->desired_state_callback;
-        event_confirm_callback = iotHubClientInstance->event_confirm_callback;
-        reported_state_callback = iotHubClientInstance->reported_state_callback;
-        connection_status_callback = iotHubClientInstance->connection_status_callback;
-        device_method_callback = iotHubClientInstance->device_method_callback;
-        inbound_device_method_callback = iotHubClientInstance->inbound_device_method_callback;
-        message_callback = iotHubClientInstance->message_callback;
+        callbacks.desired_state_callback = iotHubClientInstance->desired_state_callback;
+        callbacks.event_confirm_callback = iotHubClientInstance->event_confirm_callback;
+        callbacks.reported_state_callback = iotHubClientInstance->reported_state_callback;
+        callbacks.connection_status_callback = iotHubClientInstance->connection_status_callback;
+        callbacks.send_queue_watermark_callback = iotHubClientInstance->send_queue_watermark_callback;
+        callbacks.device_method_callback = iotHubClientInstance->device_method_callback;
+        callbacks.inbound_device_method_callback = iotHubClientInstance->inbound_device_method_callback;
+        callbacks.message_callback = iotHubClientInstance->message_callback;
         if (iotHubClientInstance->method_user_context)
         {
-            method_user_context_handle = iotHubClientInstance->method_user_context->iotHubClientHandle;
+            callbacks.method_user_context_handle = iotHubClientInstance->method_user_context->iotHubClientHandle;
         }
         if (iotHubClientInstance->message_user_context)
         {
-            message_user_context_handle = iotHubClientInstance->message_user_context->iotHubClientHandle;
+            callbacks.message_user_context_handle = iotHubClientInstance->message_user_context->iotHubClientHandle;
         }
+        callback_dispatcher = iotHubClientInstance->callback_dispatcher;
 
         (void)Unlock(iotHubClientInstance->LockHandle);
     }
@@ -466,110 +714,56 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
         {
             LogError("VECTOR_element at index %zd is NULL.", index);
         }
+        /*Codes_SRS_IOTHUBCLIENT_10_050: [ When a callback dispatcher pool was configured, the worker thread shall hand every queued user callback to the pool instead of running it: method callbacks on the parallel lane, every other callback on the ordered lane of its type. ]*/
+        else if ((callback_dispatcher != NULL) && (post_user_callback(callback_dispatcher, &callbacks, queued_cb) == 0))
+        {
+            /* the pool owns the callback now */
+        }
         else
         {
-            switch (queued_cb->type)
-            {
-            case CALLBACK_TYPE_DEVICE_TWIN:
-            {
-                if (desired_state_callback)
-                {
-                    desired_state_callback(queued_cb->iothub_callback.dev_twin_cb_info.update_state, queued_cb->iothub_callback.dev_twin_cb_info.payLoad, queued_cb->iothub_callback.dev_twin_cb_info.size, queued_cb->userContextCallback);
-                }
-
-                if (queued_cb->iothub_callback.dev_twin_cb_info.payLoad)
-                {
-                    free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
-                }
-                break;
-            }
-            case CALLBACK_TYPE_EVENT_CONFIRM:
-                if (event_confirm_callback)
-                {
-                    event_confirm_callback(queued_cb->iothub_callback.event_confirm_cb_info.confirm_result, queued_cb->userContextCallback);
-                }
-                break;
-            case CALLBACK_TYPE_REPORTED_STATE:
-                if (reported_state_callback)
-                {
-                    reported_state_callback(queued_cb->iothub_callback.reported_state_cb_info.status_code, queued_cb->userContextCallback);
-                }
-                break;
-            case CALLBACK_TYPE_CONNECTION_STATUS:
-                if (connection_status_callback)
-                {
-                    connection_status_callback(queued_cb->iothub_callback.connection_status_cb_info.connection_status, queued_cb->iothub_callback.connection_status_cb_info.status_reason, queued_cb->userContextCallback);
-                }
-                break;
-            case CALLBACK_TYPE_DEVICE_METHOD:
-                if (device_method_callback)
-                {
-                    const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
-                    const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
-                    size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
-
-                    unsigned char* payload_resp = NULL;
-                    size_t response_size = 0;
-                    int status = device_method_callback(method_name, payload, payload_len, &payload_resp, &response_size, queued_cb->userContextCallback);
-
-                    if (payload_resp && (response_size > 0))
-                    {
-                        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_DeviceMethodResponse(method_user_context_handle, queued_cb->iothub_callback.method_cb_info.method_id, (const unsigned char*)payload_resp, response_size, status);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
-                        }
-                    }
+            /*Codes_SRS_IOTHUBCLIENT_10_051: [ If there is no callback dispatcher pool, or handing a callback to it fails, the worker thread shall run the user callback itself. ]*/
+            invoke_user_callback(&callbacks, queued_cb);
+        }
+    }
+    VECTOR_destroy(call_backs);
+}
 
-                    BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
-                    STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+/* Must be called with LockHandle held */
+static void hand_over_submitted_events(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    MPSC_QUEUE_NODE* node = mpsc_queue_take_all(iotHubClientInstance->submission_queue);
 
-                    if (payload_resp)
-                    {
-                        free(payload_resp);
-                    }
-                }
-                break;
-            case CALLBACK_TYPE_INBOUD_DEVICE_METHOD:
-                if (inbound_device_method_callback)
-                {
-                    const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
-                    const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
-                    size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+    while (node != NULL)
+    {
+        SUBMITTED_EVENT* submitted_event = (SUBMITTED_EVENT*)node;
+        IOTHUB_CLIENT_RESULT send_result;
+        node = node->next;
 
-                    inbound_device_method_callback(method_name, payload, payload_len, queued_cb->iothub_callback.method_cb_info.method_id, queued_cb->userContextCallback);
+        iotHubClientInstance->event_confirm_callback = submitted_event->callback;
 
-                    BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
-                    STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
-                }
-                break;
-            case CALLBACK_TYPE_MESSAGE:
-                if (message_callback)
-                {
-                    IOTHUBMESSAGE_DISPOSITION_RESULT disposition = message_callback(queued_cb->iothub_callback.message_cb_info->messageHandle, queued_cb->userContextCallback);
+        /*Codes_SRS_IOTHUBCLIENT_10_056: [ The worker thread shall hand every submitted message, in submission order, to `IoTHubClientCore_LL_SendEventAsync_TakeOwnership` before calling `IoTHubClientCore_LL_DoWork`. ]*/
+        if (submitted_event->queue_context == NULL)
+        {
+            send_result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(iotHubClientInstance->IoTHubClientLLHandle, submitted_event->message, NULL, submitted_event->userContextCallback);
+        }
+        else
+        {
+            send_result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(iotHubClientInstance->IoTHubClientLLHandle, submitted_event->message, iothub_ll_event_confirm_callback, submitted_event->queue_context);
+        }
 
-                    if (Lock(message_user_context_handle->LockHandle) == LOCK_OK)
-                    {
-                        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(message_user_context_handle->IoTHubClientLLHandle, queued_cb->iothub_callback.message_cb_info, disposition);
-                        (void)Unlock(message_user_context_handle->LockHandle);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_SendMessageDisposition failed");
-                        }
-                    }
-                    else
-                    {
-                        LogError("Lock failed");
-                    }
-                }
-                break;
-            default:
-                LogError("Invalid callback type '%s'", ENUM_TO_STRING(USER_CALLBACK_TYPE, queued_cb->type));
-                break;
+        if (send_result != IOTHUB_CLIENT_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_10_057: [ If `IoTHubClientCore_LL_SendEventAsync_TakeOwnership` fails, the message shall be destroyed and its confirmation callback, if any, shall be called with `IOTHUB_CLIENT_CONFIRMATION_ERROR`. ]*/
+            LogError("IoTHubClientCore_LL_SendEventAsync_TakeOwnership failed for a submitted message (%s)", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, send_result));
+            IoTHubMessage_Destroy(submitted_event->message);
+            if (submitted_event->queue_context != NULL)
+            {
+                iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, submitted_event->queue_context);
             }
         }
+
+        free(submitted_event);
     }
-    VECTOR_destroy(call_backs);
 }
 
 static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
@@ -586,7 +780,9 @@ static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
 
         if (call_backs == NULL)
         {
+            /*Codes_SRS_IOTHUBCLIENT_10_069: [ If the queued user callbacks cannot be taken, the client shall put itself back in the transport's ready set. ]*/
             LogError("Failed moving user callbacks");
+            IoTHubTransport_SignalClientReady(iotHubClientInstance->TransportHandle, iotHubClientInstance, &iotHubClientInstance->readyQueued);
         }
         else
         {
@@ -596,6 +792,97 @@ static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
     else
     {
         LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
+        IoTHubTransport_SignalClientReady(iotHubClientInstance->TransportHandle, iotHubClientInstance, &iotHubClientInstance->readyQueued);
+    }
+}
+
+/* Wakes the worker thread so queued work is processed right away instead of on the next poll. Only takes WakeLockHandle, which
+   the worker never holds while in IoTHubClientCore_LL_DoWork, so it can be called with or without LockHandle held. */
+static void signal_worker_thread(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->WakeLockHandle == NULL)
+    {
+        iotHubClientInstance->WakeRequested = 1;
+    }
+    else if (Lock(iotHubClientInstance->WakeLockHandle) != LOCK_OK)
+    {
+        LogError("Could not acquire wake lock, worker thread will pick up the work on its next poll");
+    }
+    else
+    {
+        iotHubClientInstance->WakeRequested = 1;
+        if (Condition_Post(iotHubClientInstance->ThreadCondition) != COND_OK)
+        {
+            LogError("Condition_Post failed, worker thread will pick up the work on its next poll");
+        }
+        (void)Unlock(iotHubClientInstance->WakeLockHandle);
+    }
+}
+
+static void wait_for_work(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_STATUS send_status;
+    IOTHUB_CLIENT_RESULT send_status_result;
+    IOTHUB_CLIENT_RESULT next_due_result;
+    size_t ms_until_due;
+    int wait_ms;
+
+    if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClientCore_LL_DoWork shall not be called.]*/
+        (void)ThreadAPI_Sleep(DO_WORK_FREQ_BUSY_IN_MS);
+    }
+    else
+    {
+        send_status_result = IoTHubClientCore_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, &send_status);
+        next_due_result = IoTHubClientCore_LL_GetTimeUntilNextDue(iotHubClientInstance->IoTHubClientLLHandle, &ms_until_due);
+        (void)Unlock(iotHubClientInstance->LockHandle);
+
+        /*Codes_SRS_IOTHUBCLIENT_10_071: [ The worker thread shall wait no longer than the time `IoTHubClientCore_LL_GetTimeUntilNextDue` reports, and no longer than `do_work_freq_ms`; it shall only fall back to waiting 1 ms while events are waiting to be sent and no deadline is pending. ]*/
+        /* Polling is still needed to pick up acknowledgements and inbound traffic, hence the do_work_freq_ms cap. Condition_Wait
+           treats 0 as forever, so a deadline that is already due gives the shortest wait instead */
+        if (next_due_result == IOTHUB_CLIENT_OK)
+        {
+            if (ms_until_due < DO_WORK_FREQ_BUSY_IN_MS)
+            {
+                wait_ms = DO_WORK_FREQ_BUSY_IN_MS;
+            }
+            else if (ms_until_due < iotHubClientInstance->do_work_freq_ms)
+            {
+                wait_ms = (int)ms_until_due;
+            }
+            else
+            {
+                wait_ms = (int)iotHubClientInstance->do_work_freq_ms;
+            }
+        }
+        else if ((send_status_result != IOTHUB_CLIENT_OK) || (send_status == IOTHUB_CLIENT_SEND_STATUS_BUSY))
+        {
+            wait_ms = DO_WORK_FREQ_BUSY_IN_MS;
+        }
+        else
+        {
+            wait_ms = (int)iotHubClientInstance->do_work_freq_ms;
+        }
+
+        /* The wait happens on WakeLockHandle rather than LockHandle so a producer posting a wakeup never queues behind
+           IoTHubClientCore_LL_DoWork. Producers push to the submission queue before taking WakeLockHandle, so a message
+           pushed after the emptiness check below is always followed by a post that finds the worker waiting. */
+        if (Lock(iotHubClientInstance->WakeLockHandle) != LOCK_OK)
+        {
+            (void)ThreadAPI_Sleep(DO_WORK_FREQ_BUSY_IN_MS);
+        }
+        else
+        {
+            if ((iotHubClientInstance->StopThread == 0) && (iotHubClientInstance->WakeRequested == 0) &&
+                ((iotHubClientInstance->submission_queue == NULL) || mpsc_queue_is_empty(iotHubClientInstance->submission_queue)))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork at least every do_work_freq_ms ms, and as soon as new work is queued.] */
+                (void)Condition_Wait(iotHubClientInstance->ThreadCondition, iotHubClientInstance->WakeLockHandle, wait_ms);
+            }
+            iotHubClientInstance->WakeRequested = 0;
+            (void)Unlock(iotHubClientInstance->WakeLockHandle);
+        }
     }
 }
 
@@ -615,7 +902,11 @@ static int ScheduleWork_Thread(void* threadArgument)
             }
             else
             {
-                /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork every 1 ms.] */
+                if (iotHubClientInstance->submission_queue != NULL)
+                {
+                    hand_over_submitted_events(iotHubClientInstance);
+                }
+
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClientCore_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
                 IoTHubClientCore_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
 
@@ -639,7 +930,7 @@ static int ScheduleWork_Thread(void* threadArgument)
             /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClientCore_LL_DoWork shall not be called.]*/
             /*no code, shall retry*/
         }
-        (void)ThreadAPI_Sleep(1);
+        wait_for_work(iotHubClientInstance);
     }
 
     ThreadAPI_Exit(0);
@@ -712,6 +1003,10 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
             {
                 result->TransportHandle = transportHandle;
                 result->created_with_transport_handle = 0;
+                result->WakeLockHandle = NULL;
+                result->ThreadCondition = NULL;
+                result->WakeRequested = 0;
+                result->do_work_freq_ms = DO_WORK_FREQ_DEFAULT_IN_MS;
                 if (config != NULL)
                 {
                     if (transportHandle != NULL)
@@ -769,6 +1064,16 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                             LogError("Failure creating Lock object");
                             result->IoTHubClientLLHandle = NULL;
                         }
+                        else if ((result->ThreadCondition = Condition_Init()) == NULL)
+                        {
+                            LogError("Failure creating Condition object");
+                            result->IoTHubClientLLHandle = NULL;
+                        }
+                        else if ((result->WakeLockHandle = Lock_Init()) == NULL)
+                        {
+                            LogError("Failure creating wake Lock object");
+                            result->IoTHubClientLLHandle = NULL;
+                        }
                         else
                         {
                             /* Codes_SRS_IOTHUBCLIENT_01_002: [IoTHubClient_Create shall instantiate a new IoTHubClientCore_LL instance by calling IoTHubClientCore_LL_Create and passing the config argument.] */
@@ -787,6 +1092,16 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                         LogError("Failure creating Lock object");
                         result->IoTHubClientLLHandle = NULL;
                     }
+                    else if ((result->ThreadCondition = Condition_Init()) == NULL)
+                    {
+                        LogError("Failure creating Condition object");
+                        result->IoTHubClientLLHandle = NULL;
+                    }
+                    else if ((result->WakeLockHandle = Lock_Init()) == NULL)
+                    {
+                        LogError("Failure creating wake Lock object");
+                        result->IoTHubClientLLHandle = NULL;
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUBCLIENT_12_025: [** `IoTHubClient_CreateFromDeviceAuth` shall instantiate a new `IoTHubClientCore_LL` instance by calling `IoTHubClientCore_LL_CreateFromDeviceAuth` and passing iothub_uri, device_id and protocol argument.  **] */
@@ -808,6 +1123,16 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                         LogError("Failure creating Lock object");
                         result->IoTHubClientLLHandle = NULL;
                     }
+                    else if ((result->ThreadCondition = Condition_Init()) == NULL)
+                    {
+                        LogError("Failure creating Condition object");
+                        result->IoTHubClientLLHandle = NULL;
+                    }
+                    else if ((result->WakeLockHandle = Lock_Init()) == NULL)
+                    {
+                        LogError("Failure creating wake Lock object");
+                        result->IoTHubClientLLHandle = NULL;
+                    }
                     else
                     {
                         result->IoTHubClientLLHandle = IoTHubClientCore_LL_CreateFromConnectionString(connectionString, protocol);
@@ -821,6 +1146,14 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                     /* Codes_SRS_IOTHUBCLIENT_17_006: [ If IoTHubTransport_GetLock fails, then IoTHubClient_CreateWithTransport shall return NULL. ]*/
                     if (transportHandle == NULL)
                     {
+                        if (result->ThreadCondition != NULL)
+                        {
+                            Condition_Deinit(result->ThreadCondition);
+                        }
+                        if (result->WakeLockHandle != NULL)
+                        {
+                            Lock_Deinit(result->WakeLockHandle);
+                        }
                         Lock_Deinit(result->LockHandle);
                     }
 #ifndef DONT_USE_UPLOADTOBLOB
@@ -840,9 +1173,14 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                     result->devicetwin_user_context = NULL;
                     result->connection_status_callback = NULL;
                     result->connection_status_user_context = NULL;
+                    result->send_queue_watermark_callback = NULL;
+                    result->send_queue_watermark_user_context = NULL;
                     result->message_callback = NULL;
                     result->message_user_context = NULL;
                     result->method_user_context = NULL;
+                    result->callback_dispatcher = NULL;
+                    result->submission_queue = NULL;
+                    result->readyQueued = false;
                 }
             }
         }
@@ -951,7 +1289,7 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         if (iotHubClientInstance->TransportHandle != NULL)
         {
             /*Codes_SRS_IOTHUBCLIENT_01_007: [ The thread created as part of executing IoTHubClient_SendEventAsync or IoTHubClient_SetNotificationMessageCallback shall be joined. ]*/
-            joinTransportThread = IoTHubTransport_SignalEndWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle);
+            joinTransportThread = IoTHubTransport_SignalEndWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle, &iotHubClientInstance->readyQueued);
         }
         else
         {
@@ -967,6 +1305,7 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         if (iotHubClientInstance->ThreadHandle != NULL)
         {
             iotHubClientInstance->StopThread = 1;
+            signal_worker_thread(iotHubClientInstance);
             joinClientThread = true;
         }
         else
@@ -996,6 +1335,13 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             IoTHubTransport_JoinWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle);
         }
 
+        /*Codes_SRS_IOTHUBCLIENT_10_052: [ `IoTHubClient_Destroy` shall destroy the callback dispatcher pool, which runs the callbacks already handed to it, before destroying the `IoTHubClient_LL` instance. ]*/
+        if (iotHubClientInstance->callback_dispatcher != NULL)
+        {
+            callback_dispatcher_destroy(iotHubClientInstance->callback_dispatcher);
+            iotHubClientInstance->callback_dispatcher = NULL;
+        }
+
         if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             LogError("unable to Lock - - will still proceed to try to end the thread without locking");
@@ -1015,9 +1361,21 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         }
 #endif
 
+        if (iotHubClientInstance->submission_queue != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_10_058: [ `IoTHubClient_Destroy` shall hand the submitted messages not yet taken by the worker thread to `IoTHubClientCore_LL`, so they are confirmed with `IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY`, and destroy the submission queue. ]*/
+            hand_over_submitted_events(iotHubClientInstance);
+        }
+
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClientCore_LL instance by calling IoTHubClientCore_LL_Destroy.] */
         IoTHubClientCore_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
+        if (iotHubClientInstance->submission_queue != NULL)
+        {
+            mpsc_queue_destroy(iotHubClientInstance->submission_queue);
+            iotHubClientInstance->submission_queue = NULL;
+        }
+
         if (Unlock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             LogError("unable to Unlock");
@@ -1056,6 +1414,8 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
 
         if (iotHubClientInstance->TransportHandle == NULL)
         {
+            Condition_Deinit(iotHubClientInstance->ThreadCondition);
+            Lock_Deinit(iotHubClientInstance->WakeLockHandle);
             /* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
             Lock_Deinit(iotHubClientInstance->LockHandle);
         }
@@ -1067,6 +1427,10 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         {
             free(iotHubClientInstance->connection_status_user_context);
         }
+        if (iotHubClientInstance->send_queue_watermark_user_context != NULL)
+        {
+            free(iotHubClientInstance->send_queue_watermark_user_context);
+        }
         if (iotHubClientInstance->message_user_context != NULL)
         {
             free(iotHubClientInstance->message_user_context);
@@ -1079,7 +1443,97 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
     }
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+static IOTHUB_CLIENT_RESULT ll_send_event_async(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (takeOwnership)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_10_040: [IoTHubClient_SendEventAsync_TakeOwnership shall behave as IoTHubClient_SendEventAsync, calling IoTHubClientCore_LL_SendEventAsync_TakeOwnership instead of IoTHubClientCore_LL_SendEventAsync.] */
+        result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+    }
+    else
+    {
+        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+    }
+
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT submit_event(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
+{
+    IOTHUB_CLIENT_RESULT result;
+    SUBMITTED_EVENT* submitted_event;
+    bool was_empty;
+
+    if (eventMessageHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL eventMessageHandle");
+    }
+    else if ((submitted_event = (SUBMITTED_EVENT*)malloc(sizeof(SUBMITTED_EVENT))) == NULL)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("Failed allocating the submitted message");
+    }
+    else
+    {
+        submitted_event->callback = eventConfirmationCallback;
+        submitted_event->userContextCallback = userContextCallback;
+        submitted_event->queue_context = NULL;
+
+        if ((eventConfirmationCallback != NULL) &&
+            ((submitted_event->queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT))) == NULL))
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Failed allocating QUEUE_CONTEXT");
+            free(submitted_event);
+        }
+        /*Codes_SRS_IOTHUBCLIENT_10_054: [ `IoTHubClient_SendEventAsync` shall clone the message (`IoTHubClient_SendEventAsync_TakeOwnership` shall use it as is) and push it, with its callback and context, to the submission queue without acquiring the client lock. ]*/
+        else if ((submitted_event->message = takeOwnership ? eventMessageHandle : IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("IoTHubMessage_Clone failed");
+            free(submitted_event->queue_context);
+            free(submitted_event);
+        }
+        else
+        {
+            if (submitted_event->queue_context != NULL)
+            {
+                submitted_event->queue_context->iotHubClientHandle = iotHubClientInstance;
+                submitted_event->queue_context->userContextCallback = userContextCallback;
+            }
+
+            if (mpsc_queue_push(iotHubClientInstance->submission_queue, &submitted_event->node, &was_empty) != 0)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("mpsc_queue_push failed");
+                if (!takeOwnership)
+                {
+                    IoTHubMessage_Destroy(submitted_event->message);
+                }
+                free(submitted_event->queue_context);
+                free(submitted_event);
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_10_055: [ If the message made the submission queue non empty, `IoTHubClient_SendEventAsync` shall wake the worker thread under the wake lock, without acquiring the client lock; it shall then return `IOTHUB_CLIENT_OK`, errors of `IoTHubClientCore_LL` are reported through the confirmation callback. ]*/
+                /* Producers that pushed onto a non empty queue owe no wakeup: the one that made it non empty does,
+                   and the worker takes their messages along with its own. */
+                if (was_empty)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+    }
+
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT send_event_async(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
 {
     IOTHUB_CLIENT_RESULT result;
 
@@ -1100,6 +1554,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
             result = IOTHUB_CLIENT_ERROR;
             LogError("Could not start worker thread");
         }
+        /* submission_queue does not change once the worker thread runs (SRS_IOTHUBCLIENT_10_070), reading it without the lock is safe */
+        else if (iotHubClientInstance->submission_queue != NULL)
+        {
+            result = submit_event(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, takeOwnership);
+        }
         else
         {
             /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -1118,7 +1577,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
 
                 if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
                 {
-                    result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+                    result = ll_send_event_async(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, takeOwnership);
                 }
                 else
                 {
@@ -1135,7 +1594,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
                         queue_context->userContextCallback = userContextCallback;
                         /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
                         /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
-                        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
+                        result = ll_send_event_async(iotHubClientInstance, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context, takeOwnership);
                         if (result != IOTHUB_CLIENT_OK)
                         {
                             LogError("IoTHubClientCore_LL_SendEventAsync failed");
@@ -1144,6 +1603,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
@@ -1153,6 +1617,93 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return send_event_async(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync_TakeOwnership(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return send_event_async(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventBatchAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_10_062: [ If `iotHubClientHandle` is NULL, `IoTHubClient_SendEventBatchAsync` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_10_063: [ `IoTHubClient_SendEventBatchAsync` shall start the worker thread if it was not previously started, and return `IOTHUB_CLIENT_ERROR` if that fails. ]*/
+        if (StartWorkerThreadIfNeeded(iotHubClientInstance) != IOTHUB_CLIENT_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_10_064: [ `IoTHubClient_SendEventBatchAsync` shall be made thread-safe by using the lock created in `IoTHubClient_Create`, and return `IOTHUB_CLIENT_ERROR` if acquiring it fails. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if (iotHubClientInstance->submission_queue != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_10_065: [ With lock free submission, the messages submitted earlier shall be handed to `IoTHubClientCore_LL` before the batch, so the batch does not overtake them. ]*/
+                hand_over_submitted_events(iotHubClientInstance);
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle == 0)
+            {
+                iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+            {
+                result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, eventConfirmationCallback, userContextCallback);
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_10_066: [ `IoTHubClient_SendEventBatchAsync` shall call `IoTHubClientCore_LL_SendEventBatchAsync` with a single IOTHUB_QUEUE_CONTEXT for the batch, so the confirmation callback is invoked once on the worker thread, and return its result. ]*/
+                IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+                if (queue_context == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Failed allocating QUEUE_CONTEXT");
+                }
+                else
+                {
+                    queue_context->iotHubClientHandle = iotHubClientInstance;
+                    queue_context->userContextCallback = userContextCallback;
+                    result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, iothub_ll_event_confirm_callback, queue_context);
+                    if (result != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubClientCore_LL_SendEventBatchAsync failed");
+                        free(queue_context);
+                    }
+                }
+            }
+
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                signal_worker_thread(iotHubClientInstance);
+            }
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_GetSendStatus(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1180,6 +1731,12 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_GetSendStatus(IOTHUB_CLIENT_CORE_HANDLE io
             /* Codes_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClient_GetSendStatus shall return the result of IoTHubClientCore_LL_GetSendStatus.] */
             result = IoTHubClientCore_LL_GetSendStatus(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientStatus);
 
+            /*Codes_SRS_IOTHUBCLIENT_10_059: [ `IoTHubClient_GetSendStatus` shall report `IOTHUB_CLIENT_SEND_STATUS_BUSY` while submitted messages wait to be handed to `IoTHubClientCore_LL`. ]*/
+            if ((result == IOTHUB_CLIENT_OK) && (iotHubClientInstance->submission_queue != NULL) && !mpsc_queue_is_empty(iotHubClientInstance->submission_queue))
+            {
+                *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+            }
+
             /* Codes_SRS_IOTHUBCLIENT_01_033: [IoTHubClient_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
             (void)Unlock(iotHubClientInstance->LockHandle);
         }
@@ -1347,6 +1904,83 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetConnectionStatusCallback(IOTHUB_CLIENT_
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SetSendQueueWatermarkCallback(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK watermarkCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_10_041: [ If `iotHubClientHandle` is `NULL`, `IoTHubClient_SetSendQueueWatermarkCallback` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_10_042: [ `IoTHubClient_SetSendQueueWatermarkCallback` shall start the worker thread if it was not previously started. ]*/
+        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_10_043: [ If starting the thread fails, `IoTHubClient_SetSendQueueWatermarkCallback` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
+        else
+        {
+            if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_10_044: [ If acquiring the lock fails, `IoTHubClient_SetSendQueueWatermarkCallback` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("Could not acquire lock");
+            }
+            else
+            {
+                if (iotHubClientInstance->created_with_transport_handle == 0)
+                {
+                    iotHubClientInstance->send_queue_watermark_callback = watermarkCallback;
+                }
+
+                if (iotHubClientInstance->created_with_transport_handle != 0 || watermarkCallback == NULL)
+                {
+                    /* Codes_SRS_IOTHUBCLIENT_10_045: [ `IoTHubClient_SetSendQueueWatermarkCallback` shall call `IoTHubClientCore_LL_SetSendQueueWatermarkCallback`, so the watermark notifications are queued and dispatched by the worker thread outside of the client lock. ]*/
+                    result = IoTHubClientCore_LL_SetSendQueueWatermarkCallback(iotHubClientInstance->IoTHubClientLLHandle, watermarkCallback, userContextCallback);
+                }
+                else
+                {
+                    if (iotHubClientInstance->send_queue_watermark_user_context != NULL)
+                    {
+                        free(iotHubClientInstance->send_queue_watermark_user_context);
+                    }
+                    iotHubClientInstance->send_queue_watermark_user_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+                    if (iotHubClientInstance->send_queue_watermark_user_context == NULL)
+                    {
+                        /* Codes_SRS_IOTHUBCLIENT_10_046: [ If any failure occurs `IoTHubClient_SetSendQueueWatermarkCallback` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("Failed allocating QUEUE_CONTEXT");
+                    }
+                    else
+                    {
+                        iotHubClientInstance->send_queue_watermark_user_context->iotHubClientHandle = iotHubClientInstance;
+                        iotHubClientInstance->send_queue_watermark_user_context->userContextCallback = userContextCallback;
+
+                        /* Codes_SRS_IOTHUBCLIENT_10_045: [ `IoTHubClient_SetSendQueueWatermarkCallback` shall call `IoTHubClientCore_LL_SetSendQueueWatermarkCallback`, so the watermark notifications are queued and dispatched by the worker thread outside of the client lock. ]*/
+                        result = IoTHubClientCore_LL_SetSendQueueWatermarkCallback(iotHubClientInstance->IoTHubClientLLHandle, iothub_ll_send_queue_watermark_callback, iotHubClientInstance->send_queue_watermark_user_context);
+                        if (result != IOTHUB_CLIENT_OK)
+                        {
+                            /* Codes_SRS_IOTHUBCLIENT_10_046: [ If any failure occurs `IoTHubClient_SetSendQueueWatermarkCallback` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                            LogError("IoTHubClientCore_LL_SetSendQueueWatermarkCallback failed");
+                            free(iotHubClientInstance->send_queue_watermark_user_context);
+                            iotHubClientInstance->send_queue_watermark_user_context = NULL;
+                        }
+                    }
+                }
+                (void)Unlock(iotHubClientInstance->LockHandle);
+            }
+        }
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_SetRetryPolicy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1495,11 +2129,94 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
-            result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            if (strcmp(OPTION_DO_WORK_FREQUENCY_IN_MS, optionName) == 0)
             {
-                LogError("IoTHubClientCore_LL_SetOption failed");
+                unsigned int do_work_freq_ms = *(const unsigned int*)value;
+                if ((do_work_freq_ms == 0) || (do_work_freq_ms > DO_WORK_FREQ_MAXIMUM_IN_MS))
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value %u for option %s, it must be between 1 and %d", do_work_freq_ms, OPTION_DO_WORK_FREQUENCY_IN_MS, DO_WORK_FREQ_MAXIMUM_IN_MS);
+                }
+                else
+                {
+                    iotHubClientInstance->do_work_freq_ms = do_work_freq_ms;
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_LOCK_FREE_SUBMISSION, optionName) == 0)
+            {
+                bool lock_free_submission = *(const bool*)value;
+                if (iotHubClientInstance->TransportHandle != NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_10_060: [ `OPTION_LOCK_FREE_SUBMISSION` shall fail with `IOTHUB_CLIENT_ERROR` for a client sharing its transport, whose worker thread is owned by the transport. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Option %s is not supported with a shared transport", OPTION_LOCK_FREE_SUBMISSION);
+                }
+                else if (lock_free_submission == (iotHubClientInstance->submission_queue != NULL))
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+                else if (iotHubClientInstance->ThreadHandle != NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_10_070: [ Once the worker thread is started, changing `OPTION_LOCK_FREE_SUBMISSION` shall fail with `IOTHUB_CLIENT_ERROR`, so that `IoTHubClient_SendEventAsync` can read the submission queue without the lock. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Option %s must be set before the worker thread is started", OPTION_LOCK_FREE_SUBMISSION);
+                }
+                else if (!lock_free_submission)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_10_061: [ Once enabled, lock free submission cannot be disabled, setting `OPTION_LOCK_FREE_SUBMISSION` to false shall fail with `IOTHUB_CLIENT_ERROR`. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Option %s cannot be disabled once enabled", OPTION_LOCK_FREE_SUBMISSION);
+                }
+                /*Codes_SRS_IOTHUBCLIENT_10_053: [ When `OPTION_LOCK_FREE_SUBMISSION` is set to true, `IoTHubClient_SetOption` shall create the submission queue by calling `mpsc_queue_create`, and return `IOTHUB_CLIENT_ERROR` if it fails. ]*/
+                else if ((iotHubClientInstance->submission_queue = mpsc_queue_create()) == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("mpsc_queue_create failed");
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_CALLBACK_DISPATCHER_THREADS, optionName) == 0)
+            {
+                size_t thread_count = *(const size_t*)value;
+                if (iotHubClientInstance->callback_dispatcher != NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_10_048: [ If the callback dispatcher pool was already created, setting `OPTION_CALLBACK_DISPATCHER_THREADS` shall fail and return `IOTHUB_CLIENT_ERROR`. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Option %s can only be set once", OPTION_CALLBACK_DISPATCHER_THREADS);
+                }
+                else if (thread_count == 0)
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+                /*Codes_SRS_IOTHUBCLIENT_10_047: [ When `OPTION_CALLBACK_DISPATCHER_THREADS` is set to a non-zero value, `IoTHubClient_SetOption` shall create a callback dispatcher pool of that many threads by calling `callback_dispatcher_create`. ]*/
+                else if ((iotHubClientInstance->callback_dispatcher = callback_dispatcher_create(thread_count, USER_CALLBACK_DISPATCHER_LANES)) == NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_10_049: [ If `callback_dispatcher_create` fails, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("callback_dispatcher_create failed");
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
+                result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_SetOption failed");
+                }
+                else
+                {
+                    /* timeouts and transport settings may have changed, let the worker thread re-evaluate them */
+                    signal_worker_thread(iotHubClientInstance);
+                }
             }
 
             (void)Unlock(iotHubClientInstance->LockHandle);
@@ -1653,6 +2370,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -1854,6 +2576,10 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_DeviceMethodResponse(IOTHUB_CLIENT_CORE_HA
             {
                 LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
             }
+            else
+            {
+                signal_worker_thread(iotHubClientInstance);
+            }
             (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
@@ -1946,6 +2672,12 @@ static int markThreadReadyToBeGarbageCollected(UPLOADTOBLOB_THREAD_INFO* threadI
         }
     }
 
+    if (threadInfo->iotHubClientHandle->TransportHandle != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_10_068: [ With a shared transport, the thread shall then put the client in the transport's ready set by calling IoTHubTransport_SignalClientReady, so the multiplexed worker thread joins it. ]*/
+        IoTHubTransport_SignalClientReady(threadInfo->iotHubClientHandle->TransportHandle, threadInfo->iotHubClientHandle, &threadInfo->iotHubClientHandle->readyQueued);
+    }
+
     ThreadAPI_Exit(0);
     return 0;
 }
@@ -17,6 +17,8 @@
 #include "internal/iothub_client_authorization.h"
 #include "iothub_transport_ll.h"
 #include "internal/iothub_client_private.h"
+#include "internal/iothub_client_timer_wheel.h"
+#include "internal/iothub_client_slab.h"
 #include "iothub_client_options.h"
 #include "iothub_client_version.h"
 #include "internal/iothub_client_diagnostic.h"
@@ -26,6 +28,12 @@
 #include "internal/iothub_client_ll_uploadtoblob.h"
 #endif
 
+#ifdef USE_STORE_AND_FORWARD
+#include "internal/iothub_client_store_and_forward.h"
+
+#define STORE_AND_FORWARD_DEFAULT_SEGMENT_SIZE (1024 * 1024)
+#endif
+
 #define LOG_ERROR_RESULT LogError("result = %s", ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
 #define INDEFINITE_TIME ((time_t)(-1))
 
@@ -85,6 +93,30 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
     time_t lastMessageReceiveTime;
     TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
     tickcounter_ms_t currentMessageTimeout;
+    TIMER_WHEEL timeoutWheel;
+    TIMER_WHEEL_ENTRY messageTimeoutTimer; /*armed for the earliest ms_timesOutAfter in waitingToSend*/
+    bool messageTimeoutDue;
+    bool messageDeadlinesUnordered; /*a message was queued behind one of its priority that times out later, DoTimeouts cannot stop at the first message not due*/
+    SLAB_ALLOCATOR_HANDLE messageListSlab; /*NULL unless OPTION_MESSAGE_RECORD_POOL_SIZE was set, IOTHUB_MESSAGE_LIST records are then malloc'd*/
+    size_t messageListsInUse; /*IOTHUB_MESSAGE_LIST records allocated and not freed yet, wherever they are (send queue, transport, shed or spilled lists)*/
+    DLIST_ENTRY shedMessages; /*records of the messages dropped by the send queue shed policy, their callbacks are invoked from the next DoWork*/
+    size_t sendQueueMessages; /*messages accepted by SendEventAsync and not yet completed, whether in waitingToSend or in flight*/
+    size_t sendQueueBytes;
+    size_t sendQueueMaxMessages; /*0 means no limit*/
+    size_t sendQueueMaxBytes; /*0 means no limit*/
+    IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY sendQueueShedPolicy;
+    size_t sendQueueHighWatermark; /*0 disables the watermark callbacks*/
+    size_t sendQueueLowWatermark;
+    bool sendQueueAboveHighWatermark;
+    bool sendQueueReportedAboveHighWatermark; /*what the watermark callback was last told, it only runs from DoWork*/
+    IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK sendQueueWatermarkCallback;
+    void* sendQueueWatermarkUserContextCallback;
+#ifdef USE_STORE_AND_FORWARD
+    STORE_AND_FORWARD_HANDLE storeAndForward; /*NULL unless OPTION_STORE_AND_FORWARD_PATH was set*/
+    size_t storeAndForwardSegmentSize; /*0 means STORE_AND_FORWARD_DEFAULT_SEGMENT_SIZE*/
+    size_t storeAndForwardSyncBatch;
+    DLIST_ENTRY spilledMessages; /*records of journaled messages that did not fit in the send queue, only their sequence number is kept in memory. Initialized with storeAndForward*/
+#endif
     uint64_t current_device_twin_timeout;
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
     void* deviceTwinContextCallback;
@@ -194,6 +226,394 @@ static STRING_HANDLE make_product_info(const char* product)
     return result;
 }
 
+/*the message timeout timer only tells DoTimeouts that the earliest deadline in waitingToSend has passed. The transports remove
+entries from waitingToSend without notifying this layer, so the entries themselves cannot own timers. Instead waitingToSend is
+kept ordered by deadline within each priority, and DoTimeouts stops at the first message of the lowest priority that is not due*/
+static void on_message_timeout_due(void* context)
+{
+    IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)context;
+    handleData->messageTimeoutDue = true;
+}
+
+static void arm_message_timeout(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, tickcounter_ms_t nowTick, tickcounter_ms_t ms_timesOutAfter)
+{
+    /*messages time out once the tickcounter is past ms_timesOutAfter, hence the extra ms*/
+    tickcounter_ms_t timeout = (ms_timesOutAfter > nowTick) ? (ms_timesOutAfter - nowTick + 1) : 1;
+
+    if (!timer_wheel_is_armed(&handleData->messageTimeoutTimer) ||
+        (nowTick + timeout < handleData->messageTimeoutTimer.expires_at))
+    {
+        if (timer_wheel_start(&handleData->timeoutWheel, &handleData->messageTimeoutTimer, nowTick, timeout) != 0)
+        {
+            LogError("unable to arm the message timeout timer, timeouts will be checked on the next DoWork");
+            handleData->messageTimeoutDue = true;
+        }
+    }
+}
+
+static IOTHUB_MESSAGE_LIST* allocate_message_list(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    IOTHUB_MESSAGE_LIST* result;
+    if (handleData->messageListSlab != NULL)
+    {
+        result = (IOTHUB_MESSAGE_LIST*)slab_allocator_alloc(handleData->messageListSlab);
+    }
+    else
+    {
+        result = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+    }
+    if (result != NULL)
+    {
+        handleData->messageListsInUse++;
+    }
+    return result;
+}
+
+static void free_message_list(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+    handleData->messageListsInUse--;
+    if (handleData->messageListSlab != NULL)
+    {
+        slab_allocator_free(handleData->messageListSlab, messageList);
+    }
+    else
+    {
+        free(messageList);
+    }
+}
+
+static size_t get_message_size(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    size_t result;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        const unsigned char* buffer;
+        if (IoTHubMessage_GetByteArray(messageHandle, &buffer, &result) != IOTHUB_MESSAGE_OK)
+        {
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        result = (text == NULL) ? 0 : strlen(text);
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+static bool send_queue_has_room(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, size_t messageSize)
+{
+    return ((handleData->sendQueueMaxMessages == 0) || (handleData->sendQueueMessages < handleData->sendQueueMaxMessages)) &&
+        ((handleData->sendQueueMaxBytes == 0) ||
+            ((handleData->sendQueueBytes <= handleData->sendQueueMaxBytes) && (messageSize <= handleData->sendQueueMaxBytes - handleData->sendQueueBytes)));
+}
+
+static void send_queue_add(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+    handleData->sendQueueMessages++;
+    handleData->sendQueueBytes += messageList->message_size;
+
+    if ((handleData->sendQueueHighWatermark != 0) &&
+        !handleData->sendQueueAboveHighWatermark &&
+        (handleData->sendQueueMessages >= handleData->sendQueueHighWatermark))
+    {
+        handleData->sendQueueAboveHighWatermark = true;
+    }
+}
+
+static void send_queue_remove(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+    handleData->sendQueueMessages -= (handleData->sendQueueMessages > 0) ? 1 : 0;
+    handleData->sendQueueBytes -= (messageList->message_size < handleData->sendQueueBytes) ? messageList->message_size : handleData->sendQueueBytes;
+
+    if (handleData->sendQueueAboveHighWatermark &&
+        (handleData->sendQueueMessages <= handleData->sendQueueLowWatermark))
+    {
+        handleData->sendQueueAboveHighWatermark = false;
+    }
+}
+
+/*the watermark callback is not invoked from SendEventAsync, so user code never re-enters the client in the middle of a send*/
+static void notify_send_queue_watermark(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_10_081: [ If the number of queued messages crosses a watermark and crosses back before IoTHubClientCore_LL_DoWork runs, the send queue watermark callback shall not be invoked. ]*/
+    if (handleData->sendQueueReportedAboveHighWatermark != handleData->sendQueueAboveHighWatermark)
+    {
+        handleData->sendQueueReportedAboveHighWatermark = handleData->sendQueueAboveHighWatermark;
+        if (handleData->sendQueueWatermarkCallback != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_053: [ When the number of queued messages reaches the high watermark, the send queue watermark callback shall be invoked once with IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK from the next IoTHubClientCore_LL_DoWork. ]*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_054: [ Once the high watermark has been reached, when the number of queued messages drops to the low watermark or below, the send queue watermark callback shall be invoked once with IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK from the next IoTHubClientCore_LL_DoWork. ]*/
+            handleData->sendQueueWatermarkCallback(handleData->sendQueueAboveHighWatermark ? IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK : IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK,
+                handleData->sendQueueMessages, handleData->sendQueueBytes, handleData->sendQueueWatermarkUserContextCallback);
+        }
+    }
+}
+
+/*dropped messages are not completed from within SendEventAsync, so the callback of a message never runs before SendEventAsync returns*/
+static void shed_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+    if (messageList->callback != NULL)
+    {
+        DList_InsertTailList(&(handleData->shedMessages), &(messageList->entry));
+    }
+    else
+    {
+        free_message_list(handleData, messageList);
+    }
+}
+
+static void complete_shed_messages(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    while (handleData->shedMessages.Flink != &(handleData->shedMessages))
+    {
+        PDLIST_ENTRY shed = handleData->shedMessages.Flink;
+        IOTHUB_MESSAGE_LIST* messageList = containingRecord(shed, IOTHUB_MESSAGE_LIST, entry);
+        DList_RemoveEntryList(shed);
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_051: [ The callbacks of the dropped messages shall be invoked with IOTHUB_CLIENT_CONFIRMATION_ERROR from the next call to IoTHubClientCore_LL_DoWork or from IoTHubClientCore_LL_Destroy. ]*/
+        messageList->callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, messageList->context);
+        free_message_list(handleData, messageList);
+    }
+}
+
+/*lists of messages (waitingToSend, spilledMessages) are ordered by priority, oldest first within a priority. Messages of the
+lowest priority are appended, the others are inserted after the last message of the same or a higher priority, which only walks
+the (usually short) higher priority lanes at the head of the list*/
+static void insert_by_priority(PDLIST_ENTRY listHead, IOTHUB_MESSAGE_LIST* messageList)
+{
+    PDLIST_ENTRY next = listHead;
+
+    if (messageList->priority != IOTHUB_MESSAGE_PRIORITY_NORMAL)
+    {
+        next = listHead->Flink;
+        while ((next != listHead) && (containingRecord(next, IOTHUB_MESSAGE_LIST, entry)->priority >= messageList->priority))
+        {
+            next = next->Flink;
+        }
+    }
+
+    /*inserting at the tail of an entry inserts before it*/
+    DList_InsertTailList(next, &(messageList->entry));
+}
+
+/*0 means the message never times out, it then sorts after every deadline*/
+static tickcounter_ms_t get_message_deadline(const IOTHUB_MESSAGE_LIST* messageList)
+{
+    return (messageList->ms_timesOutAfter == 0) ? (tickcounter_ms_t)(-1) : messageList->ms_timesOutAfter;
+}
+
+/*queues the message as insert_by_priority does and arms the message timeout timer for it. The transports only ever take messages
+out of waitingToSend (HTTP puts a batch it could not send back at the head, where it came from), so each priority lane stays ordered
+by deadline unless a message times out before the one queued ahead of it, which only happens when "messageTimeout" is lowered*/
+static void queue_message_to_send(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+    PDLIST_ENTRY previous;
+
+    insert_by_priority(&(handleData->waitingToSend), messageList);
+
+    previous = messageList->entry.Blink;
+    if ((previous != &(handleData->waitingToSend)) &&
+        (containingRecord(previous, IOTHUB_MESSAGE_LIST, entry)->priority == messageList->priority) &&
+        (get_message_deadline(containingRecord(previous, IOTHUB_MESSAGE_LIST, entry)) > get_message_deadline(messageList)))
+    {
+        handleData->messageDeadlinesUnordered = true;
+    }
+
+    if (messageList->ms_timesOutAfter != 0)
+    {
+        arm_message_timeout(handleData, messageList->ms_timesOutAfter - handleData->currentMessageTimeout, messageList->ms_timesOutAfter);
+    }
+}
+
+/*the oldest message of the lowest priority lane of waitingToSend, NULL if that lane is of a higher priority than the message being queued*/
+static IOTHUB_MESSAGE_LIST* get_message_to_shed(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_LIST* result = NULL;
+
+    if (handleData->waitingToSend.Blink != &(handleData->waitingToSend))
+    {
+        IOTHUB_MESSAGE_PRIORITY lowest = containingRecord(handleData->waitingToSend.Blink, IOTHUB_MESSAGE_LIST, entry)->priority;
+        if (lowest <= priority)
+        {
+            PDLIST_ENTRY current = handleData->waitingToSend.Flink;
+            while (containingRecord(current, IOTHUB_MESSAGE_LIST, entry)->priority != lowest)
+            {
+                current = current->Flink;
+            }
+            result = containingRecord(current, IOTHUB_MESSAGE_LIST, entry);
+        }
+    }
+
+    return result;
+}
+
+/*makes room for a message of messageSize bytes, returns false when it does not fit (the shed policy is applied by the caller)*/
+static bool make_room_in_send_queue(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, size_t messageSize, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    bool result;
+    if ((handleData->sendQueueMaxBytes != 0) && (messageSize > handleData->sendQueueMaxBytes))
+    {
+        result = false;
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* oldest;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_069: [ Messages of a higher priority than the message being sent shall not be dropped to make room for it, the oldest messages of the lowest priority shall be dropped first. ]*/
+        while (!(result = send_queue_has_room(handleData, messageSize)) &&
+            (handleData->sendQueueShedPolicy == IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST) &&
+            ((oldest = get_message_to_shed(handleData, priority)) != NULL))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_049: [ If the shed policy is IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST, IoTHubClientCore_LL_SendEventAsync shall drop the oldest messages of waitingToSend until the new message fits. ]*/
+            DList_RemoveEntryList(&(oldest->entry));
+            send_queue_remove(handleData, oldest);
+            IoTHubMessage_Destroy(oldest->messageHandle);
+            oldest->messageHandle = NULL;
+            shed_message(handleData, oldest);
+        }
+    }
+    return result;
+}
+
+/*the journal record of a message is only removed once the message is completed, messages still pending at IoTHubClientCore_LL_Destroy are sent again by the next client using the same store*/
+static void remove_from_store(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* messageList)
+{
+#ifdef USE_STORE_AND_FORWARD
+    if ((handleData->storeAndForward != NULL) && (messageList->journal_sequence != 0))
+    {
+        store_and_forward_remove(handleData->storeAndForward, messageList->journal_sequence);
+    }
+#else
+    (void)handleData;
+    (void)messageList;
+#endif
+}
+
+#ifdef USE_STORE_AND_FORWARD
+static IOTHUB_CLIENT_RESULT spill_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* newEntry, IOTHUB_MESSAGE_HANDLE eventMessageHandle, size_t messageSize, bool takeOwnership)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (store_and_forward_save(handleData->storeAndForward, eventMessageHandle, &(newEntry->journal_sequence)) != 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_064: [ If persisting the message fails, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("unable to persist the message");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        if (takeOwnership)
+        {
+            IoTHubMessage_Destroy(eventMessageHandle);
+        }
+        newEntry->messageHandle = NULL;
+        newEntry->message_size = messageSize;
+        newEntry->ms_timesOutAfter = 0;
+        insert_by_priority(&(handleData->spilledMessages), newEntry);
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
+static void on_pending_stored_message(uint64_t sequence, void* context)
+{
+    IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)context;
+    IOTHUB_MESSAGE_LIST* spilled = allocate_message_list(handleData);
+
+    if (spilled == NULL)
+    {
+        LogError("unable to allocate the record of stored message %lu, it will be sent by the next client using the store", (unsigned long)sequence);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_062: [ The messages found in the store shall be sent again, without confirmation callback, before the messages sent afterwards. ]*/
+        spilled->messageHandle = NULL;
+        spilled->callback = NULL;
+        spilled->context = NULL;
+        spilled->message_size = 0;
+        spilled->ms_timesOutAfter = 0;
+        spilled->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+        spilled->journal_sequence = sequence;
+        DList_InsertTailList(&(handleData->spilledMessages), &(spilled->entry));
+    }
+}
+
+static void destroy_spilled_messages(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    if (handleData->storeAndForward != NULL)
+    {
+        while (handleData->spilledMessages.Flink != &(handleData->spilledMessages))
+        {
+            IOTHUB_MESSAGE_LIST* spilled = containingRecord(handleData->spilledMessages.Flink, IOTHUB_MESSAGE_LIST, entry);
+            DList_RemoveEntryList(&(spilled->entry));
+            if (spilled->callback != NULL)
+            {
+                spilled->callback(result, spilled->context);
+            }
+            free_message_list(handleData, spilled);
+        }
+    }
+}
+
+static IOTHUB_CLIENT_RESULT set_store_and_forward_option(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, const char* optionName, const void* value)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (strcmp(optionName, OPTION_STORE_AND_FORWARD_SEGMENT_SIZE) == 0)
+    {
+        handleData->storeAndForwardSegmentSize = *(const size_t*)value;
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if (strcmp(optionName, OPTION_STORE_AND_FORWARD_SYNC_BATCH) == 0)
+    {
+        handleData->storeAndForwardSyncBatch = *(const size_t*)value;
+        result = IOTHUB_CLIENT_OK;
+    }
+    else if ((handleData->sendQueueMessages != 0) ||
+        ((handleData->storeAndForward != NULL) && (handleData->spilledMessages.Flink != &(handleData->spilledMessages))))
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_060: [ Calling IoTHubClientCore_LL_SetOption with "store_and_forward_path" while messages are pending shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("store_and_forward_path cannot be changed while messages are pending");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        STORE_AND_FORWARD_HANDLE storeAndForward = NULL;
+        size_t segmentSize = (handleData->storeAndForwardSegmentSize == 0) ? STORE_AND_FORWARD_DEFAULT_SEGMENT_SIZE : handleData->storeAndForwardSegmentSize;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_061: [ "store_and_forward_path" shall open the store in that directory with the current segment size and sync batch, an empty string closes the current store. ]*/
+        if ((*(const char*)value != '\0') && ((storeAndForward = store_and_forward_create((const char*)value, segmentSize, handleData->storeAndForwardSyncBatch)) == NULL))
+        {
+            LogError("unable to open the store in %s", (const char*)value);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            if (handleData->storeAndForward != NULL)
+            {
+                store_and_forward_destroy(handleData->storeAndForward);
+            }
+            handleData->storeAndForward = storeAndForward;
+            DList_InitializeListHead(&(handleData->spilledMessages));
+
+            if ((storeAndForward != NULL) && (store_and_forward_get_pending(storeAndForward, on_pending_stored_message, handleData) != 0))
+            {
+                LogError("unable to list the messages pending in the store");
+            }
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+
+    return result;
+}
+#endif
+
 static IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* initialize_iothub_client(const IOTHUB_CLIENT_CONFIG* client_config, const IOTHUB_CLIENT_DEVICE_CONFIG* device_config, bool use_dev_auth)
 {
     IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* result;
@@ -404,6 +824,11 @@ static IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* initialize_iothub_client(const IOTHUB_
                         DList_InitializeListHead(&(result->waitingToSend));
                         DList_InitializeListHead(&(result->iot_msg_queue));
                         DList_InitializeListHead(&(result->iot_ack_queue));
+                        DList_InitializeListHead(&(result->shedMessages));
+                        timer_wheel_init(&(result->timeoutWheel));
+                        timer_wheel_entry_init(&(result->messageTimeoutTimer), on_message_timeout_due, result);
+                        result->messageTimeoutDue = false;
+                        result->messageDeadlinesUnordered = false;
                         result->messageCallback.type = CALLBACK_TYPE_NONE;
                         result->lastMessageReceiveTime = INDEFINITE_TIME;
                         result->data_msg_id = 1;
@@ -977,8 +1402,12 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
                 temp->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, temp->context);
             }
             IoTHubMessage_Destroy(temp->messageHandle);
-            free(temp);
+            free_message_list(handleData, temp);
         }
+        complete_shed_messages(handleData);
+#ifdef USE_STORE_AND_FORWARD
+        destroy_spilled_messages(handleData, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+#endif
 
         /* Codes_SRS_IOTHUBCLIENT_LL_07_007: [ IoTHubClientCore_LL_Destroy shall iterate the device twin queues and destroy any remaining items. ] */
         while ((unsend = DList_RemoveHeadList(&(handleData->iot_msg_queue))) != &(handleData->iot_msg_queue))
@@ -993,6 +1422,15 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
         }
 
         /*Codes_SRS_IOTHUBCLIENT_LL_17_011: [IoTHubClientCore_LL_Destroy  shall free the resources allocated by IoTHubClient (if any).] */
+        timer_wheel_deinit(&(handleData->timeoutWheel));
+        if (handleData->messageListSlab != NULL)
+        {
+            slab_allocator_destroy(handleData->messageListSlab);
+        }
+#ifdef USE_STORE_AND_FORWARD
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_065: [ IoTHubClientCore_LL_Destroy shall close the store, keeping the messages not completed yet. ]*/
+        store_and_forward_destroy(handleData->storeAndForward);
+#endif
         IoTHubClient_Auth_Destroy(handleData->authorization_module);
         tickcounter_destroy(handleData->tickCounter);
 #ifndef DONT_USE_UPLOADTOBLOB
@@ -1031,7 +1469,7 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+static IOTHUB_CLIENT_RESULT send_event_async(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
 {
     IOTHUB_CLIENT_RESULT result;
     /*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
@@ -1047,45 +1485,132 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
     }
     else
     {
-        IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
-        if (newEntry == NULL)
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        IOTHUB_MESSAGE_PRIORITY priority = IoTHubMessage_GetPriority(eventMessageHandle);
+        size_t messageSize = (handleData->sendQueueMaxBytes != 0) ? get_message_size(eventMessageHandle) : 0;
+        bool spill = false;
+        bool hasRoom;
+        IOTHUB_MESSAGE_LIST *newEntry;
+
+#ifdef USE_STORE_AND_FORWARD
+        if (handleData->storeAndForward != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_063: [ With a store, a message that does not fit in the send queue, or sent while older messages are still only in the store, shall be kept in the store only instead of being shed, and sent once the send queue has room. ]*/
+            hasRoom = send_queue_has_room(handleData, messageSize) && (handleData->spilledMessages.Flink == &(handleData->spilledMessages));
+            spill = !hasRoom;
+        }
+        else
+#endif
+        {
+            hasRoom = make_room_in_send_queue(handleData, messageSize, priority);
+        }
+
+        if (!hasRoom && !spill && (handleData->sendQueueShedPolicy != IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST))
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_048: [ If the send queue is at OPTION_SEND_QUEUE_MAX_MESSAGES messages or the message does not fit in OPTION_SEND_QUEUE_MAX_BYTES, and the shed policy is IOTHUB_CLIENT_SEND_QUEUE_REJECT, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_QUEUE_FULL. ]*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_050: [ If the shed policy is IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST and the message still does not fit once no message of the same or a lower priority is left in waitingToSend, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_QUEUE_FULL. ]*/
+            LogError("send queue is full (%lu messages, %lu bytes)", (unsigned long)handleData->sendQueueMessages, (unsigned long)handleData->sendQueueBytes);
+            result = IOTHUB_CLIENT_QUEUE_FULL;
+        }
+        else if ((newEntry = allocate_message_list(handleData)) == NULL)
         {
             result = IOTHUB_CLIENT_ERROR;
             LOG_ERROR_RESULT;
         }
+#ifdef USE_STORE_AND_FORWARD
+        else if (spill)
+        {
+            newEntry->callback = eventConfirmationCallback;
+            newEntry->context = userContextCallback;
+            newEntry->priority = priority;
+            if ((result = spill_message(handleData, newEntry, eventMessageHandle, messageSize, takeOwnership)) != IOTHUB_CLIENT_OK)
+            {
+                free_message_list(handleData, newEntry);
+            }
+        }
+#endif
+        else if (!hasRoom)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_052: [ If the shed policy is IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST and the message does not fit, IoTHubClientCore_LL_SendEventAsync shall drop the message and return IOTHUB_CLIENT_OK. ]*/
+            LogError("send queue is full (%lu messages, %lu bytes), dropping the message", (unsigned long)handleData->sendQueueMessages, (unsigned long)handleData->sendQueueBytes);
+            if (takeOwnership)
+            {
+                IoTHubMessage_Destroy(eventMessageHandle);
+            }
+            newEntry->messageHandle = NULL;
+            newEntry->callback = eventConfirmationCallback;
+            newEntry->context = userContextCallback;
+            shed_message(handleData, newEntry);
+            result = IOTHUB_CLIENT_OK;
+        }
         else
         {
-            IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+            newEntry->message_size = messageSize;
+            newEntry->priority = priority;
+#ifdef USE_STORE_AND_FORWARD
+            newEntry->journal_sequence = 0;
+#endif
 
             if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
             {
                 result = IOTHUB_CLIENT_ERROR;
                 LOG_ERROR_RESULT;
-                free(newEntry);
+                free_message_list(handleData, newEntry);
             }
             else
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+                if (takeOwnership)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_040: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it.]*/
+                    newEntry->messageHandle = eventMessageHandle;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                    newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+                }
+
+                if (newEntry->messageHandle == NULL)
                 {
                     result = IOTHUB_CLIENT_ERROR;
-                    free(newEntry);
+                    free_message_list(handleData, newEntry);
                     LOG_ERROR_RESULT;
                 }
                 else if (IoTHubClient_Diagnostic_AddIfNecessary(&handleData->diagnostic_setting, newEntry->messageHandle) != 0)
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information/diagnostic fails for any reason, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
                     result = IOTHUB_CLIENT_ERROR;
-                    IoTHubMessage_Destroy(newEntry->messageHandle);
-                    free(newEntry);
+                    if (!takeOwnership)
+                    {
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                    }
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_041: [If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, the ownership of eventMessageHandle shall remain with the caller.]*/
+                    free_message_list(handleData, newEntry);
                     LOG_ERROR_RESULT;
                 }
+#ifdef USE_STORE_AND_FORWARD
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_059: [ If a store is open, IoTHubClientCore_LL_SendEventAsync shall persist the message to the store before queuing it. ]*/
+                else if ((handleData->storeAndForward != NULL) &&
+                    (store_and_forward_save(handleData->storeAndForward, newEntry->messageHandle, &(newEntry->journal_sequence)) != 0))
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_064: [ If persisting the message fails, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                    result = IOTHUB_CLIENT_ERROR;
+                    if (!takeOwnership)
+                    {
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                    }
+                    free_message_list(handleData, newEntry);
+                    LogError("unable to persist the message");
+                }
+#endif
                 else
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
                     newEntry->callback = eventConfirmationCallback;
                     newEntry->context = userContextCallback;
-                    DList_InsertTailList(&(iotHubClientHandle->waitingToSend), &(newEntry->entry));
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_070: [ IoTHubClientCore_LL_SendEventAsync shall insert the message in waitingToSend after the messages of the same or a higher priority and before the messages of a lower priority, so the transports send the higher priorities first. ]*/
+                    queue_message_to_send(handleData, newEntry);
+                    send_queue_add(handleData, newEntry);
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
                     result = IOTHUB_CLIENT_OK;
                 }
@@ -1095,6 +1620,158 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return send_event_async(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync_TakeOwnership(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_10_039: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall validate its arguments and fail the same way IoTHubClientCore_LL_SendEventAsync does.]*/
+    return send_event_async(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true);
+}
+
+/*the messages of a batch are queued as individual records, so the transports batch (HTTP, AMQP) or pipeline (MQTT) them as they
+do for any messages found in waitingToSend, but they all complete into this one record*/
+typedef struct EVENT_BATCH_TAG
+{
+    size_t pending; /*messages of the batch not yet completed, plus one while IoTHubClientCore_LL_SendEventBatchAsync runs*/
+    IOTHUB_CLIENT_CONFIRMATION_RESULT result;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback; /*NULL without confirmation callback, or once queuing the batch failed*/
+    void* userContextCallback;
+} EVENT_BATCH;
+
+static void release_event_batch(EVENT_BATCH* batch)
+{
+    if (--batch->pending == 0)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_074: [ Once every message of the batch was completed, `eventConfirmationCallback` shall be invoked once, with IOTHUB_CLIENT_CONFIRMATION_OK if all of them were confirmed, otherwise with the result of the first message that was not. ]*/
+        if (batch->callback != NULL)
+        {
+            batch->callback(batch->result, batch->userContextCallback);
+        }
+        free(batch);
+    }
+}
+
+static void on_batch_message_completed(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    EVENT_BATCH* batch = (EVENT_BATCH*)userContextCallback;
+    if ((result != IOTHUB_CLIENT_CONFIRMATION_OK) && (batch->result == IOTHUB_CLIENT_CONFIRMATION_OK))
+    {
+        batch->result = result;
+    }
+    release_event_batch(batch);
+}
+
+static void unqueue_batch_messages(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, PDLIST_ENTRY listHead, EVENT_BATCH* batch)
+{
+    PDLIST_ENTRY current = listHead->Flink;
+    while (current != listHead)
+    {
+        IOTHUB_MESSAGE_LIST* messageList = containingRecord(current, IOTHUB_MESSAGE_LIST, entry);
+        current = current->Flink;
+        if ((messageList->callback == on_batch_message_completed) && (messageList->context == batch))
+        {
+            DList_RemoveEntryList(&(messageList->entry));
+            if (listHead == &(handleData->waitingToSend))
+            {
+                send_queue_remove(handleData, messageList);
+            }
+            remove_from_store(handleData, messageList);
+            if (messageList->messageHandle != NULL)
+            {
+                IoTHubMessage_Destroy(messageList->messageHandle);
+            }
+            free_message_list(handleData, messageList);
+            batch->pending--;
+        }
+    }
+}
+
+/*the messages of the batch queued before the failure can only be in the lists send_event_async puts records in, nothing took them
+out since (the transport only sees waitingToSend from DoWork). Messages of other sends dropped to make room for the batch stay dropped*/
+static void unqueue_event_batch(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, EVENT_BATCH* batch)
+{
+    unqueue_batch_messages(handleData, &(handleData->waitingToSend), batch);
+    unqueue_batch_messages(handleData, &(handleData->shedMessages), batch);
+#ifdef USE_STORE_AND_FORWARD
+    unqueue_batch_messages(handleData, &(handleData->spilledMessages), batch);
+#endif
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventBatchAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    size_t index;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_10_071: [ `IoTHubClientCore_LL_SendEventBatchAsync` shall fail and return IOTHUB_CLIENT_INVALID_ARG if `iotHubClientHandle` or `eventMessageHandles` is NULL, `eventMessageCount` is 0, any of the messages is NULL, or `eventConfirmationCallback` is NULL and `userContextCallback` is not. ]*/
+    if ((iotHubClientHandle == NULL) ||
+        (eventMessageHandles == NULL) ||
+        (eventMessageCount == 0) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL)))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        for (index = 0; index < eventMessageCount; index++)
+        {
+            if (eventMessageHandles[index] == NULL)
+            {
+                break;
+            }
+        }
+
+        if (index < eventMessageCount)
+        {
+            LogError("message %lu of the batch is NULL", (unsigned long)index);
+            result = IOTHUB_CLIENT_INVALID_ARG;
+        }
+        else
+        {
+            EVENT_BATCH* batch = (EVENT_BATCH*)malloc(sizeof(EVENT_BATCH));
+            if (batch == NULL)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("unable to allocate the batch");
+            }
+            else
+            {
+                batch->pending = 1;
+                batch->result = IOTHUB_CLIENT_CONFIRMATION_OK;
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_072: [ Without `eventConfirmationCallback`, `IoTHubClientCore_LL_SendEventBatchAsync` shall queue the messages the same way, and no callback shall be invoked for the batch. ]*/
+                batch->callback = eventConfirmationCallback;
+                batch->userContextCallback = userContextCallback;
+
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_073: [ `IoTHubClientCore_LL_SendEventBatchAsync` shall queue a clone of every message, in order, as `IoTHubClientCore_LL_SendEventAsync` does, all completing into a single batch record. ]*/
+                result = IOTHUB_CLIENT_OK;
+                for (index = 0; (index < eventMessageCount) && (result == IOTHUB_CLIENT_OK); index++)
+                {
+                    batch->pending++;
+                    if ((result = send_event_async(iotHubClientHandle, eventMessageHandles[index], on_batch_message_completed, batch, false)) != IOTHUB_CLIENT_OK)
+                    {
+                        batch->pending--;
+                    }
+                }
+
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_075: [ If queuing a message fails, `IoTHubClientCore_LL_SendEventBatchAsync` shall remove the messages of the batch already queued, so none of them is sent, return the error and not invoke `eventConfirmationCallback` for this batch. ]*/
+                    LogError("unable to queue message %lu of the batch, the batch is not sent", (unsigned long)(index - 1));
+                    unqueue_event_batch((IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle, batch);
+                    batch->callback = NULL;
+                }
+
+                release_event_batch(batch);
+            }
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1255,6 +1932,47 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendMessageDisposition(IOTHUB_CLIENT_CO
     return result;
 }
 
+#ifdef USE_STORE_AND_FORWARD
+static void load_spilled_messages(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    if (handleData->storeAndForward != NULL)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_067: [ IoTHubClientCore_LL_DoWork shall load the messages kept in the store only, oldest first, and add them to waitingToSend while the send queue has room. Their timeout starts then. ]*/
+        while ((handleData->spilledMessages.Flink != &(handleData->spilledMessages)) &&
+            send_queue_has_room(handleData, containingRecord(handleData->spilledMessages.Flink, IOTHUB_MESSAGE_LIST, entry)->message_size))
+        {
+            IOTHUB_MESSAGE_LIST* spilled = containingRecord(handleData->spilledMessages.Flink, IOTHUB_MESSAGE_LIST, entry);
+            DList_RemoveEntryList(&(spilled->entry));
+
+            if ((spilled->messageHandle = store_and_forward_load(handleData->storeAndForward, spilled->journal_sequence)) == NULL)
+            {
+                LogError("unable to load message %lu from the store, dropping it", (unsigned long)spilled->journal_sequence);
+                if (spilled->callback != NULL)
+                {
+                    spilled->callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, spilled->context);
+                }
+                store_and_forward_remove(handleData->storeAndForward, spilled->journal_sequence);
+                free_message_list(handleData, spilled);
+            }
+            else
+            {
+                if (attach_ms_timesOutAfter(handleData, spilled) != 0)
+                {
+                    LogError("unable to set the timeout of message %lu, it will not time out", (unsigned long)spilled->journal_sequence);
+                    spilled->ms_timesOutAfter = 0;
+                }
+                if (handleData->sendQueueMaxBytes != 0)
+                {
+                    spilled->message_size = get_message_size(spilled->messageHandle);
+                }
+                queue_message_to_send(handleData, spilled);
+                send_queue_add(handleData, spilled);
+            }
+        }
+    }
+}
+#endif
+
 static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
 {
     tickcounter_ms_t nowTick;
@@ -1264,26 +1982,64 @@ static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
     }
     else
     {
-        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
-        while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+        (void)timer_wheel_process(&handleData->timeoutWheel, nowTick);
+
+        /*the list is only walked once its earliest deadline has passed, and the timer is re-armed for the next one. The lowest
+        priority lane is the last one and it is ordered by deadline, so the walk ends at its first message that is not due: only
+        the due messages and the (usually short) higher priority lanes are visited*/
+        if (handleData->messageTimeoutDue)
         {
-            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
-            /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-            if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
-            {
-                PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
-                DList_RemoveEntryList(currentItemInWaitingToSend);
-                if (fullEntry->callback != NULL)
+            tickcounter_ms_t nextTimeout = 0;
+            bool walkAll = handleData->messageDeadlinesUnordered;
+            const IOTHUB_MESSAGE_LIST* previousLeft = NULL;
+            DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+            handleData->messageTimeoutDue = false;
+            handleData->messageDeadlinesUnordered = false;
+            while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+            {
+                IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+                if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
                 {
-                    fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
+                    PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
+                    DList_RemoveEntryList(currentItemInWaitingToSend);
+                    if (fullEntry->callback != NULL)
+                    {
+                        fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
+                    }
+                    IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
+                    remove_from_store(handleData, fullEntry);
+                    send_queue_remove(handleData, fullEntry);
+                    free_message_list(handleData, fullEntry);
+                    currentItemInWaitingToSend = theNext;
+                }
+                else
+                {
+                    if ((fullEntry->ms_timesOutAfter != 0) && ((nextTimeout == 0) || (fullEntry->ms_timesOutAfter < nextTimeout)))
+                    {
+                        nextTimeout = fullEntry->ms_timesOutAfter;
+                    }
+
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_079: [ The messages of the lowest priority shall be inspected only up to the first one that has not timed out, unless a message of that priority was queued behind one that times out later. ]*/
+                    if (!walkAll && (fullEntry->priority == IOTHUB_MESSAGE_PRIORITY_NORMAL))
+                    {
+                        break;
+                    }
+
+                    /*messages left behind by a full walk tell whether the lanes are back in order*/
+                    if ((previousLeft != NULL) && (previousLeft->priority == fullEntry->priority) &&
+                        (get_message_deadline(previousLeft) > get_message_deadline(fullEntry)))
+                    {
+                        handleData->messageDeadlinesUnordered = true;
+                    }
+                    previousLeft = fullEntry;
+                    currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
                 }
-                IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
-                free(fullEntry);
-                currentItemInWaitingToSend = theNext;
             }
-            else
+
+            if (nextTimeout != 0)
             {
-                currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+                arm_message_timeout(handleData, nowTick, nextTimeout);
             }
         }
     }
@@ -1295,7 +2051,11 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
     if (iotHubClientHandle != NULL)
     {
         IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        complete_shed_messages(handleData);
         DoTimeouts(handleData);
+#ifdef USE_STORE_AND_FORWARD
+        load_spilled_messages(handleData);
+#endif
 
         /*Codes_SRS_IOTHUBCLIENT_LL_07_008: [ IoTHubClientCore_LL_DoWork shall iterate the message queue and execute the underlying transports IoTHubTransport_ProcessItem function for each item. ] */
         DLIST_ENTRY* client_item = handleData->iot_msg_queue.Flink;
@@ -1333,6 +2093,17 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 
         /*Codes_SRS_IOTHUBCLIENT_LL_02_021: [Otherwise, IoTHubClientCore_LL_DoWork shall invoke the underlaying layer's _DoWork function.]*/
         handleData->IoTHubTransport_DoWork(handleData->transportHandle, iotHubClientHandle);
+
+        /*after the transport's _DoWork, so the messages it confirmed are already out of the send queue*/
+        notify_send_queue_watermark(handleData);
+
+#ifdef USE_STORE_AND_FORWARD
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_068: [ IoTHubClientCore_LL_DoWork shall flush the store after the transport's _DoWork, so messages and acknowledgements of a DoWork are synced together. ]*/
+        if ((handleData->storeAndForward != NULL) && (store_and_forward_flush(handleData->storeAndForward) != 0))
+        {
+            LogError("unable to flush the store");
+        }
+#endif
     }
 }
 
@@ -1352,7 +2123,61 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetSendStatus(IOTHUB_CLIENT_CORE_LL_HAN
 
         /* Codes_SRS_IOTHUBCLIENT_09_008: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_IDLE if there is currently no items to be sent] */
         /* Codes_SRS_IOTHUBCLIENT_09_009: [IoTHubClient_GetSendStatus shall return IOTHUB_CLIENT_OK and status IOTHUB_CLIENT_SEND_STATUS_BUSY if there are currently items to be sent] */
-        result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+#ifdef USE_STORE_AND_FORWARD
+        if ((handleData->storeAndForward != NULL) && (handleData->spilledMessages.Flink != &(handleData->spilledMessages)))
+        {
+            *iotHubClientStatus = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else
+#endif
+        {
+            result = handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, iotHubClientStatus);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetTimeUntilNextDue(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, size_t* msUntilDue)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /* Codes_SRS_IOTHUBCLIENT_LL_10_076: [ If `iotHubClientHandle` or `msUntilDue` is NULL, `IoTHubClientCore_LL_GetTimeUntilNextDue` shall return `IOTHUB_CLIENT_INVALID_ARG`. ] */
+    if (iotHubClientHandle == NULL || msUntilDue == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        tickcounter_ms_t dueTick;
+        tickcounter_ms_t nowTick;
+
+        if (handleData->messageTimeoutDue)
+        {
+            /*arming the message timeout timer failed, DoTimeouts has to walk the list on the next DoWork*/
+            *msUntilDue = 0;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUBCLIENT_LL_10_077: [ If no timer is pending, `IoTHubClientCore_LL_GetTimeUntilNextDue` shall return `IOTHUB_CLIENT_INDEFINITE_TIME`. ] */
+        else if (!timer_wheel_get_next_due(&handleData->timeoutWheel, &dueTick))
+        {
+            result = IOTHUB_CLIENT_INDEFINITE_TIME;
+        }
+        else if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
+        {
+            LogError("unable to get the current ms");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_LL_10_078: [ Otherwise `IoTHubClientCore_LL_GetTimeUntilNextDue` shall set `msUntilDue` to the milliseconds left before `IoTHubClientCore_LL_DoWork` has to run for the earliest pending timer, 0 if it is already due, and return `IOTHUB_CLIENT_OK`. ] */
+            tickcounter_ms_t untilDue = (dueTick > nowTick) ? (dueTick - nowTick) : 0;
+            *msUntilDue = (untilDue > (tickcounter_ms_t)SIZE_MAX) ? SIZE_MAX : (size_t)untilDue;
+            result = IOTHUB_CLIENT_OK;
+        }
     }
 
     return result;
@@ -1383,7 +2208,13 @@ void IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIS
                 messageList->callback(result, messageList->context);
             }
             IoTHubMessage_Destroy(messageList->messageHandle);
-            free(messageList);
+            /*Codes_SRS_IOTHUBCLIENT_LL_10_066: [ IoTHubClientCore_LL_SendComplete shall remove the completed messages from the store, unless result is IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY. ]*/
+            if (result != IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY)
+            {
+                remove_from_store(handle, messageList);
+            }
+            send_queue_remove(handle, messageList);
+            free_message_list(handle, messageList);
         }
     }
 }
@@ -1581,6 +2412,27 @@ void IoTHubClientCore_LL_ConnectionStatusCallBack(IOTHUB_CLIENT_CORE_LL_HANDLE h
 
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetSendQueueWatermarkCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_SEND_QUEUE_WATERMARK_CALLBACK watermarkCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_10_056: [ IoTHubClientCore_LL_SetSendQueueWatermarkCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle. ]*/
+    if (iotHubClientHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_057: [ IoTHubClientCore_LL_SetSendQueueWatermarkCallback shall save watermarkCallback and userContextCallback and return IOTHUB_CLIENT_OK, a NULL watermarkCallback stops the notifications. ]*/
+        handleData->sendQueueWatermarkCallback = watermarkCallback;
+        handleData->sendQueueWatermarkUserContextCallback = userContextCallback;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetConnectionStatusCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void * userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1759,6 +2611,116 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
                 result = IOTHUB_CLIENT_OK;
             }
         }
+        else if (strcmp(optionName, OPTION_MESSAGE_RECORD_POOL_SIZE) == 0)
+        {
+            size_t pool_size = *(const size_t*)value;
+            if (handleData->messageListsInUse != 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_042: [ Calling IoTHubClientCore_LL_SetOption with "message_record_pool_size" while any message record is outstanding (waiting to be sent, in the transport, shed or spilled) shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                LogError("message_record_pool_size cannot be changed while %lu message records are outstanding", (unsigned long)handleData->messageListsInUse);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                SLAB_ALLOCATOR_HANDLE messageListSlab = NULL;
+
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_043: [ If the value of "message_record_pool_size" is not 0, IoTHubClientCore_LL_SetOption shall create a slab allocator of IOTHUB_MESSAGE_LIST records growing by that many records, and use it for all the messages sent afterwards. ]*/
+                if (pool_size != 0 && (messageListSlab = slab_allocator_create(sizeof(IOTHUB_MESSAGE_LIST), pool_size)) == NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_044: [ If creating the slab allocator fails, IoTHubClientCore_LL_SetOption shall return `IOTHUB_CLIENT_ERROR` and keep the current allocator. ]*/
+                    LogError("unable to create the message record pool");
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_046: [ "message_record_pool_size" shall also be passed to Transport_SetOption, so the transport can pool its own per-message records. If it fails, IoTHubClientCore_LL_SetOption shall keep the current allocator and return its result. ]*/
+                else if ((result = handleData->IoTHubTransport_SetOption(handleData->transportHandle, optionName, value)) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("the transport refused message_record_pool_size");
+                    if (messageListSlab != NULL)
+                    {
+                        slab_allocator_destroy(messageListSlab);
+                    }
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_045: [ Any previous slab allocator shall be destroyed, a value of 0 shall make IoTHubClientCore_LL allocate every record with malloc. ]*/
+                    if (handleData->messageListSlab != NULL)
+                    {
+                        slab_allocator_destroy(handleData->messageListSlab);
+                    }
+                    handleData->messageListSlab = messageListSlab;
+                }
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_047: [ "send_queue_max_messages", "send_queue_max_bytes", "send_queue_high_watermark" and "send_queue_low_watermark" shall be handled by IoTHubClientCore_LL, the value is a size_t* and 0 disables the corresponding limit. They apply to the messages sent afterwards. ]*/
+        else if (strcmp(optionName, OPTION_SEND_QUEUE_MAX_MESSAGES) == 0)
+        {
+            handleData->sendQueueMaxMessages = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_SEND_QUEUE_MAX_BYTES) == 0)
+        {
+            handleData->sendQueueMaxBytes = *(const size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_SEND_QUEUE_HIGH_WATERMARK) == 0)
+        {
+            size_t highWatermark = *(const size_t*)value;
+            if ((highWatermark != 0) && (handleData->sendQueueLowWatermark > highWatermark))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_080: [ If the high watermark is not 0 and the low watermark would be greater than the high watermark, IoTHubClientCore_LL_SetOption shall fail, keep both watermarks and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("send_queue_high_watermark %lu is lower than send_queue_low_watermark %lu", (unsigned long)highWatermark, (unsigned long)handleData->sendQueueLowWatermark);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->sendQueueHighWatermark = highWatermark;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_SEND_QUEUE_LOW_WATERMARK) == 0)
+        {
+            size_t lowWatermark = *(const size_t*)value;
+            if ((handleData->sendQueueHighWatermark != 0) && (lowWatermark > handleData->sendQueueHighWatermark))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_080: [ If the high watermark is not 0 and the low watermark would be greater than the high watermark, IoTHubClientCore_LL_SetOption shall fail, keep both watermarks and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("send_queue_low_watermark %lu is greater than send_queue_high_watermark %lu", (unsigned long)lowWatermark, (unsigned long)handleData->sendQueueHighWatermark);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->sendQueueLowWatermark = lowWatermark;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_SEND_QUEUE_SHED_POLICY) == 0)
+        {
+            IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY shedPolicy = *(const IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY*)value;
+            if ((shedPolicy != IOTHUB_CLIENT_SEND_QUEUE_REJECT) &&
+                (shedPolicy != IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST) &&
+                (shedPolicy != IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST))
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_10_055: [ If "send_queue_shed_policy" is not a valid IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY, IoTHubClientCore_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("invalid send_queue_shed_policy %d", (int)shedPolicy);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->sendQueueShedPolicy = shedPolicy;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_10_058: [ "store_and_forward_path", "store_and_forward_segment_size" and "store_and_forward_sync_batch" shall be handled by IoTHubClientCore_LL, and fail with IOTHUB_CLIENT_ERROR when the SDK is built without use_store_and_forward. ]*/
+        else if ((strcmp(optionName, OPTION_STORE_AND_FORWARD_PATH) == 0) ||
+            (strcmp(optionName, OPTION_STORE_AND_FORWARD_SEGMENT_SIZE) == 0) ||
+            (strcmp(optionName, OPTION_STORE_AND_FORWARD_SYNC_BATCH) == 0))
+        {
+#ifdef USE_STORE_AND_FORWARD
+            result = set_store_and_forward_option(handleData, optionName, value);
+#else
+            LogError("%s option being set without the USE_STORE_AND_FORWARD compiler switch", optionName);
+            result = IOTHUB_CLIENT_ERROR;
+#endif
+        }
         else if (strcmp(optionName, OPTION_BLOB_UPLOAD_TIMEOUT_SECS) == 0)
         {
 #ifndef DONT_USE_UPLOADTOBLOB
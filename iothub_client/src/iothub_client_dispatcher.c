@@ -0,0 +1,321 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "internal/iothub_client_dispatcher.h"
+
+typedef struct DISPATCHER_ITEM_TAG
+{
+    struct DISPATCHER_ITEM_TAG* next;
+    CALLBACK_DISPATCHER_WORK work;
+    void* context;
+} DISPATCHER_ITEM;
+
+typedef struct DISPATCHER_LANE_TAG
+{
+    DISPATCHER_ITEM* head;
+    DISPATCHER_ITEM* tail;
+    bool ordered;
+    bool running; /*an item of this (ordered) lane is being run by one of the threads*/
+} DISPATCHER_LANE;
+
+typedef struct CALLBACK_DISPATCHER_TAG
+{
+    LOCK_HANDLE lock;
+    COND_HANDLE work_available;
+    THREAD_HANDLE* threads;
+    size_t thread_count;
+    DISPATCHER_LANE* lanes; /*lane_count ordered lanes followed by the parallel lane*/
+    size_t lane_count;
+    bool stop;
+} CALLBACK_DISPATCHER;
+
+/* Must be called with the lock held */
+static DISPATCHER_ITEM* take_next_item(CALLBACK_DISPATCHER* dispatcher, size_t* lane_index)
+{
+    DISPATCHER_ITEM* result = NULL;
+    size_t index;
+
+    /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_011: [ A thread of the pool shall take the oldest item of the first ordered lane that has items and no item running, or else the oldest item of the parallel lane. ] */
+    for (index = 0; index <= dispatcher->lane_count; index++)
+    {
+        DISPATCHER_LANE* lane = &dispatcher->lanes[index];
+        if ((lane->head != NULL) && !lane->running)
+        {
+            result = lane->head;
+            lane->head = result->next;
+            if (lane->head == NULL)
+            {
+                lane->tail = NULL;
+            }
+            lane->running = lane->ordered;
+            *lane_index = index;
+            break;
+        }
+    }
+
+    return result;
+}
+
+static int dispatcher_thread(void* arg)
+{
+    CALLBACK_DISPATCHER* dispatcher = (CALLBACK_DISPATCHER*)arg;
+
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("failed locking the dispatcher, the remaining items will run when it is destroyed");
+    }
+    else
+    {
+        while (1)
+        {
+            size_t lane_index;
+            DISPATCHER_ITEM* item = take_next_item(dispatcher, &lane_index);
+
+            if (item != NULL)
+            {
+                (void)Unlock(dispatcher->lock);
+
+                item->work(item->context);
+                free(item);
+
+                if (Lock(dispatcher->lock) != LOCK_OK)
+                {
+                    LogError("failed locking the dispatcher, the remaining items will run when it is destroyed");
+                    break;
+                }
+                dispatcher->lanes[lane_index].running = false;
+            }
+            /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_013: [ A thread of the pool shall exit once `callback_dispatcher_destroy` was called and there is no item it can take. ] */
+            else if (dispatcher->stop)
+            {
+                /* wake the next thread so it sees the stop request too */
+                (void)Condition_Post(dispatcher->work_available);
+                (void)Unlock(dispatcher->lock);
+                break;
+            }
+            else
+            {
+                /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_012: [ While there is no item it can take, a thread of the pool shall wait for `callback_dispatcher_post` or `callback_dispatcher_destroy` to signal it. ] */
+                (void)Condition_Wait(dispatcher->work_available, dispatcher->lock, 0);
+            }
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+static void stop_and_join_threads(CALLBACK_DISPATCHER* dispatcher, size_t started_threads)
+{
+    size_t index;
+
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock - - will still proceed to try to end the threads without locking");
+    }
+
+    dispatcher->stop = true;
+    if (Condition_Post(dispatcher->work_available) != COND_OK)
+    {
+        LogError("Condition_Post failed");
+    }
+
+    if (Unlock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("unable to Unlock");
+    }
+
+    for (index = 0; index < started_threads; index++)
+    {
+        int res;
+        if (ThreadAPI_Join(dispatcher->threads[index], &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed");
+        }
+    }
+}
+
+static void free_dispatcher(CALLBACK_DISPATCHER* dispatcher)
+{
+    if (dispatcher->work_available != NULL)
+    {
+        Condition_Deinit(dispatcher->work_available);
+    }
+    if (dispatcher->lock != NULL)
+    {
+        (void)Lock_Deinit(dispatcher->lock);
+    }
+    free(dispatcher->threads);
+    free(dispatcher->lanes);
+    free(dispatcher);
+}
+
+CALLBACK_DISPATCHER_HANDLE callback_dispatcher_create(size_t thread_count, size_t lane_count)
+{
+    CALLBACK_DISPATCHER* result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_001: [ If `thread_count` is 0 or `lane_count` is not smaller than `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_create` shall fail and return NULL. ] */
+    if (thread_count == 0 || lane_count >= CALLBACK_DISPATCHER_PARALLEL_LANE)
+    {
+        LogError("Invalid arguments: thread_count=%lu, lane_count=%lu", (unsigned long)thread_count, (unsigned long)lane_count);
+        result = NULL;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_002: [ If allocating the dispatcher, its lock or its condition fails, `callback_dispatcher_create` shall fail and return NULL. ] */
+    else if ((result = (CALLBACK_DISPATCHER*)malloc(sizeof(CALLBACK_DISPATCHER))) == NULL)
+    {
+        LogError("Failed allocating the dispatcher");
+    }
+    else
+    {
+        size_t index;
+
+        result->thread_count = thread_count;
+        result->lane_count = lane_count;
+        result->stop = false;
+        result->threads = (THREAD_HANDLE*)malloc(thread_count * sizeof(THREAD_HANDLE));
+        result->lanes = (DISPATCHER_LANE*)malloc((lane_count + 1) * sizeof(DISPATCHER_LANE));
+        result->lock = NULL;
+        result->work_available = NULL;
+
+        if ((result->threads == NULL) || (result->lanes == NULL))
+        {
+            LogError("Failed allocating the dispatcher threads and lanes");
+            free_dispatcher(result);
+            result = NULL;
+        }
+        else if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Lock_Init failed");
+            free_dispatcher(result);
+            result = NULL;
+        }
+        else if ((result->work_available = Condition_Init()) == NULL)
+        {
+            LogError("Condition_Init failed");
+            free_dispatcher(result);
+            result = NULL;
+        }
+        else
+        {
+            for (index = 0; index <= lane_count; index++)
+            {
+                result->lanes[index].head = NULL;
+                result->lanes[index].tail = NULL;
+                result->lanes[index].ordered = (index < lane_count);
+                result->lanes[index].running = false;
+            }
+
+            /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_003: [ `callback_dispatcher_create` shall start `thread_count` threads; if starting any of them fails, it shall stop and join the ones already started and return NULL. ] */
+            for (index = 0; index < thread_count; index++)
+            {
+                if (ThreadAPI_Create(&result->threads[index], dispatcher_thread, result) != THREADAPI_OK)
+                {
+                    LogError("ThreadAPI_Create failed");
+                    break;
+                }
+            }
+
+            if (index < thread_count)
+            {
+                stop_and_join_threads(result, index);
+                free_dispatcher(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+void callback_dispatcher_destroy(CALLBACK_DISPATCHER_HANDLE dispatcher)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_004: [ If `dispatcher` is NULL, `callback_dispatcher_destroy` shall do nothing. ] */
+    if (dispatcher != NULL)
+    {
+        size_t index;
+
+        /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_005: [ `callback_dispatcher_destroy` shall signal the threads to stop once there is no more work and join them. ] */
+        stop_and_join_threads(dispatcher, dispatcher->thread_count);
+
+        /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_006: [ Items left in the lanes (a thread failed to lock the dispatcher) shall be run on the calling thread, in lane order, before the dispatcher is freed. ] */
+        for (index = 0; index <= dispatcher->lane_count; index++)
+        {
+            while (dispatcher->lanes[index].head != NULL)
+            {
+                DISPATCHER_ITEM* item = dispatcher->lanes[index].head;
+                dispatcher->lanes[index].head = item->next;
+                item->work(item->context);
+                free(item);
+            }
+        }
+
+        free_dispatcher(dispatcher);
+    }
+}
+
+int callback_dispatcher_post(CALLBACK_DISPATCHER_HANDLE dispatcher, size_t lane, CALLBACK_DISPATCHER_WORK work, void* context)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_007: [ If `dispatcher` or `work` are NULL, or `lane` is neither an ordered lane nor `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_post` shall fail and return a non-zero value. ] */
+    if ((dispatcher == NULL) || (work == NULL) ||
+        ((lane >= dispatcher->lane_count) && (lane != CALLBACK_DISPATCHER_PARALLEL_LANE)))
+    {
+        LogError("Invalid arguments: dispatcher=%p, lane=%lu, work is %s", dispatcher, (unsigned long)lane, (work == NULL) ? "NULL" : "set");
+        result = __FAILURE__;
+    }
+    else
+    {
+        DISPATCHER_ITEM* item = (DISPATCHER_ITEM*)malloc(sizeof(DISPATCHER_ITEM));
+        if (item == NULL)
+        {
+            /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_008: [ If allocating the work item fails, `callback_dispatcher_post` shall fail and return a non-zero value. ] */
+            LogError("Failed allocating the work item");
+            result = __FAILURE__;
+        }
+        else if (Lock(dispatcher->lock) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_009: [ If acquiring the lock fails, `callback_dispatcher_post` shall fail and return a non-zero value. ] */
+            LogError("failed locking the dispatcher");
+            free(item);
+            result = __FAILURE__;
+        }
+        else
+        {
+            DISPATCHER_LANE* target = &dispatcher->lanes[(lane == CALLBACK_DISPATCHER_PARALLEL_LANE) ? dispatcher->lane_count : lane];
+
+            item->next = NULL;
+            item->work = work;
+            item->context = context;
+
+            /* Codes_SRS_IOTHUB_CLIENT_DISPATCHER_10_010: [ `callback_dispatcher_post` shall append the item to the lane, signal the threads of the pool and return 0. ] */
+            if (target->tail == NULL)
+            {
+                target->head = item;
+            }
+            else
+            {
+                target->tail->next = item;
+            }
+            target->tail = item;
+
+            if (Condition_Post(dispatcher->work_available) != COND_OK)
+            {
+                LogError("Condition_Post failed, the item will run when the pool is signaled next");
+            }
+
+            (void)Unlock(dispatcher->lock);
+            result = 0;
+        }
+    }
+
+    return result;
+}
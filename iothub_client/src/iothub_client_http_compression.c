@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <limits.h>
+#include "zlib.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "internal/iothub_client_http_compression.h"
+
+/*windowBits of deflateInit2 for a gzip wrapper instead of a zlib one*/
+#define GZIP_WINDOW_BITS (MAX_WBITS + 16)
+#define GZIP_MEMORY_LEVEL 8
+
+BUFFER_HANDLE http_compression_gzip(const unsigned char* source, size_t size)
+{
+    BUFFER_HANDLE result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_001: [ If `source` is NULL or `size` is 0 or does not fit in an `uInt`, `http_compression_gzip` shall fail and return NULL. ] */
+    if ((source == NULL) || (size == 0) || (size > UINT_MAX))
+    {
+        LogError("Invalid arguments: source=%p, size=%lu", source, (unsigned long)size);
+        result = NULL;
+    }
+    else
+    {
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+
+        /* Codes_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_002: [ `http_compression_gzip` shall compress `source` with zlib, at the default compression level and with a gzip wrapper. ] */
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            /* Codes_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_003: [ If zlib fails or allocating memory fails, `http_compression_gzip` shall fail and return NULL. ] */
+            LogError("deflateInit2 failed");
+            result = NULL;
+        }
+        else
+        {
+            /*deflateBound is large enough for deflate to finish in one call*/
+            uLong bound = deflateBound(&stream, (uLong)size);
+            unsigned char* compressed = (unsigned char*)malloc(bound);
+            if (compressed == NULL)
+            {
+                LogError("Failed allocating %lu bytes", (unsigned long)bound);
+                result = NULL;
+            }
+            else
+            {
+                stream.next_in = (Bytef*)source;
+                stream.avail_in = (uInt)size;
+                stream.next_out = compressed;
+                stream.avail_out = (uInt)bound;
+                if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+                {
+                    LogError("deflate failed");
+                    result = NULL;
+                }
+                /* Codes_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_004: [ On success `http_compression_gzip` shall return a buffer created by `BUFFER_create` with the complete gzip stream. ] */
+                else if ((result = BUFFER_create(compressed, (size_t)stream.total_out)) == NULL)
+                {
+                    LogError("BUFFER_create failed");
+                }
+                free(compressed);
+            }
+            (void)deflateEnd(&stream);
+        }
+    }
+
+    return result;
+}
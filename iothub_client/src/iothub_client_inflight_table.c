@@ -0,0 +1,190 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_inflight_table.h"
+
+static INFLIGHT_TABLE_ENTRY** get_bucket(INFLIGHT_TABLE_ENTRY** buckets, size_t bucket_count, uint16_t packet_id)
+{
+    return &buckets[packet_id & (bucket_count - 1)];
+}
+
+static void reset_inline_buckets(INFLIGHT_TABLE* inflight_table)
+{
+    size_t index;
+
+    for (index = 0; index < INFLIGHT_TABLE_INLINE_BUCKETS; index++)
+    {
+        inflight_table->inline_buckets[index] = NULL;
+    }
+    inflight_table->buckets = inflight_table->inline_buckets;
+    inflight_table->bucket_count = INFLIGHT_TABLE_INLINE_BUCKETS;
+    inflight_table->count = 0;
+}
+
+static void grow_buckets(INFLIGHT_TABLE* inflight_table)
+{
+    size_t new_bucket_count = inflight_table->bucket_count * 2;
+    INFLIGHT_TABLE_ENTRY** new_buckets;
+
+    /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_006: [ If the bigger bucket array cannot be allocated, `inflight_table_add` shall keep using the current one. ] */
+    if ((new_buckets = (INFLIGHT_TABLE_ENTRY**)malloc(new_bucket_count * sizeof(INFLIGHT_TABLE_ENTRY*))) == NULL)
+    {
+        LogError("Failed growing the in-flight table to %lu buckets", (unsigned long)new_bucket_count);
+    }
+    else
+    {
+        size_t index;
+
+        for (index = 0; index < new_bucket_count; index++)
+        {
+            new_buckets[index] = NULL;
+        }
+
+        for (index = 0; index < inflight_table->bucket_count; index++)
+        {
+            INFLIGHT_TABLE_ENTRY* entry = inflight_table->buckets[index];
+            while (entry != NULL)
+            {
+                INFLIGHT_TABLE_ENTRY* next = entry->next;
+                INFLIGHT_TABLE_ENTRY** bucket = get_bucket(new_buckets, new_bucket_count, entry->packet_id);
+                entry->next = *bucket;
+                *bucket = entry;
+                entry = next;
+            }
+        }
+
+        if (inflight_table->buckets != inflight_table->inline_buckets)
+        {
+            free(inflight_table->buckets);
+        }
+        inflight_table->buckets = new_buckets;
+        inflight_table->bucket_count = new_bucket_count;
+    }
+}
+
+void inflight_table_init(INFLIGHT_TABLE* inflight_table)
+{
+    if (inflight_table == NULL)
+    {
+        LogError("Invalid argument (inflight_table is NULL)");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_001: [ `inflight_table_init` shall initialize `inflight_table` as empty, using the buckets embedded in it. ] */
+        reset_inline_buckets(inflight_table);
+    }
+}
+
+void inflight_table_deinit(INFLIGHT_TABLE* inflight_table)
+{
+    if (inflight_table == NULL)
+    {
+        LogError("Invalid argument (inflight_table is NULL)");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_002: [ `inflight_table_deinit` shall free the bucket array if one was allocated and leave `inflight_table` empty, the entries still in it are not touched. It may be called on a zeroed table. ] */
+        if (inflight_table->buckets != NULL && inflight_table->buckets != inflight_table->inline_buckets)
+        {
+            free(inflight_table->buckets);
+        }
+        reset_inline_buckets(inflight_table);
+    }
+}
+
+int inflight_table_add(INFLIGHT_TABLE* inflight_table, INFLIGHT_TABLE_ENTRY* entry, uint16_t packet_id)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_003: [ If `inflight_table` or `entry` is NULL, `inflight_table_add` shall fail and return a non-zero value. ] */
+    if (inflight_table == NULL || entry == NULL)
+    {
+        LogError("Invalid argument (inflight_table=%p, entry=%p)", inflight_table, entry);
+        result = __FAILURE__;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_004: [ If an entry with the same `packet_id` is already in the table, `inflight_table_add` shall fail and return a non-zero value. ] */
+    else if (inflight_table_find(inflight_table, packet_id) != NULL)
+    {
+        LogError("Packet id %u is already in flight", (unsigned int)packet_id);
+        result = __FAILURE__;
+    }
+    else
+    {
+        INFLIGHT_TABLE_ENTRY** bucket;
+
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_005: [ When the table holds as many entries as it has buckets, `inflight_table_add` shall first double the number of buckets, up to one bucket per packet id. ] */
+        if (inflight_table->count >= inflight_table->bucket_count && inflight_table->bucket_count < INFLIGHT_TABLE_MAX_BUCKETS)
+        {
+            grow_buckets(inflight_table);
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_007: [ `inflight_table_add` shall link `entry` in the bucket of `packet_id` and return 0. ] */
+        bucket = get_bucket(inflight_table->buckets, inflight_table->bucket_count, packet_id);
+        entry->packet_id = packet_id;
+        entry->next = *bucket;
+        *bucket = entry;
+        inflight_table->count++;
+        result = 0;
+    }
+
+    return result;
+}
+
+INFLIGHT_TABLE_ENTRY* inflight_table_find(const INFLIGHT_TABLE* inflight_table, uint16_t packet_id)
+{
+    INFLIGHT_TABLE_ENTRY* result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_008: [ If `inflight_table` is NULL, `inflight_table_find` shall return NULL. ] */
+    if (inflight_table == NULL)
+    {
+        LogError("Invalid argument (inflight_table is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_009: [ `inflight_table_find` shall return the entry added with `packet_id`, or NULL if there is none. ] */
+        result = *get_bucket(inflight_table->buckets, inflight_table->bucket_count, packet_id);
+        while (result != NULL && result->packet_id != packet_id)
+        {
+            result = result->next;
+        }
+    }
+
+    return result;
+}
+
+INFLIGHT_TABLE_ENTRY* inflight_table_remove(INFLIGHT_TABLE* inflight_table, uint16_t packet_id)
+{
+    INFLIGHT_TABLE_ENTRY* result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_010: [ If `inflight_table` is NULL, `inflight_table_remove` shall return NULL. ] */
+    if (inflight_table == NULL)
+    {
+        LogError("Invalid argument (inflight_table is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        INFLIGHT_TABLE_ENTRY** link = get_bucket(inflight_table->buckets, inflight_table->bucket_count, packet_id);
+
+        while (*link != NULL && (*link)->packet_id != packet_id)
+        {
+            link = &(*link)->next;
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_011: [ `inflight_table_remove` shall unlink and return the entry added with `packet_id`, or return NULL if there is none. ] */
+        result = *link;
+        if (result != NULL)
+        {
+            *link = result->next;
+            result->next = NULL;
+            inflight_table->count--;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,862 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_journal.h"
+
+#define JOURNAL_SEGMENT_MAGIC           "AZIOTJ01"
+#define JOURNAL_RECORD_MAGIC            0x4A524543
+#define JOURNAL_SEGMENT_FILE_SUFFIX     ".journal"
+#define JOURNAL_CHECKPOINT_FILE_NAME    "checkpoint"
+#define JOURNAL_SEGMENT_FILE_NAME_SIZE  (16 + sizeof(JOURNAL_SEGMENT_FILE_SUFFIX))
+#define JOURNAL_MINIMUM_SEGMENT_SIZE    4096
+#define JOURNAL_ALIGN(value)            ((((value) + 7) / 8) * 8)
+
+typedef struct JOURNAL_SEGMENT_HEADER_TAG
+{
+    char magic[8];
+    uint64_t first_sequence;
+} JOURNAL_SEGMENT_HEADER;
+
+/* the payload follows the header, records are 8 bytes aligned */
+typedef struct JOURNAL_RECORD_HEADER_TAG
+{
+    uint32_t magic;
+    uint32_t size;
+    uint64_t sequence;
+    uint32_t checksum;
+    uint32_t acknowledged;
+} JOURNAL_RECORD_HEADER;
+
+typedef struct JOURNAL_CHECKPOINT_TAG
+{
+    uint64_t checkpoint;
+    uint64_t check; /* ~checkpoint, a torn write of the index is ignored */
+} JOURNAL_CHECKPOINT;
+
+typedef struct JOURNAL_SEGMENT_TAG
+{
+    char* file_name;
+    int fd;
+    unsigned char* base;
+    size_t mapped_size;
+    uint64_t first_sequence;
+    size_t* record_offsets; /* record i holds sequence first_sequence + i */
+    size_t record_count;
+    size_t record_capacity;
+    size_t acknowledged_count;
+    size_t write_offset;
+    size_t dirty_begin;
+    size_t dirty_end;
+} JOURNAL_SEGMENT;
+
+typedef struct MESSAGE_JOURNAL_TAG
+{
+    char* directory;
+    size_t segment_size;
+    size_t sync_batch;
+    JOURNAL_SEGMENT** segments; /* oldest first, records are appended to the last one */
+    size_t segment_count;
+    uint64_t next_sequence;
+    uint64_t checkpoint; /* lowest sequence number not acknowledged */
+    uint64_t persisted_checkpoint;
+    int checkpoint_fd;
+    size_t unsynced_records;
+} MESSAGE_JOURNAL;
+
+static uint32_t journal_checksum(uint64_t sequence, const unsigned char* data, size_t size)
+{
+    /* FNV-1a over the sequence number and the payload */
+    uint32_t hash = 2166136261u;
+    size_t index;
+
+    for (index = 0; index < sizeof(sequence); index++)
+    {
+        hash = (hash ^ (uint32_t)((sequence >> (index * 8)) & 0xFF)) * 16777619u;
+    }
+    for (index = 0; index < size; index++)
+    {
+        hash = (hash ^ data[index]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static char* make_path(const char* directory, const char* file_name)
+{
+    size_t length = strlen(directory) + 1 + strlen(file_name) + 1;
+    char* result = (char*)malloc(length);
+
+    if (result == NULL)
+    {
+        LogError("Failed allocating journal file path");
+    }
+    else
+    {
+        (void)snprintf(result, length, "%s/%s", directory, file_name);
+    }
+
+    return result;
+}
+
+static void mark_dirty(JOURNAL_SEGMENT* segment, size_t begin, size_t end)
+{
+    if (segment->dirty_begin == segment->dirty_end)
+    {
+        segment->dirty_begin = begin;
+        segment->dirty_end = end;
+    }
+    else
+    {
+        if (begin < segment->dirty_begin)
+        {
+            segment->dirty_begin = begin;
+        }
+        if (end > segment->dirty_end)
+        {
+            segment->dirty_end = end;
+        }
+    }
+}
+
+static int sync_segment(JOURNAL_SEGMENT* segment)
+{
+    int result;
+
+    if (segment->dirty_begin == segment->dirty_end)
+    {
+        result = 0;
+    }
+    else
+    {
+        long page_size = sysconf(_SC_PAGESIZE);
+        size_t begin = (page_size > 0) ? (segment->dirty_begin / (size_t)page_size) * (size_t)page_size : 0;
+
+        if (msync(segment->base + begin, segment->dirty_end - begin, MS_SYNC) != 0)
+        {
+            LogError("Failed flushing journal segment %s (errno=%d)", segment->file_name, errno);
+            result = __FAILURE__;
+        }
+        else
+        {
+            segment->dirty_begin = 0;
+            segment->dirty_end = 0;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static void close_segment(JOURNAL_SEGMENT* segment, bool remove_file)
+{
+    if (segment->base != NULL)
+    {
+        (void)munmap(segment->base, segment->mapped_size);
+    }
+    if (segment->fd >= 0)
+    {
+        (void)close(segment->fd);
+    }
+    if (remove_file && unlink(segment->file_name) != 0)
+    {
+        LogError("Failed removing journal segment %s (errno=%d)", segment->file_name, errno);
+    }
+    free(segment->record_offsets);
+    free(segment->file_name);
+    free(segment);
+}
+
+static JOURNAL_SEGMENT* allocate_segment(char* file_name, uint64_t first_sequence)
+{
+    JOURNAL_SEGMENT* result = (JOURNAL_SEGMENT*)malloc(sizeof(JOURNAL_SEGMENT));
+
+    if (result == NULL)
+    {
+        LogError("Failed allocating journal segment");
+        free(file_name);
+    }
+    else
+    {
+        (void)memset(result, 0, sizeof(JOURNAL_SEGMENT));
+        result->file_name = file_name;
+        result->fd = -1;
+        result->first_sequence = first_sequence;
+    }
+
+    return result;
+}
+
+static int map_segment(JOURNAL_SEGMENT* segment, size_t size)
+{
+    int result;
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        LogError("Failed mapping journal segment %s (errno=%d)", segment->file_name, errno);
+        result = __FAILURE__;
+    }
+    else
+    {
+        segment->base = (unsigned char*)base;
+        segment->mapped_size = size;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int add_record_offset(JOURNAL_SEGMENT* segment, size_t offset)
+{
+    int result;
+
+    if (segment->record_count == segment->record_capacity)
+    {
+        size_t new_capacity = (segment->record_capacity == 0) ? 64 : segment->record_capacity * 2;
+        size_t* new_offsets = (size_t*)realloc(segment->record_offsets, new_capacity * sizeof(size_t));
+        if (new_offsets == NULL)
+        {
+            LogError("Failed growing the journal segment index");
+            result = __FAILURE__;
+        }
+        else
+        {
+            segment->record_offsets = new_offsets;
+            segment->record_capacity = new_capacity;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        segment->record_offsets[segment->record_count] = offset;
+    }
+
+    return result;
+}
+
+static JOURNAL_SEGMENT* create_segment(MESSAGE_JOURNAL* journal, uint64_t first_sequence)
+{
+    JOURNAL_SEGMENT* result;
+    char file_name[JOURNAL_SEGMENT_FILE_NAME_SIZE];
+    char* path;
+
+    (void)snprintf(file_name, sizeof(file_name), "%016" PRIx64 JOURNAL_SEGMENT_FILE_SUFFIX, first_sequence);
+
+    if ((path = make_path(journal->directory, file_name)) == NULL)
+    {
+        result = NULL;
+    }
+    else if ((result = allocate_segment(path, first_sequence)) == NULL)
+    {
+        /* allocate_segment owns path */
+    }
+    else if ((result->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) < 0)
+    {
+        LogError("Failed creating journal segment %s (errno=%d)", path, errno);
+        close_segment(result, false);
+        result = NULL;
+    }
+    /* the file is allocated upfront, running out of storage must fail the append instead of faulting a mapped write */
+    else if ((ftruncate(result->fd, (off_t)journal->segment_size) != 0) ||
+#ifdef __linux__
+        (posix_fallocate(result->fd, 0, (off_t)journal->segment_size) != 0) ||
+#endif
+        (map_segment(result, journal->segment_size) != 0))
+    {
+        LogError("Failed allocating %lu bytes for journal segment %s", (unsigned long)journal->segment_size, path);
+        close_segment(result, true);
+        result = NULL;
+    }
+    else
+    {
+        JOURNAL_SEGMENT_HEADER* header = (JOURNAL_SEGMENT_HEADER*)result->base;
+        (void)memcpy(header->magic, JOURNAL_SEGMENT_MAGIC, sizeof(header->magic));
+        header->first_sequence = first_sequence;
+        result->write_offset = JOURNAL_ALIGN(sizeof(JOURNAL_SEGMENT_HEADER));
+        mark_dirty(result, 0, result->write_offset);
+    }
+
+    return result;
+}
+
+/* recovers the records of an existing segment, stops at the first record that is torn or out of sequence */
+static JOURNAL_SEGMENT* open_segment(MESSAGE_JOURNAL* journal, const char* file_name, uint64_t first_sequence)
+{
+    JOURNAL_SEGMENT* result;
+    char* path;
+    struct stat file_status;
+
+    if ((path = make_path(journal->directory, file_name)) == NULL)
+    {
+        result = NULL;
+    }
+    else if ((result = allocate_segment(path, first_sequence)) == NULL)
+    {
+        /* allocate_segment owns path */
+    }
+    else if ((result->fd = open(path, O_RDWR)) < 0)
+    {
+        LogError("Failed opening journal segment %s (errno=%d)", path, errno);
+        close_segment(result, false);
+        result = NULL;
+    }
+    else if ((fstat(result->fd, &file_status) != 0) ||
+        ((size_t)file_status.st_size < JOURNAL_ALIGN(sizeof(JOURNAL_SEGMENT_HEADER))) ||
+        (map_segment(result, (size_t)file_status.st_size) != 0) ||
+        (memcmp(((JOURNAL_SEGMENT_HEADER*)result->base)->magic, JOURNAL_SEGMENT_MAGIC, sizeof(((JOURNAL_SEGMENT_HEADER*)result->base)->magic)) != 0) ||
+        (((JOURNAL_SEGMENT_HEADER*)result->base)->first_sequence != first_sequence))
+    {
+        LogError("Discarding invalid journal segment %s", path);
+        close_segment(result, true);
+        result = NULL;
+    }
+    else
+    {
+        size_t offset = JOURNAL_ALIGN(sizeof(JOURNAL_SEGMENT_HEADER));
+
+        while (offset + sizeof(JOURNAL_RECORD_HEADER) <= result->mapped_size)
+        {
+            JOURNAL_RECORD_HEADER* record = (JOURNAL_RECORD_HEADER*)(result->base + offset);
+            uint64_t sequence = first_sequence + result->record_count;
+
+            if ((record->magic != JOURNAL_RECORD_MAGIC) ||
+                (record->sequence != sequence) ||
+                (record->size > result->mapped_size - offset - sizeof(JOURNAL_RECORD_HEADER)) ||
+                (record->checksum != journal_checksum(sequence, (const unsigned char*)(record + 1), record->size)) ||
+                (add_record_offset(result, offset) != 0))
+            {
+                break;
+            }
+
+            /* records below the persisted checkpoint were acknowledged even if their flag did not reach the storage */
+            if ((record->acknowledged == 0) && (sequence < journal->checkpoint))
+            {
+                record->acknowledged = 1;
+                mark_dirty(result, offset, offset + sizeof(JOURNAL_RECORD_HEADER));
+            }
+            if (record->acknowledged != 0)
+            {
+                result->acknowledged_count++;
+            }
+
+            result->record_count++;
+            offset += JOURNAL_ALIGN(sizeof(JOURNAL_RECORD_HEADER) + record->size);
+        }
+
+        result->write_offset = offset;
+    }
+
+    return result;
+}
+
+static int compare_segments(const void* left, const void* right)
+{
+    const JOURNAL_SEGMENT* left_segment = *(const JOURNAL_SEGMENT* const*)left;
+    const JOURNAL_SEGMENT* right_segment = *(const JOURNAL_SEGMENT* const*)right;
+    return (left_segment->first_sequence < right_segment->first_sequence) ? -1 : ((left_segment->first_sequence > right_segment->first_sequence) ? 1 : 0);
+}
+
+static int add_segment(MESSAGE_JOURNAL* journal, JOURNAL_SEGMENT* segment)
+{
+    int result;
+    JOURNAL_SEGMENT** new_segments = (JOURNAL_SEGMENT**)realloc(journal->segments, (journal->segment_count + 1) * sizeof(JOURNAL_SEGMENT*));
+
+    if (new_segments == NULL)
+    {
+        LogError("Failed growing the journal segment list");
+        result = __FAILURE__;
+    }
+    else
+    {
+        journal->segments = new_segments;
+        journal->segments[journal->segment_count++] = segment;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int load_segments(MESSAGE_JOURNAL* journal)
+{
+    int result;
+    DIR* directory = opendir(journal->directory);
+
+    if (directory == NULL)
+    {
+        LogError("Failed listing journal directory %s (errno=%d)", journal->directory, errno);
+        result = __FAILURE__;
+    }
+    else
+    {
+        struct dirent* entry;
+        result = 0;
+
+        while ((result == 0) && ((entry = readdir(directory)) != NULL))
+        {
+            uint64_t first_sequence;
+            JOURNAL_SEGMENT* segment;
+
+            if ((strlen(entry->d_name) != JOURNAL_SEGMENT_FILE_NAME_SIZE - 1) ||
+                (strcmp(entry->d_name + 16, JOURNAL_SEGMENT_FILE_SUFFIX) != 0) ||
+                (sscanf(entry->d_name, "%16" SCNx64, &first_sequence) != 1))
+            {
+                /* not a segment */
+            }
+            else if ((segment = open_segment(journal, entry->d_name, first_sequence)) == NULL)
+            {
+                /* invalid segments are discarded */
+            }
+            else if (add_segment(journal, segment) != 0)
+            {
+                close_segment(segment, false);
+                result = __FAILURE__;
+            }
+        }
+
+        (void)closedir(directory);
+
+        if ((result == 0) && (journal->segment_count > 1))
+        {
+            qsort(journal->segments, journal->segment_count, sizeof(JOURNAL_SEGMENT*), compare_segments);
+        }
+    }
+
+    return result;
+}
+
+static JOURNAL_SEGMENT* find_segment(MESSAGE_JOURNAL* journal, uint64_t sequence)
+{
+    JOURNAL_SEGMENT* result = NULL;
+    size_t index;
+
+    for (index = 0; index < journal->segment_count; index++)
+    {
+        JOURNAL_SEGMENT* segment = journal->segments[index];
+        if ((sequence >= segment->first_sequence) && (sequence - segment->first_sequence < segment->record_count))
+        {
+            result = segment;
+            break;
+        }
+    }
+
+    return result;
+}
+
+static JOURNAL_RECORD_HEADER* get_record(JOURNAL_SEGMENT* segment, uint64_t sequence)
+{
+    return (JOURNAL_RECORD_HEADER*)(segment->base + segment->record_offsets[sequence - segment->first_sequence]);
+}
+
+static void advance_checkpoint(MESSAGE_JOURNAL* journal)
+{
+    uint64_t checkpoint = journal->next_sequence;
+    size_t index;
+
+    for (index = 0; index < journal->segment_count; index++)
+    {
+        JOURNAL_SEGMENT* segment = journal->segments[index];
+        if (segment->acknowledged_count < segment->record_count)
+        {
+            size_t record_index = (journal->checkpoint > segment->first_sequence) ? (size_t)(journal->checkpoint - segment->first_sequence) : 0;
+            if (record_index >= segment->record_count)
+            {
+                record_index = 0;
+            }
+            while (((JOURNAL_RECORD_HEADER*)(segment->base + segment->record_offsets[record_index]))->acknowledged != 0)
+            {
+                record_index++;
+            }
+            checkpoint = segment->first_sequence + record_index;
+            break;
+        }
+    }
+
+    journal->checkpoint = checkpoint;
+}
+
+/* the active (last) segment is kept even when all its records are acknowledged, new records go there */
+static void remove_acknowledged_segments(MESSAGE_JOURNAL* journal)
+{
+    while ((journal->segment_count > 1) &&
+        (journal->segments[0]->acknowledged_count == journal->segments[0]->record_count))
+    {
+        close_segment(journal->segments[0], true);
+        journal->segment_count--;
+        (void)memmove(&journal->segments[0], &journal->segments[1], journal->segment_count * sizeof(JOURNAL_SEGMENT*));
+    }
+}
+
+static void read_checkpoint(MESSAGE_JOURNAL* journal)
+{
+    JOURNAL_CHECKPOINT value;
+
+    if ((pread(journal->checkpoint_fd, &value, sizeof(value), 0) == (ssize_t)sizeof(value)) &&
+        (value.check == ~value.checkpoint))
+    {
+        journal->checkpoint = value.checkpoint;
+    }
+    else
+    {
+        journal->checkpoint = 0;
+    }
+    journal->persisted_checkpoint = journal->checkpoint;
+}
+
+static void free_journal(MESSAGE_JOURNAL* journal)
+{
+    size_t index;
+
+    for (index = 0; index < journal->segment_count; index++)
+    {
+        close_segment(journal->segments[index], false);
+    }
+    if (journal->checkpoint_fd >= 0)
+    {
+        (void)close(journal->checkpoint_fd);
+    }
+    free(journal->segments);
+    free(journal->directory);
+    free(journal);
+}
+
+MESSAGE_JOURNAL_HANDLE message_journal_open(const char* directory, size_t segment_size, size_t sync_batch)
+{
+    MESSAGE_JOURNAL* result;
+    char* checkpoint_path = NULL;
+
+    /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_001: [ If `directory` is NULL or `segment_size` is below 4096 bytes or above 4GB, `message_journal_open` shall fail and return NULL. ] */
+    if ((directory == NULL) || (segment_size < JOURNAL_MINIMUM_SEGMENT_SIZE) || ((uint64_t)segment_size > UINT32_MAX))
+    {
+        LogError("Invalid argument (directory=%p, segment_size=%lu)", directory, (unsigned long)segment_size);
+        result = NULL;
+    }
+    else if ((result = (MESSAGE_JOURNAL*)malloc(sizeof(MESSAGE_JOURNAL))) == NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_002: [ If any failure occurs, `message_journal_open` shall fail and return NULL. ] */
+        LogError("Failed allocating journal");
+    }
+    else
+    {
+        size_t directory_length = strlen(directory);
+
+        (void)memset(result, 0, sizeof(MESSAGE_JOURNAL));
+        result->checkpoint_fd = -1;
+        result->segment_size = segment_size;
+        result->sync_batch = sync_batch;
+
+        if ((result->directory = (char*)malloc(directory_length + 1)) == NULL)
+        {
+            LogError("Failed allocating journal directory");
+            free_journal(result);
+            result = NULL;
+        }
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_003: [ `message_journal_open` shall create `directory` if it does not exist. ] */
+        else if ((memcpy(result->directory, directory, directory_length + 1) == NULL) ||
+            ((mkdir(directory, S_IRWXU) != 0) && (errno != EEXIST)))
+        {
+            LogError("Failed creating journal directory %s (errno=%d)", directory, errno);
+            free_journal(result);
+            result = NULL;
+        }
+        else if ((checkpoint_path = make_path(directory, JOURNAL_CHECKPOINT_FILE_NAME)) == NULL)
+        {
+            free_journal(result);
+            result = NULL;
+        }
+        else if ((result->checkpoint_fd = open(checkpoint_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) < 0)
+        {
+            LogError("Failed opening journal checkpoint %s (errno=%d)", checkpoint_path, errno);
+            free_journal(result);
+            result = NULL;
+        }
+        else
+        {
+            read_checkpoint(result);
+
+            /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_004: [ `message_journal_open` shall recover the records of the segments found in `directory`, up to the first torn record of each segment, and consider acknowledged the ones below the persisted checkpoint. ] */
+            if (load_segments(result) != 0)
+            {
+                free_journal(result);
+                result = NULL;
+            }
+            else
+            {
+                JOURNAL_SEGMENT* last = (result->segment_count == 0) ? NULL : result->segments[result->segment_count - 1];
+
+                /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_005: [ Sequence numbers shall start at 1 and continue after the highest sequence number recovered or checkpointed. ] */
+                result->next_sequence = (last == NULL) ? 1 : last->first_sequence + last->record_count;
+                if (result->next_sequence < result->checkpoint)
+                {
+                    result->next_sequence = result->checkpoint;
+                }
+                if (result->next_sequence == 0)
+                {
+                    result->next_sequence = 1;
+                }
+
+                advance_checkpoint(result);
+                remove_acknowledged_segments(result);
+            }
+        }
+    }
+
+    free(checkpoint_path);
+    return result;
+}
+
+void message_journal_close(MESSAGE_JOURNAL_HANDLE journal)
+{
+    if (journal == NULL)
+    {
+        LogError("Invalid argument (journal is NULL)");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_006: [ `message_journal_close` shall flush the journal, unmap and close its segments without removing them, and free the journal. ] */
+        (void)message_journal_sync(journal);
+        free_journal(journal);
+    }
+}
+
+int message_journal_append(MESSAGE_JOURNAL_HANDLE journal, const unsigned char* data, size_t size, uint64_t* sequence)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_007: [ If `journal`, `data` or `sequence` are NULL, `message_journal_append` shall fail and return a non-zero value. ] */
+    if ((journal == NULL) || (data == NULL) || (sequence == NULL))
+    {
+        LogError("Invalid argument (journal=%p, data=%p, sequence=%p)", journal, data, sequence);
+        result = __FAILURE__;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_008: [ If the record does not fit in an empty segment, `message_journal_append` shall fail and return a non-zero value. ] */
+    else if ((size > journal->segment_size) ||
+        (JOURNAL_ALIGN(sizeof(JOURNAL_RECORD_HEADER) + size) > journal->segment_size - JOURNAL_ALIGN(sizeof(JOURNAL_SEGMENT_HEADER))))
+    {
+        LogError("Record of %lu bytes does not fit in a journal segment of %lu bytes", (unsigned long)size, (unsigned long)journal->segment_size);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t record_size = JOURNAL_ALIGN(sizeof(JOURNAL_RECORD_HEADER) + size);
+        JOURNAL_SEGMENT* segment = (journal->segment_count == 0) ? NULL : journal->segments[journal->segment_count - 1];
+
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_009: [ When the record does not fit in the current segment, `message_journal_append` shall create a new segment file of `segment_size` bytes. ] */
+        if ((segment == NULL) || (segment->write_offset + record_size > segment->mapped_size))
+        {
+            if ((segment = create_segment(journal, journal->next_sequence)) != NULL &&
+                (add_segment(journal, segment) != 0))
+            {
+                close_segment(segment, true);
+                segment = NULL;
+            }
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_010: [ If any failure occurs, `message_journal_append` shall fail and return a non-zero value. ] */
+        if ((segment == NULL) || (add_record_offset(segment, segment->write_offset) != 0))
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_011: [ `message_journal_append` shall copy `data` to the mapped segment, store the next sequence number in `sequence` and return 0. ] */
+            JOURNAL_RECORD_HEADER* record = (JOURNAL_RECORD_HEADER*)(segment->base + segment->write_offset);
+
+            (void)memcpy(record + 1, data, size);
+            record->size = (uint32_t)size;
+            record->sequence = journal->next_sequence;
+            record->checksum = journal_checksum(journal->next_sequence, data, size);
+            record->acknowledged = 0;
+            record->magic = JOURNAL_RECORD_MAGIC;
+
+            mark_dirty(segment, segment->write_offset, segment->write_offset + record_size);
+            segment->write_offset += record_size;
+            segment->record_count++;
+            *sequence = journal->next_sequence++;
+
+            /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_012: [ If `sync_batch` is not 0, every `sync_batch` appended records `message_journal_append` shall flush the journal as `message_journal_sync` does. ] */
+            journal->unsynced_records++;
+            if ((journal->sync_batch != 0) && (journal->unsynced_records >= journal->sync_batch))
+            {
+                (void)message_journal_sync(journal);
+            }
+
+            remove_acknowledged_segments(journal);
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+int message_journal_read(MESSAGE_JOURNAL_HANDLE journal, uint64_t sequence, const unsigned char** data, size_t* size)
+{
+    int result;
+    JOURNAL_SEGMENT* segment;
+
+    /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_013: [ If `journal`, `data` or `size` are NULL, or `sequence` is not a pending record, `message_journal_read` shall fail and return a non-zero value. ] */
+    if ((journal == NULL) || (data == NULL) || (size == NULL))
+    {
+        LogError("Invalid argument (journal=%p, data=%p, size=%p)", journal, data, size);
+        result = __FAILURE__;
+    }
+    else if (((segment = find_segment(journal, sequence)) == NULL) ||
+        (get_record(segment, sequence)->acknowledged != 0))
+    {
+        LogError("Record %" PRIu64 " is not pending in the journal", sequence);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_014: [ `message_journal_read` shall point `data` to the mapped payload of the record, valid until the record is acknowledged or the journal closed, and return 0. ] */
+        JOURNAL_RECORD_HEADER* record = get_record(segment, sequence);
+        *data = (const unsigned char*)(record + 1);
+        *size = record->size;
+        result = 0;
+    }
+
+    return result;
+}
+
+void message_journal_acknowledge(MESSAGE_JOURNAL_HANDLE journal, uint64_t sequence)
+{
+    JOURNAL_SEGMENT* segment;
+
+    if (journal == NULL)
+    {
+        LogError("Invalid argument (journal is NULL)");
+    }
+    else if ((segment = find_segment(journal, sequence)) == NULL)
+    {
+        LogError("Record %" PRIu64 " is not in the journal", sequence);
+    }
+    else
+    {
+        JOURNAL_RECORD_HEADER* record = get_record(segment, sequence);
+
+        if (record->acknowledged == 0)
+        {
+            /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_015: [ `message_journal_acknowledge` shall flag the record as acknowledged and advance the checkpoint past the acknowledged records. ] */
+            size_t offset = (size_t)((unsigned char*)record - segment->base);
+            record->acknowledged = 1;
+            mark_dirty(segment, offset, offset + sizeof(JOURNAL_RECORD_HEADER));
+            segment->acknowledged_count++;
+
+            if (sequence == journal->checkpoint)
+            {
+                advance_checkpoint(journal);
+            }
+
+            /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_016: [ Segments other than the last one shall be deleted once all their records are acknowledged. ] */
+            remove_acknowledged_segments(journal);
+        }
+    }
+}
+
+int message_journal_for_each_pending(MESSAGE_JOURNAL_HANDLE journal, MESSAGE_JOURNAL_ON_PENDING_RECORD on_pending_record, void* context)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_017: [ If `journal` or `on_pending_record` are NULL, `message_journal_for_each_pending` shall fail and return a non-zero value. ] */
+    if ((journal == NULL) || (on_pending_record == NULL))
+    {
+        LogError("Invalid argument (journal=%p, on_pending_record=%p)", journal, on_pending_record);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_018: [ `message_journal_for_each_pending` shall call `on_pending_record` for every record not acknowledged, in sequence order, and return 0. ] */
+        size_t segment_index;
+        for (segment_index = 0; segment_index < journal->segment_count; segment_index++)
+        {
+            JOURNAL_SEGMENT* segment = journal->segments[segment_index];
+            size_t record_index;
+            for (record_index = 0; record_index < segment->record_count; record_index++)
+            {
+                JOURNAL_RECORD_HEADER* record = (JOURNAL_RECORD_HEADER*)(segment->base + segment->record_offsets[record_index]);
+                if (record->acknowledged == 0)
+                {
+                    on_pending_record(record->sequence, (const unsigned char*)(record + 1), record->size, context);
+                }
+            }
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
+int message_journal_sync(MESSAGE_JOURNAL_HANDLE journal)
+{
+    int result;
+
+    if (journal == NULL)
+    {
+        LogError("Invalid argument (journal is NULL)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+        result = 0;
+
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_019: [ `message_journal_sync` shall flush the modified pages of the segments and then, if it moved, persist the checkpoint. ] */
+        for (index = 0; index < journal->segment_count; index++)
+        {
+            if (sync_segment(journal->segments[index]) != 0)
+            {
+                result = __FAILURE__;
+            }
+        }
+
+        if ((result == 0) && (journal->checkpoint != journal->persisted_checkpoint))
+        {
+            JOURNAL_CHECKPOINT value;
+            value.checkpoint = journal->checkpoint;
+            value.check = ~journal->checkpoint;
+
+            if ((pwrite(journal->checkpoint_fd, &value, sizeof(value), 0) != (ssize_t)sizeof(value)) ||
+                (fsync(journal->checkpoint_fd) != 0))
+            {
+                LogError("Failed persisting the journal checkpoint (errno=%d)", errno);
+                result = __FAILURE__;
+            }
+            else
+            {
+                journal->persisted_checkpoint = journal->checkpoint;
+            }
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_JOURNAL_10_020: [ If flushing fails, `message_journal_sync` shall return a non-zero value, otherwise 0. ] */
+        if (result == 0)
+        {
+            journal->unsynced_records = 0;
+        }
+    }
+
+    return result;
+}
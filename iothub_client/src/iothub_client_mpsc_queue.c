@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_mpsc_queue.h"
+
+/* Producers push onto a stack with a compare-and-swap of its head; the consumer swaps the whole stack out and
+   reverses it. Since nodes are only ever removed all at once, a push cannot suffer from the ABA problem. */
+#if defined(_MSC_VER)
+#include <windows.h>
+#define MPSC_LOAD_HEAD(queue)                       ((MPSC_QUEUE_NODE*)InterlockedCompareExchangePointer((PVOID volatile*)&(queue)->head, NULL, NULL))
+#define MPSC_CAS_HEAD(queue, expected, desired)     (InterlockedCompareExchangePointer((PVOID volatile*)&(queue)->head, (desired), (expected)) == (PVOID)(expected))
+#define MPSC_EXCHANGE_HEAD(queue, value)            ((MPSC_QUEUE_NODE*)InterlockedExchangePointer((PVOID volatile*)&(queue)->head, (value)))
+#elif defined(__GNUC__) || defined(__clang__)
+#define MPSC_LOAD_HEAD(queue)                       __atomic_load_n(&(queue)->head, __ATOMIC_ACQUIRE)
+#define MPSC_CAS_HEAD(queue, expected, desired)     __sync_bool_compare_and_swap(&(queue)->head, (expected), (desired))
+#define MPSC_EXCHANGE_HEAD(queue, value)            __atomic_exchange_n(&(queue)->head, (value), __ATOMIC_ACQ_REL)
+#else
+#include "azure_c_shared_utility/lock.h"
+#define MPSC_QUEUE_USE_LOCK
+#endif
+
+typedef struct MPSC_QUEUE_TAG
+{
+    MPSC_QUEUE_NODE* head; /*most recently pushed node*/
+#ifdef MPSC_QUEUE_USE_LOCK
+    LOCK_HANDLE lock;
+#endif
+} MPSC_QUEUE;
+
+#ifdef MPSC_QUEUE_USE_LOCK
+static MPSC_QUEUE_NODE* MPSC_LOAD_HEAD(MPSC_QUEUE* queue)
+{
+    MPSC_QUEUE_NODE* result;
+    (void)Lock(queue->lock);
+    result = queue->head;
+    (void)Unlock(queue->lock);
+    return result;
+}
+
+static bool MPSC_CAS_HEAD(MPSC_QUEUE* queue, MPSC_QUEUE_NODE* expected, MPSC_QUEUE_NODE* desired)
+{
+    bool result;
+    (void)Lock(queue->lock);
+    result = (queue->head == expected);
+    if (result)
+    {
+        queue->head = desired;
+    }
+    (void)Unlock(queue->lock);
+    return result;
+}
+
+static MPSC_QUEUE_NODE* MPSC_EXCHANGE_HEAD(MPSC_QUEUE* queue, MPSC_QUEUE_NODE* value)
+{
+    MPSC_QUEUE_NODE* result;
+    (void)Lock(queue->lock);
+    result = queue->head;
+    queue->head = value;
+    (void)Unlock(queue->lock);
+    return result;
+}
+#endif
+
+MPSC_QUEUE_HANDLE mpsc_queue_create(void)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_001: [ `mpsc_queue_create` shall allocate an empty queue, and return NULL if the allocation fails. ] */
+    MPSC_QUEUE* result = (MPSC_QUEUE*)malloc(sizeof(MPSC_QUEUE));
+    if (result == NULL)
+    {
+        LogError("Failed allocating the queue");
+    }
+    else
+    {
+        result->head = NULL;
+#ifdef MPSC_QUEUE_USE_LOCK
+        if ((result->lock = Lock_Init()) == NULL)
+        {
+            LogError("Lock_Init failed");
+            free(result);
+            result = NULL;
+        }
+#endif
+    }
+
+    return result;
+}
+
+void mpsc_queue_destroy(MPSC_QUEUE_HANDLE queue)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_002: [ `mpsc_queue_destroy` shall free the queue, but not the nodes still in it. ] */
+    if (queue != NULL)
+    {
+#ifdef MPSC_QUEUE_USE_LOCK
+        (void)Lock_Deinit(queue->lock);
+#endif
+        free(queue);
+    }
+}
+
+int mpsc_queue_push(MPSC_QUEUE_HANDLE queue, MPSC_QUEUE_NODE* node, bool* was_empty)
+{
+    int result;
+
+    if ((queue == NULL) || (node == NULL))
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_003: [ If `queue` or `node` are NULL, `mpsc_queue_push` shall fail and return a non-zero value. ] */
+        LogError("Invalid arguments: queue=%p, node=%p", queue, node);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_004: [ `mpsc_queue_push` shall add `node` to the queue without blocking on the other producers nor on the consumer, and return 0. ] */
+        MPSC_QUEUE_NODE* head;
+        do
+        {
+            head = MPSC_LOAD_HEAD(queue);
+            node->next = head;
+        } while (!MPSC_CAS_HEAD(queue, head, node));
+
+        /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_008: [ If `was_empty` is not NULL, `mpsc_queue_push` shall set it to true if the queue held no node right before `node` was added, and to false otherwise. ] */
+        if (was_empty != NULL)
+        {
+            *was_empty = (head == NULL);
+        }
+
+        result = 0;
+    }
+
+    return result;
+}
+
+MPSC_QUEUE_NODE* mpsc_queue_take_all(MPSC_QUEUE_HANDLE queue)
+{
+    MPSC_QUEUE_NODE* result = NULL;
+
+    /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_005: [ If `queue` is NULL, `mpsc_queue_take_all` shall return NULL. ] */
+    if (queue != NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_006: [ `mpsc_queue_take_all` shall empty the queue and return the nodes it held linked through `next` in the order they were pushed, or NULL if it was empty. ] */
+        MPSC_QUEUE_NODE* node = MPSC_EXCHANGE_HEAD(queue, NULL);
+        while (node != NULL)
+        {
+            MPSC_QUEUE_NODE* next = node->next;
+            node->next = result;
+            result = node;
+            node = next;
+        }
+    }
+
+    return result;
+}
+
+bool mpsc_queue_is_empty(MPSC_QUEUE_HANDLE queue)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_007: [ `mpsc_queue_is_empty` shall return true if `queue` is NULL or holds no node. ] */
+    return (queue == NULL) || (MPSC_LOAD_HEAD(queue) == NULL);
+}
@@ -0,0 +1,392 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_mqtt_topic.h"
+
+/* Room reserved after the prefix at init, enough for the properties of most messages */
+#define MQTT_TOPIC_INITIAL_PROPERTIES_SIZE  128
+
+static const char SYSTEM_PROPERTY_PREFIX[] = "%24.";
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/* Number of characters URL_EncodeString writes for every byte: 1 when the byte is copied as is,
+   3 for "%xx" and 6 for the bytes above 0x7f that are written as a 2 bytes UTF-8 sequence ("%c2%xx" or "%c3%xx") */
+static const unsigned char URL_ENCODED_LENGTH[256] =
+{
+    1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 0x00 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 0x10 */
+    3, 1, 3, 3, 3, 3, 3, 3, 1, 1, 1, 3, 3, 1, 1, 3, /* 0x20 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, /* 0x30 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x40 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 1, /* 0x50 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x60 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, /* 0x70 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0x80 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0x90 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0xa0 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0xb0 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0xc0 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0xd0 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, /* 0xe0 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6  /* 0xf0 */
+};
+
+static size_t get_encoded_length(const char* text, bool url_encode)
+{
+    size_t result;
+    if (url_encode)
+    {
+        const unsigned char* current = (const unsigned char*)text;
+        result = 0;
+        while (*current != '\0')
+        {
+            result += URL_ENCODED_LENGTH[*current];
+            current++;
+        }
+    }
+    else
+    {
+        result = strlen(text);
+    }
+    return result;
+}
+
+static char* write_text(char* destination, const char* text, bool url_encode)
+{
+    if (url_encode)
+    {
+        const unsigned char* current = (const unsigned char*)text;
+        while (*current != '\0')
+        {
+            unsigned char value = *current;
+            switch (URL_ENCODED_LENGTH[value])
+            {
+                case 1:
+                    *destination++ = (char)value;
+                    break;
+                case 3:
+                    *destination++ = '%';
+                    *destination++ = HEX_DIGITS[value >> 4];
+                    *destination++ = HEX_DIGITS[value & 0x0F];
+                    break;
+                default:
+                    /*0x80-0xbf are encoded as c2 xx, 0xc0-0xff as c3 (xx - 0x40)*/
+                    *destination++ = '%';
+                    *destination++ = 'c';
+                    *destination++ = (value < 0xC0) ? '2' : '3';
+                    *destination++ = '%';
+                    *destination++ = HEX_DIGITS[(value < 0xC0) ? (value >> 4) : ((value >> 4) - 4)];
+                    *destination++ = HEX_DIGITS[value & 0x0F];
+                    break;
+            }
+            current++;
+        }
+    }
+    else
+    {
+        size_t length = strlen(text);
+        (void)memcpy(destination, text, length);
+        destination += length;
+    }
+    return destination;
+}
+
+static int get_hex_value(char c)
+{
+    int result;
+    if ((c >= '0') && (c <= '9'))
+    {
+        result = c - '0';
+    }
+    else if ((c >= 'a') && (c <= 'f'))
+    {
+        result = c - 'a' + 10;
+    }
+    else if ((c >= 'A') && (c <= 'F'))
+    {
+        result = c - 'A' + 10;
+    }
+    else
+    {
+        result = -1;
+    }
+    return result;
+}
+
+/* Writes text, '\0' terminated, decoding the "%xx" escapes when url_decode is true. Decoding never makes the text longer. */
+static char* write_decoded_text(char* destination, const char* text, size_t length, bool url_decode)
+{
+    char* result = destination;
+    if (!url_decode)
+    {
+        (void)memcpy(result, text, length);
+        result += length;
+    }
+    else
+    {
+        size_t index = 0;
+        while (index < length)
+        {
+            if (text[index] != '%')
+            {
+                *result++ = text[index];
+                index++;
+            }
+            else
+            {
+                int high;
+                int low;
+                if ((length - index < 3) || ((high = get_hex_value(text[index + 1])) < 0) || ((low = get_hex_value(text[index + 2])) < 0))
+                {
+                    LogError("Incomplete or invalid percent encoding");
+                    result = NULL;
+                    break;
+                }
+                *result++ = (char)((high << 4) | low);
+                index += 3;
+            }
+        }
+    }
+
+    if (result != NULL)
+    {
+        *result++ = '\0';
+    }
+    return result;
+}
+
+static int reserve(MQTT_TOPIC_BUFFER* topic_buffer, size_t additional_length)
+{
+    int result;
+    if (additional_length >= ((size_t)-1) - topic_buffer->length)
+    {
+        LogError("topic would not fit in a size_t");
+        result = __FAILURE__;
+    }
+    else if (topic_buffer->length + additional_length + 1 <= topic_buffer->capacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_009: [ When the topic does not fit in the buffer, the buffer shall be grown to the larger of twice its capacity and the size needed. ]*/
+        size_t needed = topic_buffer->length + additional_length + 1;
+        size_t new_capacity = (topic_buffer->capacity > ((size_t)-1) / 2) ? needed : topic_buffer->capacity * 2;
+        char* new_topic;
+        if (new_capacity < needed)
+        {
+            new_capacity = needed;
+        }
+
+        if ((new_topic = (char*)realloc(topic_buffer->topic, new_capacity)) == NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_010: [ If growing the buffer fails, the append shall fail, return a non-zero value and leave the topic unchanged. ]*/
+            LogError("Failed growing the topic buffer to %lu bytes", (unsigned long)new_capacity);
+            result = __FAILURE__;
+        }
+        else
+        {
+            topic_buffer->topic = new_topic;
+            topic_buffer->capacity = new_capacity;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int append_property(MQTT_TOPIC_BUFFER* topic_buffer, const char* name_prefix, const char* name, bool encode_name, const char* value, bool encode_value)
+{
+    int result;
+    if ((topic_buffer == NULL) || (topic_buffer->topic == NULL) || (name == NULL) || (value == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_006: [ If topic_buffer is NULL or not initialized, or name or value is NULL, the append functions shall fail and return a non-zero value. ]*/
+        LogError("Invalid argument (topic_buffer=%p, name=%p, value=%p)", topic_buffer, name, value);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_007: [ Every property but the first one after the prefix shall be preceded by "&". ]*/
+        bool needs_separator = (topic_buffer->length > topic_buffer->prefix_length);
+        size_t name_prefix_length = strlen(name_prefix);
+        size_t name_length = get_encoded_length(name, encode_name);
+        size_t value_length = get_encoded_length(value, encode_value);
+
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_008: [ The needed size shall be computed before anything is written, so that a property is added with at most one reallocation. ]*/
+        if ((name_length > ((size_t)-1) / 4) || (value_length > ((size_t)-1) / 4) ||
+            (reserve(topic_buffer, (needs_separator ? 1 : 0) + name_prefix_length + name_length + 1 + value_length) != 0))
+        {
+            LogError("Failed making room for property %s", name);
+            result = __FAILURE__;
+        }
+        else
+        {
+            char* destination = topic_buffer->topic + topic_buffer->length;
+            if (needs_separator)
+            {
+                *destination++ = '&';
+            }
+            (void)memcpy(destination, name_prefix, name_prefix_length);
+            destination += name_prefix_length;
+            destination = write_text(destination, name, encode_name);
+            *destination++ = '=';
+            destination = write_text(destination, value, encode_value);
+            *destination = '\0';
+            topic_buffer->length = destination - topic_buffer->topic;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int mqtt_topic_buffer_init(MQTT_TOPIC_BUFFER* topic_buffer, const char* prefix_begin, const char* device_id, const char* prefix_end)
+{
+    int result;
+    if ((topic_buffer == NULL) || (prefix_begin == NULL) || (device_id == NULL) || (prefix_end == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_001: [ If any argument is NULL, mqtt_topic_buffer_init shall fail and return a non-zero value. ]*/
+        LogError("Invalid argument (topic_buffer=%p, prefix_begin=%p, device_id=%p, prefix_end=%p)", topic_buffer, prefix_begin, device_id, prefix_end);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t prefix_begin_length = strlen(prefix_begin);
+        size_t device_id_length = strlen(device_id);
+        size_t prefix_end_length = strlen(prefix_end);
+        size_t capacity = prefix_begin_length + device_id_length + prefix_end_length + MQTT_TOPIC_INITIAL_PROPERTIES_SIZE + 1;
+
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_002: [ mqtt_topic_buffer_init shall allocate the buffer with room for the prefix and for MQTT_TOPIC_INITIAL_PROPERTIES_SIZE characters of properties. ]*/
+        if ((topic_buffer->topic = (char*)malloc(capacity)) == NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_003: [ If the allocation fails, mqtt_topic_buffer_init shall fail and return a non-zero value. ]*/
+            LogError("Failed allocating the topic buffer");
+            topic_buffer->length = topic_buffer->capacity = topic_buffer->prefix_length = 0;
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_004: [ mqtt_topic_buffer_init shall write prefix_begin + device_id + prefix_end as the prefix of the topic and return 0. ]*/
+            (void)memcpy(topic_buffer->topic, prefix_begin, prefix_begin_length);
+            (void)memcpy(topic_buffer->topic + prefix_begin_length, device_id, device_id_length);
+            (void)memcpy(topic_buffer->topic + prefix_begin_length + device_id_length, prefix_end, prefix_end_length + 1);
+            topic_buffer->capacity = capacity;
+            topic_buffer->length = topic_buffer->prefix_length = prefix_begin_length + device_id_length + prefix_end_length;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void mqtt_topic_buffer_deinit(MQTT_TOPIC_BUFFER* topic_buffer)
+{
+    if (topic_buffer != NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_011: [ mqtt_topic_buffer_deinit shall free the buffer, it may be called on a buffer whose init failed or that was zeroed. ]*/
+        free(topic_buffer->topic);
+        topic_buffer->topic = NULL;
+        topic_buffer->length = topic_buffer->capacity = topic_buffer->prefix_length = 0;
+    }
+}
+
+void mqtt_topic_buffer_reset(MQTT_TOPIC_BUFFER* topic_buffer)
+{
+    if ((topic_buffer != NULL) && (topic_buffer->topic != NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_005: [ mqtt_topic_buffer_reset shall truncate the topic back to its prefix without releasing any memory. ]*/
+        topic_buffer->length = topic_buffer->prefix_length;
+        topic_buffer->topic[topic_buffer->length] = '\0';
+    }
+}
+
+int mqtt_topic_buffer_append_property(MQTT_TOPIC_BUFFER* topic_buffer, const char* name, const char* value, bool url_encode)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_012: [ mqtt_topic_buffer_append_property shall append name + "=" + value, both URL encoded when url_encode is true. ]*/
+    return append_property(topic_buffer, "", name, url_encode, value, url_encode);
+}
+
+int mqtt_topic_buffer_append_system_property(MQTT_TOPIC_BUFFER* topic_buffer, const char* name, const char* value, bool url_encode)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_013: [ mqtt_topic_buffer_append_system_property shall append "%24." + name + "=" + value, only value being URL encoded when url_encode is true. ]*/
+    return append_property(topic_buffer, SYSTEM_PROPERTY_PREFIX, name, false, value, url_encode);
+}
+
+int mqtt_topic_buffer_append_url_encoded(MQTT_TOPIC_BUFFER* topic_buffer, const char* text)
+{
+    int result;
+    if ((topic_buffer == NULL) || (topic_buffer->topic == NULL) || (text == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_006: [ If topic_buffer is NULL or not initialized, or name or value is NULL, the append functions shall fail and return a non-zero value. ]*/
+        LogError("Invalid argument (topic_buffer=%p, text=%p)", topic_buffer, text);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t length = get_encoded_length(text, true);
+        if (reserve(topic_buffer, length) != 0)
+        {
+            LogError("Failed making room for the encoded text");
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_014: [ mqtt_topic_buffer_append_url_encoded shall append the URL encoded text, without any separator. ]*/
+            char* destination = write_text(topic_buffer->topic + topic_buffer->length, text, true);
+            *destination = '\0';
+            topic_buffer->length = destination - topic_buffer->topic;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int mqtt_topic_buffer_decode_property(MQTT_TOPIC_BUFFER* scratch, const MQTT_TOPIC_PROPERTY* property, bool decode_name, bool decode_value, MQTT_TOPIC_DECODED_PROPERTY* decoded)
+{
+    int result;
+    if ((scratch == NULL) || (scratch->topic == NULL) || (property == NULL) || (property->name == NULL) || (property->value == NULL) || (decoded == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_015: [ If scratch is NULL or not initialized, or property, its name or value, or decoded is NULL, mqtt_topic_buffer_decode_property shall fail and return a non-zero value. ]*/
+        LogError("Invalid argument (scratch=%p, property=%p, decoded=%p)", scratch, property, decoded);
+        result = __FAILURE__;
+    }
+    else if ((property->name_length > ((size_t)-1) / 4) || (property->value_length > ((size_t)-1) / 4))
+    {
+        LogError("Property does not fit in a size_t");
+        result = __FAILURE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_016: [ mqtt_topic_buffer_decode_property shall discard the previous content of scratch and make room for the name and value as received, growing the buffer at most once. ]*/
+        mqtt_topic_buffer_reset(scratch);
+        if (reserve(scratch, property->name_length + property->value_length + 1) != 0)
+        {
+            LogError("Failed making room for the decoded property");
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_017: [ mqtt_topic_buffer_decode_property shall copy the name and then the value in scratch, '\0' terminated, decoding the "%xx" escapes of those for which decode_name and decode_value are true. ]*/
+            char* name = scratch->topic + scratch->length;
+            char* value = write_decoded_text(name, property->name, property->name_length, decode_name);
+            char* end = (value == NULL) ? NULL : write_decoded_text(value, property->value, property->value_length, decode_value);
+            if (end == NULL)
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_018: [ If an escape is not followed by 2 hexadecimal digits, mqtt_topic_buffer_decode_property shall fail and return a non-zero value. ]*/
+                LogError("Failed decoding property");
+                mqtt_topic_buffer_reset(scratch);
+                result = __FAILURE__;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_019: [ On success mqtt_topic_buffer_decode_property shall point decoded at the copies, valid until scratch is used again, and return 0. ]*/
+                decoded->name = name;
+                decoded->value = value;
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
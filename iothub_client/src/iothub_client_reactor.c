@@ -0,0 +1,481 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "internal/iothub_client_timer_wheel.h"
+#include "iothub_client_reactor.h"
+
+#define REACTOR_MAX_EVENTS      64
+
+typedef struct CLIENT_REACTOR_TAG CLIENT_REACTOR;
+
+typedef struct CLIENT_REACTOR_REGISTRATION_TAG
+{
+    CLIENT_REACTOR* reactor;
+    IOTHUB_CLIENT_CORE_LL_HANDLE client;
+    int descriptor;
+    tickcounter_ms_t pollIntervalMs;
+    TIMER_WHEEL_ENTRY pollTimer;
+    bool signaled; /*guarded by readyLockHandle, true while the registration is in readyRegistrations*/
+    size_t lastPass; /*pass in which DoWork was last called, so it is called once per pass*/
+} CLIENT_REACTOR_REGISTRATION;
+
+typedef struct CLIENT_REACTOR_TAG
+{
+    int epollDescriptor;
+    int wakeDescriptor; /*eventfd written by IoTHubClientReactor_SignalClientReady*/
+    TICK_COUNTER_HANDLE tickCounter;
+    tickcounter_ms_t nowMs;
+    size_t pass;
+    TIMER_WHEEL pollWheel;
+    VECTOR_HANDLE registrations;
+    VECTOR_HANDLE readyRegistrations;
+    LOCK_HANDLE readyLockHandle; /*only guards readyRegistrations and the signaled flags*/
+} CLIENT_REACTOR;
+
+static bool find_registration(const void* element, const void* value)
+{
+    return *(const CLIENT_REACTOR_REGISTRATION* const*)element == (const CLIENT_REACTOR_REGISTRATION*)value;
+}
+
+static void do_work(CLIENT_REACTOR_REGISTRATION* registration)
+{
+    CLIENT_REACTOR* reactor = registration->reactor;
+
+    if (registration->lastPass != reactor->pass)
+    {
+        registration->lastPass = reactor->pass;
+        IoTHubClientCore_LL_DoWork(registration->client);
+    }
+
+    /*a client that just did work is polled again a full interval later*/
+    if (registration->pollIntervalMs != 0 &&
+        timer_wheel_start(&reactor->pollWheel, &registration->pollTimer, reactor->nowMs, registration->pollIntervalMs) != 0)
+    {
+        LogError("Could not re-arm the poll timer of client %p", registration->client);
+    }
+}
+
+static void on_poll_timer_expired(void* context)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_015: [ IoTHubClientReactor_RunOnce shall call IoTHubClientCore_LL_DoWork on every client whose poll interval elapsed since it last did work. ]*/
+    do_work((CLIENT_REACTOR_REGISTRATION*)context);
+}
+
+static VECTOR_HANDLE take_ready_registrations(CLIENT_REACTOR* reactor)
+{
+    VECTOR_HANDLE result;
+
+    if (Lock(reactor->readyLockHandle) != LOCK_OK)
+    {
+        LogError("Could not lock the ready clients");
+        result = NULL;
+    }
+    else
+    {
+        size_t count = VECTOR_size(reactor->readyRegistrations);
+        if (count == 0)
+        {
+            result = NULL;
+        }
+        else if ((result = VECTOR_move(reactor->readyRegistrations)) == NULL)
+        {
+            LogError("Could not take the ready clients");
+        }
+        else
+        {
+            size_t index;
+            for (index = 0; index < count; index++)
+            {
+                (*(CLIENT_REACTOR_REGISTRATION**)VECTOR_element(result, index))->signaled = false;
+            }
+        }
+        (void)Unlock(reactor->readyLockHandle);
+    }
+
+    return result;
+}
+
+static void destroy_registration(CLIENT_REACTOR_REGISTRATION* registration)
+{
+    CLIENT_REACTOR* reactor = registration->reactor;
+
+    timer_wheel_cancel(&reactor->pollWheel, &registration->pollTimer);
+    if (registration->descriptor != IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR &&
+        epoll_ctl(reactor->epollDescriptor, EPOLL_CTL_DEL, registration->descriptor, NULL) != 0)
+    {
+        LogError("Could not stop watching descriptor %d, errno %d", registration->descriptor, errno);
+    }
+    free(registration);
+}
+
+CLIENT_REACTOR_HANDLE IoTHubClientReactor_Create(void)
+{
+    CLIENT_REACTOR* result;
+
+    /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_001: [ IoTHubClientReactor_Create shall allocate the reactor, create an epoll instance watching an eventfd used for wake ups, a tick counter, the list of registrations and the ready list with its lock. ]*/
+    if ((result = (CLIENT_REACTOR*)malloc(sizeof(CLIENT_REACTOR))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_002: [ If any of them fails, IoTHubClientReactor_Create shall release everything it created and return NULL. ]*/
+        LogError("Reactor was not allocated.");
+    }
+    else if ((result->epollDescriptor = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        LogError("epoll_create1 failed, errno %d", errno);
+        free(result);
+        result = NULL;
+    }
+    else if ((result->wakeDescriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+    {
+        LogError("eventfd failed, errno %d", errno);
+        (void)close(result->epollDescriptor);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        struct epoll_event wakeEvent;
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = NULL;
+
+        if (epoll_ctl(result->epollDescriptor, EPOLL_CTL_ADD, result->wakeDescriptor, &wakeEvent) != 0)
+        {
+            LogError("Could not watch the wake descriptor, errno %d", errno);
+            (void)close(result->wakeDescriptor);
+            (void)close(result->epollDescriptor);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->tickCounter = tickcounter_create()) == NULL)
+        {
+            LogError("Reactor tick counter not created.");
+            (void)close(result->wakeDescriptor);
+            (void)close(result->epollDescriptor);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->registrations = VECTOR_create(sizeof(CLIENT_REACTOR_REGISTRATION*))) == NULL)
+        {
+            LogError("Reactor clients list not created.");
+            tickcounter_destroy(result->tickCounter);
+            (void)close(result->wakeDescriptor);
+            (void)close(result->epollDescriptor);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->readyRegistrations = VECTOR_create(sizeof(CLIENT_REACTOR_REGISTRATION*))) == NULL)
+        {
+            LogError("Reactor ready clients list not created.");
+            VECTOR_destroy(result->registrations);
+            tickcounter_destroy(result->tickCounter);
+            (void)close(result->wakeDescriptor);
+            (void)close(result->epollDescriptor);
+            free(result);
+            result = NULL;
+        }
+        else if ((result->readyLockHandle = Lock_Init()) == NULL)
+        {
+            LogError("Reactor ready clients Lock not created.");
+            VECTOR_destroy(result->readyRegistrations);
+            VECTOR_destroy(result->registrations);
+            tickcounter_destroy(result->tickCounter);
+            (void)close(result->wakeDescriptor);
+            (void)close(result->epollDescriptor);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->nowMs = 0;
+            result->pass = 0;
+            timer_wheel_init(&result->pollWheel);
+        }
+    }
+
+    return result;
+}
+
+void IoTHubClientReactor_Destroy(CLIENT_REACTOR_HANDLE reactor)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_003: [ If reactor is NULL, IoTHubClientReactor_Destroy shall do nothing. ]*/
+    if (reactor != NULL)
+    {
+        size_t index;
+        size_t count = VECTOR_size(reactor->registrations);
+
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_004: [ IoTHubClientReactor_Destroy shall free every registration still in the reactor, without destroying their clients, then release all the resources of the reactor. ]*/
+        for (index = 0; index < count; index++)
+        {
+            destroy_registration(*(CLIENT_REACTOR_REGISTRATION**)VECTOR_element(reactor->registrations, index));
+        }
+
+        timer_wheel_deinit(&reactor->pollWheel);
+        Lock_Deinit(reactor->readyLockHandle);
+        VECTOR_destroy(reactor->readyRegistrations);
+        VECTOR_destroy(reactor->registrations);
+        tickcounter_destroy(reactor->tickCounter);
+        (void)close(reactor->wakeDescriptor);
+        (void)close(reactor->epollDescriptor);
+        free(reactor);
+    }
+}
+
+CLIENT_REACTOR_REGISTRATION_HANDLE IoTHubClientReactor_AddClient(CLIENT_REACTOR_HANDLE reactor, IOTHUB_CLIENT_CORE_LL_HANDLE client, int descriptor, tickcounter_ms_t pollIntervalMs)
+{
+    CLIENT_REACTOR_REGISTRATION* result;
+
+    if (reactor == NULL || client == NULL || descriptor < IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_005: [ If reactor or client is NULL, or descriptor is negative and not IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, IoTHubClientReactor_AddClient shall return NULL. ]*/
+        LogError("Invalid argument, reactor [%p], client [%p], descriptor [%d].", reactor, client, descriptor);
+        result = NULL;
+    }
+    else if ((result = (CLIENT_REACTOR_REGISTRATION*)malloc(sizeof(CLIENT_REACTOR_REGISTRATION))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_008: [ If any step fails, IoTHubClientReactor_AddClient shall undo the previous ones and return NULL. ]*/
+        LogError("Reactor registration was not allocated.");
+    }
+    else
+    {
+        result->reactor = reactor;
+        result->client = client;
+        result->descriptor = descriptor;
+        result->pollIntervalMs = pollIntervalMs;
+        result->signaled = false;
+        result->lastPass = reactor->pass;
+        timer_wheel_entry_init(&result->pollTimer, on_poll_timer_expired, result);
+
+        if (descriptor != IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR)
+        {
+            struct epoll_event clientEvent;
+            clientEvent.events = EPOLLIN;
+            clientEvent.data.ptr = result;
+
+            /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_006: [ If descriptor is not IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, IoTHubClientReactor_AddClient shall add it to the epoll instance for input readiness. ]*/
+            if (epoll_ctl(reactor->epollDescriptor, EPOLL_CTL_ADD, descriptor, &clientEvent) != 0)
+            {
+                LogError("Could not watch descriptor %d, errno %d", descriptor, errno);
+                free(result);
+                result = NULL;
+            }
+        }
+
+        if (result != NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_007: [ IoTHubClientReactor_AddClient shall add the registration to the reactor and, if pollIntervalMs is not 0, arm its poll timer for the current time plus pollIntervalMs. ]*/
+            if (VECTOR_push_back(reactor->registrations, &result, 1) != 0)
+            {
+                LogError("Could not add the registration to the reactor.");
+                destroy_registration(result);
+                result = NULL;
+            }
+            else if (pollIntervalMs != 0 &&
+                (tickcounter_get_current_ms(reactor->tickCounter, &reactor->nowMs) != 0 ||
+                timer_wheel_start(&reactor->pollWheel, &result->pollTimer, reactor->nowMs, pollIntervalMs) != 0))
+            {
+                LogError("Could not arm the poll timer of client %p", client);
+                VECTOR_erase(reactor->registrations, VECTOR_back(reactor->registrations), 1);
+                destroy_registration(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+void IoTHubClientReactor_RemoveClient(CLIENT_REACTOR_HANDLE reactor, CLIENT_REACTOR_REGISTRATION_HANDLE registration)
+{
+    if (reactor == NULL || registration == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_009: [ If reactor or registration is NULL, IoTHubClientReactor_RemoveClient shall do nothing. ]*/
+        LogError("Invalid NULL argument, reactor [%p], registration [%p].", reactor, registration);
+    }
+    else
+    {
+        CLIENT_REACTOR_REGISTRATION** found = (CLIENT_REACTOR_REGISTRATION**)VECTOR_find_if(reactor->registrations, find_registration, registration);
+        if (found == NULL)
+        {
+            LogError("registration [%p] does not belong to this reactor.", registration);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_010: [ IoTHubClientReactor_RemoveClient shall remove the registration from the reactor and from the ready list, stop watching its descriptor, cancel its poll timer and free it. ]*/
+            VECTOR_erase(reactor->registrations, found, 1);
+
+            if (Lock(reactor->readyLockHandle) != LOCK_OK)
+            {
+                LogError("Could not lock the ready clients");
+            }
+            else
+            {
+                if (registration->signaled)
+                {
+                    CLIENT_REACTOR_REGISTRATION** ready = (CLIENT_REACTOR_REGISTRATION**)VECTOR_find_if(reactor->readyRegistrations, find_registration, registration);
+                    if (ready != NULL)
+                    {
+                        VECTOR_erase(reactor->readyRegistrations, ready, 1);
+                    }
+                }
+                (void)Unlock(reactor->readyLockHandle);
+            }
+
+            destroy_registration(registration);
+        }
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientReactor_SignalClientReady(CLIENT_REACTOR_HANDLE reactor, CLIENT_REACTOR_REGISTRATION_HANDLE registration)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (reactor == NULL || registration == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_011: [ If reactor or registration is NULL, IoTHubClientReactor_SignalClientReady shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("Invalid NULL argument, reactor [%p], registration [%p].", reactor, registration);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (Lock(reactor->readyLockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_013: [ If Lock, VECTOR_push_back or the write to the eventfd fails, IoTHubClientReactor_SignalClientReady shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("Could not lock the ready clients");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        bool wake = false;
+
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_012: [ IoTHubClientReactor_SignalClientReady shall add the registration to the ready list, unless it is already in it, and write to the eventfd of the reactor when it was added. ]*/
+        if (registration->signaled)
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (VECTOR_push_back(reactor->readyRegistrations, &registration, 1) != 0)
+        {
+            LogError("Could not add client to the ready list");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            registration->signaled = true;
+            wake = true;
+            result = IOTHUB_CLIENT_OK;
+        }
+        (void)Unlock(reactor->readyLockHandle);
+
+        if (wake)
+        {
+            uint64_t increment = 1;
+            if (write(reactor->wakeDescriptor, &increment, sizeof(increment)) != (ssize_t)sizeof(increment) && errno != EAGAIN)
+            {
+                LogError("Could not wake the reactor up, errno %d", errno);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientReactor_RunOnce(CLIENT_REACTOR_HANDLE reactor, tickcounter_ms_t maxWaitMs)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (reactor == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_014: [ If reactor is NULL, IoTHubClientReactor_RunOnce shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("NULL reactor");
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (tickcounter_get_current_ms(reactor->tickCounter, &reactor->nowMs) != 0)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_018: [ If reading the tick counter or epoll_wait fails, IoTHubClientReactor_RunOnce shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("Could not read the reactor tick counter");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        struct epoll_event events[REACTOR_MAX_EVENTS];
+        tickcounter_ms_t waitMs = maxWaitMs;
+        tickcounter_ms_t dueMs;
+        int eventCount;
+
+        /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_016: [ IoTHubClientReactor_RunOnce shall wait with epoll_wait for at most maxWaitMs, and no longer than until the next poll timer is due. ]*/
+        if (timer_wheel_get_next_due(&reactor->pollWheel, &dueMs))
+        {
+            tickcounter_ms_t untilDueMs = (dueMs > reactor->nowMs) ? dueMs - reactor->nowMs : 0;
+            if (untilDueMs < waitMs)
+            {
+                waitMs = untilDueMs;
+            }
+        }
+        if (waitMs > INT32_MAX)
+        {
+            waitMs = INT32_MAX;
+        }
+
+        eventCount = epoll_wait(reactor->epollDescriptor, events, REACTOR_MAX_EVENTS, (int)waitMs);
+        if (eventCount < 0 && errno != EINTR)
+        {
+            LogError("epoll_wait failed, errno %d", errno);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else if (tickcounter_get_current_ms(reactor->tickCounter, &reactor->nowMs) != 0)
+        {
+            LogError("Could not read the reactor tick counter");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            VECTOR_HANDLE ready;
+            int index;
+
+            /*Codes_SRS_IOTHUB_CLIENT_REACTOR_10_017: [ IoTHubClientReactor_RunOnce shall call IoTHubClientCore_LL_DoWork at most once per call on each client whose descriptor is readable or which was signaled ready. ]*/
+            reactor->pass++;
+
+            for (index = 0; index < eventCount; index++)
+            {
+                if (events[index].data.ptr == NULL)
+                {
+                    uint64_t signals;
+                    if (read(reactor->wakeDescriptor, &signals, sizeof(signals)) < 0 && errno != EAGAIN)
+                    {
+                        LogError("Could not reset the wake descriptor, errno %d", errno);
+                    }
+                }
+                else
+                {
+                    do_work((CLIENT_REACTOR_REGISTRATION*)events[index].data.ptr);
+                }
+            }
+
+            /*the ready list is taken after the eventfd was read, so a signal that comes later wakes the next call up*/
+            if ((ready = take_ready_registrations(reactor)) != NULL)
+            {
+                size_t readyCount = VECTOR_size(ready);
+                size_t readyIndex;
+                for (readyIndex = 0; readyIndex < readyCount; readyIndex++)
+                {
+                    do_work(*(CLIENT_REACTOR_REGISTRATION**)VECTOR_element(ready, readyIndex));
+                }
+                VECTOR_destroy(ready);
+            }
+
+            (void)timer_wheel_process(&reactor->pollWheel, reactor->nowMs);
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+
+    return result;
+}
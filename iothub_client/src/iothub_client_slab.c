@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_slab.h"
+
+/* Every record (and the block header) is padded to this so any structure can be stored in a slot */
+typedef union SLAB_ALIGNMENT_TAG
+{
+    void* pointer;
+    long long integer;
+    long double floating;
+    void(*function)(void);
+} SLAB_ALIGNMENT;
+
+typedef struct SLAB_FREE_ITEM_TAG
+{
+    struct SLAB_FREE_ITEM_TAG* next;
+} SLAB_FREE_ITEM;
+
+typedef union SLAB_BLOCK_TAG
+{
+    union SLAB_BLOCK_TAG* next;
+    SLAB_ALIGNMENT alignment;
+} SLAB_BLOCK;
+
+typedef struct SLAB_ALLOCATOR_TAG
+{
+    size_t item_stride;
+    size_t items_per_block;
+    SLAB_BLOCK* blocks;
+    SLAB_FREE_ITEM* free_items;
+    size_t items_in_use;
+} SLAB_ALLOCATOR;
+
+#define SLAB_ROUND_UP(value) ((((value) + sizeof(SLAB_ALIGNMENT) - 1) / sizeof(SLAB_ALIGNMENT)) * sizeof(SLAB_ALIGNMENT))
+
+static int add_block(SLAB_ALLOCATOR* slab_allocator)
+{
+    int result;
+    SLAB_BLOCK* block = (SLAB_BLOCK*)malloc(sizeof(SLAB_BLOCK) + (slab_allocator->item_stride * slab_allocator->items_per_block));
+
+    if (block == NULL)
+    {
+        LogError("Failed allocating slab block");
+        result = __FAILURE__;
+    }
+    else
+    {
+        unsigned char* item = (unsigned char*)(block + 1);
+        size_t index;
+
+        block->next = slab_allocator->blocks;
+        slab_allocator->blocks = block;
+
+        for (index = 0; index < slab_allocator->items_per_block; index++)
+        {
+            SLAB_FREE_ITEM* free_item = (SLAB_FREE_ITEM*)item;
+            free_item->next = slab_allocator->free_items;
+            slab_allocator->free_items = free_item;
+            item += slab_allocator->item_stride;
+        }
+
+        result = 0;
+    }
+
+    return result;
+}
+
+SLAB_ALLOCATOR_HANDLE slab_allocator_create(size_t item_size, size_t items_per_block)
+{
+    SLAB_ALLOCATOR* result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_001: [ If `item_size` or `items_per_block` are 0, or a block would not fit in a size_t, `slab_allocator_create` shall fail and return NULL. ] */
+    if (item_size == 0 || items_per_block == 0 ||
+        item_size > SIZE_MAX - sizeof(SLAB_ALIGNMENT) ||
+        items_per_block > (SIZE_MAX - sizeof(SLAB_BLOCK)) / SLAB_ROUND_UP(item_size))
+    {
+        LogError("Invalid argument (item_size=%lu, items_per_block=%lu)", (unsigned long)item_size, (unsigned long)items_per_block);
+        result = NULL;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_002: [ If allocating the allocator fails, `slab_allocator_create` shall fail and return NULL. ] */
+    else if ((result = (SLAB_ALLOCATOR*)malloc(sizeof(SLAB_ALLOCATOR))) == NULL)
+    {
+        LogError("Failed allocating slab allocator");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_003: [ `slab_allocator_create` shall not allocate any block, the first one is allocated by the first call to `slab_allocator_alloc`. ] */
+        result->item_stride = SLAB_ROUND_UP(item_size < sizeof(SLAB_FREE_ITEM) ? sizeof(SLAB_FREE_ITEM) : item_size);
+        result->items_per_block = items_per_block;
+        result->blocks = NULL;
+        result->free_items = NULL;
+        result->items_in_use = 0;
+    }
+
+    return result;
+}
+
+void slab_allocator_destroy(SLAB_ALLOCATOR_HANDLE slab_allocator)
+{
+    if (slab_allocator == NULL)
+    {
+        LogError("Invalid argument (slab_allocator is NULL)");
+    }
+    else
+    {
+        if (slab_allocator->items_in_use != 0)
+        {
+            LogError("Destroying slab allocator with %lu records still in use", (unsigned long)slab_allocator->items_in_use);
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_004: [ `slab_allocator_destroy` shall free all the blocks of `slab_allocator` and the allocator itself. ] */
+        while (slab_allocator->blocks != NULL)
+        {
+            SLAB_BLOCK* block = slab_allocator->blocks;
+            slab_allocator->blocks = block->next;
+            free(block);
+        }
+
+        free(slab_allocator);
+    }
+}
+
+void* slab_allocator_alloc(SLAB_ALLOCATOR_HANDLE slab_allocator)
+{
+    void* result;
+
+    if (slab_allocator == NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_005: [ If `slab_allocator` is NULL, `slab_allocator_alloc` shall return NULL. ] */
+        LogError("Invalid argument (slab_allocator is NULL)");
+        result = NULL;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_006: [ If there is no free record, `slab_allocator_alloc` shall allocate a new block of `items_per_block` records. ] */
+    /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_007: [ If allocating the block fails, `slab_allocator_alloc` shall return NULL. ] */
+    else if (slab_allocator->free_items == NULL && add_block(slab_allocator) != 0)
+    {
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_008: [ `slab_allocator_alloc` shall return a free record of at least `item_size` bytes, suitably aligned for any type. ] */
+        SLAB_FREE_ITEM* free_item = slab_allocator->free_items;
+        slab_allocator->free_items = free_item->next;
+        slab_allocator->items_in_use++;
+        result = free_item;
+    }
+
+    return result;
+}
+
+void slab_allocator_free(SLAB_ALLOCATOR_HANDLE slab_allocator, void* item)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_009: [ If `slab_allocator` or `item` are NULL, `slab_allocator_free` shall do nothing. ] */
+    if (slab_allocator == NULL || item == NULL)
+    {
+        LogError("Invalid argument (slab_allocator=%p, item=%p)", slab_allocator, item);
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_SLAB_10_010: [ `slab_allocator_free` shall return `item` to the free records of `slab_allocator`, to be reused by the next `slab_allocator_alloc`. ] */
+        SLAB_FREE_ITEM* free_item = (SLAB_FREE_ITEM*)item;
+        free_item->next = slab_allocator->free_items;
+        slab_allocator->free_items = free_item;
+        slab_allocator->items_in_use--;
+    }
+}
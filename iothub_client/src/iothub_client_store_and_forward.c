@@ -0,0 +1,464 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/map.h"
+#include "internal/iothub_client_journal.h"
+#include "internal/iothub_client_store_and_forward.h"
+
+/* Record layout (little endian):
+   u8 version, u8 body type (IOTHUBMESSAGE_CONTENT_TYPE), u32 body size + body,
+   message id, correlation id, content type, content encoding as strings,
+   u32 property count + key/value strings.
+   Strings are stored as u32 size + characters + '\0' (NULL strings have the size STORE_AND_FORWARD_NULL_STRING),
+   so they can be used in place from the mapped journal. */
+#define STORE_AND_FORWARD_RECORD_VERSION    1
+#define STORE_AND_FORWARD_NULL_STRING       0xFFFFFFFF
+
+typedef struct STORE_AND_FORWARD_TAG
+{
+    MESSAGE_JOURNAL_HANDLE journal;
+    unsigned char* buffer; /* reused to serialize every message */
+    size_t buffer_size;
+} STORE_AND_FORWARD;
+
+typedef struct RECORD_READER_TAG
+{
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+} RECORD_READER;
+
+typedef struct PENDING_CONTEXT_TAG
+{
+    STORE_AND_FORWARD_ON_PENDING_MESSAGE on_pending_message;
+    void* context;
+} PENDING_CONTEXT;
+
+static size_t get_string_size(const char* value)
+{
+    return 4 + ((value == NULL) ? 0 : strlen(value) + 1);
+}
+
+static unsigned char* write_u32(unsigned char* position, uint32_t value)
+{
+    position[0] = (unsigned char)(value & 0xFF);
+    position[1] = (unsigned char)((value >> 8) & 0xFF);
+    position[2] = (unsigned char)((value >> 16) & 0xFF);
+    position[3] = (unsigned char)((value >> 24) & 0xFF);
+    return position + 4;
+}
+
+static unsigned char* write_string(unsigned char* position, const char* value)
+{
+    unsigned char* result;
+
+    if (value == NULL)
+    {
+        result = write_u32(position, STORE_AND_FORWARD_NULL_STRING);
+    }
+    else
+    {
+        size_t length = strlen(value);
+        result = write_u32(position, (uint32_t)length);
+        (void)memcpy(result, value, length + 1);
+        result += length + 1;
+    }
+
+    return result;
+}
+
+static int read_u32(RECORD_READER* reader, uint32_t* value)
+{
+    int result;
+
+    if (reader->size - reader->offset < 4)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        const unsigned char* position = reader->data + reader->offset;
+        *value = (uint32_t)position[0] | ((uint32_t)position[1] << 8) | ((uint32_t)position[2] << 16) | ((uint32_t)position[3] << 24);
+        reader->offset += 4;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int read_string(RECORD_READER* reader, const char** value)
+{
+    int result;
+    uint32_t length;
+
+    if (read_u32(reader, &length) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else if (length == STORE_AND_FORWARD_NULL_STRING)
+    {
+        *value = NULL;
+        result = 0;
+    }
+    else if ((reader->size - reader->offset <= length) ||
+        (reader->data[reader->offset + length] != '\0'))
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        *value = (const char*)(reader->data + reader->offset);
+        reader->offset += (size_t)length + 1;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int serialize_message(STORE_AND_FORWARD* store, IOTHUB_MESSAGE_HANDLE message, size_t* size)
+{
+    int result;
+    IOTHUBMESSAGE_CONTENT_TYPE content_type = IoTHubMessage_GetContentType(message);
+    const unsigned char* body = NULL;
+    size_t body_size = 0;
+    const char* message_id = IoTHubMessage_GetMessageId(message);
+    const char* correlation_id = IoTHubMessage_GetCorrelationId(message);
+    const char* content_type_property = IoTHubMessage_GetContentTypeSystemProperty(message);
+    const char* content_encoding = IoTHubMessage_GetContentEncodingSystemProperty(message);
+    MAP_HANDLE properties = IoTHubMessage_Properties(message);
+    const char* const* keys = NULL;
+    const char* const* values = NULL;
+    size_t property_count = 0;
+
+    if (content_type == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        result = (IoTHubMessage_GetByteArray(message, &body, &body_size) == IOTHUB_MESSAGE_OK) ? 0 : __FAILURE__;
+    }
+    else if (content_type == IOTHUBMESSAGE_STRING)
+    {
+        body = (const unsigned char*)IoTHubMessage_GetString(message);
+        body_size = (body == NULL) ? 0 : strlen((const char*)body);
+        result = (body == NULL) ? __FAILURE__ : 0;
+    }
+    else
+    {
+        result = __FAILURE__;
+    }
+
+    if (result != 0)
+    {
+        LogError("Failed getting the body of the message");
+    }
+    else if ((properties != NULL) && (Map_GetInternals(properties, &keys, &values, &property_count) != MAP_OK))
+    {
+        LogError("Failed getting the properties of the message");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+        size_t record_size = 2 + 4 + body_size +
+            get_string_size(message_id) + get_string_size(correlation_id) + get_string_size(content_type_property) + get_string_size(content_encoding) + 4;
+
+        for (index = 0; index < property_count; index++)
+        {
+            record_size += get_string_size(keys[index]) + get_string_size(values[index]);
+        }
+
+        if (record_size > store->buffer_size)
+        {
+            unsigned char* new_buffer = (unsigned char*)realloc(store->buffer, record_size);
+            if (new_buffer == NULL)
+            {
+                LogError("Failed growing the serialization buffer to %lu bytes", (unsigned long)record_size);
+                result = __FAILURE__;
+            }
+            else
+            {
+                store->buffer = new_buffer;
+                store->buffer_size = record_size;
+            }
+        }
+
+        if (result == 0)
+        {
+            unsigned char* position = store->buffer;
+
+            *position++ = STORE_AND_FORWARD_RECORD_VERSION;
+            *position++ = (unsigned char)content_type;
+            position = write_u32(position, (uint32_t)body_size);
+            if (body_size > 0)
+            {
+                (void)memcpy(position, body, body_size);
+                position += body_size;
+            }
+            position = write_string(position, message_id);
+            position = write_string(position, correlation_id);
+            position = write_string(position, content_type_property);
+            position = write_string(position, content_encoding);
+            position = write_u32(position, (uint32_t)property_count);
+            for (index = 0; index < property_count; index++)
+            {
+                position = write_string(position, keys[index]);
+                position = write_string(position, values[index]);
+            }
+
+            *size = record_size;
+        }
+    }
+
+    return result;
+}
+
+static IOTHUB_MESSAGE_HANDLE deserialize_message(const unsigned char* data, size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    RECORD_READER reader;
+    uint32_t body_size;
+    char* body_string = NULL;
+
+    reader.data = data;
+    reader.size = size;
+    reader.offset = 2;
+
+    if ((size < 2) || (data[0] != STORE_AND_FORWARD_RECORD_VERSION) ||
+        (read_u32(&reader, &body_size) != 0) || (reader.size - reader.offset < body_size))
+    {
+        LogError("Invalid store and forward record");
+        result = NULL;
+    }
+    else if (data[1] == (unsigned char)IOTHUBMESSAGE_BYTEARRAY)
+    {
+        result = IoTHubMessage_CreateFromByteArray(data + reader.offset, body_size);
+    }
+    else if ((data[1] == (unsigned char)IOTHUBMESSAGE_STRING) &&
+        ((body_string = (char*)malloc((size_t)body_size + 1)) != NULL))
+    {
+        (void)memcpy(body_string, data + reader.offset, body_size);
+        body_string[body_size] = '\0';
+        result = IoTHubMessage_CreateFromString(body_string);
+        free(body_string);
+    }
+    else
+    {
+        LogError("Failed restoring the body of the message");
+        result = NULL;
+    }
+
+    if (result != NULL)
+    {
+        const char* message_id;
+        const char* correlation_id;
+        const char* content_type;
+        const char* content_encoding;
+        uint32_t property_count;
+        uint32_t index;
+
+        reader.offset += body_size;
+
+        if ((read_string(&reader, &message_id) != 0) ||
+            (read_string(&reader, &correlation_id) != 0) ||
+            (read_string(&reader, &content_type) != 0) ||
+            (read_string(&reader, &content_encoding) != 0) ||
+            (read_u32(&reader, &property_count) != 0) ||
+            ((message_id != NULL) && (IoTHubMessage_SetMessageId(result, message_id) != IOTHUB_MESSAGE_OK)) ||
+            ((correlation_id != NULL) && (IoTHubMessage_SetCorrelationId(result, correlation_id) != IOTHUB_MESSAGE_OK)) ||
+            ((content_type != NULL) && (IoTHubMessage_SetContentTypeSystemProperty(result, content_type) != IOTHUB_MESSAGE_OK)) ||
+            ((content_encoding != NULL) && (IoTHubMessage_SetContentEncodingSystemProperty(result, content_encoding) != IOTHUB_MESSAGE_OK)))
+        {
+            LogError("Failed restoring the system properties of the message");
+            IoTHubMessage_Destroy(result);
+            result = NULL;
+        }
+        else
+        {
+            for (index = 0; index < property_count; index++)
+            {
+                const char* key;
+                const char* value;
+
+                if ((read_string(&reader, &key) != 0) ||
+                    (read_string(&reader, &value) != 0) ||
+                    (key == NULL) || (value == NULL) ||
+                    (IoTHubMessage_SetProperty(result, key, value) != IOTHUB_MESSAGE_OK))
+                {
+                    LogError("Failed restoring the properties of the message");
+                    IoTHubMessage_Destroy(result);
+                    result = NULL;
+                    break;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+static void on_pending_record(uint64_t sequence, const unsigned char* data, size_t size, void* context)
+{
+    PENDING_CONTEXT* pending_context = (PENDING_CONTEXT*)context;
+    (void)data;
+    (void)size;
+    pending_context->on_pending_message(sequence, pending_context->context);
+}
+
+STORE_AND_FORWARD_HANDLE store_and_forward_create(const char* directory, size_t segment_size, size_t sync_batch)
+{
+    STORE_AND_FORWARD* result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_001: [ If `directory` is NULL, `store_and_forward_create` shall fail and return NULL. ] */
+    if (directory == NULL)
+    {
+        LogError("Invalid argument (directory is NULL)");
+        result = NULL;
+    }
+    else if ((result = (STORE_AND_FORWARD*)malloc(sizeof(STORE_AND_FORWARD))) == NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_002: [ If any failure occurs, `store_and_forward_create` shall fail and return NULL. ] */
+        LogError("Failed allocating store and forward");
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_003: [ `store_and_forward_create` shall open the message journal in `directory` with `segment_size` and `sync_batch`. ] */
+    else if ((result->journal = message_journal_open(directory, segment_size, sync_batch)) == NULL)
+    {
+        LogError("Failed opening the message journal in %s", directory);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        result->buffer = NULL;
+        result->buffer_size = 0;
+    }
+
+    return result;
+}
+
+void store_and_forward_destroy(STORE_AND_FORWARD_HANDLE store)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_004: [ `store_and_forward_destroy` shall close the message journal, keeping the pending messages, and free the store. ] */
+    if (store != NULL)
+    {
+        message_journal_close(store->journal);
+        free(store->buffer);
+        free(store);
+    }
+}
+
+int store_and_forward_save(STORE_AND_FORWARD_HANDLE store, IOTHUB_MESSAGE_HANDLE message, uint64_t* sequence)
+{
+    int result;
+    size_t size;
+
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_005: [ If `store`, `message` or `sequence` are NULL, `store_and_forward_save` shall fail and return a non-zero value. ] */
+    if ((store == NULL) || (message == NULL) || (sequence == NULL))
+    {
+        LogError("Invalid argument (store=%p, message=%p, sequence=%p)", store, message, sequence);
+        result = __FAILURE__;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_006: [ `store_and_forward_save` shall serialize the body, message id, correlation id, content type, content encoding and properties of `message`. ] */
+    else if (serialize_message(store, message, &size) != 0)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_007: [ If any failure occurs, `store_and_forward_save` shall fail and return a non-zero value. ] */
+        result = __FAILURE__;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_008: [ `store_and_forward_save` shall append the serialized message to the journal and return its sequence number in `sequence`. ] */
+    else if (message_journal_append(store->journal, store->buffer, size, sequence) != 0)
+    {
+        LogError("Failed appending the message to the journal");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+IOTHUB_MESSAGE_HANDLE store_and_forward_load(STORE_AND_FORWARD_HANDLE store, uint64_t sequence)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    const unsigned char* data;
+    size_t size;
+
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_009: [ If `store` is NULL, `store_and_forward_load` shall fail and return NULL. ] */
+    if (store == NULL)
+    {
+        LogError("Invalid argument (store is NULL)");
+        result = NULL;
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_010: [ If reading the record `sequence` from the journal fails, `store_and_forward_load` shall fail and return NULL. ] */
+    else if (message_journal_read(store->journal, sequence, &data, &size) != 0)
+    {
+        LogError("Failed reading message %lu from the journal", (unsigned long)sequence);
+        result = NULL;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_011: [ `store_and_forward_load` shall create a new message with the body, message id, correlation id, content type, content encoding and properties of the record. ] */
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_012: [ If the record cannot be decoded or restoring the message fails, `store_and_forward_load` shall fail and return NULL. ] */
+        result = deserialize_message(data, size);
+    }
+
+    return result;
+}
+
+void store_and_forward_remove(STORE_AND_FORWARD_HANDLE store, uint64_t sequence)
+{
+    if (store == NULL)
+    {
+        LogError("Invalid argument (store is NULL)");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_013: [ `store_and_forward_remove` shall acknowledge the record `sequence` in the journal. ] */
+        message_journal_acknowledge(store->journal, sequence);
+    }
+}
+
+int store_and_forward_get_pending(STORE_AND_FORWARD_HANDLE store, STORE_AND_FORWARD_ON_PENDING_MESSAGE on_pending_message, void* context)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_014: [ If `store` or `on_pending_message` are NULL, `store_and_forward_get_pending` shall fail and return a non-zero value. ] */
+    if ((store == NULL) || (on_pending_message == NULL))
+    {
+        LogError("Invalid argument (store=%p, on_pending_message=%p)", store, on_pending_message);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_015: [ `store_and_forward_get_pending` shall call `on_pending_message` with the sequence number of every message in the journal not removed yet, oldest first. ] */
+        PENDING_CONTEXT pending_context;
+        pending_context.on_pending_message = on_pending_message;
+        pending_context.context = context;
+
+        result = (message_journal_for_each_pending(store->journal, on_pending_record, &pending_context) == 0) ? 0 : __FAILURE__;
+    }
+
+    return result;
+}
+
+int store_and_forward_flush(STORE_AND_FORWARD_HANDLE store)
+{
+    int result;
+
+    if (store == NULL)
+    {
+        LogError("Invalid argument (store is NULL)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_016: [ `store_and_forward_flush` shall sync the journal and return 0 on success, a non-zero value otherwise. ] */
+        result = (message_journal_sync(store->journal) == 0) ? 0 : __FAILURE__;
+    }
+
+    return result;
+}
@@ -0,0 +1,333 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_timer_wheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK       ((tickcounter_ms_t)(TIMER_WHEEL_SLOTS - 1))
+#define TIMER_WHEEL_LEVEL_SHIFT(level)  ((level) * TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_RANGE_MS        ((tickcounter_ms_t)1 << TIMER_WHEEL_LEVEL_SHIFT(TIMER_WHEEL_LEVELS))
+
+static void link_timer(TIMER_WHEEL_ENTRY** head, TIMER_WHEEL_ENTRY* timer)
+{
+    timer->next = *head;
+    if (timer->next != NULL)
+    {
+        timer->next->prev_next = &timer->next;
+    }
+    timer->prev_next = head;
+    *head = timer;
+}
+
+static void unlink_timer(TIMER_WHEEL_ENTRY* timer)
+{
+    *timer->prev_next = timer->next;
+    if (timer->next != NULL)
+    {
+        timer->next->prev_next = timer->prev_next;
+    }
+    timer->next = NULL;
+    timer->prev_next = NULL;
+}
+
+static TIMER_WHEEL_ENTRY** get_slot(TIMER_WHEEL* timer_wheel, tickcounter_ms_t expires_at)
+{
+    TIMER_WHEEL_ENTRY** result;
+    tickcounter_ms_t current_ms = timer_wheel->current_ms;
+
+    if (expires_at < current_ms)
+    {
+        /* Already due, fires on the next tick */
+        result = &timer_wheel->slots[0][current_ms & TIMER_WHEEL_SLOT_MASK];
+    }
+    else
+    {
+        tickcounter_ms_t delta = expires_at - current_ms;
+        size_t level;
+
+        if (delta >= TIMER_WHEEL_RANGE_MS)
+        {
+            /* Beyond the reach of the wheel: park it in the farthest slot, it is placed again
+               (keeping its real expiry) when that slot cascades */
+            expires_at = current_ms + TIMER_WHEEL_RANGE_MS - 1;
+            delta = TIMER_WHEEL_RANGE_MS - 1;
+        }
+
+        for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+        {
+            if (delta < ((tickcounter_ms_t)1 << TIMER_WHEEL_LEVEL_SHIFT(level + 1)))
+            {
+                break;
+            }
+        }
+
+        result = &timer_wheel->slots[level][(expires_at >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK];
+    }
+
+    return result;
+}
+
+static size_t cascade(TIMER_WHEEL* timer_wheel, size_t level, size_t index)
+{
+    TIMER_WHEEL_ENTRY* pending = timer_wheel->slots[level][index];
+
+    if (pending != NULL)
+    {
+        pending->prev_next = &pending;
+        timer_wheel->slots[level][index] = NULL;
+
+        while (pending != NULL)
+        {
+            TIMER_WHEEL_ENTRY* timer = pending;
+            unlink_timer(timer);
+            link_timer(get_slot(timer_wheel, timer->expires_at), timer);
+        }
+    }
+
+    return index;
+}
+
+void timer_wheel_init(TIMER_WHEEL* timer_wheel)
+{
+    if (timer_wheel == NULL)
+    {
+        LogError("Invalid argument (timer_wheel is NULL)");
+    }
+    else
+    {
+        size_t level;
+        size_t index;
+
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_001: [ `timer_wheel_init` shall initialize all the slots of `timer_wheel` as empty. ] */
+        for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            for (index = 0; index < TIMER_WHEEL_SLOTS; index++)
+            {
+                timer_wheel->slots[level][index] = NULL;
+            }
+        }
+        timer_wheel->current_ms = 0;
+        timer_wheel->armed_count = 0;
+    }
+}
+
+void timer_wheel_deinit(TIMER_WHEEL* timer_wheel)
+{
+    if (timer_wheel == NULL)
+    {
+        LogError("Invalid argument (timer_wheel is NULL)");
+    }
+    else
+    {
+        size_t level;
+        size_t index;
+
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_002: [ `timer_wheel_deinit` shall disarm all the timers still in `timer_wheel` without invoking their callbacks. ] */
+        for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            for (index = 0; index < TIMER_WHEEL_SLOTS; index++)
+            {
+                while (timer_wheel->slots[level][index] != NULL)
+                {
+                    unlink_timer(timer_wheel->slots[level][index]);
+                }
+            }
+        }
+        timer_wheel->armed_count = 0;
+    }
+}
+
+void timer_wheel_entry_init(TIMER_WHEEL_ENTRY* timer, ON_TIMER_WHEEL_EXPIRED on_expired, void* context)
+{
+    if (timer == NULL)
+    {
+        LogError("Invalid argument (timer is NULL)");
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_003: [ `timer_wheel_entry_init` shall save `on_expired` and `context` into `timer` and mark it as not armed. ] */
+        timer->next = NULL;
+        timer->prev_next = NULL;
+        timer->expires_at = 0;
+        timer->on_expired = on_expired;
+        timer->context = context;
+    }
+}
+
+int timer_wheel_start(TIMER_WHEEL* timer_wheel, TIMER_WHEEL_ENTRY* timer, tickcounter_ms_t now_ms, tickcounter_ms_t timeout_ms)
+{
+    int result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_004: [ If `timer_wheel`, `timer` or the callback of `timer` are NULL, `timer_wheel_start` shall fail and return a non-zero value. ] */
+    if (timer_wheel == NULL || timer == NULL || timer->on_expired == NULL)
+    {
+        LogError("Invalid argument (timer_wheel=%p, timer=%p)", timer_wheel, timer);
+        result = __FAILURE__;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_005: [ If `timer` is already armed, `timer_wheel_start` shall remove it from the wheel before re-arming it. ] */
+        if (timer->prev_next != NULL)
+        {
+            unlink_timer(timer);
+            timer_wheel->armed_count--;
+        }
+
+        if (timer_wheel->armed_count == 0)
+        {
+            /* Nothing is pending, the wheel can be moved to the caller's clock */
+            timer_wheel->current_ms = now_ms;
+        }
+
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_006: [ `timer_wheel_start` shall arm `timer` to expire at `now_ms` + `timeout_ms` and return 0. ] */
+        timer->expires_at = now_ms + timeout_ms;
+        link_timer(get_slot(timer_wheel, timer->expires_at), timer);
+        timer_wheel->armed_count++;
+        result = 0;
+    }
+
+    return result;
+}
+
+void timer_wheel_cancel(TIMER_WHEEL* timer_wheel, TIMER_WHEEL_ENTRY* timer)
+{
+    if (timer_wheel == NULL || timer == NULL)
+    {
+        LogError("Invalid argument (timer_wheel=%p, timer=%p)", timer_wheel, timer);
+    }
+    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_008: [ If `timer` is not armed, `timer_wheel_cancel` shall do nothing. ] */
+    else if (timer->prev_next != NULL)
+    {
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_007: [ If `timer` is armed, `timer_wheel_cancel` shall remove it from `timer_wheel` so its callback is never invoked. ] */
+        unlink_timer(timer);
+        timer_wheel->armed_count--;
+    }
+}
+
+bool timer_wheel_is_armed(const TIMER_WHEEL_ENTRY* timer)
+{
+    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_009: [ `timer_wheel_is_armed` shall return true if `timer` is armed and false otherwise. ] */
+    return (timer != NULL && timer->prev_next != NULL);
+}
+
+size_t timer_wheel_process(TIMER_WHEEL* timer_wheel, tickcounter_ms_t now_ms)
+{
+    size_t result = 0;
+
+    if (timer_wheel == NULL)
+    {
+        LogError("Invalid argument (timer_wheel is NULL)");
+    }
+    else
+    {
+        while (timer_wheel->current_ms <= now_ms)
+        {
+            size_t index;
+            TIMER_WHEEL_ENTRY* expired;
+
+            if (timer_wheel->armed_count == 0)
+            {
+                timer_wheel->current_ms = now_ms + 1;
+                break;
+            }
+
+            index = (size_t)(timer_wheel->current_ms & TIMER_WHEEL_SLOT_MASK);
+            if (index != 0 && timer_wheel->slots[0][index] == NULL)
+            {
+                /* Skip empty level 0 slots up to the next occupied one or the next cascade */
+                tickcounter_ms_t next_ms;
+                size_t next_index = index + 1;
+
+                while (next_index < TIMER_WHEEL_SLOTS && timer_wheel->slots[0][next_index] == NULL)
+                {
+                    next_index++;
+                }
+
+                next_ms = timer_wheel->current_ms + (next_index - index);
+                timer_wheel->current_ms = (next_ms > now_ms) ? now_ms + 1 : next_ms;
+                continue;
+            }
+
+            if (index == 0)
+            {
+                size_t level;
+                for (level = 1; level < TIMER_WHEEL_LEVELS; level++)
+                {
+                    if (cascade(timer_wheel, level, (size_t)((timer_wheel->current_ms >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK)) != 0)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_011: [ A timer shall be disarmed before its callback is invoked, callbacks may start or cancel any timer of `timer_wheel`. ] */
+            /* The slot is detached before any callback runs, so timers of this batch can be
+               cancelled or re-armed by the callbacks of the ones fired before them */
+            expired = timer_wheel->slots[0][index];
+            timer_wheel->slots[0][index] = NULL;
+            timer_wheel->current_ms++;
+
+            if (expired != NULL)
+            {
+                expired->prev_next = &expired;
+            }
+
+            while (expired != NULL)
+            {
+                TIMER_WHEEL_ENTRY* timer = expired;
+                unlink_timer(timer);
+
+                if (timer->expires_at >= timer_wheel->current_ms)
+                {
+                    link_timer(get_slot(timer_wheel, timer->expires_at), timer);
+                }
+                else
+                {
+                    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ] */
+                    timer_wheel->armed_count--;
+                    timer->on_expired(timer->context);
+                    result++;
+                }
+            }
+        }
+    }
+
+    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_012: [ `timer_wheel_process` shall return the number of callbacks invoked. ] */
+    return result;
+}
+
+bool timer_wheel_get_next_due(const TIMER_WHEEL* timer_wheel, tickcounter_ms_t* due_ms)
+{
+    bool result;
+
+    /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_013: [ If `timer_wheel` or `due_ms` is NULL, or no timer is armed, `timer_wheel_get_next_due` shall return false. ] */
+    if (timer_wheel == NULL || due_ms == NULL)
+    {
+        LogError("Invalid argument (timer_wheel=%p, due_ms=%p)", timer_wheel, due_ms);
+        result = false;
+    }
+    else if (timer_wheel->armed_count == 0)
+    {
+        result = false;
+    }
+    else
+    {
+        size_t index = (size_t)(timer_wheel->current_ms & TIMER_WHEEL_SLOT_MASK);
+        size_t next_index = index;
+
+        /* Codes_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_014: [ Otherwise `timer_wheel_get_next_due` shall set `due_ms` to a time no later than the expiration of the earliest armed timer and return true; it is the time of the first occupied level 0 slot, or the time of the next cascade if there is none before it. ] */
+        /* Timers of the higher levels, and level 0 timers of the next lap, only become due after the
+           cascade that happens when the level 0 index wraps, so that is the latest time to come back */
+        while (next_index < TIMER_WHEEL_SLOTS && timer_wheel->slots[0][next_index] == NULL)
+        {
+            next_index++;
+        }
+
+        *due_ms = timer_wheel->current_ms + (next_index - index);
+        result = true;
+    }
+
+    return result;
+}
@@ -29,6 +29,8 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
     char* userDefinedContentType;
     char* contentEncoding;
     IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA_HANDLE diagnosticData;
+    IOTHUB_MESSAGE_PRIORITY priority;
+    IOTHUB_MESSAGE_DELIVERY delivery;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
 static bool ContainsOnlyUsAscii(const char* asciiValue)
@@ -272,6 +274,10 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
         {
             memset(result, 0, sizeof(*result));
             result->contentType = source->contentType;
+            /*Codes_SRS_IOTHUBMESSAGE_10_011: [IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle.]*/
+            result->priority = source->priority;
+            /*Codes_SRS_IOTHUBMESSAGE_10_016: [IoTHubMessage_Clone shall copy the delivery of iotHubMessageHandle.]*/
+            result->delivery = source->delivery;
 
             if (source->messageId != NULL && mallocAndStrcpy_s(&result->messageId, source->messageId) != 0)
             {
@@ -705,6 +711,86 @@ const char* IoTHubMessage_GetContentEncodingSystemProperty(IOTHUB_MESSAGE_HANDLE
     return result;
 }
 
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_RESULT result;
+
+    // Codes_SRS_IOTHUBMESSAGE_10_007: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY then IoTHubMessage_SetPriority shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+    if ((iotHubMessageHandle == NULL) ||
+        ((priority != IOTHUB_MESSAGE_PRIORITY_NORMAL) && (priority != IOTHUB_MESSAGE_PRIORITY_HIGH) && (priority != IOTHUB_MESSAGE_PRIORITY_CRITICAL)))
+    {
+        LogError("Invalid argument (iotHubMessageHandle=%p, priority=%d)", iotHubMessageHandle, (int)priority);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBMESSAGE_10_008: [IoTHubMessage_SetPriority shall save priority and return IOTHUB_MESSAGE_OK.]
+        iotHubMessageHandle->priority = priority;
+        result = IOTHUB_MESSAGE_OK;
+    }
+
+    return result;
+}
+
+IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+
+    // Codes_SRS_IOTHUBMESSAGE_10_009: [If iotHubMessageHandle is NULL then IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.]
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("Invalid argument (iotHubMessageHandle is NULL)");
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBMESSAGE_10_010: [IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL unless IoTHubMessage_SetPriority was called.]
+        result = iotHubMessageHandle->priority;
+    }
+
+    return result;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetDelivery(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_DELIVERY delivery)
+{
+    IOTHUB_MESSAGE_RESULT result;
+
+    // Codes_SRS_IOTHUBMESSAGE_10_012: [If iotHubMessageHandle is NULL or delivery is not a valid IOTHUB_MESSAGE_DELIVERY then IoTHubMessage_SetDelivery shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+    if ((iotHubMessageHandle == NULL) ||
+        ((delivery != IOTHUB_MESSAGE_DELIVERY_DEFAULT) && (delivery != IOTHUB_MESSAGE_DELIVERY_AT_LEAST_ONCE) && (delivery != IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE)))
+    {
+        LogError("Invalid argument (iotHubMessageHandle=%p, delivery=%d)", iotHubMessageHandle, (int)delivery);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBMESSAGE_10_013: [IoTHubMessage_SetDelivery shall save delivery and return IOTHUB_MESSAGE_OK.]
+        iotHubMessageHandle->delivery = delivery;
+        result = IOTHUB_MESSAGE_OK;
+    }
+
+    return result;
+}
+
+IOTHUB_MESSAGE_DELIVERY IoTHubMessage_GetDelivery(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_DELIVERY result;
+
+    // Codes_SRS_IOTHUBMESSAGE_10_014: [If iotHubMessageHandle is NULL then IoTHubMessage_GetDelivery shall return IOTHUB_MESSAGE_DELIVERY_DEFAULT.]
+    if (iotHubMessageHandle == NULL)
+    {
+        LogError("Invalid argument (iotHubMessageHandle is NULL)");
+        result = IOTHUB_MESSAGE_DELIVERY_DEFAULT;
+    }
+    else
+    {
+        // Codes_SRS_IOTHUBMESSAGE_10_015: [IoTHubMessage_GetDelivery shall return the delivery of the message, IOTHUB_MESSAGE_DELIVERY_DEFAULT unless IoTHubMessage_SetDelivery was called.]
+        result = iotHubMessageHandle->delivery;
+    }
+
+    return result;
+}
+
 const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* IoTHubMessage_GetDiagnosticPropertyData(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
     const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* result;
@@ -0,0 +1,325 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "iothub_transport_pool.h"
+
+typedef struct POOLED_TRANSPORT_TAG
+{
+    TRANSPORT_HANDLE transportHandle;
+    size_t deviceCount;
+    bool connected;
+} POOLED_TRANSPORT;
+
+typedef struct TRANSPORT_POOL_TAG
+{
+    POOLED_TRANSPORT* transports;
+    size_t transportCount;
+    LOCK_HANDLE lockHandle; /*only guards the device counts and connection flags*/
+} TRANSPORT_POOL;
+
+static void destroy_transports(TRANSPORT_POOL* pool, size_t count)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        IoTHubTransport_Destroy(pool->transports[index].transportHandle);
+    }
+}
+
+static POOLED_TRANSPORT* find_transport(TRANSPORT_POOL* pool, TRANSPORT_HANDLE transportHandle)
+{
+    POOLED_TRANSPORT* result = NULL;
+    size_t index;
+    for (index = 0; index < pool->transportCount; index++)
+    {
+        if (pool->transports[index].transportHandle == transportHandle)
+        {
+            result = &pool->transports[index];
+            break;
+        }
+    }
+    return result;
+}
+
+TRANSPORT_POOL_HANDLE IoTHubTransportPool_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix, size_t transportCount)
+{
+    TRANSPORT_POOL* result;
+
+    if (protocol == NULL || iotHubName == NULL || iotHubSuffix == NULL || transportCount == 0)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_001: [ If protocol, iotHubName or iotHubSuffix is NULL, or transportCount is 0, IoTHubTransportPool_Create shall fail and return NULL. ]*/
+        LogError("Invalid argument, protocol [%p], name [%p], suffix [%p], count [%lu].", protocol, iotHubName, iotHubSuffix, (unsigned long)transportCount);
+        result = NULL;
+    }
+    else if ((result = (TRANSPORT_POOL*)malloc(sizeof(TRANSPORT_POOL))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_004: [ If any allocation, Lock_Init or IoTHubTransport_Create fails, IoTHubTransportPool_Create shall release everything it created and return NULL. ]*/
+        LogError("Transport pool was not allocated.");
+    }
+    /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_002: [ IoTHubTransportPool_Create shall allocate the pool and its transportCount entries, and create the pool lock by calling Lock_Init. ]*/
+    else if ((result->transports = (POOLED_TRANSPORT*)malloc(sizeof(POOLED_TRANSPORT) * transportCount)) == NULL)
+    {
+        LogError("Transport pool entries were not allocated.");
+        free(result);
+        result = NULL;
+    }
+    else if ((result->lockHandle = Lock_Init()) == NULL)
+    {
+        LogError("Transport pool lock not created.");
+        free(result->transports);
+        free(result);
+        result = NULL;
+    }
+    else
+    {
+        size_t index;
+        result->transportCount = transportCount;
+
+        for (index = 0; index < transportCount; index++)
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_003: [ IoTHubTransportPool_Create shall create transportCount shared transports by calling IoTHubTransport_Create, each starting with no device and marked as connected. ]*/
+            if ((result->transports[index].transportHandle = IoTHubTransport_Create(protocol, iotHubName, iotHubSuffix)) == NULL)
+            {
+                LogError("Pooled transport %lu not created.", (unsigned long)index);
+                break;
+            }
+            result->transports[index].deviceCount = 0;
+            result->transports[index].connected = true;
+        }
+
+        if (index < transportCount)
+        {
+            destroy_transports(result, index);
+            Lock_Deinit(result->lockHandle);
+            free(result->transports);
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void IoTHubTransportPool_Destroy(TRANSPORT_POOL_HANDLE transportPool)
+{
+    /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_005: [ If transportPool is NULL, IoTHubTransportPool_Destroy shall do nothing. ]*/
+    if (transportPool != NULL)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_006: [ IoTHubTransportPool_Destroy shall destroy every transport by calling IoTHubTransport_Destroy, then release the lock and the memory of the pool. ]*/
+        destroy_transports(transportPool, transportPool->transportCount);
+        Lock_Deinit(transportPool->lockHandle);
+        free(transportPool->transports);
+        free(transportPool);
+    }
+}
+
+TRANSPORT_HANDLE IoTHubTransportPool_GetTransport(TRANSPORT_POOL_HANDLE transportPool)
+{
+    TRANSPORT_HANDLE result;
+
+    if (transportPool == NULL)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_007: [ If transportPool is NULL, IoTHubTransportPool_GetTransport shall return NULL. ]*/
+        LogError("NULL transportPool");
+        result = NULL;
+    }
+    else if (Lock(transportPool->lockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_010: [ If Lock fails, IoTHubTransportPool_GetTransport shall return NULL. ]*/
+        LogError("Could not lock the transport pool");
+        result = NULL;
+    }
+    else
+    {
+        POOLED_TRANSPORT* leastLoaded = NULL;
+        POOLED_TRANSPORT* leastLoadedConnected = NULL;
+        size_t index;
+
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_008: [ IoTHubTransportPool_GetTransport shall return, under the pool lock, the transport with the fewest devices among the connected ones, or among all of them if none is connected. ]*/
+        for (index = 0; index < transportPool->transportCount; index++)
+        {
+            POOLED_TRANSPORT* entry = &transportPool->transports[index];
+            if (leastLoaded == NULL || entry->deviceCount < leastLoaded->deviceCount)
+            {
+                leastLoaded = entry;
+            }
+            if (entry->connected && (leastLoadedConnected == NULL || entry->deviceCount < leastLoadedConnected->deviceCount))
+            {
+                leastLoadedConnected = entry;
+            }
+        }
+
+        if (leastLoadedConnected != NULL)
+        {
+            leastLoaded = leastLoadedConnected;
+        }
+
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_009: [ IoTHubTransportPool_GetTransport shall count one more device on the returned transport. ]*/
+        leastLoaded->deviceCount++;
+        result = leastLoaded->transportHandle;
+
+        (void)Unlock(transportPool->lockHandle);
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransportPool_ReleaseTransport(TRANSPORT_POOL_HANDLE transportPool, TRANSPORT_HANDLE transportHandle)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (transportPool == NULL || transportHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_011: [ If transportPool or transportHandle is NULL, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("Invalid NULL argument, transportPool [%p], transportHandle [%p].", transportPool, transportHandle);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (Lock(transportPool->lockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_014: [ If Lock fails, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("Could not lock the transport pool");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        POOLED_TRANSPORT* entry = find_transport(transportPool, transportHandle);
+        if (entry == NULL || entry->deviceCount == 0)
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_013: [ If transportHandle does not belong to the pool or has no device, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+            LogError("transportHandle [%p] is not in use in this pool.", transportHandle);
+            result = IOTHUB_CLIENT_INVALID_ARG;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_012: [ IoTHubTransportPool_ReleaseTransport shall count one less device on transportHandle and return IOTHUB_CLIENT_OK. ]*/
+            entry->deviceCount--;
+            result = IOTHUB_CLIENT_OK;
+        }
+
+        (void)Unlock(transportPool->lockHandle);
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransportPool_SetConnectionStatus(TRANSPORT_POOL_HANDLE transportPool, TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_CONNECTION_STATUS connectionStatus, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (transportPool == NULL || transportHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_015: [ If transportPool or transportHandle is NULL, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("Invalid NULL argument, transportPool [%p], transportHandle [%p].", transportPool, transportHandle);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (Lock(transportPool->lockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_018: [ If Lock fails, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("Could not lock the transport pool");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        POOLED_TRANSPORT* entry = find_transport(transportPool, transportHandle);
+        if (entry == NULL)
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_017: [ If transportHandle does not belong to the pool, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+            LogError("transportHandle [%p] does not belong to this pool.", transportHandle);
+            result = IOTHUB_CLIENT_INVALID_ARG;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_016: [ IoTHubTransportPool_SetConnectionStatus shall mark transportHandle as connected if connectionStatus is IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, and as disconnected if reason is IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR or IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED, and return IOTHUB_CLIENT_OK. ]*/
+            if (connectionStatus == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+            {
+                entry->connected = true;
+            }
+            else if ((reason == IOTHUB_CLIENT_CONNECTION_NO_NETWORK) ||
+                (reason == IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR) ||
+                (reason == IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED))
+            {
+                entry->connected = false;
+            }
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_024: [ Any other reason is about the device reporting it (an expired SAS token, a disabled device, bad credentials), not the shared connection, and shall leave the status of transportHandle unchanged. ]*/
+            result = IOTHUB_CLIENT_OK;
+        }
+
+        (void)Unlock(transportPool->lockHandle);
+    }
+
+    return result;
+}
+
+/*the connected transport other than failedEntry with the fewest devices, NULL if there is none*/
+static POOLED_TRANSPORT* get_relocation_target(TRANSPORT_POOL* pool, POOLED_TRANSPORT* failedEntry)
+{
+    POOLED_TRANSPORT* result = NULL;
+    size_t index;
+    for (index = 0; index < pool->transportCount; index++)
+    {
+        POOLED_TRANSPORT* entry = &pool->transports[index];
+        if ((entry != failedEntry) && entry->connected && (result == NULL || entry->deviceCount < result->deviceCount))
+        {
+            result = entry;
+        }
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransportPool_RelocateDevices(TRANSPORT_POOL_HANDLE transportPool, TRANSPORT_HANDLE failedTransport, TRANSPORT_HANDLE* newTransports, size_t deviceCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (transportPool == NULL || failedTransport == NULL || newTransports == NULL || deviceCount == 0)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_019: [ If transportPool, failedTransport or newTransports is NULL, or deviceCount is 0, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("Invalid argument, transportPool [%p], failedTransport [%p], newTransports [%p], deviceCount [%lu].", transportPool, failedTransport, newTransports, (unsigned long)deviceCount);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (Lock(transportPool->lockHandle) != LOCK_OK)
+    {
+        /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_021: [ If Lock fails, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_ERROR. ]*/
+        LogError("Could not lock the transport pool");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        POOLED_TRANSPORT* failedEntry = find_transport(transportPool, failedTransport);
+        if (failedEntry == NULL || failedEntry->deviceCount < deviceCount)
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_020: [ If failedTransport does not belong to the pool or has fewer than deviceCount devices, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+            LogError("failedTransport [%p] does not have %lu devices in this pool.", failedTransport, (unsigned long)deviceCount);
+            result = IOTHUB_CLIENT_INVALID_ARG;
+        }
+        else if (get_relocation_target(transportPool, failedEntry) == NULL)
+        {
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_023: [ If no other transport of the pool is connected, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_ERROR and count nothing differently. ]*/
+            LogError("No other connected transport to relocate the devices of [%p] to.", failedTransport);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            size_t index;
+
+            /*Codes_SRS_IOTHUB_TRANSPORT_POOL_10_022: [ IoTHubTransportPool_RelocateDevices shall, under the pool lock, move deviceCount devices one by one from failedTransport to the connected transport with the fewest devices, store in newTransports[i] the transport of the i-th device and return IOTHUB_CLIENT_OK. ]*/
+            for (index = 0; index < deviceCount; index++)
+            {
+                POOLED_TRANSPORT* target = get_relocation_target(transportPool, failedEntry);
+                target->deviceCount++;
+                failedEntry->deviceCount--;
+                newTransports[index] = target->transportHandle;
+            }
+            result = IOTHUB_CLIENT_OK;
+        }
+
+        (void)Unlock(transportPool->lockHandle);
+    }
+
+    return result;
+}
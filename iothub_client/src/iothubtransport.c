@@ -25,9 +25,17 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG
     TRANSPORT_PROVIDER_FIELDS;
     VECTOR_HANDLE clients;
     LOCK_HANDLE clientsLockHandle;
+    VECTOR_HANDLE readyClients; /*READY_CLIENT entries for clients with queued callbacks or finished uploads, visited by the next worker pass*/
+    LOCK_HANDLE readyLockHandle; /*only guards readyClients and the clients' queued flags, never held while taking another lock*/
     IOTHUB_CLIENT_MULTIPLEXED_DO_WORK clientDoWork;
 } TRANSPORT_HANDLE_DATA;
 
+typedef struct READY_CLIENT_TAG
+{
+    IOTHUB_CLIENT_CORE_HANDLE clientHandle;
+    bool* queued; /*owned by the client, true while the client is in readyClients (and for good once it ended)*/
+} READY_CLIENT;
+
 /* Used for Unit test */
 const size_t IoTHubTransport_ThreadTerminationOffset = offsetof(TRANSPORT_HANDLE_DATA, stopThread);
 
@@ -112,6 +120,28 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
                         free(result);
                         result = NULL;
                     }
+                    /*Codes_SRS_IOTHUBTRANSPORT_10_001: [ IoTHubTransport_Create shall create the ready set of clients, and the lock protecting it, by calling VECTOR_create and Lock_Init. ]*/
+                    else if ((result->readyClients = VECTOR_create(sizeof(READY_CLIENT))) == NULL)
+                    {
+                        LogError("ready clients list not created.");
+                        VECTOR_destroy(result->clients);
+                        Lock_Deinit(result->clientsLockHandle);
+                        Lock_Deinit(result->lockHandle);
+                        transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
+                        free(result);
+                        result = NULL;
+                    }
+                    else if ((result->readyLockHandle = Lock_Init()) == NULL)
+                    {
+                        LogError("ready clients Lock not created.");
+                        VECTOR_destroy(result->readyClients);
+                        VECTOR_destroy(result->clients);
+                        Lock_Deinit(result->clientsLockHandle);
+                        Lock_Deinit(result->lockHandle);
+                        transportProtocol->IoTHubTransport_Destroy(result->transportLLHandle);
+                        free(result);
+                        result = NULL;
+                    }
                     else
                     {
                         /*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
@@ -138,6 +168,62 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
     return result;
 }
 
+static bool find_by_handle(const void* element, const void* value)
+{
+    /* data stored at element is device handle */
+    const IOTHUB_CLIENT_CORE_HANDLE * guess = (const IOTHUB_CLIENT_CORE_HANDLE *)element;
+    const IOTHUB_CLIENT_CORE_HANDLE match = (const IOTHUB_CLIENT_CORE_HANDLE)value;
+    return (*guess == match);
+}
+
+static bool find_ready_by_handle(const void* element, const void* value)
+{
+    const READY_CLIENT* guess = (const READY_CLIENT*)element;
+    const IOTHUB_CLIENT_CORE_HANDLE match = (const IOTHUB_CLIENT_CORE_HANDLE)value;
+    return (guess->clientHandle == match);
+}
+
+static VECTOR_HANDLE take_ready_clients(TRANSPORT_HANDLE_DATA* transportData)
+{
+    VECTOR_HANDLE result;
+
+    if (Lock(transportData->readyLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for take_ready_clients");
+        result = NULL;
+    }
+    else
+    {
+        if (VECTOR_size(transportData->readyClients) == 0)
+        {
+            result = NULL;
+        }
+        else if ((result = VECTOR_move(transportData->readyClients)) == NULL)
+        {
+            LogError("failed moving the ready clients, they will be visited on the next pass");
+        }
+        else
+        {
+            size_t numberOfClients = VECTOR_size(result);
+            size_t iterator;
+
+            /*Codes_SRS_IOTHUBTRANSPORT_10_005: [ Taking the ready set shall clear the queued flag of each client in it, so they can signal again while being visited. ]*/
+            for (iterator = 0; iterator < numberOfClients; iterator++)
+            {
+                READY_CLIENT* readyClient = (READY_CLIENT*)VECTOR_element(result, iterator);
+                *(readyClient->queued) = false;
+            }
+        }
+
+        if (Unlock(transportData->readyLockHandle) != LOCK_OK)
+        {
+            LogError("failed to unlock on take_ready_clients");
+        }
+    }
+
+    return result;
+}
+
 static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
 {
     if (Lock(transportData->clientsLockHandle) != LOCK_OK)
@@ -146,18 +232,26 @@ static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
     }
     else
     {
-        size_t numberOfClients;
-        size_t iterator;
-
-        numberOfClients = VECTOR_size(transportData->clients);
-        for (iterator = 0; iterator < numberOfClients; iterator++)
+        /*Codes_SRS_IOTHUBTRANSPORT_10_002: [ After the lower layer transport DoWork, the thread shall take the whole ready set and call the client DoWork once for each client in it. ]*/
+        VECTOR_HANDLE readyClients = take_ready_clients(transportData);
+        if (readyClients != NULL)
         {
-            IOTHUB_CLIENT_CORE_HANDLE* clientHandle = (IOTHUB_CLIENT_CORE_HANDLE*)VECTOR_element(transportData->clients, iterator);
+            size_t numberOfClients;
+            size_t iterator;
 
-            if (clientHandle != NULL)
+            numberOfClients = VECTOR_size(readyClients);
+            for (iterator = 0; iterator < numberOfClients; iterator++)
             {
-                transportData->clientDoWork(*clientHandle);
+                READY_CLIENT* readyClient = (READY_CLIENT*)VECTOR_element(readyClients, iterator);
+
+                /* clients that ended were taken out of the ready set under clientsLockHandle, which is held here */
+                if (readyClient != NULL)
+                {
+                    transportData->clientDoWork(readyClient->clientHandle);
+                }
             }
+
+            VECTOR_destroy(readyClients);
         }
 
         if (Unlock(transportData->clientsLockHandle) != LOCK_OK)
@@ -201,14 +295,6 @@ static int transport_worker_thread(void* threadArgument)
     return 0;
 }
 
-static bool find_by_handle(const void* element, const void* value)
-{
-    /* data stored at element is device handle */
-    const IOTHUB_CLIENT_CORE_HANDLE * guess = (const IOTHUB_CLIENT_CORE_HANDLE *)element;
-    const IOTHUB_CLIENT_CORE_HANDLE match = (const IOTHUB_CLIENT_CORE_HANDLE)value;
-    return (*guess == match);
-}
-
 static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -287,7 +373,33 @@ static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
     }
 }
 
-static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
+static void remove_ready_client(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle, bool* readyQueued)
+{
+    if (Lock(transportData->readyLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for remove_ready_client");
+    }
+    else
+    {
+        if (*readyQueued)
+        {
+            void* element = VECTOR_find_if(transportData->readyClients, find_ready_by_handle, clientHandle);
+            if (element != NULL)
+            {
+                VECTOR_erase(transportData->readyClients, element, 1);
+            }
+        }
+        /* left set so signals raised while the client is being destroyed are ignored */
+        *readyQueued = true;
+
+        if (Unlock(transportData->readyLockHandle) != LOCK_OK)
+        {
+            LogError("failed to unlock on remove_ready_client");
+        }
+    }
+}
+
+static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle, bool* readyQueued)
 {
     bool okToJoin;
 
@@ -304,6 +416,8 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
             /*Codes_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_EndWorkerThread shall remove clientHandlehandle from handle list. ]*/
             VECTOR_erase(transportData->clients, element, 1);
         }
+        /*Codes_SRS_IOTHUBTRANSPORT_10_006: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandle from the ready set and leave its queued flag set, so later calls to IoTHubTransport_SignalClientReady for it do nothing. ]*/
+        remove_ready_client(transportData, clientHandle, readyQueued);
         /*Codes_SRS_IOTHUBTRANSPORT_17_025: [ If the worker thread does not exist, then IoTHubTransport_EndWorkerThread shall return. ]*/
         if (transportData->workerThreadHandle != NULL)
         {
@@ -353,6 +467,8 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
         (transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
         VECTOR_destroy(transportData->clients);
         Lock_Deinit(transportData->clientsLockHandle);
+        VECTOR_destroy(transportData->readyClients);
+        Lock_Deinit(transportData->readyLockHandle);
         free(transportHandle);
     }
 }
@@ -423,15 +539,15 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_StartWorkerThread(TRANSPORT_HANDLE transpor
     return result;
 }
 
-bool IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
+bool IoTHubTransport_SignalEndWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_CORE_HANDLE clientHandle, bool* readyQueued)
 {
     bool okToJoin;
     /*Codes_SRS_IOTHUBTRANSPORT_17_023: [ If transportHandle is NULL, IoTHubTransport_EndWorkerThread shall return. ]*/
     /*Codes_SRS_IOTHUBTRANSPORT_17_024: [ If clientHandle is NULL, IoTHubTransport_EndWorkerThread shall return. ]*/
-    if (!(transportHandle == NULL || clientHandle == NULL))
+    if (!(transportHandle == NULL || clientHandle == NULL || readyQueued == NULL))
     {
         TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
-        okToJoin = signal_end_worker_thread(transportData, clientHandle);
+        okToJoin = signal_end_worker_thread(transportData, clientHandle, readyQueued);
     }
     else
     {
@@ -451,3 +567,41 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
         wait_worker_thread(transportData);
     }
 }
+
+void IoTHubTransport_SignalClientReady(TRANSPORT_HANDLE transportHandle, IOTHUB_CLIENT_CORE_HANDLE clientHandle, bool* readyQueued)
+{
+    /*Codes_SRS_IOTHUBTRANSPORT_10_003: [ If transportHandle, clientHandle or readyQueued is NULL, IoTHubTransport_SignalClientReady shall do nothing. ]*/
+    if (!(transportHandle == NULL || clientHandle == NULL || readyQueued == NULL))
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+
+        if (Lock(transportData->readyLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for IoTHubTransport_SignalClientReady");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_10_004: [ Unless readyQueued is already true, IoTHubTransport_SignalClientReady shall add clientHandle to the ready set and set readyQueued to true. ]*/
+            if (!*readyQueued)
+            {
+                READY_CLIENT readyClient;
+                readyClient.clientHandle = clientHandle;
+                readyClient.queued = readyQueued;
+
+                if (VECTOR_push_back(transportData->readyClients, &readyClient, 1) != 0)
+                {
+                    LogError("Failed adding client to the ready set (VECTOR_push_back failed)");
+                }
+                else
+                {
+                    *readyQueued = true;
+                }
+            }
+
+            if (Unlock(transportData->readyLockHandle) != LOCK_OK)
+            {
+                LogError("failed to unlock on IoTHubTransport_SignalClientReady");
+            }
+        }
+    }
+}
@@ -7,7 +7,7 @@
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/gballoc.h"
-#include "azure_c_shared_utility/agenttime.h" 
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/uniqueid.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
@@ -25,7 +25,6 @@ DEFINE_ENUM_STRINGS(TWIN_UPDATE_TYPE, TWIN_UPDATE_TYPE_VALUES);
 
 
 #define RESULT_OK 0
-#define INDEFINITE_TIME ((time_t)(-1))
 
 #define CLIENT_VERSION_PROPERTY_NAME					"com.microsoft:client-version"
 #define UNIQUE_ID_BUFFER_SIZE                           37
@@ -47,7 +46,7 @@ DEFINE_ENUM_STRINGS(TWIN_UPDATE_TYPE, TWIN_UPDATE_TYPE_VALUES);
 #define TWIN_API_VERSION_NUMBER							"2016-11-14"
 
 #define DEFAULT_MAX_TWIN_SUBSCRIPTION_ERROR_COUNT		3
-#define DEFAULT_TWIN_OPERATION_TIMEOUT_SECS				300.0
+#define DEFAULT_TWIN_OPERATION_TIMEOUT_MS				(300 * 1000)
 
 static char* DEFAULT_TWIN_SEND_LINK_SOURCE_NAME =		"twin";
 static char* DEFAULT_TWIN_RECEIVE_LINK_TARGET_NAME =	"twin";
@@ -94,8 +93,10 @@ typedef struct TWIN_MESSENGER_INSTANCE_TAG
 
 	TWIN_MESSENGER_STATE state;
 
+	// Both lists are kept in the order items were enqueued/sent, so timeouts only need to look at their heads.
 	SINGLYLINKEDLIST_HANDLE pending_patches;
 	SINGLYLINKEDLIST_HANDLE operations;
+	TICK_COUNTER_HANDLE tick_counter;
 	
 	TWIN_MESSENGER_STATE_CHANGED_CALLBACK on_state_changed_callback;
 	void* on_state_changed_context;
@@ -115,7 +116,7 @@ typedef struct TWIN_PATCH_OPERATION_CONTEXT_TAG
 	CONSTBUFFER_HANDLE data;
 	TWIN_MESSENGER_REPORT_STATE_COMPLETE_CALLBACK on_report_state_complete_callback;
 	const void* on_report_state_complete_context;
-	time_t time_enqueued;
+	tickcounter_ms_t time_enqueued;
 } TWIN_PATCH_OPERATION_CONTEXT;
 
 typedef struct TWIN_OPERATION_CONTEXT_TAG
@@ -125,7 +126,7 @@ typedef struct TWIN_OPERATION_CONTEXT_TAG
 	char* correlation_id;
 	TWIN_MESSENGER_REPORT_STATE_COMPLETE_CALLBACK on_report_state_complete_callback;
 	const void* on_report_state_complete_context;
-	time_t time_sent;
+	tickcounter_ms_t time_sent;
 } TWIN_OPERATION_CONTEXT;
 
 
@@ -950,7 +951,7 @@ static int send_twin_operation_request(TWIN_MESSENGER_INSTANCE* twin_msgr, TWIN_
 	}
 	else
 	{
-		if ((op_ctx->time_sent = get_time(NULL)) == INDEFINITE_TIME)
+		if (tickcounter_get_current_ms(twin_msgr->tick_counter, &op_ctx->time_sent) != 0)
 		{
 			LogError("Failed setting TWIN operation sent time (%s, %s, %s)", twin_msgr->device_id, ENUM_TO_STRING(TWIN_OPERATION_TYPE, op_ctx->type), op_ctx->correlation_id);
 			result = __FAILURE__;
@@ -987,10 +988,10 @@ static bool remove_expired_twin_patch_request(const void* item, const void* matc
 	else
 	{
 
-		time_t current_time = *(time_t*)match_context;
+		tickcounter_ms_t current_time = *(tickcounter_ms_t*)match_context;
 		TWIN_PATCH_OPERATION_CONTEXT* twin_patch_ctx = (TWIN_PATCH_OPERATION_CONTEXT*)item;
 
-		if (get_difftime(current_time, twin_patch_ctx->time_enqueued) >= DEFAULT_TWIN_OPERATION_TIMEOUT_SECS)
+		if (current_time - twin_patch_ctx->time_enqueued >= DEFAULT_TWIN_OPERATION_TIMEOUT_MS)
 		{
 			remove_item = true;
 			*continue_processing = true;
@@ -1006,6 +1007,7 @@ static bool remove_expired_twin_patch_request(const void* item, const void* matc
 		else
 		{
 			remove_item = false;
+			// All next elements in the list were enqueued later, so they won't be expired either.
 			*continue_processing = false;
 		}
 	}
@@ -1027,9 +1029,9 @@ static bool remove_expired_twin_operation_request(const void* item, const void*
 	{
 		TWIN_OPERATION_CONTEXT* twin_op_ctx = (TWIN_OPERATION_CONTEXT*)item;
 		TWIN_MESSENGER_INSTANCE* twin_msgr = twin_op_ctx->msgr;
-		time_t current_time = *(time_t*)match_context;
+		tickcounter_ms_t current_time = *(tickcounter_ms_t*)match_context;
 
-		if (get_difftime(current_time, twin_op_ctx->time_sent) < DEFAULT_TWIN_OPERATION_TIMEOUT_SECS)
+		if (current_time - twin_op_ctx->time_sent < DEFAULT_TWIN_OPERATION_TIMEOUT_MS)
 		{
 			result = false;
 			// All next elements in the list have a later time_sent, so they won't be expired, and don't need to be removed.
@@ -1083,9 +1085,9 @@ static bool remove_expired_twin_operation_request(const void* item, const void*
 
 static void process_timeouts(TWIN_MESSENGER_INSTANCE* twin_msgr)
 {
-	time_t current_time;
+	tickcounter_ms_t current_time;
 
-	if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
+	if (tickcounter_get_current_ms(twin_msgr->tick_counter, &current_time) != 0)
 	{
 		// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_082: [If any failure occurs while verifying/removing timed-out items `twin_msgr->state` shall be set to TWIN_MESSENGER_STATE_ERROR and user informed]  
 		LogError("Failed obtaining current time (%s)", twin_msgr->device_id);
@@ -1323,6 +1325,12 @@ static void internal_twin_messenger_destroy(TWIN_MESSENGER_INSTANCE* twin_msgr)
 		singlylinkedlist_destroy(twin_msgr->operations);
 	}
 
+	if (twin_msgr->tick_counter != NULL)
+	{
+		// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_111: [`twin_msgr->tick_counter` shall be destroyed using tickcounter_destroy()]
+		tickcounter_destroy(twin_msgr->tick_counter);
+	}
+
 	// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_102: [twin_messenger_destroy() shall release all memory allocated for and within `twin_msgr`]  
 	if (twin_msgr->client_version != NULL)
 	{
@@ -1721,6 +1729,14 @@ TWIN_MESSENGER_HANDLE twin_messenger_create(const TWIN_MESSENGER_CONFIG* messeng
 				internal_twin_messenger_destroy(twin_msgr);
 				twin_msgr = NULL;
 			}
+			// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_109: [`twin_msgr->tick_counter` shall be set using tickcounter_create()]
+			else if ((twin_msgr->tick_counter = tickcounter_create()) == NULL)
+			{
+				// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_110: [If tickcounter_create() fails, twin_messenger_create() shall fail and return NULL]
+				LogError("Failed creating tick counter (%s)", messenger_config->device_id);
+				internal_twin_messenger_destroy(twin_msgr);
+				twin_msgr = NULL;
+			}
 			else if ((link_attach_properties = create_link_attach_properties(twin_msgr)) == NULL)
 			{
 				LogError("Failed creating link attach properties (%s)", messenger_config->device_id);
@@ -1818,8 +1834,8 @@ int twin_messenger_report_state_async(TWIN_MESSENGER_HANDLE twin_msgr_handle, CO
 			// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_026: [If `data` fails to be copied, twin_messenger_report_state_async() shall fail and return a non-zero value]    
 			result = __FAILURE__;
 		}
-		// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_027: [`twin_op_ctx->time_enqueued` shall be set using get_time]    
-		else if ((twin_patch_ctx->time_enqueued = get_time(NULL)) == INDEFINITE_TIME)
+		// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_027: [`twin_op_ctx->time_enqueued` shall be set using tickcounter_get_current_ms]    
+		else if (tickcounter_get_current_ms(twin_msgr->tick_counter, &twin_patch_ctx->time_enqueued) != 0)
 		{
 			LogError("Failed setting reported state enqueue time (%s)", twin_msgr->device_id);
 			// Codes_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_031: [If any failure occurs, twin_messenger_report_state_async() shall free any memory it has allocated]  
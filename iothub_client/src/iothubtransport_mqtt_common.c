@@ -26,6 +26,10 @@
 #include "azure_c_shared_utility/urlencode.h"
 #include "iothub_client_version.h"
 #include "internal/iothub_client_retry_control.h"
+#include "internal/iothub_client_timer_wheel.h"
+#include "internal/iothub_client_inflight_table.h"
+#include "internal/iothub_client_slab.h"
+#include "internal/iothub_client_mqtt_topic.h"
 
 #include "internal/iothubtransport_mqtt_common.h"
 
@@ -37,13 +41,18 @@
 
 #define SAS_TOKEN_DEFAULT_LIFETIME          3600
 #define SAS_REFRESH_MULTIPLIER              .8
+#define DEFAULT_SAS_REFRESH_DRAIN_TIMEOUT_MS 2000
 #define EPOCH_TIME_T_VALUE                  0
 #define DEFAULT_MQTT_KEEPALIVE              4*60 // 4 min
 #define DEFAULT_CONNACK_TIMEOUT             30 // 30 seconds
 #define BUILD_CONFIG_USERNAME               24
 #define SAS_TOKEN_DEFAULT_LEN               10
 #define RESEND_TIMEOUT_VALUE_MIN            1*60
+#define RESEND_TIMEOUT_VALUE_MS             ((tickcounter_ms_t)(RESEND_TIMEOUT_VALUE_MIN + 1) * 1000) // first whole second past RESEND_TIMEOUT_VALUE_MIN
 #define MAX_SEND_RECOUNT_LIMIT              2
+// Packet ids are shared with the twin, method and subscribe packets and the ids of the telemetry in flight are never
+// handed out again, keeping half of them free makes finding the next free id cheap
+#define MAX_TELEMETRY_IN_FLIGHT             (USHRT_MAX / 2)
 #define DEFAULT_CONNECTION_INTERVAL         30
 #define FAILED_CONN_BACKOFF_VALUE           5
 #define STATUS_CODE_FAILURE_VALUE           500
@@ -59,7 +68,8 @@ static const char* TOPIC_GET_DESIRED_STATE = "$iothub/twin/res/#";
 static const char* TOPIC_NOTIFICATION_STATE = "$iothub/twin/PATCH/properties/desired/#";
 
 static const char* TOPIC_DEVICE_MSG = "devices/%s/messages/devicebound/#";
-static const char* TOPIC_DEVICE_DEVICE = "devices/%s/messages/events/";
+static const char* TOPIC_DEVICE_EVENTS_BEGIN = "devices/";
+static const char* TOPIC_DEVICE_EVENTS_END = "/messages/events/";
 
 static const char* TOPIC_DEVICE_METHOD_SUBSCRIBE = "$iothub/methods/POST/#";
 
@@ -89,6 +99,9 @@ static const char* DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY = "creationtime
 #define SUBSCRIBE_DEVICE_METHOD_TOPIC           0x0010
 #define SUBSCRIBE_TOPIC_COUNT                   4
 
+// The topics in the order SubscribeToMqttProtocol puts them in a SUBSCRIBE, which is the order of the return codes of its SUBACK
+static const uint32_t SUBSCRIBE_TOPIC_ORDER[SUBSCRIBE_TOPIC_COUNT] = { SUBSCRIBE_TELEMETRY_TOPIC, SUBSCRIBE_GET_REPORTED_STATE_TOPIC, SUBSCRIBE_NOTIFICATION_STATE_TOPIC, SUBSCRIBE_DEVICE_METHOD_TOPIC };
+
 DEFINE_ENUM_STRINGS(MQTT_CLIENT_EVENT_ERROR, MQTT_CLIENT_EVENT_ERROR_VALUES)
 
 typedef struct SYSTEM_PROPERTY_INFO_TAG
@@ -135,7 +148,8 @@ typedef enum MQTT_CLIENT_STATUS_TAG
 typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 {
     // Topic control
-    STRING_HANDLE topic_MqttEvent;
+    MQTT_TOPIC_BUFFER telemetry_topic; // "devices/{id}/messages/events/" followed by the properties of the message being published
+    MQTT_TOPIC_BUFFER received_property; // scratch the name and value of a property of a received topic are decoded into
     STRING_HANDLE topic_MqttMessage;
     STRING_HANDLE topic_GetState;
     STRING_HANDLE topic_NotifyState;
@@ -143,6 +157,10 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     STRING_HANDLE topic_DeviceMethods;
 
     uint32_t topics_ToSubscribe;
+    uint32_t topics_Subscribed; // topics acknowledged by a SUBACK, kept by the service as long as the session is
+    uint32_t topics_Subscribing; // topics of the last SUBSCRIBE sent, waiting for its SUBACK
+    uint16_t subscribe_packet_id;
+    bool persistent_session; // OPTION_PERSISTENT_SESSION, resume the subscriptions and in-flight publishes of a present session
 
     // Connection related constants
     STRING_HANDLE hostAddress;
@@ -186,6 +204,10 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     TICK_COUNTER_HANDLE msgTickCounter;
     OPTIONHANDLER_HANDLE saved_tls_options; // Here are the options from the xio layer if any is saved.
     size_t option_sas_token_lifetime_secs;
+    bool sas_token_refresh_drain; // OPTION_SAS_TOKEN_REFRESH_DRAIN, wait for the in-flight PUBACKs before reconnecting with a new sas token
+    size_t sas_token_refresh_drain_timeout_ms; // OPTION_SAS_TOKEN_REFRESH_DRAIN_TIMEOUT
+    bool sas_token_refresh_draining;
+    tickcounter_ms_t sas_token_refresh_drain_end;
 
     // Internal lists for message tracking
     PDLIST_ENTRY waitingToSend;
@@ -196,6 +218,13 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 
     // Telemetry specific
     DLIST_ENTRY telemetry_waitingForAck;
+    INFLIGHT_TABLE telemetry_inflight; // the messages of telemetry_waitingForAck indexed by packet id
+    TIMER_WHEEL telemetry_resend_timers;
+    tickcounter_ms_t telemetry_resend_now_ms; // the time telemetry_resend_timers is being processed for
+    size_t max_inflight_messages; // 0 unless OPTION_MAX_IN_FLIGHT_MESSAGES was set
+    size_t max_publishes_per_dowork; // 0 unless OPTION_MAX_PUBLISHES_PER_DOWORK was set
+    bool telemetry_at_most_once; // publish the messages without an explicit delivery at QoS 0
+    SLAB_ALLOCATOR_HANDLE telemetry_details_slab; // NULL unless OPTION_MESSAGE_RECORD_POOL_SIZE was set
     bool auto_url_encode_decode;
 
     // Controls frequency of reconnection logic.
@@ -230,7 +259,8 @@ typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
     size_t retryCount;
     IOTHUB_MESSAGE_LIST* iotHubMessageEntry;
     void* context;
-    uint16_t packet_id;
+    INFLIGHT_TABLE_ENTRY inflight_entry; // holds the packet id
+    TIMER_WHEEL_ENTRY resend_timer;
     DLIST_ENTRY entry;
 } MQTT_MESSAGE_DETAILS_LIST, *PMQTT_MESSAGE_DETAILS_LIST;
 
@@ -269,6 +299,32 @@ static void set_saved_tls_options(PMQTTTRANSPORT_HANDLE_DATA transport, OPTIONHA
     transport->saved_tls_options = new_options;
 }
 
+static MQTT_MESSAGE_DETAILS_LIST* allocate_message_details(MQTTTRANSPORT_HANDLE_DATA* transport_data)
+{
+    MQTT_MESSAGE_DETAILS_LIST* result;
+    if (transport_data->telemetry_details_slab != NULL)
+    {
+        result = (MQTT_MESSAGE_DETAILS_LIST*)slab_allocator_alloc(transport_data->telemetry_details_slab);
+    }
+    else
+    {
+        result = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+    }
+    return result;
+}
+
+static void free_message_details(MQTTTRANSPORT_HANDLE_DATA* transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    if (transport_data->telemetry_details_slab != NULL)
+    {
+        slab_allocator_free(transport_data->telemetry_details_slab, mqttMsgEntry);
+    }
+    else
+    {
+        free(mqttMsgEntry);
+    }
+}
+
 static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data)
 {
     if (transport_data->mqttClient != NULL)
@@ -284,11 +340,19 @@ static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data
     set_saved_tls_options(transport_data, NULL);
 
     tickcounter_destroy(transport_data->msgTickCounter);
+
+    if (transport_data->telemetry_details_slab != NULL)
+    {
+        slab_allocator_destroy(transport_data->telemetry_details_slab);
+    }
+
+    inflight_table_deinit(&transport_data->telemetry_inflight);
     
     free_proxy_data(transport_data);
 
     STRING_delete(transport_data->devicesPath);
-    STRING_delete(transport_data->topic_MqttEvent);
+    mqtt_topic_buffer_deinit(&transport_data->telemetry_topic);
+    mqtt_topic_buffer_deinit(&transport_data->received_property);
     STRING_delete(transport_data->topic_MqttMessage);
     STRING_delete(transport_data->device_id);
     STRING_delete(transport_data->hostAddress);
@@ -350,6 +414,110 @@ static uint16_t get_next_packet_id(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     return transport_data->packetId;
 }
 
+static int add_telemetry_in_flight(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    uint16_t packet_id;
+
+    // The packet ids wrap around, skip the ones still waiting for their PUBACK
+    do
+    {
+        packet_id = get_next_packet_id(transport_data);
+    } while (inflight_table_find(&transport_data->telemetry_inflight, packet_id) != NULL);
+
+    return inflight_table_add(&transport_data->telemetry_inflight, &mqttMsgEntry->inflight_entry, packet_id);
+}
+
+static void remove_telemetry_in_flight(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    (void)DList_RemoveEntryList(&mqttMsgEntry->entry);
+    (void)inflight_table_remove(&transport_data->telemetry_inflight, mqttMsgEntry->inflight_entry.packet_id);
+}
+
+static bool can_publish_telemetry(PMQTTTRANSPORT_HANDLE_DATA transport_data, size_t publish_count)
+{
+    size_t in_flight_count = transport_data->telemetry_inflight.count;
+    size_t max_in_flight = transport_data->max_inflight_messages == 0 ? MAX_TELEMETRY_IN_FLIGHT : transport_data->max_inflight_messages;
+
+    return !transport_data->sas_token_refresh_draining &&
+        (in_flight_count < max_in_flight) &&
+        (transport_data->max_publishes_per_dowork == 0 || publish_count < transport_data->max_publishes_per_dowork);
+}
+
+static bool is_telemetry_at_most_once(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    IOTHUB_MESSAGE_DELIVERY delivery = IoTHubMessage_GetDelivery(messageHandle);
+
+    return (delivery == IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE) ||
+        (delivery == IOTHUB_MESSAGE_DELIVERY_DEFAULT && transport_data->telemetry_at_most_once);
+}
+
+static bool is_sas_token_refresh_drained(PMQTTTRANSPORT_HANDLE_DATA transport_data, tickcounter_ms_t current_time)
+{
+    bool result;
+
+    if (transport_data->telemetry_inflight.count == 0)
+    {
+        result = true;
+    }
+    else if (!transport_data->sas_token_refresh_draining)
+    {
+        PDLIST_ENTRY current_entry = transport_data->telemetry_waitingForAck.Flink;
+
+        transport_data->sas_token_refresh_draining = true;
+        transport_data->sas_token_refresh_drain_end = current_time + transport_data->sas_token_refresh_drain_timeout_ms;
+
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_027: [ The drain shall not last past the time the resend of the oldest telemetry message waiting for its PUBACK is due. ] */
+        // That message would be published again on the connection being replaced, waiting any longer only holds telemetry back.
+        // timer_wheel_get_next_due is only a lower bound, so the resend timers are looked at one by one, once per drain
+        while (current_entry != &transport_data->telemetry_waitingForAck)
+        {
+            MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
+
+            if (timer_wheel_is_armed(&mqttMsgEntry->resend_timer) &&
+                mqttMsgEntry->resend_timer.expires_at < transport_data->sas_token_refresh_drain_end)
+            {
+                transport_data->sas_token_refresh_drain_end = mqttMsgEntry->resend_timer.expires_at;
+            }
+            current_entry = current_entry->Flink;
+        }
+
+        result = (current_time >= transport_data->sas_token_refresh_drain_end);
+    }
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_023: [ If the PUBACKs have not all been received after "sas_token_refresh_drain_timeout" milliseconds, IoTHubTransport_MQTT_Common_DoWork shall disconnect anyway. ] */
+    else if (current_time >= transport_data->sas_token_refresh_drain_end)
+    {
+        LogError("Timed out waiting for %lu PUBACK(s) before refreshing the sas token", (unsigned long)transport_data->telemetry_inflight.count);
+        result = true;
+    }
+    else
+    {
+        result = false;
+    }
+
+    return result;
+}
+
+static uint32_t get_topics_acknowledged(uint32_t topics_subscribing, const SUBSCRIBE_ACK* suback)
+{
+    uint32_t result = 0;
+    size_t index;
+    size_t qos_index = 0;
+
+    for (index = 0; index < SUBSCRIBE_TOPIC_COUNT && qos_index < suback->qosCount; index++)
+    {
+        if (topics_subscribing & SUBSCRIBE_TOPIC_ORDER[index])
+        {
+            if (suback->qosReturn[qos_index] != DELIVER_FAILURE)
+            {
+                result |= SUBSCRIBE_TOPIC_ORDER[index];
+            }
+            qos_index++;
+        }
+    }
+
+    return result;
+}
+
 static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
 {
     switch (rtn_code)
@@ -372,64 +540,57 @@ static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
     }
 }
 
-static int retrieve_device_method_rid_info(const char* resp_topic, STRING_HANDLE method_name, STRING_HANDLE request_id)
+static const char* find_topic_separator(const char* text, char separator)
 {
-    int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
-    {
-        LogError("Failed creating token from device twin topic.");
-        result = __FAILURE__;
-    }
-    else
+    const char* result = strchr(text, separator);
+    return (result == NULL) ? (text + strlen(text)) : result;
+}
+
+static int retrieve_device_method_rid_info(MQTT_TOPIC_BUFFER* scratch, const char* resp_topic, const char** method_name, STRING_HANDLE request_id)
+{
+    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_004: [ The method name and request id shall be read from the topic in place, walking its "/" separated segments once, and the method name shall be copied in the received property buffer of the transport. ]
+    int result = __FAILURE__;
+    size_t request_id_length = strlen(REQUEST_ID_PROPERTY);
+    size_t segment_index = 0;
+    MQTT_TOPIC_PROPERTY method_info = { NULL, 0, NULL, 0 };
+    const char* segment = resp_topic;
+
+    while (*segment != '\0')
     {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = __FAILURE__;
-        }
-        else
+        const char* segment_end = find_topic_separator(segment, '/');
+        if (segment_end != segment)
         {
-            size_t token_index = 0;
-            size_t request_id_length = strlen(REQUEST_ID_PROPERTY);
-            result = __FAILURE__;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
+            if (segment_index == 3)
+            {
+                method_info.name = segment;
+                method_info.name_length = segment_end - segment;
+            }
+            else if (segment_index == 4)
             {
-                if (token_index == 3)
+                if (((size_t)(segment_end - segment) >= request_id_length) && (memcmp(segment, REQUEST_ID_PROPERTY, request_id_length) == 0))
                 {
-                    if (STRING_concat_with_STRING(method_name, token_value) != 0)
+                    MQTT_TOPIC_DECODED_PROPERTY decoded;
+                    method_info.value = segment + request_id_length;
+                    method_info.value_length = segment_end - method_info.value;
+                    if (mqtt_topic_buffer_decode_property(scratch, &method_info, false, false, &decoded) != 0)
                     {
-                        LogError("Failed STRING_concat_with_STRING.");
-                        result = __FAILURE__;
-                        break;
+                        LogError("Failed copying the method name.");
                     }
-                }
-                else if (token_index == 4)
-                {
-                    if (STRING_length(token_value) >= request_id_length)
+                    else if (STRING_concat(request_id, decoded.value) != 0)
                     {
-                        const char* request_id_value = STRING_c_str(token_value);
-                        if (memcmp(request_id_value, REQUEST_ID_PROPERTY, request_id_length) == 0)
-                        {
-                            if (STRING_concat(request_id, request_id_value+request_id_length) != 0)
-                            {
-                                LogError("Failed STRING_concat failed.");
-                                result = __FAILURE__;
-                            }
-                            else
-                            {
-                                result = 0;
-                            }
-                            break;
-                        }
+                        LogError("Failed STRING_concat failed.");
+                    }
+                    else
+                    {
+                        *method_name = decoded.name;
+                        result = 0;
                     }
                 }
-                token_index++;
+                break;
             }
-            STRING_delete(token_value);
+            segment_index++;
         }
-        STRING_TOKENIZER_destroy(token_handle);
+        segment = (*segment_end == '\0') ? segment_end : segment_end + 1;
     }
     return result;
 }
@@ -579,13 +740,12 @@ static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_H
     IoTHubClientCore_LL_SendComplete(transport_data->llClientHandle, &messageCompleted, confirmResult);
 }
 
-static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
+static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MQTT_TOPIC_BUFFER* topic_buffer, bool urlencode)
 {
     int result = 0;
     const char* const* propertyKeys;
     const char* const* propertyValues;
     size_t propertyCount;
-    size_t index = *index_ptr;
     MAP_HANDLE properties_map = IoTHubMessage_Properties(iothub_message_handle);
     if (properties_map != NULL)
     {
@@ -596,85 +756,45 @@ static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_
         }
         else
         {
-            if (propertyCount != 0)
+            size_t index;
+            for (index = 0; index < propertyCount && result == 0; index++)
             {
-                for (index = 0; index < propertyCount && result == 0; index++)
+                if (mqtt_topic_buffer_append_property(topic_buffer, propertyKeys[index], propertyValues[index], urlencode) != 0)
                 {
-                    if (urlencode)
-                    {
-                        STRING_HANDLE property_key = URL_EncodeString(propertyKeys[index]);
-                        STRING_HANDLE property_value = URL_EncodeString(propertyValues[index]);
-                        if ((property_key == NULL) || (property_value == NULL))
-                        {
-                            LogError("Failed URL Encoding properties");
-                            result = __FAILURE__;
-                        }
-                        else if (STRING_sprintf(topic_string, "%s=%s%s", STRING_c_str(property_key), STRING_c_str(property_value), propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
-                        {
-                            LogError("Failed constructing property string.");
-                            result = __FAILURE__;
-                        }
-                        STRING_delete(property_key);
-                        STRING_delete(property_value);
-                    }
-                    else
-                    {
-                        if (STRING_sprintf(topic_string, "%s=%s%s", propertyKeys[index], propertyValues[index], propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
-                        {
-                            LogError("Failed constructing property string.");
-                            result = __FAILURE__;
-                        }
-                    }
+                    LogError("Failed constructing property string.");
+                    result = __FAILURE__;
                 }
             }
         }
     }
-    *index_ptr = index;
     return result;
 }
 
-static int addSystemPropertyToTopicString(STRING_HANDLE topic_string, size_t index, const char* property_key, const char* property_value, bool urlencode)
+static int addSystemPropertyToTopicString(MQTT_TOPIC_BUFFER* topic_buffer, const char* property_key, const char* property_value, bool urlencode)
 {
-    int result = 0;
+    int result;
 
-    if (urlencode)
+    if (mqtt_topic_buffer_append_system_property(topic_buffer, property_key, property_value, urlencode) != 0)
     {
-        STRING_HANDLE encoded_property_value = URL_EncodeString(property_value);
-        if (encoded_property_value == NULL)
-        {
-            LogError("Failed URL encoding %s.", property_key);
-            result = __FAILURE__;
-        }
-        else if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, STRING_c_str(encoded_property_value)) != 0)
-        {
-            LogError("Failed setting %s.", property_key);
-            result = __FAILURE__;
-        }
-        STRING_delete(encoded_property_value);
+        LogError("Failed setting %s.", property_key);
+        result = __FAILURE__;
     }
     else
     {
-        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, property_value) != 0)
-        {
-            LogError("Failed setting %s.", property_key);
-            result = __FAILURE__;
-        }
+        result = 0;
     }
     return result;
 }
 
-static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
+static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MQTT_TOPIC_BUFFER* topic_buffer, bool urlencode)
 {
-    (void)urlencode;
     int result = 0;
-    size_t index = *index_ptr;
 
     /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_052: [ IoTHubTransport_MQTT_Common_DoWork shall check for the CorrelationId property and if found add the value as a system property in the format of $.cid=<id> ] */
     const char* correlation_id = IoTHubMessage_GetCorrelationId(iothub_message_handle);
     if (correlation_id != NULL)
     {
-        result = addSystemPropertyToTopicString(topic_string, index, CORRELATION_ID_PROPERTY, correlation_id, urlencode);
-        index++;
+        result = addSystemPropertyToTopicString(topic_buffer, CORRELATION_ID_PROPERTY, correlation_id, urlencode);
     }
     /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_053: [ IoTHubTransport_MQTT_Common_DoWork shall check for the MessageId property and if found add the value as a system property in the format of $.mid=<id> ] */
     if (result == 0)
@@ -682,8 +802,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         const char* msg_id = IoTHubMessage_GetMessageId(iothub_message_handle);
         if (msg_id != NULL)
         {
-            result = addSystemPropertyToTopicString(topic_string, index, MESSAGE_ID_PROPERTY, msg_id, urlencode);
-            index++;
+            result = addSystemPropertyToTopicString(topic_buffer, MESSAGE_ID_PROPERTY, msg_id, urlencode);
         }
     }
     // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_010: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the ContentType property and if found add the `value` as a system property in the format of `$.ct=<value>` ]
@@ -692,8 +811,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         const char* content_type = IoTHubMessage_GetContentTypeSystemProperty(iothub_message_handle);
         if (content_type != NULL)
         {
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_TYPE_PROPERTY, content_type, urlencode);
-            index++;
+            result = addSystemPropertyToTopicString(topic_buffer, CONTENT_TYPE_PROPERTY, content_type, urlencode);
         }
     }
     // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_011: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the ContentEncoding property and if found add the `value` as a system property in the format of `$.ce=<value>` ]
@@ -702,18 +820,15 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         const char* content_encoding = IoTHubMessage_GetContentEncodingSystemProperty(iothub_message_handle);
         if (content_encoding != NULL)
         {
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_ENCODING_PROPERTY, content_encoding, urlencode);
-            index++;
+            result = addSystemPropertyToTopicString(topic_buffer, CONTENT_ENCODING_PROPERTY, content_encoding, urlencode);
         }
     }
-    *index_ptr = index;
     return result;
 }
 
-static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr)
+static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MQTT_TOPIC_BUFFER* topic_buffer)
 {
     int result = 0;
-    size_t index = *index_ptr;
 
     // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_014: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the diagnostic properties including diagid and diagCreationTimeUtc and if found both add them as system property in the format of `$.diagid` and `$.diagctx` respectively]
     const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* diagnosticData = IoTHubMessage_GetDiagnosticPropertyData(iothub_message_handle);
@@ -724,47 +839,18 @@ static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
         //diagid and creationtimeutc must be present/unpresent simultaneously
         if (diag_id != NULL && creation_time_utc != NULL)
         {
-            if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_ID_PROPERTY, diag_id) != 0)
+            if (mqtt_topic_buffer_append_system_property(topic_buffer, DIAGNOSTIC_ID_PROPERTY, diag_id, false) != 0)
             {
                 LogError("Failed setting diagnostic id");
                 result = __FAILURE__;
             }
-            index++;
-
-            if (result == 0)
+            //diagnostic context is urlencode(key1=value1,key2=value2), add other diagnostic context properties here if have more
+            else if ((mqtt_topic_buffer_append_system_property(topic_buffer, DIAGNOSTIC_CONTEXT_PROPERTY, DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY, true) != 0) ||
+                (mqtt_topic_buffer_append_url_encoded(topic_buffer, "=") != 0) ||
+                (mqtt_topic_buffer_append_url_encoded(topic_buffer, creation_time_utc) != 0))
             {
-                //construct diagnostic context, it should be urlencode(key1=value1,key2=value2)
-                STRING_HANDLE diagContextHandle = STRING_construct_sprintf("%s=%s", DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY, creation_time_utc);
-                if (diagContextHandle == NULL)
-                {
-                    LogError("Failed constructing diagnostic context");
-                    result = __FAILURE__;
-                }
-                else
-                {
-                    //Add other diagnostic context properties here if have more
-                    STRING_HANDLE encodedContextValueHandle = URL_Encode(diagContextHandle);
-                    const char* encodedContextValueString = NULL;
-                    if (encodedContextValueHandle != NULL &&
-                        (encodedContextValueString = STRING_c_str(encodedContextValueHandle)) != NULL)
-                    {
-                        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_CONTEXT_PROPERTY, encodedContextValueString) != 0)
-                        {
-                            LogError("Failed setting diagnostic context");
-                            result = __FAILURE__;
-                        }
-                        STRING_delete(encodedContextValueHandle);
-                        encodedContextValueHandle = NULL;
-                    }
-                    else
-                    {
-                        LogError("Failed encoding diagnostic context value");
-                        result = __FAILURE__;
-                    }
-                    STRING_delete(diagContextHandle);
-                    diagContextHandle = NULL;
-                    index++;
-                }
+                LogError("Failed setting diagnostic context");
+                result = __FAILURE__;
             }
         }
         else if (diag_id != NULL || creation_time_utc != NULL)
@@ -778,48 +864,81 @@ static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
 }
 
 
-static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic, bool urlencode)
+static int addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, MQTT_TOPIC_BUFFER* topic_buffer, bool urlencode)
 {
-    size_t index = 0;
-    STRING_HANDLE result = STRING_construct(eventTopic);
-    if (result == NULL)
-    {
-        LogError("Failed to create event topic string handle");
-    }
-    else if (addUserPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
+    int result;
+
+    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_003: [ The telemetry topic shall be built in the topic buffer of the transport, truncated back to "devices/{id}/messages/events/" before the properties of the message are appended. ]
+    mqtt_topic_buffer_reset(topic_buffer);
+    if (addUserPropertiesTouMqttMessage(iothub_message_handle, topic_buffer, urlencode) != 0)
     {
         LogError("Failed adding Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
+        result = __FAILURE__;
     }
-    else if (addSystemPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
+    else if (addSystemPropertiesTouMqttMessage(iothub_message_handle, topic_buffer, urlencode) != 0)
     {
         LogError("Failed adding System Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
+        result = __FAILURE__;
     }
-    else if (addDiagnosticPropertiesTouMqttMessage(iothub_message_handle, result, &index) != 0)
+    else if (addDiagnosticPropertiesTouMqttMessage(iothub_message_handle, topic_buffer) != 0)
     {
         LogError("Failed adding Diagnostic Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
     }
 
     return result;
 }
 
-static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
+// QoS 0 publishes have no packet id and are neither acknowledged nor resent, once mqtt_client_publish
+// returns the packet has been handed to the IO and nothing is left to track
+static int publish_mqtt_telemetry_msg_at_most_once(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE messageHandle, const unsigned char* payload, size_t len)
 {
     int result;
-    STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transport_data->topic_MqttEvent), transport_data->auto_url_encode_decode);
-    if (msgTopic == NULL)
+    if (addPropertiesTouMqttMessage(messageHandle, &transport_data->telemetry_topic, transport_data->auto_url_encode_decode) != 0)
+    {
+        LogError("Failed adding properties to mqtt message");
+        result = __FAILURE__;
+    }
+    else
+    {
+        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(0, transport_data->telemetry_topic.topic, DELIVER_AT_MOST_ONCE, payload, len);
+        if (mqttMsg == NULL)
+        {
+            LogError("Failed creating mqtt message");
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
+            {
+                LogError("Failed attempting to publish mqtt message");
+                result = __FAILURE__;
+            }
+            else
+            {
+                result = 0;
+            }
+            mqttmessage_destroy(mqttMsg);
+        }
+    }
+    return result;
+}
+
+static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len, bool resumed)
+{
+    int result;
+    if (addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, &transport_data->telemetry_topic, transport_data->auto_url_encode_decode) != 0)
     {
         LogError("Failed adding properties to mqtt message");
         result = __FAILURE__;
     }
     else
     {
-        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->packet_id, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
+        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->inflight_entry.packet_id, transport_data->telemetry_topic.topic, DELIVER_AT_LEAST_ONCE, payload, len);
         if (mqttMsg == NULL)
         {
             LogError("Failed creating mqtt message");
@@ -827,7 +946,12 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
         }
         else
         {
-            if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
+            if (resumed && mqttmessage_setIsDuplicateMsg(mqttMsg, true) != 0)
+            {
+                LogError("Failed setting the DUP flag of the mqtt message");
+                result = __FAILURE__;
+            }
+            else if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
             {
                 LogError("Failed retrieving tickcounter info");
                 result = __FAILURE__;
@@ -841,17 +965,95 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
                 }
                 else
                 {
-                    mqttMsgEntry->retryCount++;
+                    if (!resumed)
+                    {
+                        mqttMsgEntry->retryCount++;
+                    }
+                    if (timer_wheel_start(&transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer, mqttMsgEntry->msgPublishTime, RESEND_TIMEOUT_VALUE_MS) != 0)
+                    {
+                        LogError("Failed arming the resend timer of the telemetry message");
+                    }
                     result = 0;
                 }
             }
             mqttmessage_destroy(mqttMsg);
         }
-        STRING_delete(msgTopic);
     }
     return result;
 }
 
+static const unsigned char* RetrieveMessagePayload(IOTHUB_MESSAGE_HANDLE messageHandle, size_t* length)
+{
+    const unsigned char* result;
+
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        if (IoTHubMessage_GetByteArray(messageHandle, &result, length) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("Failure result from IoTHubMessage_GetByteArray");
+            result = NULL;
+            *length = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        result = (const unsigned char*)IoTHubMessage_GetString(messageHandle);
+        if (result == NULL)
+        {
+            LogError("Failure result from IoTHubMessage_GetString");
+            result = NULL;
+            *length = 0;
+        }
+        else
+        {
+            *length = strlen((const char*)result);
+        }
+    }
+    else
+    {
+        result = NULL;
+        *length = 0;
+    }
+    return result;
+}
+
+static void on_session_resumed(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    PDLIST_ENTRY current_entry;
+
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_017: [ When "persistent_session" is set and the CONNACK reports the session is present, the topics acknowledged by a SUBACK in that session shall not be subscribed again. ] */
+    transport_data->topics_ToSubscribe &= ~transport_data->topics_Subscribed;
+
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_018: [ If no topic is left to subscribe, IoTHubTransport_MQTT_Common_DoWork shall carry on as if the SUBACK had been received. ] */
+    if (transport_data->topics_ToSubscribe == UNSUBSCRIBE_FROM_TOPIC)
+    {
+        transport_data->currPacketState = SUBACK_TYPE;
+    }
+
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_019: [ The telemetry messages waiting for their PUBACK shall be published again when the CONNACK is received, with the packet id they were first sent with and the DUP flag set, without counting it as one of their resends. ] */
+    current_entry = transport_data->telemetry_waitingForAck.Flink;
+    while (current_entry != &transport_data->telemetry_waitingForAck)
+    {
+        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
+        size_t messageLength;
+        const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
+        current_entry = current_entry->Flink;
+
+        if (messageLength == 0 || messagePayload == NULL)
+        {
+            // Left to its resend timer
+            LogError("Failure from creating Message IoTHubMessage_GetData");
+        }
+        else if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength, true) != 0)
+        {
+            remove_telemetry_in_flight(transport_data, mqttMsgEntry);
+            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+            free_message_details(transport_data, mqttMsgEntry);
+        }
+    }
+}
+
 static int publish_device_method_message(MQTTTRANSPORT_HANDLE_DATA* transport_data, int status_code, STRING_HANDLE request_id, const unsigned char* response, size_t response_size)
 {
     int result;
@@ -991,14 +1193,14 @@ static int publish_device_twin_message(MQTTTRANSPORT_HANDLE_DATA* transport_data
     return result;
 }
 
-static bool isSystemProperty(const char* tokenData)
+static bool isSystemProperty(const char* tokenData, size_t tokenLen)
 {
     bool result = false;
     size_t propCount = sizeof(sysPropList)/sizeof(sysPropList[0]);
     size_t index = 0;
     for (index = 0; index < propCount; index++)
     {
-        if (memcmp(tokenData, sysPropList[index].propName, sysPropList[index].propLength) == 0)
+        if ((tokenLen >= sysPropList[index].propLength) && (memcmp(tokenData, sysPropList[index].propName, sysPropList[index].propLength) == 0))
         {
             result = true;
             break;
@@ -1057,178 +1259,58 @@ static int setMqttMessagePropertyIfPossible(IOTHUB_MESSAGE_HANDLE IoTHubMessage,
     return result;
 }
 
-static int extractMqttProperties(IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* topic_name, bool urldecode)
+static int extractMqttProperties(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* topic_name, bool urldecode)
 {
     int result;
-    STRING_HANDLE mqttTopic = STRING_construct(topic_name);
-    if (mqttTopic == NULL)
+    MAP_HANDLE propertyMap = IoTHubMessage_Properties(IoTHubMessage);
+    if (propertyMap == NULL)
     {
-        LogError("Failure constructing string topic name.");
+        LogError("Failure to retrieve IoTHubMessage_properties.");
         result = __FAILURE__;
     }
     else
     {
-        STRING_TOKENIZER_HANDLE token = STRING_TOKENIZER_create(mqttTopic);
-        if (token != NULL)
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_005: [ The properties of a received message shall be read from the topic in place, walking its "&" separated properties once, and each one shall be decoded in the received property buffer of the transport before being set on the message. ]
+        const char* token = topic_name;
+        result = 0;
+
+        while (*token != '\0' && result == 0)
         {
-            MAP_HANDLE propertyMap = IoTHubMessage_Properties(IoTHubMessage);
-            if (propertyMap == NULL)
-            {
-                LogError("Failure to retrieve IoTHubMessage_properties.");
-                result = __FAILURE__;
-            }
-            else
+            const char* token_end = find_topic_separator(token, PROPERTY_SEPARATOR[0]);
+            const char* equal_sign = (const char*)memchr(token, '=', token_end - token);
+            if (equal_sign != NULL)
             {
-                STRING_HANDLE output = STRING_new();
-                if (output == NULL)
+                MQTT_TOPIC_PROPERTY property;
+                MQTT_TOPIC_DECODED_PROPERTY decoded;
+                bool system_property = isSystemProperty(token, token_end - token);
+
+                property.name = token;
+                property.name_length = equal_sign - token;
+                property.value = equal_sign + 1;
+                property.value_length = token_end - property.value;
+
+                // System property names are matched as received, only their value is decoded
+                if (mqtt_topic_buffer_decode_property(&transport_data->received_property, &property, urldecode && !system_property, urldecode, &decoded) != 0)
                 {
-                    LogError("Failure to allocate STRING_new.");
+                    LogError("Failed to URL decode property");
                     result = __FAILURE__;
                 }
-                else
+                else if (system_property)
                 {
-                    result = 0;
-
-                    while (STRING_TOKENIZER_get_next_token(token, output, PROPERTY_SEPARATOR) == 0 && result == 0)
+                    if (setMqttMessagePropertyIfPossible(IoTHubMessage, decoded.name, decoded.value, property.name_length) != 0)
                     {
-                        const char* tokenData = STRING_c_str(output);
-                        size_t tokenLen = strlen(tokenData);
-                        if (tokenData == NULL || tokenLen == 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            if (isSystemProperty(tokenData))
-                            {
-                                const char* iterator = tokenData;
-                                while (iterator != NULL && *iterator != '\0' && result == 0)
-                                {
-                                    if (*iterator == '=')
-                                    {
-                                        size_t nameLen = iterator - tokenData;
-                                        char* propName = malloc(nameLen + 1);
-
-                                        size_t valLen = tokenLen - (nameLen + 1) + 1;
-                                        char* propValue = malloc(valLen + 1);
-
-                                        if (propName == NULL || propValue == NULL)
-                                        {
-                                            LogError("Failed allocating property name (%p) and/or value (%p)", propName, propValue);
-                                            result = __FAILURE__;
-                                        }
-                                        else
-                                        {
-                                            strncpy(propName, tokenData, nameLen);
-                                            propName[nameLen] = '\0';
-
-                                            strncpy(propValue, iterator + 1, valLen);
-                                            propValue[valLen] = '\0';
-
-                                            if (urldecode)
-                                            {
-                                                STRING_HANDLE propValue_decoded;
-                                                if ((propValue_decoded = URL_DecodeString(propValue)) == NULL)
-                                                {
-                                                    LogError("Failed to URL decode property value");
-                                                    result = __FAILURE__;
-                                                }
-                                                else if (setMqttMessagePropertyIfPossible(IoTHubMessage, propName, STRING_c_str(propValue_decoded), nameLen) != 0)
-                                                {
-                                                    LogError("Unable to set message property");
-                                                    result = __FAILURE__;
-                                                }
-                                                STRING_delete(propValue_decoded);
-                                            }
-                                            else
-                                            {
-                                                if (setMqttMessagePropertyIfPossible(IoTHubMessage, propName, propValue, nameLen) != 0)
-                                                {
-                                                    LogError("Unable to set message property");
-                                                    result = __FAILURE__;
-                                                }
-                                            }
-                                        }
-                                        free(propName);
-                                        free(propValue);
-
-                                        break;
-                                    }
-                                    iterator++;
-                                }
-                            }
-                            else //User Properties
-                            {
-                                const char* iterator = tokenData;
-                                while (iterator != NULL && *iterator != '\0' && result == 0)
-                                {
-                                    if (*iterator == '=')
-                                    {
-                                        size_t nameLen = iterator - tokenData;
-                                        char* propName = malloc(nameLen + 1);
-
-                                        size_t valLen = tokenLen - (nameLen + 1) + 1;
-                                        char* propValue = malloc(valLen + 1);
-
-                                        if (propName == NULL || propValue == NULL)
-                                        {
-                                            result = __FAILURE__;
-                                        }
-                                        else
-                                        {
-                                            strncpy(propName, tokenData, nameLen);
-                                            propName[nameLen] = '\0';
-
-                                            strncpy(propValue, iterator + 1, valLen);
-                                            propValue[valLen] = '\0';
-
-                                            if (urldecode)
-                                            {
-                                                STRING_HANDLE propName_decoded = URL_DecodeString(propName);
-                                                STRING_HANDLE propValue_decoded = URL_DecodeString(propValue);
-                                                if (propName_decoded == NULL || propValue_decoded == NULL)
-                                                {
-                                                    LogError("Failed to URL decode property");
-                                                    result = __FAILURE__;
-                                                }
-                                                else if (Map_AddOrUpdate(propertyMap, STRING_c_str(propName_decoded), STRING_c_str(propValue_decoded)) != MAP_OK)
-                                                {
-                                                    LogError("Map_AddOrUpdate failed.");
-                                                    result = __FAILURE__;
-                                                }
-                                                STRING_delete(propName_decoded);
-                                                STRING_delete(propValue_decoded);
-                                            }
-                                            else
-                                            {
-                                                if (Map_AddOrUpdate(propertyMap, propName, propValue) != MAP_OK)
-                                                {
-                                                    LogError("Map_AddOrUpdate failed.");
-                                                    result = __FAILURE__;
-                                                }
-                                            }
-                                        }
-                                        free(propName);
-                                        free(propValue);
-
-                                        break;
-                                    }
-                                    iterator++;
-                                }
-                            }
-                        }
+                        LogError("Unable to set message property");
+                        result = __FAILURE__;
                     }
-                    STRING_delete(output);
+                }
+                else if (Map_AddOrUpdate(propertyMap, decoded.name, decoded.value) != MAP_OK)
+                {
+                    LogError("Map_AddOrUpdate failed.");
+                    result = __FAILURE__;
                 }
             }
-            STRING_TOKENIZER_destroy(token);
+            token = (*token_end == '\0') ? token_end : token_end + 1;
         }
-        else
-        {
-            LogError("Unable to create Tokenizer object.");
-            result = __FAILURE__;
-        }
-        STRING_delete(mqttTopic);
     }
     return result;
 }
@@ -1296,45 +1378,37 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
             }
             else if (type == IOTHUB_TYPE_DEVICE_METHODS)
             {
-                STRING_HANDLE method_name = STRING_new();
-                if (method_name == NULL)
+                DEVICE_METHOD_INFO* dev_method_info = malloc(sizeof(DEVICE_METHOD_INFO) );
+                if (dev_method_info == NULL)
                 {
-                    LogError("Failure: allocating method_name string value");
+                    LogError("Failure: allocating DEVICE_METHOD_INFO object");
                 }
                 else
                 {
-                    DEVICE_METHOD_INFO* dev_method_info = malloc(sizeof(DEVICE_METHOD_INFO) );
-                    if (dev_method_info == NULL)
+                    const char* method_name;
+                    dev_method_info->request_id = STRING_new();
+                    if (dev_method_info->request_id == NULL)
+                    {
+                        LogError("Failure constructing request_id string");
+                        free(dev_method_info);
+                    }
+                    else if (retrieve_device_method_rid_info(&transportData->received_property, topic_resp, &method_name, dev_method_info->request_id) != 0)
                     {
-                        LogError("Failure: allocating DEVICE_METHOD_INFO object");
+                        LogError("Failure: retrieve device topic info");
+                        STRING_delete(dev_method_info->request_id);
+                        free(dev_method_info);
                     }
                     else
                     {
-                        dev_method_info->request_id = STRING_new();
-                        if (dev_method_info->request_id == NULL)
-                        {
-                            LogError("Failure constructing request_id string");
-                            free(dev_method_info);
-                        }
-                        else if (retrieve_device_method_rid_info(topic_resp, method_name, dev_method_info->request_id) != 0)
+                        /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
+                        const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+                        if (IoTHubClientCore_LL_DeviceMethodComplete(transportData->llClientHandle, method_name, payload->message, payload->length, (void*)dev_method_info) != 0)
                         {
-                            LogError("Failure: retrieve device topic info");
+                            LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
                             STRING_delete(dev_method_info->request_id);
                             free(dev_method_info);
                         }
-                        else
-                        {
-                            /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
-                            const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                            if (IoTHubClientCore_LL_DeviceMethodComplete(transportData->llClientHandle, STRING_c_str(method_name), payload->message, payload->length, (void*)dev_method_info) != 0)
-                            {
-                                LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
-                                STRING_delete(dev_method_info->request_id);
-                                free(dev_method_info);
-                            }
-                        }
                     }
-                    STRING_delete(method_name);
                 }
             }
             else
@@ -1348,7 +1422,7 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                 else
                 {
                     // Will need to update this when the service has messages that can be rejected
-                    if (extractMqttProperties(IoTHubMessage, topic_resp, transportData->auto_url_encode_decode) != 0)
+                    if (extractMqttProperties(transportData, IoTHubMessage, topic_resp, transportData->auto_url_encode_decode) != 0)
                     {
                         LogError("failure extracting mqtt properties.");
                     }
@@ -1395,20 +1469,15 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                 const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
                 if (puback != NULL)
                 {
-                    PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                    while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_006: [ The telemetry message acknowledged by a PUBACK shall be found by its packet id without going through the other messages waiting for their PUBACK. ] */
+                    INFLIGHT_TABLE_ENTRY* inflight_entry = inflight_table_remove(&transport_data->telemetry_inflight, puback->packetId);
+                    if (inflight_entry != NULL)
                     {
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                        DLIST_ENTRY saveListEntry;
-                        saveListEntry.Flink = currentListEntry->Flink;
-
-                        if (puback->packetId == mqttMsgEntry->packet_id)
-                        {
-                            (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
-                            free(mqttMsgEntry);
-                        }
-                        currentListEntry = saveListEntry.Flink;
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(inflight_entry, MQTT_MESSAGE_DETAILS_LIST, inflight_entry);
+                        (void)DList_RemoveEntryList(&mqttMsgEntry->entry); //First remove the item from Waiting for Ack List.
+                        timer_wheel_cancel(&transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer);
+                        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        free_message_details(transport_data, mqttMsgEntry);
                     }
                 }
                 else
@@ -1432,6 +1501,18 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                         // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_008: [ Upon successful connection the retry control shall be reset using retry_control_reset() ]
                         retry_control_reset(transport_data->retry_control_handle);
 
+                        transport_data->topics_Subscribing = 0;
+                        transport_data->sas_token_refresh_draining = false;
+                        if (!connack->isSessionPresent)
+                        {
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_016: [ When a CONNACK reports no session is present, the topics recorded as subscribed shall be forgotten. ] */
+                            transport_data->topics_Subscribed = 0;
+                        }
+                        else if (transport_data->persistent_session)
+                        {
+                            on_session_resumed(transport_data);
+                        }
+
                         IoTHubClientCore_LL_ConnectionStatusCallBack(transport_data->llClientHandle, IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
                     }
                     else
@@ -1477,6 +1558,12 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                             LogError("Subscribe delivery failure of subscribe %zu", index);
                         }
                     }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_020: [ A SUBACK shall record as subscribed the topics of the SUBSCRIBE it acknowledges that were not refused. ] */
+                    if (transport_data->topics_Subscribing != 0 && suback->packetId == transport_data->subscribe_packet_id)
+                    {
+                        transport_data->topics_Subscribed |= get_topics_acknowledged(transport_data->topics_Subscribing, suback);
+                        transport_data->topics_Subscribing = 0;
+                    }
                     // The connect packet has been acked
                     transport_data->currPacketState = SUBACK_TYPE;
                 }
@@ -1639,8 +1726,10 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 
         if (subscribe_count != 0)
         {
+            uint16_t packet_id = get_next_packet_id(transport_data);
+
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_016: [IoTHubTransport_MQTT_Common_Subscribe shall call mqtt_client_subscribe to subscribe to the Message Topic.] */
-            if (mqtt_client_subscribe(transport_data->mqttClient, get_next_packet_id(transport_data), subscribe, subscribe_count) != 0)
+            if (mqtt_client_subscribe(transport_data->mqttClient, packet_id, subscribe, subscribe_count) != 0)
             {
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_017: [Upon failure IoTHubTransport_MQTT_Common_Subscribe shall return a non-zero value.] */
                 LogError("Failure: mqtt_client_subscribe returned error.");
@@ -1649,6 +1738,8 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
             {
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_018: [On success IoTHubTransport_MQTT_Common_Subscribe shall return 0.] */
                 transport_data->topics_ToSubscribe &= ~topic_subscription;
+                transport_data->topics_Subscribing = topic_subscription;
+                transport_data->subscribe_packet_id = packet_id;
                 transport_data->currPacketState = SUBSCRIBE_TYPE;
             }
         }
@@ -1665,42 +1756,6 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     }
 }
 
-static const unsigned char* RetrieveMessagePayload(IOTHUB_MESSAGE_HANDLE messageHandle, size_t* length)
-{
-    const unsigned char* result;
-
-    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
-    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
-    {
-        if (IoTHubMessage_GetByteArray(messageHandle, &result, length) != IOTHUB_MESSAGE_OK)
-        {
-            LogError("Failure result from IoTHubMessage_GetByteArray");
-            result = NULL;
-            *length = 0;
-        }
-    }
-    else if (contentType == IOTHUBMESSAGE_STRING)
-    {
-        result = (const unsigned char*)IoTHubMessage_GetString(messageHandle);
-        if (result == NULL)
-        {
-            LogError("Failure result from IoTHubMessage_GetString");
-            result = NULL;
-            *length = 0;
-        }
-        else
-        {
-            *length = strlen((const char*)result);
-        }
-    }
-    else
-    {
-        result = NULL;
-        *length = 0;
-    }
-    return result;
-}
-
 static int GetTransportProviderIfNecessary(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
     int result;
@@ -1976,7 +2031,10 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
             }
             else
             {
-                if ((current_time - transport_data->mqtt_connect_time) / 1000 > (transport_data->option_sas_token_lifetime_secs*SAS_REFRESH_MULTIPLIER))
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_022: [ If "sas_token_refresh_drain" is set, IoTHubTransport_MQTT_Common_DoWork shall stop publishing telemetry and keep the connection until the telemetry messages waiting for their PUBACK are acknowledged before disconnecting to refresh the sas token. ] */
+                // The hub closes a connection when another one opens with the same client id, so the new token can only be used once this one is done
+                if ((current_time - transport_data->mqtt_connect_time) / 1000 > (transport_data->option_sas_token_lifetime_secs*SAS_REFRESH_MULTIPLIER) &&
+                    (!transport_data->sas_token_refresh_drain || is_sas_token_refresh_drained(transport_data, current_time)))
                 {
                     /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_058: [ If the sas token has timed out IoTHubTransport_MQTT_Common_DoWork shall disconnect from the mqtt client and destroy the transport information and wait for reconnect. ] */
                     OPTIONHANDLER_HANDLE options = xio_retrieveoptions(transport_data->xioTransport);
@@ -1989,6 +2047,7 @@ static int InitializeConnection(PMQTTTRANSPORT_HANDLE_DATA transport_data)
                     transport_data->mqttClientStatus = MQTT_CLIENT_STATUS_NOT_CONNECTED;
                     transport_data->currPacketState = UNKNOWN_TYPE;
                     transport_data->device_twin_get_sent = false;
+                    transport_data->sas_token_refresh_draining = false;
                     if (transport_data->topic_MqttMessage != NULL)
                     {
                         transport_data->topics_ToSubscribe |= SUBSCRIBE_TELEMETRY_TOPIC;
@@ -2054,9 +2113,15 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
         }
         else
         {
-            if ( (state->topic_MqttEvent = STRING_construct_sprintf(TOPIC_DEVICE_DEVICE, upperConfig->deviceId) ) == NULL)
+            if (mqtt_topic_buffer_init(&state->telemetry_topic, TOPIC_DEVICE_EVENTS_BEGIN, upperConfig->deviceId, TOPIC_DEVICE_EVENTS_END) != 0)
             {
-                LogError("Could not create topic_MqttEvent for MQTT");
+                LogError("Could not create the telemetry topic for MQTT");
+                free_transport_handle_data(state);
+                state = NULL;
+            }
+            else if (mqtt_topic_buffer_init(&state->received_property, "", "", "") != 0)
+            {
+                LogError("Could not create the buffer received properties are decoded in");
                 free_transport_handle_data(state);
                 state = NULL;
             }
@@ -2096,6 +2161,9 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransport_MQTT_Common_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
                         DList_InitializeListHead(&(state->telemetry_waitingForAck));
+                        inflight_table_init(&(state->telemetry_inflight));
+                        timer_wheel_init(&(state->telemetry_resend_timers));
+                        state->telemetry_resend_now_ms = 0;
                         DList_InitializeListHead(&(state->ack_waiting_queue));
                         state->isDestroyCalled = false;
                         state->isRegistered = false;
@@ -2116,13 +2184,24 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                         state->topic_GetState = NULL;
                         state->topic_NotifyState = NULL;
                         state->topics_ToSubscribe = UNSUBSCRIBE_FROM_TOPIC;
+                        state->topics_Subscribed = UNSUBSCRIBE_FROM_TOPIC;
+                        state->topics_Subscribing = UNSUBSCRIBE_FROM_TOPIC;
+                        state->subscribe_packet_id = 0;
+                        state->persistent_session = false;
                         state->topic_DeviceMethods = NULL;
                         state->log_trace = state->raw_trace = false;
                         srand((unsigned int)get_time(NULL));
                         state->authorization_module = auth_module;
                         state->isProductInfoSet = false;
                         state->option_sas_token_lifetime_secs = SAS_TOKEN_DEFAULT_LIFETIME;
+                        state->sas_token_refresh_drain = false;
+                        state->sas_token_refresh_drain_timeout_ms = DEFAULT_SAS_REFRESH_DRAIN_TIMEOUT_MS;
+                        state->sas_token_refresh_draining = false;
+                        state->sas_token_refresh_drain_end = 0;
                         state->auto_url_encode_decode = false;
+                        state->max_inflight_messages = 0;
+                        state->max_publishes_per_dowork = 0;
+                        state->telemetry_at_most_once = false;
                     }
                 }
             }
@@ -2224,8 +2303,9 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
         {
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->telemetry_waitingForAck);
             MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
+            timer_wheel_cancel(&transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer);
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
-            free(mqttMsgEntry);
+            free_message_details(transport_data, mqttMsgEntry);
         }
         while (!DList_IsListEmpty(&transport_data->ack_waiting_queue))
         {
@@ -2314,6 +2394,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE han
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_049: [If subscribe_state is set to IOTHUB_DEVICE_TWIN_DESIRED_STATE then IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin shall unsubscribe from the topic_GetState to the mqtt client.] */
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
             STRING_delete(transport_data->topic_GetState);
             transport_data->topic_GetState = NULL;
         }
@@ -2321,6 +2402,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE han
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_050: [If subscribe_state is set to IOTHUB_DEVICE_TWIN_NOTIFICATION_STATE then IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin shall unsubscribe from the topic_NotifyState to the mqtt client.] */
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
             STRING_delete(transport_data->topic_NotifyState);
             transport_data->topic_NotifyState = NULL;
         }
@@ -2406,6 +2488,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE h
             STRING_delete(transport_data->topic_DeviceMethods);
             transport_data->topic_DeviceMethods = NULL;
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_DEVICE_METHOD_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_DEVICE_METHOD_TOPIC;
         }
     }
     else
@@ -2504,6 +2587,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
         STRING_delete(transport_data->topic_MqttMessage);
         transport_data->topic_MqttMessage = NULL;
         transport_data->topics_ToSubscribe &= ~SUBSCRIBE_TELEMETRY_TOPIC;
+        transport_data->topics_Subscribed &= ~SUBSCRIBE_TELEMETRY_TOPIC;
     }
     else
     {
@@ -2573,6 +2657,67 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_MQTT_Common_ProcessItem(TRANSPORT_LL_
     return result;
 }
 
+static void defer_telemetry_resend(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry)
+{
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_025: [ A telemetry message that cannot be resent when its resend is due shall be looked at again once, by the next IoTHubTransport_MQTT_Common_DoWork. ] */
+    // Armed past the time being processed, an already due timer would fire again on every millisecond left to process
+    (void)timer_wheel_start(&transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer, transport_data->telemetry_resend_now_ms, 1);
+}
+
+static void on_telemetry_resend_due(void* context)
+{
+    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)context;
+    PMQTTTRANSPORT_HANDLE_DATA transport_data = (PMQTTTRANSPORT_HANDLE_DATA)mqttMsgEntry->context;
+
+    if (transport_data->currPacketState != PUBLISH_TYPE)
+    {
+        // An earlier message of this batch dropped the connection, look at this one again once publishing resumes
+        defer_telemetry_resend(transport_data, mqttMsgEntry);
+    }
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransport_MQTT_Common_DoWork has resent the message two times then it shall fail the message and reconnect to IoTHub ... ] */
+    else if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
+    {
+        PDLIST_ENTRY current_entry;
+        remove_telemetry_in_flight(transport_data, mqttMsgEntry);
+        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+        free_message_details(transport_data, mqttMsgEntry);
+
+        transport_data->currPacketState = PACKET_TYPE_ERROR;
+        transport_data->device_twin_get_sent = false;
+        DisconnectFromClient(transport_data);
+
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_057: [ ... then go through all the rest of the waiting messages and reset the retryCount on the message. ]*/
+        current_entry = transport_data->telemetry_waitingForAck.Flink;
+        while (current_entry != &transport_data->telemetry_waitingForAck)
+        {
+            MQTT_MESSAGE_DETAILS_LIST* msg_reset_entry;
+            msg_reset_entry = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
+            msg_reset_entry->retryCount = 0;
+            current_entry = current_entry->Flink;
+        }
+    }
+    else
+    {
+        size_t messageLength;
+        const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
+        if (messageLength == 0 || messagePayload == NULL)
+        {
+            LogError("Failure from creating Message IoTHubMessage_GetData");
+            // Try again on the next DoWork
+            defer_telemetry_resend(transport_data, mqttMsgEntry);
+        }
+        else
+        {
+            if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength, false) != 0)
+            {
+                remove_telemetry_in_flight(transport_data, mqttMsgEntry);
+                sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                free_message_details(transport_data, mqttMsgEntry);
+            }
+        }
+    }
+}
+
 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ IoTHubTransport_MQTT_Common_DoWork shall subscribe to the Notification and get_state Topics if they are defined. ] */
 void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
@@ -2617,65 +2762,30 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
             }
             else if (transport_data->currPacketState == PUBLISH_TYPE)
             {
-                PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                PDLIST_ENTRY currentListEntry;
+                size_t publish_count = 0;
+
+                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransport_MQTT_Common_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
+                // Only the messages whose resend timer expired are visited, see on_telemetry_resend_due
+                if (transport_data->telemetry_waitingForAck.Flink != &transport_data->telemetry_waitingForAck)
                 {
                     tickcounter_ms_t current_ms;
-                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                    DLIST_ENTRY nextListEntry;
-                    nextListEntry.Flink = currentListEntry->Flink;
-
-                    (void)tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms);
-                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransport_MQTT_Common_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
-                    if (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN)
+                    if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) != 0)
                     {
-                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransport_MQTT_Common_DoWork has resent the message two times then it shall fail the message and reconnect to IoTHub ... ] */
-                        if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
-                        {
-                            PDLIST_ENTRY current_entry;
-                            (void)DList_RemoveEntryList(currentListEntry);
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
-                            free(mqttMsgEntry);
-
-                            transport_data->currPacketState = PACKET_TYPE_ERROR;
-                            transport_data->device_twin_get_sent = false;
-                            DisconnectFromClient(transport_data);
-
-                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_057: [ ... then go through all the rest of the waiting messages and reset the retryCount on the message. ]*/
-                            current_entry = transport_data->telemetry_waitingForAck.Flink;
-                            while (current_entry != &transport_data->telemetry_waitingForAck)
-                            {
-                                MQTT_MESSAGE_DETAILS_LIST* msg_reset_entry;
-                                msg_reset_entry = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                                msg_reset_entry->retryCount = 0;
-                                current_entry = current_entry->Flink;
-                            }
-                        }
-                        else
-                        {
-                            size_t messageLength;
-                            const unsigned char* messagePayload = RetrieveMessagePayload(mqttMsgEntry->iotHubMessageEntry->messageHandle, &messageLength);
-                            if (messageLength == 0 || messagePayload == NULL)
-                            {
-                                LogError("Failure from creating Message IoTHubMessage_GetData");
-                            }
-                            else
-                            {
-                                if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
-                                {
-                                    (void)DList_RemoveEntryList(currentListEntry);
-                                    sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                    free(mqttMsgEntry);
-                                }
-                            }
-                        }
+                        LogError("Failed retrieving tickcounter info, resends will not be processed");
+                    }
+                    else
+                    {
+                        transport_data->telemetry_resend_now_ms = current_ms;
+                        (void)timer_wheel_process(&transport_data->telemetry_resend_timers, current_ms);
                     }
-                    currentListEntry = nextListEntry.Flink;
                 }
 
                 currentListEntry = transport_data->waitingToSend->Flink;
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                while (currentListEntry != transport_data->waitingToSend)
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_007: [ IoTHubTransport_MQTT_Common_DoWork shall leave the messages in "waitingToSend" once the number of telemetry messages waiting for their PUBACK reaches the value of "max_in_flight_messages". ] */
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_008: [ IoTHubTransport_MQTT_Common_DoWork shall publish at most "max_publishes_per_dowork" messages of "waitingToSend" per call. ] */
+                while (currentListEntry != transport_data->waitingToSend && can_publish_telemetry(transport_data, publish_count))
                 {
                     IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
                     DLIST_ENTRY savedFromCurrentListEntry;
@@ -2688,10 +2798,26 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                     {
                         LogError("Failure result from IoTHubMessage_GetData");
                     }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_012: [ IoTHubTransport_MQTT_Common_DoWork shall publish at QoS 0 the messages whose delivery is IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE, or IOTHUB_MESSAGE_DELIVERY_DEFAULT when "telemetry_at_most_once" is set, without tracking them for a PUBACK. ] */
+                    else if (is_telemetry_at_most_once(transport_data, iothubMsgList->messageHandle))
+                    {
+                        publish_count++;
+                        (void)(DList_RemoveEntryList(currentListEntry));
+                        if (publish_mqtt_telemetry_msg_at_most_once(transport_data, iothubMsgList->messageHandle, messagePayload, messageLength) != 0)
+                        {
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_014: [ If publishing a message at QoS 0 fails, it shall be completed with IOTHUB_CLIENT_CONFIRMATION_ERROR. ] */
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                        }
+                        else
+                        {
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_013: [ A message published at QoS 0 shall be completed with IOTHUB_CLIENT_CONFIRMATION_OK as soon as mqtt_client_publish has handed it to the IO. ] */
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        }
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransport_MQTT_Common_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = allocate_message_details(transport_data);
                         if (mqttMsgEntry == NULL)
                         {
                             LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
@@ -2700,12 +2826,20 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                         {
                             mqttMsgEntry->retryCount = 0;
                             mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
-                            mqttMsgEntry->packet_id = get_next_packet_id(transport_data);
-                            if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            mqttMsgEntry->context = transport_data;
+                            timer_wheel_entry_init(&mqttMsgEntry->resend_timer, on_telemetry_resend_due, mqttMsgEntry);
+                            publish_count++;
+                            if (add_telemetry_in_flight(transport_data, mqttMsgEntry) != 0)
+                            {
+                                LogError("Failure tracking the packet id of the telemetry message");
+                                free_message_details(transport_data, mqttMsgEntry);
+                            }
+                            else if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength, false) != 0)
                             {
+                                (void)inflight_table_remove(&transport_data->telemetry_inflight, mqttMsgEntry->inflight_entry.packet_id);
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                free(mqttMsgEntry);
+                                free_message_details(transport_data, mqttMsgEntry);
                             }
                             else
                             {
@@ -2788,6 +2922,80 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
             transport_data->auto_url_encode_decode = *((bool*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        else if (strcmp(OPTION_MESSAGE_RECORD_POOL_SIZE, option) == 0)
+        {
+            size_t pool_size = *((const size_t*)value);
+            SLAB_ALLOCATOR_HANDLE telemetry_details_slab = NULL;
+
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_001: [ If the option parameter is set to "message_record_pool_size" while telemetry messages are waiting for their PUBACK, IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_ERROR. ] */
+            if (transport_data->telemetry_waitingForAck.Flink != &transport_data->telemetry_waitingForAck)
+            {
+                LogError("message_record_pool_size cannot be changed while telemetry messages are in flight");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_002: [ If the value is not 0, IoTHubTransport_MQTT_Common_SetOption shall allocate the telemetry message details from a slab allocator growing by that many records, a value of 0 shall revert to malloc. ] */
+            else if (pool_size != 0 && (telemetry_details_slab = slab_allocator_create(sizeof(MQTT_MESSAGE_DETAILS_LIST), pool_size)) == NULL)
+            {
+                LogError("failure creating the telemetry message details pool");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                if (transport_data->telemetry_details_slab != NULL)
+                {
+                    slab_allocator_destroy(transport_data->telemetry_details_slab);
+                }
+                transport_data->telemetry_details_slab = telemetry_details_slab;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(OPTION_MAX_IN_FLIGHT_MESSAGES, option) == 0)
+        {
+            size_t max_inflight_messages = *((const size_t*)value);
+
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_009: [ If the option parameter is set to "max_in_flight_messages" with a value larger than half of the packet ids, IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ] */
+            if (max_inflight_messages > MAX_TELEMETRY_IN_FLIGHT)
+            {
+                LogError("max_in_flight_messages cannot be larger than %lu", (unsigned long)MAX_TELEMETRY_IN_FLIGHT);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_010: [ Otherwise the value shall be saved as the maximum number of telemetry messages waiting for their PUBACK, 0 meaning half of the packet ids. ] */
+            else
+            {
+                transport_data->max_inflight_messages = max_inflight_messages;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_011: [ If the option parameter is set to "max_publishes_per_dowork" then the value shall be a size_t_ptr and the value will determine how many messages of "waitingToSend" are published per IoTHubTransport_MQTT_Common_DoWork call, 0 meaning no limit. ] */
+        else if (strcmp(OPTION_MAX_PUBLISHES_PER_DOWORK, option) == 0)
+        {
+            transport_data->max_publishes_per_dowork = *((const size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_015: [ If the option parameter is set to "telemetry_at_most_once" then the value shall be a bool_ptr and the value will determine if the messages without an explicit delivery are published at QoS 0. ] */
+        else if (strcmp(OPTION_TELEMETRY_AT_MOST_ONCE, option) == 0)
+        {
+            transport_data->telemetry_at_most_once = *((const bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_021: [ If the option parameter is set to "persistent_session" then the value shall be a bool_ptr and the value will determine if the subscriptions and the publishes waiting for their PUBACK are resumed when the CONNACK reports the session is present. ] */
+        else if (strcmp(OPTION_PERSISTENT_SESSION, option) == 0)
+        {
+            transport_data->persistent_session = *((const bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_024: [ If the option parameter is set to "sas_token_refresh_drain" then the value shall be a bool_ptr and the value will determine if the telemetry in flight is acknowledged before disconnecting to refresh the sas token. ] */
+        else if (strcmp(OPTION_SAS_TOKEN_REFRESH_DRAIN, option) == 0)
+        {
+            transport_data->sas_token_refresh_drain = *((const bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_10_026: [ If the option parameter is set to "sas_token_refresh_drain_timeout" then the value shall be a size_t_ptr and the value will determine for how many milliseconds at most the connection is drained before refreshing the sas token. ] */
+        else if (strcmp(OPTION_SAS_TOKEN_REFRESH_DRAIN_TIMEOUT, option) == 0)
+        {
+            transport_data->sas_token_refresh_drain_timeout_ms = *((const size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
         /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_052: [ If the option parameter is set to "sas_token_lifetime" then the value shall be a size_t_ptr and the value will determine the mqtt sas token lifetime.] */
         else if (strcmp(OPTION_SAS_TOKEN_LIFETIME, option) == 0)
         {
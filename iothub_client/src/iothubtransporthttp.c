@@ -11,6 +11,11 @@
 #include "iothub_transport_ll.h"
 #include "iothubtransporthttp.h"
 #include "internal/iothubtransport.h"
+#include "iothub_client_base64.h"
+#include "internal/iothub_client_dispatcher.h"
+#ifdef USE_HTTP_COMPRESSION
+#include "internal/iothub_client_http_compression.h"
+#endif
 
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
@@ -19,11 +24,12 @@
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 static const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -34,6 +40,7 @@ static const char* IOTHUB_CONTENT_TYPE_C2D = "ContentType";
 static const char* IOTHUB_CONTENT_ENCODING_C2D = "ContentEncoding";
 
 #define CONTENT_TYPE "Content-Type"
+#define CONTENT_ENCODING "Content-Encoding"
 #define APPLICATION_OCTET_STREAM "application/octet-stream"
 #define APPLICATION_VND_MICROSOFT_IOTHUB_JSON "application/vnd.microsoft.iothub.json"
 
@@ -45,8 +52,15 @@ static const char* IOTHUB_CONTENT_ENCODING_C2D = "ContentEncoding";
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
+struct HTTPTRANSPORT_HANDLE_DATA_TAG;
+
+/*one keep-alive connection to the hub and the devices DoWork runs through it: devices index, index + connectionCount, ...*/
+typedef struct HTTP_CONNECTION_TAG
+{
+    struct HTTPTRANSPORT_HANDLE_DATA_TAG* handleData;
+    HTTPAPIEX_HANDLE httpApiExHandle;
+    size_t index;
+} HTTP_CONNECTION;
 
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
@@ -54,7 +68,19 @@ typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
     HTTPAPIEX_HANDLE httpApiExHandle;
     bool doBatchedTransfers;
     unsigned int getMinimumPollingTime;
+    unsigned int getMaximumPollingTime; /*0 when not set, the polling interval is then fixed to getMinimumPollingTime*/
     VECTOR_HANDLE perDeviceList;
+#ifdef USE_HTTP_COMPRESSION
+    size_t compressionThreshold; /*batches of at least this many bytes are sent gzipped, 0 disables compression*/
+#endif
+
+    bool wereConnectionOptionsSet; /*an option was passed to HTTPAPIEX, connections created afterwards would miss it*/
+    size_t connectionCount; /*1 unless "HttpConnectionCount" was set*/
+    HTTP_CONNECTION* connections; /*connectionCount items, connections[0] is httpApiExHandle. NULL when connectionCount is 1*/
+    CALLBACK_DISPATCHER_HANDLE connectionWorkers; /*runs connections 1..connectionCount-1 while DoWork runs connections[0]*/
+    LOCK_HANDLE connectionWorkersLock;
+    COND_HANDLE connectionWorkersDone;
+    size_t runningConnectionWorkers;
 }HTTPTRANSPORT_HANDLE_DATA;
 
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
@@ -69,10 +95,13 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
     HTTP_HEADERS_HANDLE eventHTTPrequestHeaders;
     HTTP_HEADERS_HANDLE messageHTTPrequestHeaders;
     STRING_HANDLE abandonHTTPrelativePathBegin;
+    HTTP_HEADERS_HANDLE dispositionHTTPrequestHeaders; /*reused by every abandon, complete and reject, only "If-Match" changes between them*/
     HTTPAPIEX_SAS_HANDLE sasObject;
     bool DoWork_PullMessage;
     time_t lastPollTime;
     bool isFirstPoll;
+    unsigned int emptyPollCount; /*number of consecutive GETs answered with 204 No Content*/
+    HTTPAPIEX_HANDLE httpApiExHandle; /*the connection the requests of this device go through*/
 
     IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle;
     PDLIST_ENTRY waitingToSend;
@@ -188,6 +217,12 @@ static HTTP_HEADERS_RESULT addUserAgentHeaderInfo(IOTHUB_CLIENT_CORE_LL_HANDLE h
     return result;
 }
 
+static const char* getAuthorizationHeaderValue(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_10_026: [ If the device has a deviceSasToken, IoTHubTransportHttp_Register shall set the "Authorization" header of the event, message and disposition HTTP request headers to it, otherwise to " ". ]*/
+    return (handleData->deviceSasToken == NULL) ? " " : STRING_c_str(handleData->deviceSasToken);
+}
+
 static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData, const char * deviceId, bool is_x509_used)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_021: [ IoTHubTransportHttp_Register shall create a set of HTTP headers (further called "event HTTP request headers") consisting of the following fixed field names and values: "iothub-to":"/devices/" + URL_ENCODED(deviceId) + "/messages/events"; "Authorization":""
@@ -226,7 +261,7 @@ static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleD
             {
                 if (!(
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "iothub-to", STRING_c_str(temp)) == HTTP_HEADERS_OK) &&
-                    (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Authorization", " ") == HTTP_HEADERS_OK)) &&
+                    (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Authorization", getAuthorizationHeaderValue(handleData)) == HTTP_HEADERS_OK)) &&
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Accept", "application/json") == HTTP_HEADERS_OK) &&
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Connection", "Keep-Alive") == HTTP_HEADERS_OK) &&
                     (addUserAgentHeaderInfo(handleData->iotHubClientHandle, handleData->eventHTTPrequestHeaders) == HTTP_HEADERS_OK)
@@ -270,7 +305,7 @@ static bool create_messageHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handl
     {
         if (!(
             (addUserAgentHeaderInfo(handleData->iotHubClientHandle, handleData->messageHTTPrequestHeaders) == HTTP_HEADERS_OK) &&
-            (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->messageHTTPrequestHeaders, "Authorization", " ") == HTTP_HEADERS_OK))
+            (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->messageHTTPrequestHeaders, "Authorization", getAuthorizationHeaderValue(handleData)) == HTTP_HEADERS_OK))
             ))
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_023: [ If creating message HTTP request headers then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
@@ -324,6 +359,42 @@ static bool create_abandonHTTPrelativePathBegin(HTTPTRANSPORT_PERDEVICE_DATA* ha
     return result;
 }
 
+static void destroy_dispositionHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    HTTPHeaders_Free(handleData->dispositionHTTPrequestHeaders);
+    handleData->dispositionHTTPrequestHeaders = NULL;
+}
+
+static bool create_dispositionHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_10_027: [ IoTHubTransportHttp_Register shall create a set of HTTP headers (further called "disposition HTTP request headers") consisting of "User-Agent" and "Authorization", used by every abandon, complete and reject of the device. ]*/
+    bool result;
+    handleData->dispositionHTTPrequestHeaders = HTTPHeaders_Alloc();
+    if (handleData->dispositionHTTPrequestHeaders == NULL)
+    {
+        LogError("HTTPHeaders_Alloc failed.");
+        result = false;
+    }
+    else
+    {
+        if (!(
+            (addUserAgentHeaderInfo(handleData->iotHubClientHandle, handleData->dispositionHTTPrequestHeaders) == HTTP_HEADERS_OK) &&
+            (HTTPHeaders_AddHeaderNameValuePair(handleData->dispositionHTTPrequestHeaders, "Authorization", getAuthorizationHeaderValue(handleData)) == HTTP_HEADERS_OK)
+            ))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_028: [ If creating the disposition HTTP request headers fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+            destroy_dispositionHTTPrequestHeaders(handleData);
+            LogError("adding header properties failed.");
+            result = false;
+        }
+        else
+        {
+            result = true;
+        }
+    }
+    return result;
+}
+
 static void destroy_SASObject(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
 {
     HTTPAPIEX_SAS_Destroy(handleData->sasObject);
@@ -585,6 +656,7 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
             }
             bool was_messageHTTPrequestHeaders_ok = was_eventHTTPrequestHeaders_ok && create_messageHTTPrequestHeaders(result, was_x509_ok);
             bool was_abandonHTTPrelativePathBegin_ok = was_messageHTTPrequestHeaders_ok && create_abandonHTTPrelativePathBegin(result, device->deviceId);
+            bool was_dispositionHTTPrequestHeaders_ok = was_abandonHTTPrelativePathBegin_ok && create_dispositionHTTPrequestHeaders(result);
 
             if (was_x509_ok)
             {
@@ -595,12 +667,12 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
             {
                 if (!was_create_deviceSasToken_ok)
                 {
-                    was_sasObject_ok = was_abandonHTTPrelativePathBegin_ok && create_deviceSASObject(result, handleData->hostName, device->deviceId, device->deviceKey);
+                    was_sasObject_ok = was_dispositionHTTPrequestHeaders_ok && create_deviceSASObject(result, handleData->hostName, device->deviceId, device->deviceKey);
                 }
             }
 
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_041: [ IoTHubTransportHttp_Register shall call VECTOR_push_back to store the new device information. ]*/
-            bool was_list_add_ok = (was_sasObject_ok || was_create_deviceSasToken_ok || was_x509_ok) && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
+            bool was_list_add_ok = was_dispositionHTTPrequestHeaders_ok && (was_sasObject_ok || was_create_deviceSasToken_ok || was_x509_ok) && (VECTOR_push_back(handleData->perDeviceList, &result, 1) == 0);
 
             if (was_list_add_ok)
             {
@@ -609,6 +681,8 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
                 result->DoWork_PullMessage = false;
                 result->isFirstPoll = true;
+                result->emptyPollCount = 0;
+                result->httpApiExHandle = ((HTTPTRANSPORT_HANDLE_DATA*)handle)->httpApiExHandle;
                 result->waitingToSend = waitingToSend;
                 DList_InitializeListHead(&(result->eventConfirmations));
                 result->transportHandle = (HTTPTRANSPORT_HANDLE_DATA *)handle;
@@ -617,6 +691,7 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_042: [ If the singlylinkedlist_add fails then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
                 if (was_sasObject_ok) destroy_SASObject(result);
+                if (was_dispositionHTTPrequestHeaders_ok) destroy_dispositionHTTPrequestHeaders(result);
                 if (was_abandonHTTPrelativePathBegin_ok) destroy_abandonHTTPrelativePathBegin(result);
                 if (was_messageHTTPrelativePath_ok) destroy_messageHTTPrelativePath(result);
                 if (was_eventHTTPrequestHeaders_ok) destroy_eventHTTPrequestHeaders(result);
@@ -646,6 +721,7 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
     destroy_eventHTTPrequestHeaders(perDeviceItem);
     destroy_messageHTTPrequestHeaders(perDeviceItem);
     destroy_abandonHTTPrelativePathBegin(perDeviceItem);
+    destroy_dispositionHTTPrequestHeaders(perDeviceItem);
     destroy_SASObject(perDeviceItem);
 }
 
@@ -795,6 +871,93 @@ static bool create_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
     return result;
 }
 
+/*stops the connection workers (waiting for the running ones) before destroying the connections they use*/
+static void destroy_connections(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    if (handleData->connectionWorkers != NULL)
+    {
+        callback_dispatcher_destroy(handleData->connectionWorkers);
+        handleData->connectionWorkers = NULL;
+    }
+    if (handleData->connectionWorkersDone != NULL)
+    {
+        Condition_Deinit(handleData->connectionWorkersDone);
+        handleData->connectionWorkersDone = NULL;
+    }
+    if (handleData->connectionWorkersLock != NULL)
+    {
+        (void)Lock_Deinit(handleData->connectionWorkersLock);
+        handleData->connectionWorkersLock = NULL;
+    }
+    if (handleData->connections != NULL)
+    {
+        size_t i;
+        /*connections[0] is httpApiExHandle, destroyed by destroy_httpApiExHandle*/
+        for (i = 1; i < handleData->connectionCount; i++)
+        {
+            if (handleData->connections[i].httpApiExHandle != NULL)
+            {
+                HTTPAPIEX_Destroy(handleData->connections[i].httpApiExHandle);
+            }
+        }
+        free(handleData->connections);
+        handleData->connections = NULL;
+    }
+    handleData->connectionCount = 1;
+}
+
+static int create_connections(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t connectionCount)
+{
+    int result;
+    /*Codes_SRS_TRANSPORTMULTITHTTP_10_015: [ IoTHubTransportHttp_SetOption shall create connectionCount - 1 additional HTTPAPIEX_HANDLEs by calling HTTPAPIEX_Create with the hostname, and a pool of connectionCount - 1 threads by calling callback_dispatcher_create. ]*/
+    if ((handleData->connections = (HTTP_CONNECTION*)malloc(connectionCount * sizeof(HTTP_CONNECTION))) == NULL)
+    {
+        LogError("unable to malloc the connections");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t i;
+        handleData->connectionCount = connectionCount;
+        result = 0;
+        for (i = 0; i < connectionCount; i++)
+        {
+            handleData->connections[i].handleData = handleData;
+            handleData->connections[i].index = i;
+            handleData->connections[i].httpApiExHandle = (i == 0) ? handleData->httpApiExHandle : HTTPAPIEX_Create(STRING_c_str(handleData->hostName));
+            if (handleData->connections[i].httpApiExHandle == NULL)
+            {
+                LogError("unable to HTTPAPIEX_Create connection %lu", (unsigned long)i);
+                result = __FAILURE__;
+            }
+        }
+
+        if (result != 0)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_016: [ If any of them fails, IoTHubTransportHttp_SetOption shall release what was created and return IOTHUB_CLIENT_ERROR. ]*/
+            destroy_connections(handleData);
+        }
+        else if ((handleData->connectionWorkersLock = Lock_Init()) == NULL)
+        {
+            LogError("unable to Lock_Init");
+            destroy_connections(handleData);
+            result = __FAILURE__;
+        }
+        else if ((handleData->connectionWorkersDone = Condition_Init()) == NULL)
+        {
+            LogError("unable to Condition_Init");
+            destroy_connections(handleData);
+            result = __FAILURE__;
+        }
+        else if ((handleData->connectionWorkers = callback_dispatcher_create(connectionCount - 1, 0)) == NULL)
+        {
+            LogError("unable to callback_dispatcher_create");
+            destroy_connections(handleData);
+            result = __FAILURE__;
+        }
+    }
+    return result;
+}
 
 static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* config)
 {
@@ -850,6 +1013,17 @@ static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONF
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
                 result->doBatchedTransfers = false;
                 result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+                result->getMaximumPollingTime = 0;
+#ifdef USE_HTTP_COMPRESSION
+                result->compressionThreshold = 0;
+#endif
+                result->wereConnectionOptionsSet = false;
+                result->connectionCount = 1;
+                result->connections = NULL;
+                result->connectionWorkers = NULL;
+                result->connectionWorkersLock = NULL;
+                result->connectionWorkersDone = NULL;
+                result->runningConnectionWorkers = 0;
             }
             else
             {
@@ -883,6 +1057,7 @@ static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
             free(perDeviceItem);
         }
 
+        destroy_connections((HTTPTRANSPORT_HANDLE_DATA *)handle);
         destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *)handle);
         destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *)handle);
         destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
@@ -917,6 +1092,8 @@ static int IoTHubTransportHttp_Subscribe(IOTHUB_DEVICE_HANDLE handle)
             perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. ]*/
             perDeviceItem->DoWork_PullMessage = true;
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_011: [ IoTHubTransportHttp_Subscribe shall reset the polling interval of the device to GetMinimumPollingTime. ]*/
+            perDeviceItem->emptyPollCount = 0;
         }
         result = 0;
     }
@@ -989,230 +1166,251 @@ static int IoTHubTransportHttp_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle
     return __FAILURE__;
 }
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
+static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
 {
-    int result;
+    /*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
+    DList_AppendTailList(destination->Flink, source);
+    DList_RemoveEntryList(source);
+    DList_InitializeListHead(source);
+}
+
+/*the fixed parts of the JSON representation of 1 batched message*/
+#define BATCH_ITEM_BYTEARRAY_BEGIN "{\"body\":\""
+#define BATCH_ITEM_BYTEARRAY_END "\""
+#define BATCH_ITEM_STRING_BEGIN "{\"body\":"
+#define BATCH_ITEM_STRING_END ",\"base64Encoded\":false"
+#define BATCH_ITEM_PROPERTIES_BEGIN ",\"properties\":{"
+#define BATCH_ITEM_FIRST_PROPERTY_BEGIN "\"" IOTHUB_APP_PREFIX
+#define BATCH_ITEM_NEXT_PROPERTY_BEGIN ",\"" IOTHUB_APP_PREFIX
+#define BATCH_ITEM_PROPERTY_SEPARATOR "\":\""
+#define BATCH_ITEM_PROPERTY_END "\""
+#define BATCH_ITEM_PROPERTIES_END "}"
+#define BATCH_ITEM_END "}," /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
+
+#define CONST_STRLEN(s) (sizeof(s) - 1)
+
+static const char hexCharacters[] = "0123456789ABCDEF";
+
+/*everything needed to serialize 1 message of a batch, as obtained from the message itself (nothing is copied)*/
+typedef struct BATCH_ITEM_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    const unsigned char* source; /*the bytes of a IOTHUBMESSAGE_BYTEARRAY or the characters of a IOTHUBMESSAGE_STRING*/
+    size_t size;
     const char*const* keys;
     const char*const* values;
     size_t count;
-    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
+} BATCH_ITEM;
+
+static int getBatchItem(PDLIST_ENTRY entry, BATCH_ITEM* item)
+{
+    int result;
+    IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
+    item->contentType = IoTHubMessage_GetContentType(message->messageHandle);
+
+    switch (item->contentType)
     {
-        result = __FAILURE__;
-        LogError("error while Map_GetInternals");
-    }
-    else
+    case IOTHUBMESSAGE_BYTEARRAY:
     {
-
-        if (count == 0)
+        if (IoTHubMessage_GetByteArray(message->messageHandle, &item->source, &item->size) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to get the data for the message.");
+            result = __FAILURE__;
+        }
+        else if ((item->source == NULL) && (item->size != 0))
+        {
+            LogError("invalid data for the message.");
+            result = __FAILURE__;
+        }
+        else
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-            /*no properties - do nothing with existing*/
             result = 0;
-            *propertiesMessageSizeContribution = 0;
+        }
+        break;
+    }
+    case IOTHUBMESSAGE_STRING:
+    {
+        const char* source = IoTHubMessage_GetString(message->messageHandle);
+        if (source == NULL)
+        {
+            LogError("unable to IoTHubMessage_GetString");
+            result = __FAILURE__;
         }
         else
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-            if (STRING_concat(existing, ",\"properties\":") != 0)
-            {
-                /*go ahead and return it*/
-                result = __FAILURE__;
-                LogError("failed STRING_concat");
-            }
-            else if (appendMapToJSON(existing, keys, values, count) != 0)
-            {
-                result = __FAILURE__;
-                LogError("unable to append the properties");
-            }
-            else
-            {
-                /*all is fine*/
-                size_t i;
-                *propertiesMessageSizeContribution = 0;
-                for (i = 0; i < count; i++)
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-                    *propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
-                }
-                result = 0;
-            }
+            item->source = (const unsigned char*)source;
+            item->size = strlen(source);
+            result = 0;
+        }
+        break;
+    }
+    default:
+    {
+        LogError("an unknown message type was encountered (%d)", item->contentType);
+        result = __FAILURE__;
+        break;
+    }
+    }
+
+    if (result == 0)
+    {
+        if (Map_GetInternals(IoTHubMessage_Properties(message->messageHandle), &item->keys, &item->values, &item->count) != MAP_OK)
+        {
+            LogError("error while Map_GetInternals");
+            result = __FAILURE__;
         }
     }
     return result;
 }
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
+/*computes how many bytes the JSON representation of item takes, and how much it contributes to the message size*/
+static int getBatchItemLength(const BATCH_ITEM* item, size_t* jsonLength, size_t* messageSizeContribution)
 {
     int result;
-    if (STRING_concat(existing, "{") != 0)
+    size_t i;
+
+    if (item->contentType == IOTHUBMESSAGE_BYTEARRAY)
     {
-        /*go on and return it*/
-        LogError("STRING_construct failed");
-        result = __FAILURE__;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
+        *jsonLength = CONST_STRLEN(BATCH_ITEM_BYTEARRAY_BEGIN) + IOTHUB_BASE64_ENCODED_LENGTH(item->size) + CONST_STRLEN(BATCH_ITEM_BYTEARRAY_END);
+        result = 0;
     }
     else
     {
-        size_t i;
-        for (i = 0; i < count; i++)
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
+        size_t escapedLength = 2; /*the quotes*/
+        for (i = 0; i < item->size; i++)
         {
-            if (!(
-                (STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-                (STRING_concat(existing, keys[i]) == 0) &&
-                (STRING_concat(existing, "\":\"") == 0) &&
-                (STRING_concat(existing, values[i]) == 0) &&
-                (STRING_concat(existing, "\"") == 0)
-                ))
+            unsigned char c = item->source[i];
+            if (c >= 128)
             {
-                LogError("unable to STRING_concat");
                 break;
             }
+            else if (c <= 0x1F)
+            {
+                escapedLength += 6; /*\u00XX*/
+            }
+            else if ((c == '"') || (c == '\\') || (c == '/'))
+            {
+                escapedLength += 2;
+            }
+            else
+            {
+                escapedLength++;
+            }
         }
 
-        if (i < count)
-        {
-            result = __FAILURE__;
-            /*error, let it go through*/
-        }
-        else if (STRING_concat(existing, "}") != 0)
+        if (i < item->size)
         {
-            LogError("unable to STRING_concat");
+            LogError("invalid character in the message string");
             result = __FAILURE__;
         }
         else
         {
-            /*all is fine*/
+            *jsonLength = CONST_STRLEN(BATCH_ITEM_STRING_BEGIN) + escapedLength + CONST_STRLEN(BATCH_ITEM_STRING_END);
             result = 0;
         }
     }
-    return result;
-}
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
-{
-    STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-    IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
-    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
-
-    switch (contentType)
-    {
-    case IOTHUBMESSAGE_BYTEARRAY:
+    if (result == 0)
     {
-        result = STRING_construct("{\"body\":\"");
-        if (result == NULL)
-        {
-            LogError("unable to STRING_construct");
-        }
-        else
-        {
-            const unsigned char* source;
-            size_t size;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
+        *messageSizeContribution = item->size + MAXIMUM_PAYLOAD_OVERHEAD;
+        *jsonLength += CONST_STRLEN(BATCH_ITEM_END);
 
-            if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
+        if (item->count > 0)
+        {
+            *jsonLength += CONST_STRLEN(BATCH_ITEM_PROPERTIES_BEGIN) + CONST_STRLEN(BATCH_ITEM_PROPERTIES_END);
+            for (i = 0; i < item->count; i++)
             {
-                LogError("unable to get the data for the message.");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                STRING_HANDLE encoded = Base64_Encode_Bytes(source, size);
-                if (encoded == NULL)
-                {
-                    LogError("unable to Base64_Encode_Bytes.");
-                    STRING_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, encoded) == 0) &&
-                        (STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
-                    {
-                        STRING_delete(result);
-                        result = NULL;
-                        LogError("unable to STRING_concat_with_STRING.");
-                    }
-                    else
-                    {
-                        /*all is fine... */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-                    }
-                    STRING_delete(encoded);
-                }
+                size_t keyLength = strlen(item->keys[i]);
+                size_t valueLength = strlen(item->values[i]);
+                *jsonLength += ((i == 0) ? CONST_STRLEN(BATCH_ITEM_FIRST_PROPERTY_BEGIN) : CONST_STRLEN(BATCH_ITEM_NEXT_PROPERTY_BEGIN)) +
+                    keyLength + CONST_STRLEN(BATCH_ITEM_PROPERTY_SEPARATOR) + valueLength + CONST_STRLEN(BATCH_ITEM_PROPERTY_END);
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
+                *messageSizeContribution += (keyLength + valueLength + MAXIMUM_PROPERTY_OVERHEAD);
             }
         }
-        break;
     }
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
-    case IOTHUBMESSAGE_STRING:
+    return result;
+}
+
+static size_t writeText(unsigned char* destination, const char* text)
+{
+    size_t length = strlen(text);
+    (void)memcpy(destination, text, length);
+    return length;
+}
+
+/*same escaping as STRING_new_JSON, the characters have already been validated by getBatchItemLength*/
+static size_t writeJSONString(unsigned char* destination, const unsigned char* source, size_t size)
+{
+    unsigned char* current = destination;
+    size_t i;
+    *current++ = '"';
+    for (i = 0; i < size; i++)
     {
-        result = STRING_construct("{\"body\":");
-        if (result == NULL)
+        unsigned char c = source[i];
+        if (c <= 0x1F)
+        {
+            *current++ = '\\';
+            *current++ = 'u';
+            *current++ = '0';
+            *current++ = '0';
+            *current++ = hexCharacters[(c & 0xF0) >> 4];
+            *current++ = hexCharacters[c & 0x0F];
+        }
+        else if ((c == '"') || (c == '\\') || (c == '/'))
         {
-            LogError("unable to STRING_construct");
+            *current++ = '\\';
+            *current++ = c;
         }
         else
         {
-            const char* source = IoTHubMessage_GetString(message->messageHandle);
-            if (source == NULL)
-            {
-                LogError("unable to IoTHubMessage_GetString");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                STRING_HANDLE asJson = STRING_new_JSON(source);
-                if (asJson == NULL)
-                {
-                    LogError("unable to STRING_new_JSON");
-                    STRING_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, asJson) == 0) &&
-                        (STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
-                    {
-                        LogError("unable to STRING_concat_with_STRING");
-                        STRING_delete(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        /*result has the intended content*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-                    }
-                    STRING_delete(asJson);
-                }
-            }
+            *current++ = c;
         }
-        break;
     }
-    default:
+    *current++ = '"';
+    return (size_t)(current - destination);
+}
+
+/*writes {"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}, and returns how many bytes were written*/
+static size_t writeBatchItem(unsigned char* destination, const BATCH_ITEM* item)
+{
+    unsigned char* current = destination;
+    size_t i;
+
+    if (item->contentType == IOTHUBMESSAGE_BYTEARRAY)
     {
-        LogError("an unknown message type was encountered (%d)", contentType);
-        result = NULL; /*unknown message type*/
-        break;
+        current += writeText(current, BATCH_ITEM_BYTEARRAY_BEGIN);
+        current += iothub_base64_encode((char*)current, item->source, item->size, IOTHUB_BASE64_ALPHABET_STANDARD);
+        current += writeText(current, BATCH_ITEM_BYTEARRAY_END);
     }
+    else
+    {
+        current += writeText(current, BATCH_ITEM_STRING_BEGIN);
+        current += writeJSONString(current, item->source, item->size);
+        current += writeText(current, BATCH_ITEM_STRING_END);
     }
-    return result;
+
+    if (item->count > 0)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
+        current += writeText(current, BATCH_ITEM_PROPERTIES_BEGIN);
+        for (i = 0; i < item->count; i++)
+        {
+            current += writeText(current, (i == 0) ? BATCH_ITEM_FIRST_PROPERTY_BEGIN : BATCH_ITEM_NEXT_PROPERTY_BEGIN);
+            current += writeText(current, item->keys[i]);
+            current += writeText(current, BATCH_ITEM_PROPERTY_SEPARATOR);
+            current += writeText(current, item->values[i]);
+            current += writeText(current, BATCH_ITEM_PROPERTY_END);
+        }
+        current += writeText(current, BATCH_ITEM_PROPERTIES_END);
+    }
+
+    current += writeText(current, BATCH_ITEM_END);
+    return (size_t)(current - destination);
 }
 
 #define MAKE_PAYLOAD_RESULT_VALUES \
@@ -1224,131 +1422,169 @@ static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeCo
 DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
 
 /*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
+/*the items are first moved to eventConfirmations while the exact size of the payload is computed, then the payload is allocated once and each item is encoded directly into it*/
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload)
 {
-    MAKE_PAYLOAD_RESULT result;
+    MAKE_PAYLOAD_RESULT result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
     size_t allMessagesSize = 0;
-    *payload = STRING_construct("[");
-    if (*payload == NULL)
-    {
-        LogError("unable to STRING_construct");
-        result = MAKE_PAYLOAD_ERROR;
-    }
-    else
-    {
-        bool isFirst = true;
-        PDLIST_ENTRY actual;
-        bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
-                               /*either all the items enter the list or only some*/
-        result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
-        while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+    size_t payloadLength = 1; /*the opening '['*/
+    bool isFirst = true;
+    bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
+                           /*either all the items enter the list or only some*/
+    PDLIST_ENTRY actual;
+
+    *payload = NULL;
+    while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+    {
+        BATCH_ITEM item;
+        size_t itemLength;
+        size_t messageSize;
+        if ((getBatchItem(actual, &item) != 0) ||
+            (getBatchItemLength(&item, &itemLength, &messageSize) != 0))
         {
-            size_t messageSize;
-            STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
             if (isFirst)
             {
-                isFirst = false;
+                /*first item failed to create, nothing to send*/
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                if (temp == NULL) /*first item failed to create, nothing to send*/
-                {
-                    result = MAKE_PAYLOAD_ERROR;
-                    STRING_delete(*payload);
-                    *payload = NULL;
-                    keepGoing = false;
-                }
-                else
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-                    if (messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-                        STRING_delete(*payload);
-                        *payload = NULL;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        if (STRING_concat_with_STRING(*payload, temp) != 0)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            result = MAKE_PAYLOAD_ERROR;
-                            STRING_delete(*payload);
-                            *payload = NULL;
-                            keepGoing = false;
-                        }
-                        else
-                        {
-                            /*first item was put nicely in the payload*/
-                            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                            DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                            allMessagesSize += messageSize;
-                        }
-                    }
-                    STRING_delete(temp);
-                }
+                result = MAKE_PAYLOAD_ERROR;
             }
             else
             {
-                /*there is at least 1 item already in the payload*/
-                if (temp == NULL)
+                /*there are multiple payloads encoded, the last one had an internal error, just go with those*/
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+            }
+            keepGoing = false;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+        else if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
+        {
+            if (isFirst)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+                PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+            }
+            else
+            {
+                /*this item doesn't make it to the payload, but the payload is valid so far*/
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+            }
+            keepGoing = false;
+        }
+        else
+        {
+            /*cool, the item makes it in the payload, let's continue... */
+            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+            DList_InsertTailList(&(deviceData->eventConfirmations), head);
+            allMessagesSize += messageSize;
+            payloadLength += itemLength;
+            isFirst = false;
+        }
+    }
+
+    if (result == MAKE_PAYLOAD_OK)
+    {
+        *payload = BUFFER_new();
+        if (*payload == NULL)
+        {
+            LogError("unable to BUFFER_new");
+            result = MAKE_PAYLOAD_ERROR;
+        }
+        else if (BUFFER_pre_build(*payload, payloadLength) != 0)
+        {
+            LogError("unable to BUFFER_pre_build");
+            BUFFER_delete(*payload);
+            *payload = NULL;
+            result = MAKE_PAYLOAD_ERROR;
+        }
+        else
+        {
+            unsigned char* destination = BUFFER_u_char(*payload);
+            size_t written = 0;
+            destination[written++] = '[';
+            for (actual = deviceData->eventConfirmations.Flink; actual != &(deviceData->eventConfirmations); actual = actual->Flink)
+            {
+                BATCH_ITEM item;
+                /*the messages cannot change while they are queued, so this succeeds just like it did when the payload was sized*/
+                if (getBatchItem(actual, &item) != 0)
                 {
-                    /*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                    result = MAKE_PAYLOAD_OK;
-                    keepGoing = false;
+                    break;
                 }
                 else
                 {
-                    if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        /*this item doesn't make it to the payload, but the payload is valid so far*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else if (STRING_concat_with_STRING(*payload, temp) != 0)
-                    {
-                        /*should still send what there is so far...*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        /*cool, the payload made it there, let's continue... */
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        allMessagesSize += messageSize;
-                    }
-                    STRING_delete(temp);
+                    written += writeBatchItem(destination + written, &item);
                 }
             }
-        }
 
-        /*closing the payload*/
-        if (result == MAKE_PAYLOAD_OK)
-        {
-            ((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
+            if (actual != &(deviceData->eventConfirmations))
+            {
+                LogError("unable to serialize a message that was previously serialized");
+                BUFFER_delete(*payload);
+                *payload = NULL;
+                result = MAKE_PAYLOAD_ERROR;
+            }
+            else
+            {
+                /*closing the payload*/
+                destination[written - 1] = ']';
+            }
         }
-        else
+
+        if (result != MAKE_PAYLOAD_OK)
         {
-            /*no need to close anything*/
+            /*items go back to waitingToSend*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
         }
     }
     return result;
 }
 
-static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
+#ifdef USE_HTTP_COMPRESSION
+/*replaces *payload by its gzip stream when compression is enabled, the batch is big enough and it gets smaller.
+Returns the request headers to send the compressed payload with, NULL when *payload was left as is*/
+static HTTP_HEADERS_HANDLE compressPayload(const HTTPTRANSPORT_HANDLE_DATA* handleData, const HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BUFFER_HANDLE* payload)
 {
-    /*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
-    DList_AppendTailList(destination->Flink, source);
-    DList_RemoveEntryList(source);
-    DList_InitializeListHead(source);
+    HTTP_HEADERS_HANDLE result = NULL;
+    size_t payloadLength = 0;
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_10_023: [ If "HttpCompressionThreshold" is not 0 and the batch is at least that many bytes, _DoWork shall compress it by calling http_compression_gzip. ]*/
+    if ((handleData->compressionThreshold != 0) && ((payloadLength = BUFFER_length(*payload)) >= handleData->compressionThreshold))
+    {
+        BUFFER_HANDLE compressed = http_compression_gzip(BUFFER_u_char(*payload), payloadLength);
+        if (compressed == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_024: [ If compressing fails, or does not make the batch smaller, or the request headers cannot be prepared, the batch shall be sent uncompressed. ]*/
+            LogError("unable to compress the batch, sending it uncompressed");
+        }
+        else if (BUFFER_length(compressed) >= payloadLength)
+        {
+            BUFFER_delete(compressed);
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_025: [ The compressed batch shall be sent with a copy of the event request headers, made by HTTPHeaders_Clone, with "Content-Encoding" set to "gzip". ]*/
+        else if ((result = HTTPHeaders_Clone(deviceData->eventHTTPrequestHeaders)) == NULL)
+        {
+            LogError("unable to HTTPHeaders_Clone, sending the batch uncompressed");
+            BUFFER_delete(compressed);
+        }
+        else if (HTTPHeaders_ReplaceHeaderNameValuePair(result, CONTENT_ENCODING, HTTP_COMPRESSION_CONTENT_ENCODING) != HTTP_HEADERS_OK)
+        {
+            LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair, sending the batch uncompressed");
+            HTTPHeaders_Free(result);
+            result = NULL;
+            BUFFER_delete(compressed);
+        }
+        else
+        {
+            BUFFER_delete(*payload);
+            *payload = compressed;
+        }
+    }
+    return result;
 }
+#endif
 
 static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
@@ -1371,67 +1607,60 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
             else
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                STRING_HANDLE payload;
+                BUFFER_HANDLE payload;
                 switch (makePayload(deviceData, &payload))
                 {
                 case MAKE_PAYLOAD_OK:
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-                    BUFFER_HANDLE temp = BUFFER_new();
-                    if (temp == NULL)
+                    unsigned int statusCode;
+                    HTTP_HEADERS_HANDLE requestHeaders = deviceData->eventHTTPrequestHeaders;
+#ifdef USE_HTTP_COMPRESSION
+                    HTTP_HEADERS_HANDLE compressedRequestHeaders = compressPayload(handleData, deviceData, &payload);
+                    if (compressedRequestHeaders != NULL)
                     {
-                        LogError("unable to BUFFER_new");
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                        requestHeaders = compressedRequestHeaders;
+                    }
+#endif
+                    if (HTTPAPIEX_SAS_ExecuteRequest(
+                        deviceData->sasObject,
+                        deviceData->httpApiExHandle,
+                        HTTPAPI_REQUEST_POST,
+                        STRING_c_str(deviceData->eventHTTPrelativePath),
+                        requestHeaders,
+                        payload,
+                        &statusCode,
+                        NULL,
+                        NULL
+                    ) != HTTPAPIEX_OK)
+                    {
+                        LogError("unable to HTTPAPIEX_ExecuteRequest");
+                        //items go back to waitingToSend
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                         reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                     }
                     else
                     {
-                        if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+                        if (statusCode < 300)
                         {
-                            LogError("unable to BUFFER_build");
-                            //items go back to waitingToSend
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
+                            IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
                         }
                         else
                         {
-                            unsigned int statusCode;
-                            if (HTTPAPIEX_SAS_ExecuteRequest(
-                                deviceData->sasObject,
-                                handleData->httpApiExHandle,
-                                HTTPAPI_REQUEST_POST,
-                                STRING_c_str(deviceData->eventHTTPrelativePath),
-                                deviceData->eventHTTPrequestHeaders,
-                                temp,
-                                &statusCode,
-                                NULL,
-                                NULL
-                            ) != HTTPAPIEX_OK)
-                            {
-                                LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                //items go back to waitingToSend
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                            }
-                            else
-                            {
-                                if (statusCode < 300)
-                                {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
-                                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
-                                }
-                                else
-                                {
-                                    //items go back to waitingToSend
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                    LogError("unexpected HTTP status code (%u)", statusCode);
-                                    reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                                }
-                            }
+                            //items go back to waitingToSend
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+                            LogError("unexpected HTTP status code (%u)", statusCode);
+                            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                         }
-                        BUFFER_delete(temp);
                     }
-                    STRING_delete(payload);
+#ifdef USE_HTTP_COMPRESSION
+                    if (compressedRequestHeaders != NULL)
+                    {
+                        HTTPHeaders_Free(compressedRequestHeaders);
+                    }
+#endif
+                    BUFFER_delete(payload);
                     break;
                 }
                 case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
@@ -1644,17 +1873,9 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                             HTTPAPIEX_RESULT r;
                                             if (deviceData->deviceSasToken != NULL)
                                             {
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                                                if (HTTPHeaders_ReplaceHeaderNameValuePair(clonedEventHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                                                {
-                                                    r = HTTPAPIEX_ERROR;
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                                                    LogError("Unable to replace the old SAS Token.");
-                                                }
-
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
-                                                else if ((r = HTTPAPIEX_ExecuteRequest(
-                                                    handleData->httpApiExHandle,
+                                                if ((r = HTTPAPIEX_ExecuteRequest(
+                                                    deviceData->httpApiExHandle,
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1672,7 +1893,7 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
                                                 if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                                                     deviceData->sasObject,
-                                                    handleData->httpApiExHandle,
+                                                    deviceData->httpApiExHandle,
                                                     HTTPAPI_REQUEST_POST,
                                                     STRING_c_str(deviceData->eventHTTPrelativePath),
                                                     clonedEventHTTPrequestHeaders,
@@ -1783,67 +2004,26 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
             }
             else
             {
-                HTTP_HEADERS_HANDLE abandonRequestHttpHeaders = HTTPHeaders_Alloc();
-                if (abandonRequestHttpHeaders == NULL)
+                /*Codes_SRS_TRANSPORTMULTITHTTP_10_029: [ The "If-Match" header of the disposition HTTP request headers shall be set to the value of ETag by calling HTTPHeaders_ReplaceHeaderNameValuePair. ]*/
+                if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->dispositionHTTPrequestHeaders, "If-Match", ETag) != HTTP_HEADERS_OK)
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                    LogError("unable to HTTPHeaders_Alloc");
+                    LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
                     result = false;
                 }
                 else
                 {
-                    if (!(
-                        (addUserAgentHeaderInfo(deviceData->iotHubClientHandle, abandonRequestHttpHeaders) == HTTP_HEADERS_OK) &&
-                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", " ") == HTTP_HEADERS_OK) &&
-                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "If-Match", ETag) == HTTP_HEADERS_OK)
-                        ))
-                    {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                        LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
-                        result = false;
-                    }
-                    else
+                    unsigned int statusCode = 0;
+                    HTTPAPIEX_RESULT r;
+                    if (deviceData->deviceSasToken != NULL)
                     {
-                        unsigned int statusCode = 0;
-                        HTTPAPIEX_RESULT r;
-                        if (deviceData->deviceSasToken != NULL)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                            if (HTTPHeaders_ReplaceHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                            {
-                                r = HTTPAPIEX_ERROR;
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                                LogError("Unable to replace the old SAS Token.");
-                                result = false;
-                            }
-                            else if ((r = HTTPAPIEX_ExecuteRequest(
-                                handleData->httpApiExHandle,
-                                (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
-                                STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
-                                abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
-                                NULL,                                               /*- requestContent: NULL                                                                                                   */
-                                &statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
-                                NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
-                                NULL                                                /*- responseContent: NULL]                                                                                                 */
-                            )) != HTTPAPIEX_OK)
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                                result = false;
-                            }
-                        }
-                        else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                            deviceData->sasObject,
-                            handleData->httpApiExHandle,
+                        if ((r = HTTPAPIEX_ExecuteRequest(
+                            deviceData->httpApiExHandle,
                             (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                             STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
-                            abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
+                            deviceData->dispositionHTTPrequestHeaders,          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
                             NULL,                                               /*- requestContent: NULL                                                                                                   */
                             &statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
                             NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
@@ -1853,34 +2033,51 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                            LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+                            LogError("Unable to HTTPAPIEX_ExecuteRequest.");
                             result = false;
                         }
-                        if (r == HTTPAPIEX_OK)
+                    }
+                    else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
+                        deviceData->sasObject,
+                        deviceData->httpApiExHandle,
+                        (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
+                        STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
+                        deviceData->dispositionHTTPrequestHeaders,          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
+                        NULL,                                               /*- requestContent: NULL                                                                                                   */
+                        &statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
+                        NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
+                        NULL                                                /*- responseContent: NULL]                                                                                                 */
+                    )) != HTTPAPIEX_OK)
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                        LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+                        result = false;
+                    }
+                    if (r == HTTPAPIEX_OK)
+                    {
+                        if (statusCode != 204)
                         {
-                            if (statusCode != 204)
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                LogError("unexpected status code returned %u (was expecting 204)", statusCode);
-                                result = false;
-                            }
-                            else
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*all is fine*/
-                                result = true;
-                            }
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                            LogError("unexpected status code returned %u (was expecting 204)", statusCode);
+                            result = false;
                         }
                         else
                         {
-                            result = false;
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                            /*all is fine*/
+                            result = true;
                         }
                     }
-                    HTTPHeaders_Free(abandonRequestHttpHeaders);
+                    else
+                    {
+                        result = false;
+                    }
                 }
             }
             STRING_delete(ETagUnquoted);
@@ -1998,6 +2195,26 @@ static MESSAGE_CALLBACK_INFO* MESSAGE_CALLBACK_INFO_Create(IOTHUB_MESSAGE_HANDLE
     return result;
 }
 
+/*when "MaximumPollingTime" is not set (or is below "MinimumPollingTime") the polling interval does not back off*/
+static unsigned int getMaximumPollingTime(const HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    return (handleData->getMaximumPollingTime > handleData->getMinimumPollingTime) ? handleData->getMaximumPollingTime : handleData->getMinimumPollingTime;
+}
+
+/*returns the number of seconds to wait between the previous GET and the next one: GetMinimumPollingTime doubled for every consecutive
+empty poll, never more than GetMaximumPollingTime*/
+static unsigned int getPollingTime(const HTTPTRANSPORT_HANDLE_DATA* handleData, const HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    unsigned int result = handleData->getMinimumPollingTime;
+    unsigned int maximum = getMaximumPollingTime(handleData);
+    unsigned int i;
+    for (i = 0; (i < deviceData->emptyPollCount) && (result < maximum); i++)
+    {
+        result = (result == 0) ? 1 : ((result > maximum / 2) ? maximum : (result * 2));
+    }
+    return result;
+}
+
 static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
@@ -2006,8 +2223,9 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_008: [ A GET request that happens earlier than GetMinimumPollingTime doubled for every consecutive GET answered with 204, but never more than GetMaximumPollingTime, shall be ignored. ]*/
         time_t timeNow = get_time(NULL);
-        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > getPollingTime(handleData, deviceData));
         if (isPollingAllowed)
         {
             HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
@@ -2030,15 +2248,8 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                     HTTPAPIEX_RESULT r;
                     if (deviceData->deviceSasToken != NULL)
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                        if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                        {
-                            r = HTTPAPIEX_ERROR;
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                            LogError("Unable to replace the old SAS Token.");
-                        }
-                        else if ((r = HTTPAPIEX_ExecuteRequest(
-                            handleData->httpApiExHandle,
+                        if ((r = HTTPAPIEX_ExecuteRequest(
+                            deviceData->httpApiExHandle,
                             HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                             STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                             deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2064,7 +2275,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                     */
                     else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                         deviceData->sasObject,
-                        handleData->httpApiExHandle,
+                        deviceData->httpApiExHandle,
                         HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                         STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                         deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2094,7 +2305,11 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
                             /*this is an expected status code, means "no commands", but logging that creates panic*/
 
-                            /*do nothing, advance to next action*/
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_10_009: [ If the GET is answered with 204, the polling interval of the device shall back off. ]*/
+                            if (getPollingTime(handleData, deviceData) < getMaximumPollingTime(handleData))
+                            {
+                                deviceData->emptyPollCount++;
+                            }
                         }
                         else if (statusCode != 200)
                         {
@@ -2103,6 +2318,9 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                         }
                         else
                         {
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_10_010: [ If the GET is answered with 200, the polling interval of the device shall be reset to GetMinimumPollingTime. ]*/
+                            deviceData->emptyPollCount = 0;
+
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
                             const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
                             if (etagValue == NULL)
@@ -2308,6 +2526,96 @@ static IOTHUB_PROCESS_ITEM_RESULT IoTHubTransportHttp_ProcessItem(TRANSPORT_LL_H
     return IOTHUB_PROCESS_ERROR;
 }
 
+/*Codes_SRS_TRANSPORTMULTITHTTP_10_018: [ The devices of connection k shall be the devices k, k + connectionCount, k + 2 * connectionCount... of the transport device list, processed in this order through that connection. ]*/
+static void DoWorkForConnection(HTTP_CONNECTION* connection)
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData = connection->handleData;
+    size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+    size_t i;
+    for (i = connection->index; i < deviceListSize; i += handleData->connectionCount)
+    {
+        IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+        HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+        perDeviceItem->httpApiExHandle = connection->httpApiExHandle;
+        DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+        DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+    }
+}
+
+static void connectionWorker(void* context)
+{
+    HTTP_CONNECTION* connection = (HTTP_CONNECTION*)context;
+    HTTPTRANSPORT_HANDLE_DATA* handleData = connection->handleData;
+
+    DoWorkForConnection(connection);
+
+    if (Lock(handleData->connectionWorkersLock) != LOCK_OK)
+    {
+        LogError("unable to Lock, DoWork will not return");
+    }
+    else
+    {
+        handleData->runningConnectionWorkers--;
+        if ((handleData->runningConnectionWorkers == 0) && (Condition_Post(handleData->connectionWorkersDone) != COND_OK))
+        {
+            LogError("unable to Condition_Post");
+        }
+        (void)Unlock(handleData->connectionWorkersLock);
+    }
+}
+
+static void DoWorkConcurrently(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t deviceListSize)
+{
+    if (Lock(handleData->connectionWorkersLock) != LOCK_OK)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_020: [ If the workers cannot be used, IoTHubTransportHttp_DoWork shall process the devices of that connection itself. ]*/
+        size_t k;
+        LogError("unable to Lock, the devices are processed one after the other");
+        for (k = 0; (k < handleData->connectionCount) && (k < deviceListSize); k++)
+        {
+            DoWorkForConnection(&handleData->connections[k]);
+        }
+    }
+    else
+    {
+        size_t k;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_019: [ IoTHubTransportHttp_DoWork shall post the processing of the devices of every connection but the first one to the pool by calling callback_dispatcher_post, process the devices of the first connection itself, and return only once all of them were processed. ]*/
+        for (k = 1; (k < handleData->connectionCount) && (k < deviceListSize); k++)
+        {
+            handleData->runningConnectionWorkers++;
+            if (callback_dispatcher_post(handleData->connectionWorkers, CALLBACK_DISPATCHER_PARALLEL_LANE, connectionWorker, &handleData->connections[k]) != 0)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_10_020: [ If the workers cannot be used, IoTHubTransportHttp_DoWork shall process the devices of that connection itself. ]*/
+                LogError("unable to callback_dispatcher_post, the devices of connection %lu are processed by DoWork", (unsigned long)k);
+                handleData->runningConnectionWorkers--;
+                (void)Unlock(handleData->connectionWorkersLock);
+                DoWorkForConnection(&handleData->connections[k]);
+                if (Lock(handleData->connectionWorkersLock) != LOCK_OK)
+                {
+                    LogError("unable to Lock");
+                    break;
+                }
+            }
+        }
+        (void)Unlock(handleData->connectionWorkersLock);
+
+        DoWorkForConnection(&handleData->connections[0]);
+
+        if (Lock(handleData->connectionWorkersLock) != LOCK_OK)
+        {
+            LogError("unable to Lock, not waiting for the other connections");
+        }
+        else
+        {
+            while (handleData->runningConnectionWorkers > 0)
+            {
+                (void)Condition_Wait(handleData->connectionWorkersDone, handleData->connectionWorkersLock, 0);
+            }
+            (void)Unlock(handleData->connectionWorkersLock);
+        }
+    }
+}
+
 static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
@@ -2322,13 +2630,21 @@ static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+        if ((handleData->connectionCount > 1) && (deviceListSize > 1))
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-            DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-            DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_017: [ When "HttpConnectionCount" is greater than 1 and there is more than 1 device, IoTHubTransportHttp_DoWork shall process the devices of every connection concurrently. ]*/
+            DoWorkConcurrently(handleData, deviceListSize);
+        }
+        else
+        {
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
 
+            }
         }
     }
     else
@@ -2413,16 +2729,70 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             handleData->getMinimumPollingTime = *(unsigned int*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_012: [ "MaximumPollingTime" ] */
+        else if (strcmp(OPTION_MAX_POLLING_TIME, option) == 0)
+        {
+            handleData->getMaximumPollingTime = *(unsigned int*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_022: [ "HttpCompressionThreshold" ] */
+        else if (strcmp(OPTION_HTTP_COMPRESSION_THRESHOLD, option) == 0)
+        {
+#ifdef USE_HTTP_COMPRESSION
+            handleData->compressionThreshold = *(size_t*)value;
+            result = IOTHUB_CLIENT_OK;
+#else
+            LogError("%s option being set without the USE_HTTP_COMPRESSION compiler switch", option);
+            result = IOTHUB_CLIENT_ERROR;
+#endif
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_013: [ "HttpConnectionCount" ] */
+        else if (strcmp(OPTION_HTTP_CONNECTION_COUNT, option) == 0)
+        {
+            size_t connectionCount = *(size_t*)value;
+            if (connectionCount == 0)
+            {
+                LogError("%s cannot be 0", OPTION_HTTP_CONNECTION_COUNT);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_014: [ If "HttpConnectionCount" was already set, or an option was already passed to HTTPAPIEX_SetOption, IoTHubTransportHttp_SetOption shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+            else if ((handleData->connectionCount > 1) || handleData->wereConnectionOptionsSet)
+            {
+                LogError("%s can only be set once, before the options of the connection", OPTION_HTTP_CONNECTION_COUNT);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else if ((connectionCount > 1) && (create_connections(handleData, connectionCount) != 0))
+            {
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_10_030: [ "message_record_pool_size" ] */
+        else if (strcmp(OPTION_MESSAGE_RECORD_POOL_SIZE, option) == 0)
+        {
+            /*the HTTP transport keeps no per-message records of its own*/
+            result = IOTHUB_CLIENT_OK;
+        }
         else
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_127: [ NULL shall be allowed. ]*/
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_129: [ This option shall passed down to the lower layer by calling HTTPAPIEX_SetOption. ]*/
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_118: [Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code.] */
+            /*Codes_SRS_TRANSPORTMULTITHTTP_10_021: [ When there are several connections, the option shall be passed to every one of them, the first failure being returned. ]*/
             HTTPAPIEX_RESULT HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->httpApiExHandle, option, value);
+            size_t i;
+            for (i = 1; (HTTPAPIEX_result == HTTPAPIEX_OK) && (i < handleData->connectionCount); i++)
+            {
+                HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->connections[i].httpApiExHandle, option, value);
+            }
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
             if (HTTPAPIEX_result == HTTPAPIEX_OK)
             {
+                handleData->wereConnectionOptionsSet = true;
                 result = IOTHUB_CLIENT_OK;
             }
             else if (HTTPAPIEX_result == HTTPAPIEX_INVALID_ARG)
@@ -6,16 +6,17 @@
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/gballoc.h"
-#include "azure_c_shared_utility/agenttime.h" 
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
+#include "internal/iothub_client_timer_wheel.h"
 
 typedef struct MESSAGE_QUEUE_TAG MESSAGE_QUEUE;
 
 #include "internal/message_queue.h"
 
 #define RESULT_OK 0
-#define INDEFINITE_TIME ((time_t)(-1))
+#define MILLISECONDS_IN_A_SECOND ((tickcounter_ms_t)1000)
 
 static const char* SAVED_OPTION_MAX_RETRY_COUNT = "SAVED_OPTION_MAX_RETRY_COUNT";
 static const char* SAVED_OPTION_MAX_ENQUEUE_TIME_SECS = "SAVED_OPTION_MAX_ENQUEUE_TIME_SECS";
@@ -33,6 +34,10 @@ struct MESSAGE_QUEUE_TAG
 
     SINGLYLINKEDLIST_HANDLE pending;
     SINGLYLINKEDLIST_HANDLE in_progress;
+
+    TICK_COUNTER_HANDLE tick_counter;
+    TIMER_WHEEL timeouts; /*one timer per message, so message_queue_do_work only visits the messages that are due*/
+    tickcounter_ms_t current_time; /*time passed to timer_wheel_process, read by the timer callbacks*/
 };
 
 typedef struct MESSAGE_QUEUE_ITEM_TAG
@@ -40,9 +45,13 @@ typedef struct MESSAGE_QUEUE_ITEM_TAG
     MQ_MESSAGE_HANDLE message;
     MESSAGE_PROCESSING_COMPLETED_CALLBACK on_message_processing_completed_callback;
     void* user_context;
-    time_t enqueue_time;
-    time_t processing_start_time;
+    tickcounter_ms_t enqueue_time;
+    tickcounter_ms_t processing_start_time;
     size_t number_of_attempts;
+    MESSAGE_QUEUE_HANDLE message_queue;
+    SINGLYLINKEDLIST_HANDLE list; /*the list holding the item (pending or in_progress), so a timer can remove it without searching*/
+    LIST_ITEM_HANDLE list_item;
+    TIMER_WHEEL_ENTRY timeout_timer; /*armed for the earliest of the enqueued and processing time limits of the message*/
 } MESSAGE_QUEUE_ITEM;
 
 
@@ -70,6 +79,131 @@ static void fire_message_callback(MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RES
     }
 }
 
+/*false if no time limit applies to the message in its current list*/
+static bool get_message_deadline(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, tickcounter_ms_t* deadline)
+{
+    bool result = false;
+
+    if (message_queue->max_message_enqueued_time_secs > 0)
+    {
+        *deadline = mq_item->enqueue_time + message_queue->max_message_enqueued_time_secs * MILLISECONDS_IN_A_SECOND;
+        result = true;
+    }
+
+    if (message_queue->max_message_processing_time_secs > 0 && mq_item->list == message_queue->in_progress)
+    {
+        tickcounter_ms_t processing_deadline = mq_item->processing_start_time + message_queue->max_message_processing_time_secs * MILLISECONDS_IN_A_SECOND;
+
+        if (!result || processing_deadline < *deadline)
+        {
+            *deadline = processing_deadline;
+        }
+        result = true;
+    }
+
+    return result;
+}
+
+static void arm_timeout_timer(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, tickcounter_ms_t current_time)
+{
+    tickcounter_ms_t deadline;
+
+    if (!get_message_deadline(message_queue, mq_item, &deadline))
+    {
+        timer_wheel_cancel(&message_queue->timeouts, &mq_item->timeout_timer);
+    }
+    else if (timer_wheel_start(&message_queue->timeouts, &mq_item->timeout_timer, current_time, (deadline > current_time ? deadline - current_time : 0)) != 0)
+    {
+        LogError("failed arming the timeout of message (%p)", mq_item->message);
+    }
+}
+
+static void dequeue_message_and_fire_callback(MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result, void* reason)
+{
+    timer_wheel_cancel(&mq_item->message_queue->timeouts, &mq_item->timeout_timer);
+
+    // Codes_SRS_MESSAGE_QUEUE_09_045: [If `message` is present in `message_queue->in_progress`, it shall be removed]
+    if (singlylinkedlist_remove(mq_item->list, mq_item->list_item))
+    {
+        LogError("failed removing message from list (%p)", mq_item->list);
+    }
+
+    // Codes_SRS_MESSAGE_QUEUE_09_049: [Otherwise `mq_item->on_message_processing_completed_callback` shall be invoked passing `mq_item->message`, `result`, `reason` and `mq_item->user_context`]
+    fire_message_callback(mq_item, result, reason);
+
+    // Codes_SRS_MESSAGE_QUEUE_09_050: [The `mq_item` related to `message` shall be freed]
+    free(mq_item);
+}
+
+/*the timer is not moved when a time limit of the message is extended (a retry, message_queue_move_all_back_to_pending or a longer
+option), it is re-armed here when it fires early*/
+static void on_timeout_timer_expired(void* context)
+{
+    MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)context;
+    MESSAGE_QUEUE_HANDLE message_queue = mq_item->message_queue;
+    tickcounter_ms_t deadline;
+
+    if (!get_message_deadline(message_queue, mq_item, &deadline))
+    {
+        // No time limit applies to the message anymore.
+    }
+    else if (deadline > message_queue->current_time)
+    {
+        arm_timeout_timer(message_queue, mq_item, message_queue->current_time);
+    }
+    else
+    {
+        // Codes_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
+        // Codes_SRS_MESSAGE_QUEUE_09_038: [If any items are in `message_queue->in_progress` for `message_queue->max_message_processing_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
+        dequeue_message_and_fire_callback(mq_item, MESSAGE_QUEUE_TIMEOUT, NULL);
+    }
+}
+
+static int rearm_timeout_timers(MESSAGE_QUEUE_HANDLE message_queue)
+{
+    int result;
+    tickcounter_ms_t current_time;
+
+    if (tickcounter_get_current_ms(message_queue->tick_counter, &current_time) != 0)
+    {
+        LogError("failed re-arming message timeouts (tickcounter_get_current_ms failed)");
+        result = __FAILURE__;
+    }
+    else
+    {
+        SINGLYLINKEDLIST_HANDLE lists[2];
+        size_t i;
+
+        lists[0] = message_queue->pending;
+        lists[1] = message_queue->in_progress;
+
+        for (i = 0; i < sizeof(lists) / sizeof(lists[0]); i++)
+        {
+            LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(lists[i]);
+
+            while (list_item != NULL)
+            {
+                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
+
+                if (mq_item == NULL)
+                {
+                    LogError("failed re-arming message timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
+                }
+                else
+                {
+                    arm_timeout_timer(message_queue, mq_item, current_time);
+                }
+
+                list_item = singlylinkedlist_get_next_item(list_item);
+            }
+        }
+
+        result = RESULT_OK;
+    }
+
+    return result;
+}
+
 static bool should_retry_sending(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result)
 {
     return (result == MESSAGE_QUEUE_RETRYABLE_ERROR && mq_item->number_of_attempts <= message_queue->max_retry_count);
@@ -87,36 +221,21 @@ static int retry_sending_message(MESSAGE_QUEUE_HANDLE message_queue, LIST_ITEM_H
         LogError("Failed removing message from in-progress list");
         result = __FAILURE__;
     }
-    else if (singlylinkedlist_add(message_queue->pending, (const void*)mq_item) == NULL)
+    else if ((mq_item->list_item = singlylinkedlist_add(message_queue->pending, (const void*)mq_item)) == NULL)
     {
         LogError("Failed moving message back to pending list");
         result = __FAILURE__;
     }
     else
     {
+        // The timer of the message stays armed, the processing time limit no longer applies to it.
+        mq_item->list = message_queue->pending;
         result = RESULT_OK;
     }
 
     return result;
 }
 
-static void dequeue_message_and_fire_callback(SINGLYLINKEDLIST_HANDLE list, LIST_ITEM_HANDLE list_item, MESSAGE_QUEUE_RESULT result, void* reason)
-{
-    MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-
-    // Codes_SRS_MESSAGE_QUEUE_09_045: [If `message` is present in `message_queue->in_progress`, it shall be removed]
-    if (singlylinkedlist_remove(list, list_item))
-    {
-        LogError("failed removing message from list (%p)", list);
-    }
-    
-    // Codes_SRS_MESSAGE_QUEUE_09_049: [Otherwise `mq_item->on_message_processing_completed_callback` shall be invoked passing `mq_item->message`, `result`, `reason` and `mq_item->user_context`]
-    fire_message_callback(mq_item, result, reason);
-
-    // Codes_SRS_MESSAGE_QUEUE_09_050: [The `mq_item` related to `message` shall be freed]
-    free(mq_item);
-}
-
 static void on_process_message_completed_callback(MESSAGE_QUEUE_HANDLE message_queue, MQ_MESSAGE_HANDLE message, MESSAGE_QUEUE_RESULT result, USER_DEFINED_REASON reason)
 {
     // Codes_SRS_MESSAGE_QUEUE_09_069: [If `message` or `message_queue` are NULL, on_message_processing_completed_callback shall return immediately]
@@ -141,7 +260,7 @@ static void on_process_message_completed_callback(MESSAGE_QUEUE_HANDLE message_q
             // Codes_SRS_MESSAGE_QUEUE_09_048: [If `result` is MESSAGE_QUEUE_RETRYABLE_ERROR and `mq_item->number_of_attempts` is greater than `message_queue->max_retry_count`, result shall be changed to MESSAGE_QUEUE_ERROR]
             if (!should_retry_sending(message_queue, mq_item, result) || retry_sending_message(message_queue, list_item) != RESULT_OK)
             {
-                dequeue_message_and_fire_callback(message_queue->in_progress, list_item, result, reason);
+                dequeue_message_and_fire_callback(mq_item, result, reason);
             }
         }
     }
@@ -149,90 +268,15 @@ static void on_process_message_completed_callback(MESSAGE_QUEUE_HANDLE message_q
 
 static void process_timeouts(MESSAGE_QUEUE_HANDLE message_queue)
 {
-    time_t current_time;
-
-    if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
+    if (tickcounter_get_current_ms(message_queue->tick_counter, &message_queue->current_time) != 0)
     {
-        LogError("failed processing timeouts (get_time failed)");
+        LogError("failed processing timeouts (tickcounter_get_current_ms failed)");
     }
     else
     {
         // Codes_SRS_MESSAGE_QUEUE_09_035: [If `message_queue->max_message_enqueued_time_secs` is greater than zero, `message_queue->in_progress` and `message_queue->pending` items shall be checked for timeout]
-        if (message_queue->max_message_enqueued_time_secs > 0)
-        {
-            LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(message_queue->pending);
-
-            while (list_item != NULL)
-            {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
-
-                if (mq_item == NULL)
-                {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->enqueue_time) >= message_queue->max_message_enqueued_time_secs)
-                {
-                    // Codes_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
-                    dequeue_message_and_fire_callback(message_queue->pending, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
-                else
-                {
-                    // The pending list order is already based on enqueue time, so if one message is not expired, later ones won't be either.
-                    break;
-                }
-            }
-
-            list_item = singlylinkedlist_get_head_item(message_queue->in_progress);
-
-            while (list_item != NULL)
-            {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
-
-                if (mq_item == NULL)
-                {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->enqueue_time) >= message_queue->max_message_enqueued_time_secs)
-                {
-                    // Codes_SRS_MESSAGE_QUEUE_09_038: [If any items are in `message_queue->in_progress` for `message_queue->max_message_processing_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
-                    dequeue_message_and_fire_callback(message_queue->in_progress, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
-            }
-        }
-
         // Codes_SRS_MESSAGE_QUEUE_09_037: [If `message_queue->max_message_processing_time_secs` is greater than zero, `message_queue->in_progress` items shall be checked for timeout]
-        if (message_queue->max_message_processing_time_secs > 0)
-        {
-            LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(message_queue->in_progress);
-
-            while (list_item != NULL)
-            {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
-
-                if (mq_item == NULL)
-                {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->processing_start_time) >= message_queue->max_message_processing_time_secs)
-                {
-                    dequeue_message_and_fire_callback(message_queue->in_progress, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
-                else
-                {
-                    // The in-progress list order is already based on start-processing time, so if one message is not expired, later ones won't be either.
-                    break;
-                }
-            }
-        }
+        (void)timer_wheel_process(&message_queue->timeouts, message_queue->current_time);
     }
 }
 
@@ -263,12 +307,14 @@ static void process_pending_messages(MESSAGE_QUEUE_HANDLE message_queue)
 
             break; // Trying to avoid an infinite loop
         }
-        // Codes_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using get_time()]
-        else if ((mq_item->processing_start_time = get_time(NULL)) == INDEFINITE_TIME)
+        // Codes_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using tickcounter_get_current_ms()]
+        else if (tickcounter_get_current_ms(message_queue->tick_counter, &mq_item->processing_start_time) != 0)
         {
-            // Codes_SRS_MESSAGE_QUEUE_09_041: [If get_time() fails, `mq_item` shall be removed from `message_queue->in_progress`]
+            // Codes_SRS_MESSAGE_QUEUE_09_041: [If tickcounter_get_current_ms() fails, `mq_item` shall be removed from `message_queue->in_progress`]
             LogError("failed setting message processing_start_time (%p)", mq_item->message);
 
+            timer_wheel_cancel(&message_queue->timeouts, &mq_item->timeout_timer);
+
             // Codes_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
             if (mq_item->on_message_processing_completed_callback != NULL)
             {
@@ -278,10 +324,12 @@ static void process_pending_messages(MESSAGE_QUEUE_HANDLE message_queue)
             free(mq_item);
         }
         // Codes_SRS_MESSAGE_QUEUE_09_039: [Each `mq_item` in `message_queue->pending` shall be moved to `message_queue->in_progress`]
-        else if (singlylinkedlist_add(message_queue->in_progress, (const void*)mq_item) == NULL)
+        else if ((mq_item->list_item = singlylinkedlist_add(message_queue->in_progress, (const void*)mq_item)) == NULL)
         {
             LogError("failed moving message to in-progress list (%p)", mq_item->message);
 
+            timer_wheel_cancel(&message_queue->timeouts, &mq_item->timeout_timer);
+
             // Codes_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
             if (mq_item->on_message_processing_completed_callback != NULL)
             {
@@ -292,8 +340,12 @@ static void process_pending_messages(MESSAGE_QUEUE_HANDLE message_queue)
         }
         else
         {
+            mq_item->list = message_queue->in_progress;
             mq_item->number_of_attempts++;
 
+            // Codes_SRS_MESSAGE_QUEUE_09_070: [The timeout timer of `mq_item` shall be armed for the earliest of its enqueued and processing time limits]
+            arm_timeout_timer(message_queue, mq_item, mq_item->processing_start_time);
+
             // Codes_SRS_MESSAGE_QUEUE_09_043: [If no failures occur, `message_queue->on_process_message_callback` shall be invoked passing `mq_item->message` and `on_process_message_completed_callback`]
             message_queue->on_process_message_callback(message_queue, mq_item->message, on_process_message_completed_callback, mq_item->user_context);
         }
@@ -365,14 +417,14 @@ void message_queue_remove_all(MESSAGE_QUEUE_HANDLE message_queue)
         {
             // Codes_SRS_MESSAGE_QUEUE_09_028: [`message_queue->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_CANCELLED for each `mq_item` removed]
             // Codes_SRS_MESSAGE_QUEUE_09_029: [Each `mq_item` shall be freed] 
-            dequeue_message_and_fire_callback(message_queue->in_progress, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
+            dequeue_message_and_fire_callback((MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item), MESSAGE_QUEUE_CANCELLED, NULL);
         }
 
         while ((list_item = singlylinkedlist_get_head_item(message_queue->pending)) != NULL)
         {
             // Codes_SRS_MESSAGE_QUEUE_09_028: [`message_queue->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_CANCELLED for each `mq_item` removed]
             // Codes_SRS_MESSAGE_QUEUE_09_029: [Each `mq_item` shall be freed] 
-            dequeue_message_and_fire_callback(message_queue->pending, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
+            dequeue_message_and_fire_callback((MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item), MESSAGE_QUEUE_CANCELLED, NULL);
         }
     }
 }
@@ -386,19 +438,23 @@ static int move_messages_between_lists(SINGLYLINKEDLIST_HANDLE from_list, SINGLY
 
     while ((list_item = singlylinkedlist_get_head_item(from_list)) != NULL)
     {
+        // The value is read first, removing the item frees list_item.
+        MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
+
         if (singlylinkedlist_remove(from_list, list_item) != 0)
         {
             LogError("failed removing message from list");
             result = __FAILURE__;
+            break;
         }
         else
         {
-            MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-
-            if (singlylinkedlist_add(to_list, (const void*)mq_item) != 0)
+            if ((mq_item->list_item = singlylinkedlist_add(to_list, (const void*)mq_item)) == NULL)
             {
                 LogError("failed moving message to list");
 
+                timer_wheel_cancel(&mq_item->message_queue->timeouts, &mq_item->timeout_timer);
+
                 fire_message_callback(mq_item, MESSAGE_QUEUE_CANCELLED, NULL);
 
                 free(mq_item);
@@ -409,8 +465,9 @@ static int move_messages_between_lists(SINGLYLINKEDLIST_HANDLE from_list, SINGLY
             }
             else
             {
+                // The timer of the message stays armed, the processing time limit no longer applies to it.
+                mq_item->list = to_list;
                 mq_item->number_of_attempts = 0;
-                mq_item->processing_start_time = INDEFINITE_TIME;
             }
         }
     }
@@ -464,7 +521,7 @@ int message_queue_move_all_back_to_pending(MESSAGE_QUEUE_HANDLE message_queue)
 
                 while ((list_item = singlylinkedlist_get_head_item(temp_list)) != NULL)
                 {
-                    dequeue_message_and_fire_callback(temp_list, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
+                    dequeue_message_and_fire_callback((MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item), MESSAGE_QUEUE_CANCELLED, NULL);
                 }
             }
 
@@ -493,7 +550,14 @@ void message_queue_destroy(MESSAGE_QUEUE_HANDLE message_queue)
         {
             singlylinkedlist_destroy(message_queue->in_progress);
         }
-        
+
+        timer_wheel_deinit(&message_queue->timeouts);
+
+        if (message_queue->tick_counter != NULL)
+        {
+            tickcounter_destroy(message_queue->tick_counter);
+        }
+
         free(message_queue);
     }
 }
@@ -543,8 +607,19 @@ MESSAGE_QUEUE_HANDLE message_queue_create(MESSAGE_QUEUE_CONFIG* config)
             message_queue_destroy(result);
             result = NULL;
         }
+        // Codes_SRS_MESSAGE_QUEUE_09_071: [`message_queue->tick_counter` shall be set using tickcounter_create()]
+        else if ((result->tick_counter = tickcounter_create()) == NULL)
+        {
+            // Codes_SRS_MESSAGE_QUEUE_09_072: [If tickcounter_create fails, message_queue_create shall fail and return NULL]
+            LogError("failed creating MESSAGE_QUEUE tick counter");
+            // Codes_SRS_MESSAGE_QUEUE_09_011: [If any failures occur, message_queue_create shall release all memory it has allocated]
+            message_queue_destroy(result);
+            result = NULL;
+        }
         else
         {
+            timer_wheel_init(&result->timeouts);
+
             // Codes_SRS_MESSAGE_QUEUE_09_010: [All arguments in `config` shall be saved into `message_queue`]
             // Codes_SRS_MESSAGE_QUEUE_09_012: [If no failures occur, message_queue_create shall return the `message_queue` pointer]
 
@@ -583,17 +658,17 @@ int message_queue_add(MESSAGE_QUEUE_HANDLE message_queue, MQ_MESSAGE_HANDLE mess
         {
             memset(mq_item, 0, sizeof(MESSAGE_QUEUE_ITEM));
 
-            // Codes_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using get_time()]
-            if ((mq_item->enqueue_time = get_time(NULL)) == INDEFINITE_TIME)
+            // Codes_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using tickcounter_get_current_ms()]
+            if (tickcounter_get_current_ms(message_queue->tick_counter, &mq_item->enqueue_time) != 0)
             {
-                // Codes_SRS_MESSAGE_QUEUE_09_020: [If get_time fails, message_queue_add shall fail and return non-zero]
+                // Codes_SRS_MESSAGE_QUEUE_09_020: [If tickcounter_get_current_ms fails, message_queue_add shall fail and return non-zero]
                 LogError("failed setting message enqueue time");
                 // Codes_SRS_MESSAGE_QUEUE_09_024: [If any failures occur, message_queue_add shall release all memory it has allocated]
                 free(mq_item);
                 result = __FAILURE__;
             }
             // Codes_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to `message_queue->pending` list]
-            else if (singlylinkedlist_add(message_queue->pending, (const void*)mq_item) == NULL)
+            else if ((mq_item->list_item = singlylinkedlist_add(message_queue->pending, (const void*)mq_item)) == NULL)
             {
                 // Codes_SRS_MESSAGE_QUEUE_09_022: [`mq_item` fails to be added to `message_queue->pending`, message_queue_add shall fail and return non-zero]
                 LogError("failed enqueing message");
@@ -607,7 +682,11 @@ int message_queue_add(MESSAGE_QUEUE_HANDLE message_queue, MQ_MESSAGE_HANDLE mess
                 mq_item->message = message;
                 mq_item->on_message_processing_completed_callback = on_message_processing_completed_callback;
                 mq_item->user_context = user_context;
-                mq_item->processing_start_time = INDEFINITE_TIME;
+                mq_item->message_queue = message_queue;
+                mq_item->list = message_queue->pending;
+                timer_wheel_entry_init(&mq_item->timeout_timer, on_timeout_timer_expired, mq_item);
+                // Codes_SRS_MESSAGE_QUEUE_09_070: [The timeout timer of `mq_item` shall be armed for the earliest of its enqueued and processing time limits]
+                arm_timeout_timer(message_queue, mq_item, mq_item->enqueue_time);
                 // Codes_SRS_MESSAGE_QUEUE_09_025: [If no failures occur, message_queue_add shall return 0]
                 result = RESULT_OK;
             }
@@ -663,8 +742,19 @@ int message_queue_set_max_message_enqueued_time_secs(MESSAGE_QUEUE_HANDLE messag
     {
         // Codes_SRS_MESSAGE_QUEUE_09_053: [`seconds` shall be saved into `message_queue->max_message_enqueued_time_secs`]
         message_queue->max_message_enqueued_time_secs = seconds;
-        // Codes_SRS_MESSAGE_QUEUE_09_054: [If no failures occur, message_queue_set_max_message_enqueued_time_secs shall return 0]
-        result = RESULT_OK;
+
+        // Codes_SRS_MESSAGE_QUEUE_09_073: [The timeout timers of the messages in `message_queue` shall be armed again for the new time limit]
+        if (rearm_timeout_timers(message_queue) != RESULT_OK)
+        {
+            // Codes_SRS_MESSAGE_QUEUE_09_074: [If the timeout timers cannot be armed again, the function shall fail and return non-zero]
+            LogError("failed applying the new time limit to the queued messages");
+            result = __FAILURE__;
+        }
+        else
+        {
+            // Codes_SRS_MESSAGE_QUEUE_09_054: [If no failures occur, message_queue_set_max_message_enqueued_time_secs shall return 0]
+            result = RESULT_OK;
+        }
     }
 
     return result;
@@ -684,8 +774,19 @@ int message_queue_set_max_message_processing_time_secs(MESSAGE_QUEUE_HANDLE mess
     {
         // Codes_SRS_MESSAGE_QUEUE_09_057: [`seconds` shall be saved into `message_queue->max_message_processing_time_secs`]
         message_queue->max_message_processing_time_secs = seconds;
-        // Codes_SRS_MESSAGE_QUEUE_09_058: [If no failures occur, message_queue_set_max_message_processing_time_secs shall return 0]
-        result = RESULT_OK;
+
+        // Codes_SRS_MESSAGE_QUEUE_09_073: [The timeout timers of the messages in `message_queue` shall be armed again for the new time limit]
+        if (rearm_timeout_timers(message_queue) != RESULT_OK)
+        {
+            // Codes_SRS_MESSAGE_QUEUE_09_074: [If the timeout timers cannot be armed again, the function shall fail and return non-zero]
+            LogError("failed applying the new time limit to the queued messages");
+            result = __FAILURE__;
+        }
+        else
+        {
+            // Codes_SRS_MESSAGE_QUEUE_09_058: [If no failures occur, message_queue_set_max_message_processing_time_secs shall return 0]
+            result = RESULT_OK;
+        }
     }
 
     return result;
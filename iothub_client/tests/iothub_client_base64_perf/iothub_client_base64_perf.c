@@ -0,0 +1,148 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*microbenchmark of the base64 implementations of iothub_client_base64 against the base64 module of the shared utility.
+Prints the throughput in GB/s of raw bytes (encoded from or decoded to) for a few payload sizes*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "azure_c_shared_utility/base64.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/strings.h"
+#include "iothub_client_base64.h"
+
+/*every measure processes about this many bytes*/
+#define BYTES_PER_MEASURE ((size_t)256 * 1024 * 1024)
+
+static const size_t payload_sizes[] = { 48, 1023, 16383, 255 * 1024 };
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void print_result(const char* name, const char* operation, size_t payload_size, size_t total_bytes, double seconds)
+{
+    (void)printf("%-12s %-7s %8lu bytes %8.3f GB/s\r\n", name, operation, (unsigned long)payload_size, (seconds > 0) ? ((double)total_bytes / seconds / 1e9) : 0.0);
+}
+
+static int measure_shared_utility(const unsigned char* payload, size_t payload_size, const char* encoded)
+{
+    int result = 0;
+    size_t iterations = BYTES_PER_MEASURE / payload_size;
+    size_t i;
+    clock_t start = clock();
+    for (i = 0; i < iterations; i++)
+    {
+        STRING_HANDLE string = Base64_Encode_Bytes(payload, payload_size);
+        if (string == NULL)
+        {
+            result = __LINE__;
+            break;
+        }
+        STRING_delete(string);
+    }
+    print_result("c-utility", "encode", payload_size, iterations * payload_size, seconds_since(start));
+
+    start = clock();
+    for (i = 0; (result == 0) && (i < iterations); i++)
+    {
+        BUFFER_HANDLE buffer = Base64_Decoder(encoded);
+        if (buffer == NULL)
+        {
+            result = __LINE__;
+            break;
+        }
+        BUFFER_delete(buffer);
+    }
+    print_result("c-utility", "decode", payload_size, iterations * payload_size, seconds_since(start));
+    return result;
+}
+
+static int measure_implementation(const char* name, const unsigned char* payload, size_t payload_size, char* encoded, unsigned char* decoded)
+{
+    int result = 0;
+    size_t iterations = BYTES_PER_MEASURE / payload_size;
+    size_t encoded_size = 0;
+    size_t i;
+    clock_t start = clock();
+    for (i = 0; i < iterations; i++)
+    {
+        encoded_size = iothub_base64_encode(encoded, payload, payload_size, IOTHUB_BASE64_ALPHABET_STANDARD);
+    }
+    print_result(name, "encode", payload_size, iterations * payload_size, seconds_since(start));
+
+    start = clock();
+    for (i = 0; i < iterations; i++)
+    {
+        if (iothub_base64_decode_groups(decoded, encoded, encoded_size, IOTHUB_BASE64_ALPHABET_STANDARD) != encoded_size)
+        {
+            result = __LINE__;
+            break;
+        }
+    }
+    print_result(name, "decode", payload_size, iterations * payload_size, seconds_since(start));
+
+    if ((result == 0) && (memcmp(payload, decoded, payload_size) != 0))
+    {
+        result = __LINE__;
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+    static const IOTHUB_BASE64_IMPLEMENTATION implementations[] =
+    {
+        IOTHUB_BASE64_IMPLEMENTATION_SCALAR,
+        IOTHUB_BASE64_IMPLEMENTATION_SSE41,
+        IOTHUB_BASE64_IMPLEMENTATION_AVX2,
+        IOTHUB_BASE64_IMPLEMENTATION_NEON
+    };
+    static const char* const names[] = { "scalar", "sse4.1", "avx2", "neon" };
+    size_t s;
+
+    for (s = 0; (result == 0) && (s < sizeof(payload_sizes) / sizeof(payload_sizes[0])); s++)
+    {
+        /*the payload sizes are multiples of 3, so the decoders see only complete groups*/
+        size_t payload_size = payload_sizes[s];
+        unsigned char* payload = (unsigned char*)malloc(payload_size);
+        unsigned char* decoded = (unsigned char*)malloc(payload_size);
+        char* encoded = (char*)malloc(IOTHUB_BASE64_ENCODED_LENGTH(payload_size) + 1);
+        if ((payload == NULL) || (decoded == NULL) || (encoded == NULL))
+        {
+            (void)printf("failed allocating %lu bytes\r\n", (unsigned long)payload_size);
+            result = __LINE__;
+        }
+        else
+        {
+            size_t i;
+            for (i = 0; i < payload_size; i++)
+            {
+                payload[i] = (unsigned char)rand();
+            }
+            encoded[iothub_base64_encode(encoded, payload, payload_size, IOTHUB_BASE64_ALPHABET_STANDARD)] = '\0';
+
+            result = measure_shared_utility(payload, payload_size, encoded);
+            for (i = 0; (result == 0) && (i < sizeof(implementations) / sizeof(implementations[0])); i++)
+            {
+                if (iothub_base64_set_implementation(implementations[i]) == 0)
+                {
+                    result = measure_implementation(names[i], payload, payload_size, encoded, decoded);
+                }
+            }
+        }
+        free(payload);
+        free(decoded);
+        free(encoded);
+    }
+
+    if (result != 0)
+    {
+        (void)printf("iothub_client_base64_perf failed (%d)\r\n", result);
+    }
+    return result;
+}
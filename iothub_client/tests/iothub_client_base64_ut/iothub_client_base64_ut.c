@@ -0,0 +1,441 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "iothub_client_base64.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+static IOTHUB_BASE64_IMPLEMENTATION g_default_implementation;
+
+static const IOTHUB_BASE64_IMPLEMENTATION all_implementations[] =
+{
+    IOTHUB_BASE64_IMPLEMENTATION_SCALAR,
+    IOTHUB_BASE64_IMPLEMENTATION_SSE41,
+    IOTHUB_BASE64_IMPLEMENTATION_AVX2,
+    IOTHUB_BASE64_IMPLEMENTATION_NEON
+};
+
+// Data definitions
+
+/*long enough for several iterations of every vector kernel plus a scalar tail*/
+#define TEST_DATA_SIZE          200
+#define TEST_ENCODED_SIZE       IOTHUB_BASE64_ENCODED_LENGTH(TEST_DATA_SIZE)
+
+static unsigned char test_data[TEST_DATA_SIZE];
+
+static void fill_test_data(void)
+{
+    size_t i;
+    for (i = 0; i < TEST_DATA_SIZE; i++)
+    {
+        test_data[i] = (unsigned char)(i * 151 + 7);
+    }
+}
+
+/*encodes test_data[0..size) with the portable implementation*/
+static size_t encode_with_scalar(char* destination, size_t size, IOTHUB_BASE64_ALPHABET alphabet)
+{
+    size_t result;
+    IOTHUB_BASE64_IMPLEMENTATION current = iothub_base64_get_implementation();
+    ASSERT_ARE_EQUAL(int, 0, iothub_base64_set_implementation(IOTHUB_BASE64_IMPLEMENTATION_SCALAR));
+    result = iothub_base64_encode(destination, test_data, size, alphabet);
+    ASSERT_ARE_EQUAL(int, 0, iothub_base64_set_implementation(current));
+    return result;
+}
+
+BEGIN_TEST_SUITE(iothub_client_base64_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    fill_test_data();
+    g_default_implementation = iothub_base64_get_implementation();
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    (void)iothub_base64_set_implementation(g_default_implementation);
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_001: [ If `destination` is NULL, or `source` is NULL while `size` is not 0, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_encode` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_encode_with_NULL_destination_returns_0)
+{
+    // arrange
+    unsigned char source[3] = { 1, 2, 3 };
+
+    // act
+    size_t result = iothub_base64_encode(NULL, source, sizeof(source), IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_001: [ If `destination` is NULL, or `source` is NULL while `size` is not 0, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_encode` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_encode_with_NULL_source_and_non_zero_size_returns_0)
+{
+    // arrange
+    char destination[4] = { 'x', 'x', 'x', 'x' };
+
+    // act
+    size_t result = iothub_base64_encode(destination, NULL, 3, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char, 'x', destination[0]);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_001: [ If `destination` is NULL, or `source` is NULL while `size` is not 0, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_encode` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_encode_with_invalid_alphabet_returns_0)
+{
+    // arrange
+    char destination[4] = { 'x', 'x', 'x', 'x' };
+    unsigned char source[3] = { 1, 2, 3 };
+
+    // act
+    size_t result = iothub_base64_encode(destination, source, sizeof(source), (IOTHUB_BASE64_ALPHABET)42);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char, 'x', destination[0]);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_002: [ `iothub_base64_encode` shall write to `destination` the `IOTHUB_BASE64_ENCODED_LENGTH(size)` characters encoding `source` with `alphabet`, padded with '=', and return that number of characters. ]
+TEST_FUNCTION(iothub_base64_encode_with_NULL_source_and_0_size_returns_0)
+{
+    // arrange
+    char destination[4] = { 'x', 'x', 'x', 'x' };
+
+    // act
+    size_t result = iothub_base64_encode(destination, NULL, 0, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(char, 'x', destination[0]);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_002: [ `iothub_base64_encode` shall write to `destination` the `IOTHUB_BASE64_ENCODED_LENGTH(size)` characters encoding `source` with `alphabet`, padded with '=', and return that number of characters. ]
+TEST_FUNCTION(iothub_base64_encode_produces_the_RFC_4648_test_vectors)
+{
+    // arrange
+    static const char* const expected[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+    const unsigned char source[] = { 'f', 'o', 'o', 'b', 'a', 'r' };
+    size_t i;
+
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        char destination[9];
+
+        // act
+        size_t result = iothub_base64_encode(destination, source, i, IOTHUB_BASE64_ALPHABET_STANDARD);
+        destination[result] = '\0';
+
+        // assert
+        ASSERT_ARE_EQUAL(size_t, IOTHUB_BASE64_ENCODED_LENGTH(i), result);
+        ASSERT_ARE_EQUAL(char_ptr, expected[i], destination);
+    }
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_002: [ `iothub_base64_encode` shall write to `destination` the `IOTHUB_BASE64_ENCODED_LENGTH(size)` characters encoding `source` with `alphabet`, padded with '=', and return that number of characters. ]
+TEST_FUNCTION(iothub_base64_encode_uses_the_characters_of_the_alphabet)
+{
+    // arrange
+    const unsigned char source[] = { 0xFB, 0xFF, 0xBF };
+    char standard[5];
+    char url[5];
+
+    // act
+    size_t standard_result = iothub_base64_encode(standard, source, sizeof(source), IOTHUB_BASE64_ALPHABET_STANDARD);
+    size_t url_result = iothub_base64_encode(url, source, sizeof(source), IOTHUB_BASE64_ALPHABET_URL);
+    standard[standard_result] = '\0';
+    url[url_result] = '\0';
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, "+/+/", standard);
+    ASSERT_ARE_EQUAL(char_ptr, "-_-_", url);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_003: [ `iothub_base64_encode` shall encode with the selected implementation as many bytes as it handles and shall encode the remaining bytes one group of 3 at a time. ]
+TEST_FUNCTION(iothub_base64_encode_all_implementations_produce_the_scalar_output)
+{
+    size_t i;
+    for (i = 0; i < sizeof(all_implementations) / sizeof(all_implementations[0]); i++)
+    {
+        size_t size;
+        if (iothub_base64_set_implementation(all_implementations[i]) != 0)
+        {
+            /*not available on this machine*/
+            continue;
+        }
+
+        for (size = 0; size <= TEST_DATA_SIZE; size++)
+        {
+            int alphabet;
+            for (alphabet = 0; alphabet < 2; alphabet++)
+            {
+                // arrange
+                char expected[TEST_ENCODED_SIZE];
+                char actual[TEST_ENCODED_SIZE];
+                size_t expected_size = encode_with_scalar(expected, size, (IOTHUB_BASE64_ALPHABET)alphabet);
+
+                // act
+                size_t result = iothub_base64_encode(actual, test_data, size, (IOTHUB_BASE64_ALPHABET)alphabet);
+
+                // assert
+                ASSERT_ARE_EQUAL(size_t, expected_size, result);
+                ASSERT_ARE_EQUAL(int, 0, memcmp(expected, actual, result));
+            }
+        }
+    }
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_004: [ If `destination` or `source` is NULL, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_decode_groups` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_decode_groups_with_NULL_destination_returns_0)
+{
+    // act
+    size_t result = iothub_base64_decode_groups(NULL, "Zm9v", 4, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_004: [ If `destination` or `source` is NULL, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_decode_groups` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_decode_groups_with_NULL_source_returns_0)
+{
+    // arrange
+    unsigned char destination[3] = { 0 };
+
+    // act
+    size_t result = iothub_base64_decode_groups(destination, NULL, 4, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_004: [ If `destination` or `source` is NULL, or `alphabet` is not a valid `IOTHUB_BASE64_ALPHABET`, `iothub_base64_decode_groups` shall write nothing and return 0. ]
+TEST_FUNCTION(iothub_base64_decode_groups_with_invalid_alphabet_returns_0)
+{
+    // arrange
+    unsigned char destination[3] = { 0 };
+
+    // act
+    size_t result = iothub_base64_decode_groups(destination, "Zm9v", 4, (IOTHUB_BASE64_ALPHABET)42);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+    ASSERT_ARE_EQUAL(int, 0, destination[0]);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_005: [ `iothub_base64_decode_groups` shall decode groups of 4 characters from `source` for as long as the 4 characters belong to `alphabet`, write the 3 bytes of every group to `destination` and return the number of characters decoded. ]
+TEST_FUNCTION(iothub_base64_decode_groups_decodes_complete_groups)
+{
+    // arrange
+    unsigned char destination[6];
+
+    // act
+    size_t result = iothub_base64_decode_groups(destination, "Zm9vYmFy", 8, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 8, result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(destination, "foobar", 6));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_005: [ `iothub_base64_decode_groups` shall decode groups of 4 characters from `source` for as long as the 4 characters belong to `alphabet`, write the 3 bytes of every group to `destination` and return the number of characters decoded. ]
+TEST_FUNCTION(iothub_base64_decode_groups_stops_at_the_padded_group)
+{
+    // arrange
+    unsigned char destination[6];
+
+    // act
+    size_t result = iothub_base64_decode_groups(destination, "Zm9vYg==", 8, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 4, result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(destination, "foo", 3));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_005: [ `iothub_base64_decode_groups` shall decode groups of 4 characters from `source` for as long as the 4 characters belong to `alphabet`, write the 3 bytes of every group to `destination` and return the number of characters decoded. ]
+TEST_FUNCTION(iothub_base64_decode_groups_ignores_an_incomplete_group)
+{
+    // arrange
+    unsigned char destination[6];
+
+    // act
+    size_t result = iothub_base64_decode_groups(destination, "Zm9vYmF", 7, IOTHUB_BASE64_ALPHABET_STANDARD);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 4, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_005: [ `iothub_base64_decode_groups` shall decode groups of 4 characters from `source` for as long as the 4 characters belong to `alphabet`, write the 3 bytes of every group to `destination` and return the number of characters decoded. ]
+TEST_FUNCTION(iothub_base64_decode_groups_does_not_mix_the_alphabets)
+{
+    // arrange
+    unsigned char destination[6];
+
+    // act
+    size_t standard_result = iothub_base64_decode_groups(destination, "AAAA-_-_", 8, IOTHUB_BASE64_ALPHABET_STANDARD);
+    size_t url_result = iothub_base64_decode_groups(destination, "AAAA+/+/", 8, IOTHUB_BASE64_ALPHABET_URL);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 4, standard_result);
+    ASSERT_ARE_EQUAL(size_t, 4, url_result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_006: [ `iothub_base64_decode_groups` shall decode with the selected implementation as many characters as it handles and shall decode the remaining characters one group of 4 at a time. ]
+TEST_FUNCTION(iothub_base64_decode_groups_all_implementations_decode_what_was_encoded)
+{
+    size_t i;
+    for (i = 0; i < sizeof(all_implementations) / sizeof(all_implementations[0]); i++)
+    {
+        int alphabet;
+        if (iothub_base64_set_implementation(all_implementations[i]) != 0)
+        {
+            continue;
+        }
+
+        for (alphabet = 0; alphabet < 2; alphabet++)
+        {
+            // arrange
+            char encoded[TEST_ENCODED_SIZE];
+            unsigned char decoded[TEST_DATA_SIZE];
+            /*no padding, so that all the groups are complete*/
+            size_t size = (TEST_DATA_SIZE / 3) * 3;
+            size_t encoded_size = encode_with_scalar(encoded, size, (IOTHUB_BASE64_ALPHABET)alphabet);
+
+            // act
+            size_t result = iothub_base64_decode_groups(decoded, encoded, encoded_size, (IOTHUB_BASE64_ALPHABET)alphabet);
+
+            // assert
+            ASSERT_ARE_EQUAL(size_t, encoded_size, result);
+            ASSERT_ARE_EQUAL(int, 0, memcmp(test_data, decoded, size));
+        }
+    }
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_006: [ `iothub_base64_decode_groups` shall decode with the selected implementation as many characters as it handles and shall decode the remaining characters one group of 4 at a time. ]
+TEST_FUNCTION(iothub_base64_decode_groups_all_implementations_stop_at_the_group_with_an_invalid_character)
+{
+    static const char invalid_characters[] = { '=', '"', ' ', '.', '\0', '\x80', '\xFF' };
+    size_t i;
+    for (i = 0; i < sizeof(all_implementations) / sizeof(all_implementations[0]); i++)
+    {
+        char encoded[TEST_ENCODED_SIZE];
+        size_t size = (TEST_DATA_SIZE / 3) * 3;
+        size_t encoded_size;
+        size_t position;
+        if (iothub_base64_set_implementation(all_implementations[i]) != 0)
+        {
+            continue;
+        }
+
+        encoded_size = encode_with_scalar(encoded, size, IOTHUB_BASE64_ALPHABET_URL);
+        for (position = 0; position < encoded_size; position++)
+        {
+            size_t k;
+            for (k = 0; k < sizeof(invalid_characters); k++)
+            {
+                // arrange
+                unsigned char decoded[TEST_DATA_SIZE];
+                char saved = encoded[position];
+                size_t result;
+                encoded[position] = invalid_characters[k];
+
+                // act
+                result = iothub_base64_decode_groups(decoded, encoded, encoded_size, IOTHUB_BASE64_ALPHABET_URL);
+
+                // assert
+                ASSERT_ARE_EQUAL(size_t, (position / 4) * 4, result);
+                ASSERT_ARE_EQUAL(int, 0, memcmp(test_data, decoded, (position / 4) * 3));
+
+                // cleanup
+                encoded[position] = saved;
+            }
+        }
+    }
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_007: [ `iothub_base64_get_implementation` shall return the implementation used by `iothub_base64_encode` and `iothub_base64_decode_groups`. ]
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_010: [ Otherwise `iothub_base64_set_implementation` shall use `implementation` from then on and return 0. ]
+TEST_FUNCTION(iothub_base64_set_implementation_SCALAR_succeeds)
+{
+    // act
+    int result = iothub_base64_set_implementation(IOTHUB_BASE64_IMPLEMENTATION_SCALAR);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_BASE64_IMPLEMENTATION_SCALAR, (int)iothub_base64_get_implementation());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_009: [ When no implementation was selected yet, the first one supported by the build and the CPU among `IOTHUB_BASE64_IMPLEMENTATION_AVX2`, `IOTHUB_BASE64_IMPLEMENTATION_SSE41`, `IOTHUB_BASE64_IMPLEMENTATION_NEON` and `IOTHUB_BASE64_IMPLEMENTATION_SCALAR` shall be selected. ]
+TEST_FUNCTION(iothub_base64_default_implementation_is_the_first_supported_one)
+{
+    // arrange
+    static const IOTHUB_BASE64_IMPLEMENTATION preference[] =
+    {
+        IOTHUB_BASE64_IMPLEMENTATION_AVX2,
+        IOTHUB_BASE64_IMPLEMENTATION_SSE41,
+        IOTHUB_BASE64_IMPLEMENTATION_NEON,
+        IOTHUB_BASE64_IMPLEMENTATION_SCALAR
+    };
+    size_t i;
+    IOTHUB_BASE64_IMPLEMENTATION expected = IOTHUB_BASE64_IMPLEMENTATION_SCALAR;
+    for (i = 0; i < sizeof(preference) / sizeof(preference[0]); i++)
+    {
+        if (iothub_base64_set_implementation(preference[i]) == 0)
+        {
+            expected = preference[i];
+            break;
+        }
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, (int)expected, (int)g_default_implementation);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_BASE64_10_008: [ If `implementation` is not compiled in or not supported by the CPU, `iothub_base64_set_implementation` shall fail and return a non-zero value, keeping the current implementation. ]
+TEST_FUNCTION(iothub_base64_set_implementation_with_unknown_implementation_fails)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, iothub_base64_set_implementation(IOTHUB_BASE64_IMPLEMENTATION_SCALAR));
+
+    // act
+    int result = iothub_base64_set_implementation((IOTHUB_BASE64_IMPLEMENTATION)42);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_BASE64_IMPLEMENTATION_SCALAR, (int)iothub_base64_get_implementation());
+}
+
+END_TEST_SUITE(iothub_client_base64_ut)
@@ -0,0 +1,565 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_dispatcher.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_LANE_COUNT     2
+#define TEST_MAX_THREADS    4
+#define TEST_MAX_WORK       16
+
+static LOCK_HANDLE TEST_LOCK_HANDLE = (LOCK_HANDLE)0x4001;
+static COND_HANDLE TEST_COND_HANDLE = (COND_HANDLE)0x4002;
+
+static THREAD_START_FUNC g_thread_funcs[TEST_MAX_THREADS];
+static void* g_thread_args[TEST_MAX_THREADS];
+static size_t g_thread_count;
+static bool g_run_threads_on_join;
+
+static char g_work_order[TEST_MAX_WORK + 1];
+static size_t g_work_count;
+
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    g_thread_funcs[g_thread_count] = func;
+    g_thread_args[g_thread_count] = arg;
+    g_thread_count++;
+    *threadHandle = (THREAD_HANDLE)g_thread_count;
+    return THREADAPI_OK;
+}
+
+/* the pool threads never run on their own, joining a thread runs it to completion instead */
+static THREADAPI_RESULT my_ThreadAPI_Join(THREAD_HANDLE threadHandle, int* res)
+{
+    size_t index = (size_t)threadHandle - 1;
+    if (g_run_threads_on_join)
+    {
+        *res = g_thread_funcs[index](g_thread_args[index]);
+    }
+    return THREADAPI_OK;
+}
+
+static void record_work(void* context)
+{
+    g_work_order[g_work_count++] = *(const char*)context;
+}
+
+/* runs the second pool thread while the first one is still running this item */
+static void record_work_and_run_second_thread(void* context)
+{
+    record_work(context);
+    (void)g_thread_funcs[1](g_thread_args[1]);
+}
+
+static const char WORK_A = 'A';
+static const char WORK_B = 'B';
+static const char WORK_C = 'C';
+static const char WORK_D = 'D';
+static const char WORK_P = 'P';
+
+BEGIN_TEST_SUITE(iothub_client_dispatcher_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Deinit, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Wait, COND_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+
+    g_thread_count = 0;
+    g_run_threads_on_join = true;
+    memset(g_work_order, 0, sizeof(g_work_order));
+    g_work_count = 0;
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+static void set_expected_calls_for_create(size_t thread_count)
+{
+    size_t index;
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    for (index = 0; index < thread_count; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+}
+
+static void set_expected_calls_for_free(void)
+{
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_001: [ If `thread_count` is 0 or `lane_count` is not smaller than `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_create` shall fail and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_with_0_threads_fails)
+{
+    // arrange
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(0, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_003: [ `callback_dispatcher_create` shall start `thread_count` threads; if starting any of them fails, it shall stop and join the ones already started and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_succeeds)
+{
+    // arrange
+    set_expected_calls_for_create(2);
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 2, g_thread_count);
+
+    // cleanup
+    callback_dispatcher_destroy(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_002: [ If allocating the dispatcher, its lock or its condition fails, `callback_dispatcher_create` shall fail and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_fails_when_allocating_the_dispatcher_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_002: [ If allocating the dispatcher, its lock or its condition fails, `callback_dispatcher_create` shall fail and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_fails_when_allocating_the_lanes_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_002: [ If allocating the dispatcher, its lock or its condition fails, `callback_dispatcher_create` shall fail and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_fails_when_Lock_Init_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_002: [ If allocating the dispatcher, its lock or its condition fails, `callback_dispatcher_create` shall fail and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_fails_when_Condition_Init_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init())
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_003: [ `callback_dispatcher_create` shall start `thread_count` threads; if starting any of them fails, it shall stop and join the ones already started and return NULL. ]
+TEST_FUNCTION(callback_dispatcher_create_joins_the_started_threads_when_ThreadAPI_Create_fails)
+{
+    // arrange
+    g_run_threads_on_join = false;
+
+    set_expected_calls_for_create(1);
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join((THREAD_HANDLE)1, IGNORED_PTR_ARG));
+    set_expected_calls_for_free();
+
+    // act
+    CALLBACK_DISPATCHER_HANDLE result = callback_dispatcher_create(2, TEST_LANE_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_004: [ If `dispatcher` is NULL, `callback_dispatcher_destroy` shall do nothing. ]
+TEST_FUNCTION(callback_dispatcher_destroy_with_NULL_does_nothing)
+{
+    // arrange
+
+    // act
+    callback_dispatcher_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_005: [ `callback_dispatcher_destroy` shall signal the threads to stop once there is no more work and join them. ]
+TEST_FUNCTION(callback_dispatcher_destroy_stops_and_joins_the_threads)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(2, TEST_LANE_COUNT);
+    g_run_threads_on_join = false;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join((THREAD_HANDLE)1, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join((THREAD_HANDLE)2, IGNORED_PTR_ARG));
+    set_expected_calls_for_free();
+
+    // act
+    callback_dispatcher_destroy(dispatcher);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_013: [ A thread of the pool shall exit once `callback_dispatcher_destroy` was called and there is no item it can take. ]
+TEST_FUNCTION(callback_dispatcher_thread_exits_when_stopped_and_idle)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join((THREAD_HANDLE)1, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
+    set_expected_calls_for_free();
+
+    // act
+    callback_dispatcher_destroy(dispatcher);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_007: [ If `dispatcher` or `work` are NULL, or `lane` is neither an ordered lane nor `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_post` shall fail and return a non-zero value. ]
+TEST_FUNCTION(callback_dispatcher_post_with_NULL_dispatcher_fails)
+{
+    // arrange
+
+    // act
+    int result = callback_dispatcher_post(NULL, 0, record_work, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_007: [ If `dispatcher` or `work` are NULL, or `lane` is neither an ordered lane nor `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_post` shall fail and return a non-zero value. ]
+TEST_FUNCTION(callback_dispatcher_post_with_NULL_work_fails)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = callback_dispatcher_post(dispatcher, 0, NULL, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    callback_dispatcher_destroy(dispatcher);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_007: [ If `dispatcher` or `work` are NULL, or `lane` is neither an ordered lane nor `CALLBACK_DISPATCHER_PARALLEL_LANE`, `callback_dispatcher_post` shall fail and return a non-zero value. ]
+TEST_FUNCTION(callback_dispatcher_post_with_unknown_lane_fails)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = callback_dispatcher_post(dispatcher, TEST_LANE_COUNT, record_work, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    callback_dispatcher_destroy(dispatcher);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_008: [ If allocating the work item fails, `callback_dispatcher_post` shall fail and return a non-zero value. ]
+TEST_FUNCTION(callback_dispatcher_post_fails_when_allocating_the_item_fails)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = callback_dispatcher_post(dispatcher, 0, record_work, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    callback_dispatcher_destroy(dispatcher);
+    ASSERT_ARE_EQUAL(size_t, 0, g_work_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_009: [ If acquiring the lock fails, `callback_dispatcher_post` shall fail and return a non-zero value. ]
+TEST_FUNCTION(callback_dispatcher_post_fails_when_Lock_fails)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE))
+        .SetReturn(LOCK_ERROR);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = callback_dispatcher_post(dispatcher, 0, record_work, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    callback_dispatcher_destroy(dispatcher);
+    ASSERT_ARE_EQUAL(size_t, 0, g_work_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_010: [ `callback_dispatcher_post` shall append the item to the lane, signal the threads of the pool and return 0. ]
+TEST_FUNCTION(callback_dispatcher_post_succeeds)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+
+    // act
+    int result = callback_dispatcher_post(dispatcher, CALLBACK_DISPATCHER_PARALLEL_LANE, record_work, (void*)&WORK_A);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_work_count);
+
+    // cleanup
+    callback_dispatcher_destroy(dispatcher);
+    ASSERT_ARE_EQUAL(char_ptr, "A", g_work_order);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_011: [ A thread of the pool shall take the oldest item of the first ordered lane that has items and no item running, or else the oldest item of the parallel lane. ]
+TEST_FUNCTION(callback_dispatcher_thread_runs_ordered_lanes_in_order_before_the_parallel_lane)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 1, record_work, (void*)&WORK_A));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, CALLBACK_DISPATCHER_PARALLEL_LANE, record_work, (void*)&WORK_B));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 0, record_work, (void*)&WORK_C));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 1, record_work, (void*)&WORK_D));
+    umock_c_reset_all_calls();
+
+    // act
+    callback_dispatcher_destroy(dispatcher);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, "CADB", g_work_order);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_011: [ A thread of the pool shall take the oldest item of the first ordered lane that has items and no item running, or else the oldest item of the parallel lane. ]
+TEST_FUNCTION(callback_dispatcher_second_thread_skips_a_lane_with_a_running_item)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(2, TEST_LANE_COUNT);
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 0, record_work_and_run_second_thread, (void*)&WORK_A));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 0, record_work, (void*)&WORK_B));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, CALLBACK_DISPATCHER_PARALLEL_LANE, record_work, (void*)&WORK_P));
+    umock_c_reset_all_calls();
+
+    // act
+    callback_dispatcher_destroy(dispatcher);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, "APB", g_work_order);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_DISPATCHER_10_006: [ Items left in the lanes (a thread failed to lock the dispatcher) shall be run on the calling thread, in lane order, before the dispatcher is freed. ]
+TEST_FUNCTION(callback_dispatcher_destroy_runs_the_items_the_threads_did_not_run)
+{
+    // arrange
+    CALLBACK_DISPATCHER_HANDLE dispatcher = callback_dispatcher_create(1, TEST_LANE_COUNT);
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, CALLBACK_DISPATCHER_PARALLEL_LANE, record_work, (void*)&WORK_P));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 1, record_work, (void*)&WORK_A));
+    ASSERT_ARE_EQUAL(int, 0, callback_dispatcher_post(dispatcher, 1, record_work, (void*)&WORK_B));
+    g_run_threads_on_join = false;
+    umock_c_reset_all_calls();
+
+    // act
+    callback_dispatcher_destroy(dispatcher);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, "ABP", g_work_order);
+}
+
+END_TEST_SUITE(iothub_client_dispatcher_ut)
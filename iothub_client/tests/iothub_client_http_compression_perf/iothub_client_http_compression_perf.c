@@ -0,0 +1,152 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*measures what gzipping the batched HTTP telemetry saves. Builds batches the way the HTTP transport does
+([{"body":"base64 of the message","properties":{...}},...]) out of typical JSON telemetry, compresses them with
+http_compression_gzip, inflates the result back to check it and prints the sizes and the compression throughput*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zlib.h"
+#include "azure_c_shared_utility/buffer_.h"
+#include "iothub_client_base64.h"
+#include "internal/iothub_client_http_compression.h"
+
+/*every measure compresses about this many bytes*/
+#define BYTES_PER_MEASURE ((size_t)64 * 1024 * 1024)
+#define MAX_MESSAGE_SIZE 256
+
+static const size_t messages_per_batch[] = { 1, 10, 100, 1000 };
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static size_t make_batch(unsigned char* batch, size_t message_count)
+{
+    size_t length = 0;
+    size_t i;
+    batch[length++] = '[';
+    for (i = 0; i < message_count; i++)
+    {
+        char message[MAX_MESSAGE_SIZE];
+        int message_size = snprintf(message, sizeof(message), "{\"deviceId\":\"myFirstDevice\",\"windSpeed\":%.2f,\"temperature\":%.2f,\"humidity\":%.2f,\"sequence\":%lu}",
+            10.0 + (rand() % 500) / 100.0, 20.0 + (rand() % 1000) / 100.0, 60.0 + (rand() % 2000) / 100.0, (unsigned long)i);
+        if (i > 0)
+        {
+            batch[length++] = ',';
+        }
+        (void)memcpy(batch + length, "{\"body\":\"", 9);
+        length += 9;
+        length += iothub_base64_encode((char*)batch + length, (const unsigned char*)message, (size_t)message_size, IOTHUB_BASE64_ALPHABET_STANDARD);
+        (void)memcpy(batch + length, "\",\"properties\":{\"iothub-app-level\":\"info\"}}", 43);
+        length += 43;
+    }
+    batch[length++] = ']';
+    return length;
+}
+
+static int check_round_trip(const unsigned char* batch, size_t batch_size, BUFFER_HANDLE compressed)
+{
+    int result;
+    unsigned char* inflated = (unsigned char*)malloc(batch_size);
+    if (inflated == NULL)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        z_stream stream;
+        (void)memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            stream.next_in = BUFFER_u_char(compressed);
+            stream.avail_in = (uInt)BUFFER_length(compressed);
+            stream.next_out = inflated;
+            stream.avail_out = (uInt)batch_size;
+            if ((inflate(&stream, Z_FINISH) != Z_STREAM_END) ||
+                (stream.total_out != batch_size) ||
+                (memcmp(inflated, batch, batch_size) != 0))
+            {
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+            (void)inflateEnd(&stream);
+        }
+        free(inflated);
+    }
+    return result;
+}
+
+static int measure(size_t message_count)
+{
+    int result;
+    /*every message is at most MAX_MESSAGE_SIZE bytes before base64 plus the JSON around it*/
+    unsigned char* batch = (unsigned char*)malloc(2 + message_count * (IOTHUB_BASE64_ENCODED_LENGTH(MAX_MESSAGE_SIZE) + 64));
+    if (batch == NULL)
+    {
+        (void)printf("failed allocating a batch of %lu messages\r\n", (unsigned long)message_count);
+        result = __LINE__;
+    }
+    else
+    {
+        size_t batch_size = make_batch(batch, message_count);
+        BUFFER_HANDLE compressed = http_compression_gzip(batch, batch_size);
+        if (compressed == NULL)
+        {
+            result = __LINE__;
+        }
+        else if ((result = check_round_trip(batch, batch_size, compressed)) == 0)
+        {
+            size_t compressed_size = BUFFER_length(compressed);
+            size_t iterations = BYTES_PER_MEASURE / batch_size + 1;
+            size_t i;
+            double seconds;
+            clock_t start = clock();
+            for (i = 0; i < iterations; i++)
+            {
+                BUFFER_HANDLE again = http_compression_gzip(batch, batch_size);
+                if (again == NULL)
+                {
+                    result = __LINE__;
+                    break;
+                }
+                BUFFER_delete(again);
+            }
+            seconds = seconds_since(start);
+            (void)printf("%5lu messages %9lu bytes -> %8lu bytes (%5.1f%% saved) %8.1f MB/s\r\n",
+                (unsigned long)message_count, (unsigned long)batch_size, (unsigned long)compressed_size,
+                100.0 * (1.0 - (double)compressed_size / (double)batch_size),
+                (seconds > 0) ? ((double)(iterations * batch_size) / seconds / 1e6) : 0.0);
+        }
+        BUFFER_delete(compressed);
+        free(batch);
+    }
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+    size_t i;
+    for (i = 0; (result == 0) && (i < sizeof(messages_per_batch) / sizeof(messages_per_batch[0])); i++)
+    {
+        result = measure(messages_per_batch[i]);
+    }
+
+    if (result != 0)
+    {
+        (void)printf("iothub_client_http_compression_perf failed (%d)\r\n", result);
+    }
+    return result;
+}
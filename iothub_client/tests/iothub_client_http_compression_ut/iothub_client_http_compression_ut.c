@@ -0,0 +1,267 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#include "zlib.h"
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/buffer_.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_http_compression.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    extern BUFFER_HANDLE real_BUFFER_create(const unsigned char* source, size_t size);
+    extern void real_BUFFER_delete(BUFFER_HANDLE handle);
+    extern unsigned char* real_BUFFER_u_char(BUFFER_HANDLE handle);
+    extern size_t real_BUFFER_length(BUFFER_HANDLE handle);
+#ifdef __cplusplus
+}
+#endif
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+/*a batch the way the HTTP transport builds it: a JSON array of base64 encoded telemetry bodies, similar from message to message*/
+#define TEST_BATCH_ITEM "{\"body\":\"eyJkZXZpY2VJZCI6Im15Rmlyc3REZXZpY2UiLCJ0ZW1wZXJhdHVyZSI6MjMuNSwiaHVtaWRpdHkiOjU2fQ==\",\"base64Encoded\":true,\"properties\":{\"iothub-app-level\":\"normal\"}}"
+#define TEST_BATCH_ITEMS 64
+
+static unsigned char* test_batch;
+static size_t test_batch_size;
+
+static void build_test_batch(void)
+{
+    size_t i;
+    size_t item_size = sizeof(TEST_BATCH_ITEM) - 1;
+    test_batch_size = 2 + TEST_BATCH_ITEMS * (item_size + 1) - 1;
+    test_batch = (unsigned char*)malloc(test_batch_size);
+    ASSERT_IS_NOT_NULL(test_batch);
+
+    test_batch[0] = '[';
+    for (i = 0; i < TEST_BATCH_ITEMS; i++)
+    {
+        unsigned char* item = test_batch + 1 + i * (item_size + 1);
+        (void)memcpy(item, TEST_BATCH_ITEM, item_size);
+        item[item_size] = (i == TEST_BATCH_ITEMS - 1) ? ']' : ',';
+    }
+}
+
+/*stands in for the receiving end: inflates a gzip body, returns the number of bytes produced or 0 on error*/
+static size_t gunzip(const unsigned char* source, size_t size, unsigned char* destination, size_t destination_size)
+{
+    size_t result;
+    z_stream stream;
+    (void)memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK)
+    {
+        result = 0;
+    }
+    else
+    {
+        stream.next_in = (Bytef*)source;
+        stream.avail_in = (uInt)size;
+        stream.next_out = destination;
+        stream.avail_out = (uInt)destination_size;
+        result = (inflate(&stream, Z_FINISH) == Z_STREAM_END) ? (size_t)stream.total_out : 0;
+        (void)inflateEnd(&stream);
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(iothub_client_http_compression_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_create, real_BUFFER_create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_delete, real_BUFFER_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_u_char, real_BUFFER_u_char);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, real_BUFFER_length);
+
+    build_test_batch();
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    free(test_batch);
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_001: [ If `source` is NULL or `size` is 0 or does not fit in an `uInt`, `http_compression_gzip` shall fail and return NULL. ]
+TEST_FUNCTION(http_compression_gzip_with_NULL_source_fails)
+{
+    // arrange
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(NULL, test_batch_size);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_001: [ If `source` is NULL or `size` is 0 or does not fit in an `uInt`, `http_compression_gzip` shall fail and return NULL. ]
+TEST_FUNCTION(http_compression_gzip_with_0_size_fails)
+{
+    // arrange
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(test_batch, 0);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_002: [ `http_compression_gzip` shall compress `source` with zlib, at the default compression level and with a gzip wrapper. ]
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_004: [ On success `http_compression_gzip` shall return a buffer created by `BUFFER_create` with the complete gzip stream. ]
+TEST_FUNCTION(http_compression_gzip_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(test_batch, test_batch_size);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    /*gzip magic number*/
+    ASSERT_ARE_EQUAL(int, 0x1F, real_BUFFER_u_char(result)[0]);
+    ASSERT_ARE_EQUAL(int, 0x8B, real_BUFFER_u_char(result)[1]);
+
+    // cleanup
+    real_BUFFER_delete(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_002: [ `http_compression_gzip` shall compress `source` with zlib, at the default compression level and with a gzip wrapper. ]
+TEST_FUNCTION(http_compression_gzip_output_inflates_back_to_the_batch_and_is_much_smaller)
+{
+    // arrange
+    unsigned char* inflated = (unsigned char*)malloc(test_batch_size + 1);
+    ASSERT_IS_NOT_NULL(inflated);
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(test_batch, test_batch_size);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, test_batch_size, gunzip(real_BUFFER_u_char(result), real_BUFFER_length(result), inflated, test_batch_size + 1));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(test_batch, inflated, test_batch_size));
+    /*similar telemetry messages compress very well, well beyond the 4:1 checked here*/
+    ASSERT_IS_TRUE(real_BUFFER_length(result) * 4 < test_batch_size);
+
+    // cleanup
+    real_BUFFER_delete(result);
+    free(inflated);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_003: [ If zlib fails or allocating memory fails, `http_compression_gzip` shall fail and return NULL. ]
+TEST_FUNCTION(http_compression_gzip_fails_when_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(test_batch, test_batch_size);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_HTTP_COMPRESSION_10_003: [ If zlib fails or allocating memory fails, `http_compression_gzip` shall fail and return NULL. ]
+TEST_FUNCTION(http_compression_gzip_fails_when_BUFFER_create_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    BUFFER_HANDLE result = http_compression_gzip(test_batch, test_batch_size);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothub_client_http_compression_ut)
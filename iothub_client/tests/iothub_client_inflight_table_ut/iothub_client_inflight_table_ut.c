@@ -0,0 +1,395 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_inflight_table.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_ENTRY_COUNT    (2 * INFLIGHT_TABLE_INLINE_BUCKETS + 1)
+
+static INFLIGHT_TABLE g_table;
+static INFLIGHT_TABLE_ENTRY g_entries[TEST_ENTRY_COUNT];
+
+// Adds g_entries[0..count[ with the packet ids first_packet_id, first_packet_id + 1, ...
+static void add_entries(size_t count, uint16_t first_packet_id)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        int result = inflight_table_add(&g_table, &g_entries[index], (uint16_t)(first_packet_id + index));
+        ASSERT_ARE_EQUAL(int, 0, result);
+    }
+}
+
+static void assert_entries_found(size_t count, uint16_t first_packet_id)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_entries[index], inflight_table_find(&g_table, (uint16_t)(first_packet_id + index)));
+    }
+}
+
+BEGIN_TEST_SUITE(iothub_client_inflight_table_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    inflight_table_init(&g_table);
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    inflight_table_deinit(&g_table);
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_001: [ `inflight_table_init` shall initialize `inflight_table` as empty, using the buckets embedded in it. ]
+TEST_FUNCTION(inflight_table_init_initializes_an_empty_table)
+{
+    // arrange
+    INFLIGHT_TABLE table;
+
+    // act
+    inflight_table_init(&table);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+    ASSERT_ARE_EQUAL(size_t, INFLIGHT_TABLE_INLINE_BUCKETS, table.bucket_count);
+    ASSERT_ARE_EQUAL(void_ptr, table.inline_buckets, table.buckets);
+    ASSERT_IS_NULL(inflight_table_find(&table, 1));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_003: [ If `inflight_table` or `entry` is NULL, `inflight_table_add` shall fail and return a non-zero value. ]
+TEST_FUNCTION(inflight_table_add_with_NULL_table_fails)
+{
+    // arrange
+
+    // act
+    int result = inflight_table_add(NULL, &g_entries[0], 1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_003: [ If `inflight_table` or `entry` is NULL, `inflight_table_add` shall fail and return a non-zero value. ]
+TEST_FUNCTION(inflight_table_add_with_NULL_entry_fails)
+{
+    // arrange
+
+    // act
+    int result = inflight_table_add(&g_table, NULL, 1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, g_table.count);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_007: [ `inflight_table_add` shall link `entry` in the bucket of `packet_id` and return 0. ]
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_009: [ `inflight_table_find` shall return the entry added with `packet_id`, or NULL if there is none. ]
+TEST_FUNCTION(inflight_table_add_makes_the_entry_findable_by_packet_id)
+{
+    // arrange
+
+    // act
+    int result = inflight_table_add(&g_table, &g_entries[0], 42);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_table.count);
+    ASSERT_ARE_EQUAL(int, 42, (int)g_entries[0].packet_id);
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[0], inflight_table_find(&g_table, 42));
+    ASSERT_IS_NULL(inflight_table_find(&g_table, 43));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_004: [ If an entry with the same `packet_id` is already in the table, `inflight_table_add` shall fail and return a non-zero value. ]
+TEST_FUNCTION(inflight_table_add_with_a_packet_id_already_in_flight_fails)
+{
+    // arrange
+    add_entries(1, 7);
+
+    // act
+    int result = inflight_table_add(&g_table, &g_entries[1], 7);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_table.count);
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[0], inflight_table_find(&g_table, 7));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_007: [ `inflight_table_add` shall link `entry` in the bucket of `packet_id` and return 0. ]
+TEST_FUNCTION(inflight_table_add_does_not_allocate_while_the_embedded_buckets_are_not_full)
+{
+    // arrange
+
+    // act
+    add_entries(INFLIGHT_TABLE_INLINE_BUCKETS, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, INFLIGHT_TABLE_INLINE_BUCKETS, g_table.count);
+    ASSERT_ARE_EQUAL(void_ptr, g_table.inline_buckets, g_table.buckets);
+    assert_entries_found(INFLIGHT_TABLE_INLINE_BUCKETS, 1);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_005: [ When the table holds as many entries as it has buckets, `inflight_table_add` shall first double the number of buckets, up to one bucket per packet id. ]
+TEST_FUNCTION(inflight_table_add_doubles_the_buckets_when_they_are_full)
+{
+    // arrange
+    add_entries(INFLIGHT_TABLE_INLINE_BUCKETS, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(2 * INFLIGHT_TABLE_INLINE_BUCKETS * sizeof(INFLIGHT_TABLE_ENTRY*)));
+
+    // act
+    int result = inflight_table_add(&g_table, &g_entries[INFLIGHT_TABLE_INLINE_BUCKETS], INFLIGHT_TABLE_INLINE_BUCKETS + 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 2 * INFLIGHT_TABLE_INLINE_BUCKETS, g_table.bucket_count);
+    assert_entries_found(INFLIGHT_TABLE_INLINE_BUCKETS + 1, 1);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_005: [ When the table holds as many entries as it has buckets, `inflight_table_add` shall first double the number of buckets, up to one bucket per packet id. ]
+TEST_FUNCTION(inflight_table_add_frees_the_previous_bucket_array_when_growing_again)
+{
+    // arrange
+    add_entries(2 * INFLIGHT_TABLE_INLINE_BUCKETS, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(4 * INFLIGHT_TABLE_INLINE_BUCKETS * sizeof(INFLIGHT_TABLE_ENTRY*)));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    int result = inflight_table_add(&g_table, &g_entries[2 * INFLIGHT_TABLE_INLINE_BUCKETS], 2 * INFLIGHT_TABLE_INLINE_BUCKETS + 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 4 * INFLIGHT_TABLE_INLINE_BUCKETS, g_table.bucket_count);
+    assert_entries_found(TEST_ENTRY_COUNT, 1);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_006: [ If the bigger bucket array cannot be allocated, `inflight_table_add` shall keep using the current one. ]
+TEST_FUNCTION(inflight_table_add_keeps_the_current_buckets_when_growing_fails)
+{
+    // arrange
+    add_entries(INFLIGHT_TABLE_INLINE_BUCKETS, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = inflight_table_add(&g_table, &g_entries[INFLIGHT_TABLE_INLINE_BUCKETS], INFLIGHT_TABLE_INLINE_BUCKETS + 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, INFLIGHT_TABLE_INLINE_BUCKETS, g_table.bucket_count);
+    ASSERT_ARE_EQUAL(size_t, INFLIGHT_TABLE_INLINE_BUCKETS + 1, g_table.count);
+    assert_entries_found(INFLIGHT_TABLE_INLINE_BUCKETS + 1, 1);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_008: [ If `inflight_table` is NULL, `inflight_table_find` shall return NULL. ]
+TEST_FUNCTION(inflight_table_find_with_NULL_table_returns_NULL)
+{
+    // arrange
+
+    // act
+    INFLIGHT_TABLE_ENTRY* result = inflight_table_find(NULL, 1);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_010: [ If `inflight_table` is NULL, `inflight_table_remove` shall return NULL. ]
+TEST_FUNCTION(inflight_table_remove_with_NULL_table_returns_NULL)
+{
+    // arrange
+
+    // act
+    INFLIGHT_TABLE_ENTRY* result = inflight_table_remove(NULL, 1);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_011: [ `inflight_table_remove` shall unlink and return the entry added with `packet_id`, or return NULL if there is none. ]
+TEST_FUNCTION(inflight_table_remove_unlinks_the_entry)
+{
+    // arrange
+    add_entries(3, 1);
+
+    // act
+    INFLIGHT_TABLE_ENTRY* result = inflight_table_remove(&g_table, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[1], result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_table.count);
+    ASSERT_IS_NULL(inflight_table_find(&g_table, 2));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[0], inflight_table_find(&g_table, 1));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[2], inflight_table_find(&g_table, 3));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_011: [ `inflight_table_remove` shall unlink and return the entry added with `packet_id`, or return NULL if there is none. ]
+TEST_FUNCTION(inflight_table_remove_keeps_the_other_entries_of_the_same_bucket)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, inflight_table_add(&g_table, &g_entries[0], 5));
+    ASSERT_ARE_EQUAL(int, 0, inflight_table_add(&g_table, &g_entries[1], 5 + INFLIGHT_TABLE_INLINE_BUCKETS));
+    ASSERT_ARE_EQUAL(int, 0, inflight_table_add(&g_table, &g_entries[2], 5 + 2 * INFLIGHT_TABLE_INLINE_BUCKETS));
+
+    // act
+    INFLIGHT_TABLE_ENTRY* result = inflight_table_remove(&g_table, 5 + INFLIGHT_TABLE_INLINE_BUCKETS);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[1], result);
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[0], inflight_table_find(&g_table, 5));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[2], inflight_table_find(&g_table, 5 + 2 * INFLIGHT_TABLE_INLINE_BUCKETS));
+    ASSERT_IS_NULL(inflight_table_find(&g_table, 5 + INFLIGHT_TABLE_INLINE_BUCKETS));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_011: [ `inflight_table_remove` shall unlink and return the entry added with `packet_id`, or return NULL if there is none. ]
+TEST_FUNCTION(inflight_table_remove_of_an_unknown_packet_id_returns_NULL)
+{
+    // arrange
+    add_entries(1, 1);
+
+    // act
+    INFLIGHT_TABLE_ENTRY* result = inflight_table_remove(&g_table, 1 + INFLIGHT_TABLE_INLINE_BUCKETS);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_table.count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_002: [ `inflight_table_deinit` shall free the bucket array if one was allocated and leave `inflight_table` empty, the entries still in it are not touched. It may be called on a zeroed table. ]
+TEST_FUNCTION(inflight_table_deinit_frees_the_allocated_buckets)
+{
+    // arrange
+    add_entries(INFLIGHT_TABLE_INLINE_BUCKETS + 1, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    inflight_table_deinit(&g_table);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_table.count);
+    ASSERT_ARE_EQUAL(void_ptr, g_table.inline_buckets, g_table.buckets);
+    ASSERT_IS_NULL(inflight_table_find(&g_table, 1));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_002: [ `inflight_table_deinit` shall free the bucket array if one was allocated and leave `inflight_table` empty, the entries still in it are not touched. It may be called on a zeroed table. ]
+TEST_FUNCTION(inflight_table_deinit_of_a_table_that_did_not_grow_does_not_free)
+{
+    // arrange
+    add_entries(2, 1);
+    umock_c_reset_all_calls();
+
+    // act
+    inflight_table_deinit(&g_table);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_table.count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INFLIGHT_TABLE_10_002: [ `inflight_table_deinit` shall free the bucket array if one was allocated and leave `inflight_table` empty, the entries still in it are not touched. It may be called on a zeroed table. ]
+TEST_FUNCTION(inflight_table_deinit_of_a_zeroed_table_does_not_free)
+{
+    // arrange
+    INFLIGHT_TABLE table;
+    memset(&table, 0, sizeof(table));
+
+    // act
+    inflight_table_deinit(&table);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+}
+
+END_TEST_SUITE(iothub_client_inflight_table_ut)
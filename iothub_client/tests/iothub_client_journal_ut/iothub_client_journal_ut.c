@@ -0,0 +1,555 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_journal.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_SEGMENT_SIZE       4096
+#define TEST_RECORD_SIZE        100
+#define TEST_SYNC_BATCH         4
+
+static char g_directory[64];
+static size_t g_pending_count;
+static uint64_t g_pending_sequences[64];
+
+static void make_test_directory(void)
+{
+    (void)strcpy(g_directory, "/tmp/iothub_client_journal_ut_XXXXXX");
+    ASSERT_IS_NOT_NULL(mkdtemp(g_directory));
+}
+
+static size_t count_files(const char* suffix)
+{
+    size_t result = 0;
+    DIR* directory = opendir(g_directory);
+    struct dirent* entry;
+
+    ASSERT_IS_NOT_NULL(directory);
+    while ((entry = readdir(directory)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if ((length >= strlen(suffix)) && (strcmp(entry->d_name + length - strlen(suffix), suffix) == 0))
+        {
+            result++;
+        }
+    }
+    (void)closedir(directory);
+
+    return result;
+}
+
+static void remove_test_directory(void)
+{
+    DIR* directory = opendir(g_directory);
+    struct dirent* entry;
+
+    if (directory != NULL)
+    {
+        while ((entry = readdir(directory)) != NULL)
+        {
+            if (entry->d_name[0] != '.')
+            {
+                char path[320];
+                (void)snprintf(path, sizeof(path), "%s/%s", g_directory, entry->d_name);
+                (void)unlink(path);
+            }
+        }
+        (void)closedir(directory);
+        (void)rmdir(g_directory);
+    }
+}
+
+static void make_record(unsigned char* record, uint64_t value)
+{
+    (void)memset(record, (int)(value & 0xFF), TEST_RECORD_SIZE);
+}
+
+static void append_records(MESSAGE_JOURNAL_HANDLE journal, size_t count)
+{
+    size_t index;
+    for (index = 0; index < count; index++)
+    {
+        unsigned char record[TEST_RECORD_SIZE];
+        uint64_t sequence;
+        make_record(record, index + 1);
+        ASSERT_ARE_EQUAL(int, 0, message_journal_append(journal, record, sizeof(record), &sequence));
+    }
+}
+
+static void on_pending_record(uint64_t sequence, const unsigned char* data, size_t size, void* context)
+{
+    unsigned char expected[TEST_RECORD_SIZE];
+    (void)context;
+    make_record(expected, sequence);
+    ASSERT_ARE_EQUAL(size_t, TEST_RECORD_SIZE, size);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expected, data, size));
+    if (g_pending_count < sizeof(g_pending_sequences) / sizeof(g_pending_sequences[0]))
+    {
+        g_pending_sequences[g_pending_count] = sequence;
+    }
+    g_pending_count++;
+}
+
+BEGIN_TEST_SUITE(iothub_client_journal_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    make_test_directory();
+    g_pending_count = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    remove_test_directory();
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_001: [ If `directory` is NULL or `segment_size` is below 4096 bytes or above 4GB, `message_journal_open` shall fail and return NULL. ]
+TEST_FUNCTION(message_journal_open_with_NULL_directory_fails)
+{
+    // arrange
+
+    // act
+    MESSAGE_JOURNAL_HANDLE result = message_journal_open(NULL, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_001: [ If `directory` is NULL or `segment_size` is below 4096 bytes or above 4GB, `message_journal_open` shall fail and return NULL. ]
+TEST_FUNCTION(message_journal_open_with_too_small_segment_size_fails)
+{
+    // arrange
+
+    // act
+    MESSAGE_JOURNAL_HANDLE result = message_journal_open(g_directory, TEST_SEGMENT_SIZE - 1, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_002: [ If any failure occurs, `message_journal_open` shall fail and return NULL. ]
+TEST_FUNCTION(when_allocating_the_journal_fails_message_journal_open_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    MESSAGE_JOURNAL_HANDLE result = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_003: [ `message_journal_open` shall create `directory` if it does not exist. ]
+TEST_FUNCTION(message_journal_open_creates_the_directory)
+{
+    // arrange
+    char directory[96];
+    (void)snprintf(directory, sizeof(directory), "%s/journal", g_directory);
+
+    // act
+    MESSAGE_JOURNAL_HANDLE result = message_journal_open(directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(int, 0, access(directory, F_OK));
+
+    // cleanup
+    message_journal_close(result);
+    {
+        char checkpoint[128];
+        (void)snprintf(checkpoint, sizeof(checkpoint), "%s/checkpoint", directory);
+        (void)unlink(checkpoint);
+        (void)rmdir(directory);
+    }
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_005: [ Sequence numbers shall start at 1 and continue after the highest sequence number recovered or checkpointed. ]
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_011: [ `message_journal_append` shall copy `data` to the mapped segment, store the next sequence number in `sequence` and return 0. ]
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_014: [ `message_journal_read` shall point `data` to the mapped payload of the record, valid until the record is acknowledged or the journal closed, and return 0. ]
+TEST_FUNCTION(message_journal_append_and_read_succeed)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    unsigned char record[TEST_RECORD_SIZE];
+    uint64_t sequence1;
+    uint64_t sequence2;
+    const unsigned char* data;
+    size_t size;
+    make_record(record, 2);
+
+    // act
+    int result1 = message_journal_append(journal, record, 10, &sequence1);
+    int result2 = message_journal_append(journal, record, sizeof(record), &sequence2);
+    int read_result = message_journal_read(journal, sequence2, &data, &size);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(uint64_t, 1, sequence1);
+    ASSERT_ARE_EQUAL(uint64_t, 2, sequence2);
+    ASSERT_ARE_EQUAL(int, 0, read_result);
+    ASSERT_ARE_EQUAL(size_t, sizeof(record), size);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(record, data, size));
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_007: [ If `journal`, `data` or `sequence` are NULL, `message_journal_append` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_journal_append_with_NULL_arguments_fails)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    unsigned char record[TEST_RECORD_SIZE];
+    uint64_t sequence;
+    make_record(record, 1);
+
+    // act
+    int result1 = message_journal_append(NULL, record, sizeof(record), &sequence);
+    int result2 = message_journal_append(journal, NULL, sizeof(record), &sequence);
+    int result3 = message_journal_append(journal, record, sizeof(record), NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_008: [ If the record does not fit in an empty segment, `message_journal_append` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_journal_append_with_a_record_larger_than_a_segment_fails)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    unsigned char* record = (unsigned char*)malloc(TEST_SEGMENT_SIZE);
+    uint64_t sequence;
+    ASSERT_IS_NOT_NULL(record);
+    (void)memset(record, 0x42, TEST_SEGMENT_SIZE);
+
+    // act
+    int result = message_journal_append(journal, record, TEST_SEGMENT_SIZE, &sequence);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    free(record);
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_009: [ When the record does not fit in the current segment, `message_journal_append` shall create a new segment file of `segment_size` bytes. ]
+TEST_FUNCTION(message_journal_append_creates_a_new_segment_when_the_current_one_is_full)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // act
+    append_records(journal, 70); /* a segment of 4096 bytes holds 31 records of 128 bytes */
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, count_files(".journal"));
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_013: [ If `journal`, `data` or `size` are NULL, or `sequence` is not a pending record, `message_journal_read` shall fail and return a non-zero value. ]
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_015: [ `message_journal_acknowledge` shall flag the record as acknowledged and advance the checkpoint past the acknowledged records. ]
+TEST_FUNCTION(message_journal_read_of_an_acknowledged_record_fails)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    const unsigned char* data;
+    size_t size;
+    append_records(journal, 2);
+
+    // act
+    message_journal_acknowledge(journal, 1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_journal_read(journal, 1, &data, &size));
+    ASSERT_ARE_EQUAL(int, 0, message_journal_read(journal, 2, &data, &size));
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_journal_read(journal, 3, &data, &size));
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_016: [ Segments other than the last one shall be deleted once all their records are acknowledged. ]
+TEST_FUNCTION(message_journal_acknowledge_deletes_fully_acknowledged_segments)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence;
+    append_records(journal, 60);
+
+    // act
+    for (sequence = 1; sequence <= 60; sequence++)
+    {
+        message_journal_acknowledge(journal, sequence);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, count_files(".journal"));
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_018: [ `message_journal_for_each_pending` shall call `on_pending_record` for every record not acknowledged, in sequence order, and return 0. ]
+TEST_FUNCTION(message_journal_for_each_pending_skips_acknowledged_records)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    append_records(journal, 4);
+    message_journal_acknowledge(journal, 1);
+    message_journal_acknowledge(journal, 3);
+
+    // act
+    int result = message_journal_for_each_pending(journal, on_pending_record, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, g_pending_count);
+    ASSERT_ARE_EQUAL(uint64_t, 2, g_pending_sequences[0]);
+    ASSERT_ARE_EQUAL(uint64_t, 4, g_pending_sequences[1]);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_017: [ If `journal` or `on_pending_record` are NULL, `message_journal_for_each_pending` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_journal_for_each_pending_with_NULL_on_pending_record_fails)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // act
+    int result = message_journal_for_each_pending(journal, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_004: [ `message_journal_open` shall recover the records of the segments found in `directory`, up to the first torn record of each segment, and consider acknowledged the ones below the persisted checkpoint. ]
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_006: [ `message_journal_close` shall flush the journal, unmap and close its segments without removing them, and free the journal. ]
+TEST_FUNCTION(message_journal_open_recovers_the_pending_records)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence;
+    append_records(journal, 60);
+    for (sequence = 1; sequence <= 40; sequence++)
+    {
+        message_journal_acknowledge(journal, sequence);
+    }
+    message_journal_acknowledge(journal, 50);
+    message_journal_close(journal);
+
+    // act
+    journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NOT_NULL(journal);
+    ASSERT_ARE_EQUAL(int, 0, message_journal_for_each_pending(journal, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 19, g_pending_count);
+    ASSERT_ARE_EQUAL(uint64_t, 41, g_pending_sequences[0]);
+    ASSERT_ARE_EQUAL(uint64_t, 60, g_pending_sequences[18]);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_005: [ Sequence numbers shall start at 1 and continue after the highest sequence number recovered or checkpointed. ]
+TEST_FUNCTION(message_journal_open_continues_the_sequence_numbers_after_all_records_were_acknowledged)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    unsigned char record[TEST_RECORD_SIZE];
+    uint64_t sequence;
+    append_records(journal, 60);
+    for (sequence = 1; sequence <= 60; sequence++)
+    {
+        message_journal_acknowledge(journal, sequence);
+    }
+    message_journal_close(journal);
+    journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    make_record(record, 61);
+
+    // act
+    int result = message_journal_append(journal, record, sizeof(record), &sequence);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(uint64_t, 61, sequence);
+    ASSERT_ARE_EQUAL(int, 0, message_journal_for_each_pending(journal, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 1, g_pending_count);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_004: [ `message_journal_open` shall recover the records of the segments found in `directory`, up to the first torn record of each segment, and consider acknowledged the ones below the persisted checkpoint. ]
+TEST_FUNCTION(message_journal_open_stops_the_recovery_at_a_torn_record)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    char path[128];
+    unsigned char garbage = 0x5A;
+    int fd;
+    append_records(journal, 3);
+    message_journal_close(journal);
+
+    /* segment header (16) + 2 records (2 * 128) + record header (24): first payload byte of the third record */
+    (void)snprintf(path, sizeof(path), "%s/%016x.journal", g_directory, 1);
+    fd = open(path, O_WRONLY);
+    ASSERT_IS_TRUE(fd >= 0);
+    ASSERT_ARE_EQUAL(int, 1, (int)pwrite(fd, &garbage, 1, 16 + 2 * 128 + 24));
+    (void)close(fd);
+
+    // act
+    journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NOT_NULL(journal);
+    ASSERT_ARE_EQUAL(int, 0, message_journal_for_each_pending(journal, on_pending_record, NULL));
+    ASSERT_ARE_EQUAL(size_t, 2, g_pending_count);
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_019: [ `message_journal_sync` shall flush the modified pages of the segments and then, if it moved, persist the checkpoint. ]
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_020: [ If flushing fails, `message_journal_sync` shall return a non-zero value, otherwise 0. ]
+TEST_FUNCTION(message_journal_sync_succeeds)
+{
+    // arrange
+    MESSAGE_JOURNAL_HANDLE journal = message_journal_open(g_directory, TEST_SEGMENT_SIZE, 0);
+    append_records(journal, 2);
+    message_journal_acknowledge(journal, 1);
+
+    // act
+    int result = message_journal_sync(journal);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, count_files("checkpoint"));
+
+    // cleanup
+    message_journal_close(journal);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_JOURNAL_10_020: [ If flushing fails, `message_journal_sync` shall return a non-zero value, otherwise 0. ]
+TEST_FUNCTION(message_journal_sync_with_NULL_journal_fails)
+{
+    // arrange
+
+    // act
+    int result = message_journal_sync(NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+END_TEST_SUITE(iothub_client_journal_ut)
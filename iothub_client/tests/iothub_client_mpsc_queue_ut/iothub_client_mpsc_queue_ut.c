@@ -0,0 +1,299 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_mpsc_queue.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_RECORD_COUNT   4
+
+typedef struct TEST_RECORD_TAG
+{
+    MPSC_QUEUE_NODE node;
+    int value;
+} TEST_RECORD;
+
+
+BEGIN_TEST_SUITE(iothub_client_mpsc_queue_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_001: [ `mpsc_queue_create` shall allocate an empty queue, and return NULL if the allocation fails. ]
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_007: [ `mpsc_queue_is_empty` shall return true if `queue` is NULL or holds no node. ]
+TEST_FUNCTION(mpsc_queue_create_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    MPSC_QUEUE_HANDLE result = mpsc_queue_create();
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_IS_TRUE(mpsc_queue_is_empty(result));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_001: [ `mpsc_queue_create` shall allocate an empty queue, and return NULL if the allocation fails. ]
+TEST_FUNCTION(mpsc_queue_create_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    MPSC_QUEUE_HANDLE result = mpsc_queue_create();
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_002: [ `mpsc_queue_destroy` shall free the queue, but not the nodes still in it. ]
+TEST_FUNCTION(mpsc_queue_destroy_frees_the_queue_only)
+{
+    // arrange
+    TEST_RECORD record;
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    (void)mpsc_queue_push(queue, &record.node, NULL);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(queue));
+
+    // act
+    mpsc_queue_destroy(queue);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_002: [ `mpsc_queue_destroy` shall free the queue, but not the nodes still in it. ]
+TEST_FUNCTION(mpsc_queue_destroy_with_NULL_does_nothing)
+{
+    // arrange
+
+    // act
+    mpsc_queue_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_003: [ If `queue` or `node` are NULL, `mpsc_queue_push` shall fail and return a non-zero value. ]
+TEST_FUNCTION(mpsc_queue_push_with_NULL_arguments_fails)
+{
+    // arrange
+    TEST_RECORD record;
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result1 = mpsc_queue_push(NULL, &record.node, NULL);
+    int result2 = mpsc_queue_push(queue, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_IS_TRUE(mpsc_queue_is_empty(queue));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_004: [ `mpsc_queue_push` shall add `node` to the queue without blocking on the other producers nor on the consumer, and return 0. ]
+TEST_FUNCTION(mpsc_queue_push_succeeds)
+{
+    // arrange
+    TEST_RECORD record;
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    umock_c_reset_all_calls();
+
+    // act
+    int result = mpsc_queue_push(queue, &record.node, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(mpsc_queue_is_empty(queue));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_008: [ If `was_empty` is not NULL, `mpsc_queue_push` shall set it to true if the queue held no node right before `node` was added, and to false otherwise. ]
+TEST_FUNCTION(mpsc_queue_push_reports_whether_the_queue_was_empty)
+{
+    // arrange
+    TEST_RECORD records[3];
+    bool was_empty1 = false;
+    bool was_empty2 = true;
+    bool was_empty3 = false;
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    umock_c_reset_all_calls();
+
+    // act
+    (void)mpsc_queue_push(queue, &records[0].node, &was_empty1);
+    (void)mpsc_queue_push(queue, &records[1].node, &was_empty2);
+    (void)mpsc_queue_take_all(queue);
+    (void)mpsc_queue_push(queue, &records[2].node, &was_empty3);
+
+    // assert
+    ASSERT_IS_TRUE(was_empty1);
+    ASSERT_IS_FALSE(was_empty2);
+    ASSERT_IS_TRUE(was_empty3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_005: [ If `queue` is NULL, `mpsc_queue_take_all` shall return NULL. ]
+TEST_FUNCTION(mpsc_queue_take_all_with_NULL_queue_returns_NULL)
+{
+    // arrange
+
+    // act
+    MPSC_QUEUE_NODE* result = mpsc_queue_take_all(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_006: [ `mpsc_queue_take_all` shall empty the queue and return the nodes it held linked through `next` in the order they were pushed, or NULL if it was empty. ]
+TEST_FUNCTION(mpsc_queue_take_all_on_empty_queue_returns_NULL)
+{
+    // arrange
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    umock_c_reset_all_calls();
+
+    // act
+    MPSC_QUEUE_NODE* result = mpsc_queue_take_all(queue);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_006: [ `mpsc_queue_take_all` shall empty the queue and return the nodes it held linked through `next` in the order they were pushed, or NULL if it was empty. ]
+// Tests_SRS_IOTHUB_CLIENT_MPSC_QUEUE_10_007: [ `mpsc_queue_is_empty` shall return true if `queue` is NULL or holds no node. ]
+TEST_FUNCTION(mpsc_queue_take_all_returns_the_nodes_in_push_order)
+{
+    // arrange
+    TEST_RECORD records[TEST_RECORD_COUNT];
+    MPSC_QUEUE_NODE* node;
+    int index;
+    MPSC_QUEUE_HANDLE queue = mpsc_queue_create();
+    for (index = 0; index < TEST_RECORD_COUNT; index++)
+    {
+        records[index].value = index;
+        (void)mpsc_queue_push(queue, &records[index].node, NULL);
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    node = mpsc_queue_take_all(queue);
+
+    // assert
+    for (index = 0; index < TEST_RECORD_COUNT; index++)
+    {
+        ASSERT_IS_NOT_NULL(node);
+        ASSERT_ARE_EQUAL(int, index, ((TEST_RECORD*)node)->value);
+        node = node->next;
+    }
+    ASSERT_IS_NULL(node);
+    ASSERT_IS_TRUE(mpsc_queue_is_empty(queue));
+    ASSERT_IS_TRUE(mpsc_queue_is_empty(NULL));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mpsc_queue_destroy(queue);
+}
+
+END_TEST_SUITE(iothub_client_mpsc_queue_ut)
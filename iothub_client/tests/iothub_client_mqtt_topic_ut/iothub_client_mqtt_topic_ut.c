@@ -0,0 +1,584 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_mqtt_topic.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_PREFIX_BEGIN   "devices/"
+#define TEST_DEVICE_ID      "myDevice"
+#define TEST_PREFIX_END     "/messages/events/"
+#define TEST_PREFIX         TEST_PREFIX_BEGIN TEST_DEVICE_ID TEST_PREFIX_END
+
+/* Same value as MQTT_TOPIC_INITIAL_PROPERTIES_SIZE in the module */
+#define TEST_INITIAL_PROPERTIES_SIZE    128
+
+static void init_topic_buffer(MQTT_TOPIC_BUFFER* topic_buffer)
+{
+    int result = mqtt_topic_buffer_init(topic_buffer, TEST_PREFIX_BEGIN, TEST_DEVICE_ID, TEST_PREFIX_END);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    umock_c_reset_all_calls();
+}
+
+BEGIN_TEST_SUITE(iothub_client_mqtt_topic_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_001: [ If any argument is NULL, mqtt_topic_buffer_init shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_buffer_init_with_NULL_arguments_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+
+    // act
+    int result1 = mqtt_topic_buffer_init(NULL, TEST_PREFIX_BEGIN, TEST_DEVICE_ID, TEST_PREFIX_END);
+    int result2 = mqtt_topic_buffer_init(&topic_buffer, NULL, TEST_DEVICE_ID, TEST_PREFIX_END);
+    int result3 = mqtt_topic_buffer_init(&topic_buffer, TEST_PREFIX_BEGIN, NULL, TEST_PREFIX_END);
+    int result4 = mqtt_topic_buffer_init(&topic_buffer, TEST_PREFIX_BEGIN, TEST_DEVICE_ID, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result4);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_003: [ If the allocation fails, mqtt_topic_buffer_init shall fail and return a non-zero value. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_011: [ mqtt_topic_buffer_deinit shall free the buffer, it may be called on a buffer whose init failed or that was zeroed. ]
+TEST_FUNCTION(mqtt_topic_buffer_init_fails_when_malloc_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = mqtt_topic_buffer_init(&topic_buffer, TEST_PREFIX_BEGIN, TEST_DEVICE_ID, TEST_PREFIX_END);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_002: [ mqtt_topic_buffer_init shall allocate the buffer with room for the prefix and for MQTT_TOPIC_INITIAL_PROPERTIES_SIZE characters of properties. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_004: [ mqtt_topic_buffer_init shall write prefix_begin + device_id + prefix_end as the prefix of the topic and return 0. ]
+TEST_FUNCTION(mqtt_topic_buffer_init_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(TEST_PREFIX) + TEST_INITIAL_PROPERTIES_SIZE));
+
+    // act
+    int result = mqtt_topic_buffer_init(&topic_buffer, TEST_PREFIX_BEGIN, TEST_DEVICE_ID, TEST_PREFIX_END);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX, topic_buffer.topic);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_PREFIX) - 1, topic_buffer.length);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_PREFIX) - 1, topic_buffer.prefix_length);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_011: [ mqtt_topic_buffer_deinit shall free the buffer, it may be called on a buffer whose init failed or that was zeroed. ]
+TEST_FUNCTION(mqtt_topic_buffer_deinit_frees_the_buffer)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    init_topic_buffer(&topic_buffer);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    mqtt_topic_buffer_deinit(&topic_buffer);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(topic_buffer.topic);
+    ASSERT_ARE_EQUAL(size_t, 0, topic_buffer.length);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_012: [ mqtt_topic_buffer_append_property shall append name + "=" + value, both URL encoded when url_encode is true. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_007: [ Every property but the first one after the prefix shall be preceded by "&". ]
+TEST_FUNCTION(mqtt_topic_buffer_append_property_without_encoding_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    init_topic_buffer(&topic_buffer);
+
+    // act
+    int result1 = mqtt_topic_buffer_append_property(&topic_buffer, "key1", "value1", false);
+    int result2 = mqtt_topic_buffer_append_property(&topic_buffer, "key 2", "value&2", false);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX "key1=value1&key 2=value&2", topic_buffer.topic);
+    ASSERT_ARE_EQUAL(size_t, strlen(topic_buffer.topic), topic_buffer.length);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_012: [ mqtt_topic_buffer_append_property shall append name + "=" + value, both URL encoded when url_encode is true. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_property_with_encoding_matches_URL_EncodeString)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    init_topic_buffer(&topic_buffer);
+
+    // act
+    int result1 = mqtt_topic_buffer_append_property(&topic_buffer, "a-Z_0.9!(*)", "x y/z", true);
+    int result2 = mqtt_topic_buffer_append_property(&topic_buffer, "latin", "\xA9\xE9", true);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX "a-Z_0.9!(*)=x%20y%2fz&latin=%c2%a9%c3%a9", topic_buffer.topic);
+    ASSERT_ARE_EQUAL(size_t, strlen(topic_buffer.topic), topic_buffer.length);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_013: [ mqtt_topic_buffer_append_system_property shall append "%24." + name + "=" + value, only value being URL encoded when url_encode is true. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_014: [ mqtt_topic_buffer_append_url_encoded shall append the URL encoded text, without any separator. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_system_property_and_url_encoded_succeed)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    init_topic_buffer(&topic_buffer);
+
+    // act
+    int result1 = mqtt_topic_buffer_append_system_property(&topic_buffer, "mid", "id 1", false);
+    int result2 = mqtt_topic_buffer_append_system_property(&topic_buffer, "ct", "text/plain", true);
+    int result3 = mqtt_topic_buffer_append_url_encoded(&topic_buffer, "=");
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(int, 0, result3);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX "%24.mid=id 1&%24.ct=text%2fplain%3d", topic_buffer.topic);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_005: [ mqtt_topic_buffer_reset shall truncate the topic back to its prefix without releasing any memory. ]
+TEST_FUNCTION(mqtt_topic_buffer_reset_truncates_to_the_prefix)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    init_topic_buffer(&topic_buffer);
+    (void)mqtt_topic_buffer_append_property(&topic_buffer, "key1", "value1", false);
+    umock_c_reset_all_calls();
+
+    // act
+    mqtt_topic_buffer_reset(&topic_buffer);
+    int result = mqtt_topic_buffer_append_property(&topic_buffer, "key2", "value2", false);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX "key2=value2", topic_buffer.topic);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_006: [ If topic_buffer is NULL or not initialized, or name or value is NULL, the append functions shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_with_invalid_arguments_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    MQTT_TOPIC_BUFFER zeroed_buffer;
+    memset(&zeroed_buffer, 0, sizeof(zeroed_buffer));
+    init_topic_buffer(&topic_buffer);
+
+    // act
+    int result1 = mqtt_topic_buffer_append_property(NULL, "key", "value", false);
+    int result2 = mqtt_topic_buffer_append_property(&zeroed_buffer, "key", "value", false);
+    int result3 = mqtt_topic_buffer_append_property(&topic_buffer, NULL, "value", false);
+    int result4 = mqtt_topic_buffer_append_system_property(&topic_buffer, "key", NULL, false);
+    int result5 = mqtt_topic_buffer_append_url_encoded(&topic_buffer, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result4);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result5);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX, topic_buffer.topic);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_008: [ The needed size shall be computed before anything is written, so that a property is added with at most one reallocation. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_009: [ When the topic does not fit in the buffer, the buffer shall be grown to the larger of twice its capacity and the size needed. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_property_grows_the_buffer_once)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    char value[3 * TEST_INITIAL_PROPERTIES_SIZE];
+    size_t initial_capacity;
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    init_topic_buffer(&topic_buffer);
+    initial_capacity = topic_buffer.capacity;
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, sizeof(TEST_PREFIX) + 2 + sizeof(value) - 1));
+
+    // act
+    int result = mqtt_topic_buffer_append_property(&topic_buffer, "k", value, false);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(topic_buffer.capacity > 2 * initial_capacity);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_PREFIX) - 1 + 2 + sizeof(value) - 1, topic_buffer.length);
+    ASSERT_ARE_EQUAL(size_t, topic_buffer.length, strlen(topic_buffer.topic));
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_009: [ When the topic does not fit in the buffer, the buffer shall be grown to the larger of twice its capacity and the size needed. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_url_encoded_doubles_the_buffer)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    char text[TEST_INITIAL_PROPERTIES_SIZE + 2];
+    size_t initial_capacity;
+    memset(text, 't', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    init_topic_buffer(&topic_buffer);
+    initial_capacity = topic_buffer.capacity;
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, 2 * initial_capacity));
+
+    // act
+    int result = mqtt_topic_buffer_append_url_encoded(&topic_buffer, text);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 2 * initial_capacity, topic_buffer.capacity);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_010: [ If growing the buffer fails, the append shall fail, return a non-zero value and leave the topic unchanged. ]
+TEST_FUNCTION(mqtt_topic_buffer_append_property_fails_when_realloc_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer;
+    char value[2 * TEST_INITIAL_PROPERTIES_SIZE];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    init_topic_buffer(&topic_buffer);
+    (void)mqtt_topic_buffer_append_property(&topic_buffer, "key1", "value1", false);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = mqtt_topic_buffer_append_property(&topic_buffer, "key2", value, true);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PREFIX "key1=value1", topic_buffer.topic);
+    ASSERT_ARE_EQUAL(size_t, strlen(topic_buffer.topic), topic_buffer.length);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+static void init_scratch(MQTT_TOPIC_BUFFER* scratch)
+{
+    int result = mqtt_topic_buffer_init(scratch, "", "", "");
+    ASSERT_ARE_EQUAL(int, 0, result);
+    umock_c_reset_all_calls();
+}
+
+static void set_property(MQTT_TOPIC_PROPERTY* property, const char* name, const char* value)
+{
+    property->name = name;
+    property->name_length = strlen(name);
+    property->value = value;
+    property->value_length = strlen(value);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_015: [ If scratch is NULL or not initialized, or property, its name or value, or decoded is NULL, mqtt_topic_buffer_decode_property shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_with_invalid_arguments_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_BUFFER zeroed_scratch;
+    MQTT_TOPIC_PROPERTY property;
+    MQTT_TOPIC_PROPERTY null_value_property;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    memset(&zeroed_scratch, 0, sizeof(zeroed_scratch));
+    set_property(&property, "key", "value");
+    set_property(&null_value_property, "key", "value");
+    null_value_property.value = NULL;
+    init_scratch(&scratch);
+
+    // act
+    int result1 = mqtt_topic_buffer_decode_property(NULL, &property, true, true, &decoded);
+    int result2 = mqtt_topic_buffer_decode_property(&zeroed_scratch, &property, true, true, &decoded);
+    int result3 = mqtt_topic_buffer_decode_property(&scratch, NULL, true, true, &decoded);
+    int result4 = mqtt_topic_buffer_decode_property(&scratch, &null_value_property, true, true, &decoded);
+    int result5 = mqtt_topic_buffer_decode_property(&scratch, &property, true, true, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result4);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result5);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_017: [ mqtt_topic_buffer_decode_property shall copy the name and then the value in scratch, '\0' terminated, decoding the "%xx" escapes of those for which decode_name and decode_value are true. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_019: [ On success mqtt_topic_buffer_decode_property shall point decoded at the copies, valid until scratch is used again, and return 0. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_decodes_name_and_value_in_place)
+{
+    // arrange
+    static const char topic[] = "devices/myDevice/messages/devicebound/%24.to=%2Fdevices&key%201=a%2fb%3D%C3%A9&next=1";
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_PROPERTY property;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    const char* name = strchr(topic, '&') + 1;
+    const char* value = strchr(name, '=') + 1;
+    property.name = name;
+    property.name_length = value - 1 - name;
+    property.value = value;
+    property.value_length = strchr(value, '&') - value;
+    init_scratch(&scratch);
+
+    // act
+    int result = mqtt_topic_buffer_decode_property(&scratch, &property, true, true, &decoded);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, "key 1", decoded.name);
+    ASSERT_ARE_EQUAL(char_ptr, "a/b=\xC3\xA9", decoded.value);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_017: [ mqtt_topic_buffer_decode_property shall copy the name and then the value in scratch, '\0' terminated, decoding the "%xx" escapes of those for which decode_name and decode_value are true. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_copies_what_is_not_decoded)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_PROPERTY property;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    set_property(&property, "%24.ct", "application%2Fjson");
+    init_scratch(&scratch);
+
+    // act
+    int result1 = mqtt_topic_buffer_decode_property(&scratch, &property, false, true, &decoded);
+    ASSERT_ARE_EQUAL(char_ptr, "%24.ct", decoded.name);
+    ASSERT_ARE_EQUAL(char_ptr, "application/json", decoded.value);
+    int result2 = mqtt_topic_buffer_decode_property(&scratch, &property, false, false, &decoded);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, "%24.ct", decoded.name);
+    ASSERT_ARE_EQUAL(char_ptr, "application%2Fjson", decoded.value);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_018: [ If an escape is not followed by 2 hexadecimal digits, mqtt_topic_buffer_decode_property shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_with_invalid_escape_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_PROPERTY property1;
+    MQTT_TOPIC_PROPERTY property2;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    set_property(&property1, "key", "value%2");
+    set_property(&property2, "key%G0", "value");
+    init_scratch(&scratch);
+
+    // act
+    int result1 = mqtt_topic_buffer_decode_property(&scratch, &property1, true, true, &decoded);
+    int result2 = mqtt_topic_buffer_decode_property(&scratch, &property2, true, true, &decoded);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_016: [ mqtt_topic_buffer_decode_property shall discard the previous content of scratch and make room for the name and value as received, growing the buffer at most once. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_grows_the_scratch_once)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_PROPERTY property;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    char value[2 * TEST_INITIAL_PROPERTIES_SIZE];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    set_property(&property, "key", value);
+    init_scratch(&scratch);
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+    // act
+    int result1 = mqtt_topic_buffer_decode_property(&scratch, &property, true, true, &decoded);
+    int result2 = mqtt_topic_buffer_decode_property(&scratch, &property, true, true, &decoded);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, "key", decoded.name);
+    ASSERT_ARE_EQUAL(char_ptr, value, decoded.value);
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_10_010: [ If growing the buffer fails, the append shall fail, return a non-zero value and leave the topic unchanged. ]
+TEST_FUNCTION(mqtt_topic_buffer_decode_property_fails_when_realloc_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER scratch;
+    MQTT_TOPIC_PROPERTY property;
+    MQTT_TOPIC_DECODED_PROPERTY decoded;
+    char value[2 * TEST_INITIAL_PROPERTIES_SIZE];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    set_property(&property, "key", value);
+    init_scratch(&scratch);
+
+    STRICT_EXPECTED_CALL(gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = mqtt_topic_buffer_decode_property(&scratch, &property, true, true, &decoded);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&scratch);
+}
+
+END_TEST_SUITE(iothub_client_mqtt_topic_ut)
@@ -0,0 +1,507 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include <unistd.h>
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "iothub_client_core_ll.h"
+#undef ENABLE_MOCKS
+
+#include "iothub_client_reactor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    extern VECTOR_HANDLE real_VECTOR_create(size_t elementSize);
+    extern VECTOR_HANDLE real_VECTOR_move(VECTOR_HANDLE handle);
+    extern void real_VECTOR_destroy(VECTOR_HANDLE handle);
+    extern int real_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements);
+    extern void real_VECTOR_erase(VECTOR_HANDLE handle, void* elements, size_t numElements);
+    extern void* real_VECTOR_element(VECTOR_HANDLE handle, size_t index);
+    extern void* real_VECTOR_back(VECTOR_HANDLE handle);
+    extern void* real_VECTOR_find_if(VECTOR_HANDLE handle, PREDICATE_FUNCTION pred, const void* value);
+    extern size_t real_VECTOR_size(VECTOR_HANDLE handle);
+#ifdef __cplusplus
+}
+#endif
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+TEST_DEFINE_ENUM_TYPE(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_TICK_COUNTER_HANDLE    (TICK_COUNTER_HANDLE)0x4243
+#define TEST_CLIENT_1               (IOTHUB_CLIENT_CORE_LL_HANDLE)0x4244
+#define TEST_CLIENT_2               (IOTHUB_CLIENT_CORE_LL_HANDLE)0x4245
+#define TEST_POLL_INTERVAL_MS       100
+#define TEST_LONG_WAIT_MS           10000
+
+static tickcounter_ms_t g_now_ms;
+static size_t g_client_1_work;
+static size_t g_client_2_work;
+static int g_pipe[2];
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
+{
+    (void)tick_counter;
+    *current_ms = g_now_ms;
+    return 0;
+}
+
+static void my_IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    if (iotHubClientHandle == TEST_CLIENT_1)
+    {
+        g_client_1_work++;
+    }
+    else if (iotHubClientHandle == TEST_CLIENT_2)
+    {
+        g_client_2_work++;
+    }
+}
+
+static LOCK_HANDLE my_Lock_Init(void)
+{
+    return (LOCK_HANDLE)my_gballoc_malloc(1);
+}
+
+static LOCK_RESULT my_Lock_Deinit(LOCK_HANDLE handle)
+{
+    my_gballoc_free(handle);
+    return LOCK_OK;
+}
+
+static void make_pipe_readable(void)
+{
+    ASSERT_ARE_EQUAL(int, 1, (int)write(g_pipe[1], "x", 1));
+}
+
+
+BEGIN_TEST_SUITE(iothub_client_reactor_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Init, my_Lock_Init);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Deinit, my_Lock_Deinit);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_move, real_VECTOR_move);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, real_VECTOR_destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_push_back, real_VECTOR_push_back);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_push_back, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_erase, real_VECTOR_erase);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_element, real_VECTOR_element);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_back, real_VECTOR_back);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_find_if, real_VECTOR_find_if);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_size, real_VECTOR_size);
+
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_get_current_ms, __LINE__);
+
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_DoWork, my_IoTHubClientCore_LL_DoWork);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    g_now_ms = 1000;
+    g_client_1_work = 0;
+    g_client_2_work = 0;
+    ASSERT_ARE_EQUAL(int, 0, pipe(g_pipe));
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    (void)close(g_pipe[0]);
+    (void)close(g_pipe[1]);
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_001: [ IoTHubClientReactor_Create shall allocate the reactor, create an epoll instance watching an eventfd used for wake ups, a tick counter, the list of registrations and the ready list with its lock. ]
+TEST_FUNCTION(IoTHubClientReactor_Create_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+
+    // act
+    CLIENT_REACTOR_HANDLE result = IoTHubClientReactor_Create();
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_002: [ If any of them fails, IoTHubClientReactor_Create shall release everything it created and return NULL. ]
+TEST_FUNCTION(IoTHubClientReactor_Create_fails_when_Lock_Init_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    CLIENT_REACTOR_HANDLE result = IoTHubClientReactor_Create();
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_003: [ If reactor is NULL, IoTHubClientReactor_Destroy shall do nothing. ]
+TEST_FUNCTION(IoTHubClientReactor_Destroy_NULL_does_nothing)
+{
+    // act
+    IoTHubClientReactor_Destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_004: [ IoTHubClientReactor_Destroy shall free every registration still in the reactor, without destroying their clients, then release all the resources of the reactor. ]
+TEST_FUNCTION(IoTHubClientReactor_Destroy_frees_the_registrations)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    ASSERT_IS_NOT_NULL(IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, g_pipe[0], TEST_POLL_INTERVAL_MS));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    IoTHubClientReactor_Destroy(reactor);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_1_work);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_005: [ If reactor or client is NULL, or descriptor is negative and not IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, IoTHubClientReactor_AddClient shall return NULL. ]
+TEST_FUNCTION(IoTHubClientReactor_AddClient_invalid_args_fail)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    umock_c_reset_all_calls();
+
+    // act
+    CLIENT_REACTOR_REGISTRATION_HANDLE result1 = IoTHubClientReactor_AddClient(NULL, TEST_CLIENT_1, g_pipe[0], TEST_POLL_INTERVAL_MS);
+    CLIENT_REACTOR_REGISTRATION_HANDLE result2 = IoTHubClientReactor_AddClient(reactor, NULL, g_pipe[0], TEST_POLL_INTERVAL_MS);
+    CLIENT_REACTOR_REGISTRATION_HANDLE result3 = IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, -2, TEST_POLL_INTERVAL_MS);
+
+    // assert
+    ASSERT_IS_NULL(result1);
+    ASSERT_IS_NULL(result2);
+    ASSERT_IS_NULL(result3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_008: [ If any step fails, IoTHubClientReactor_AddClient shall undo the previous ones and return NULL. ]
+TEST_FUNCTION(IoTHubClientReactor_AddClient_fails_when_the_descriptor_cannot_be_watched)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    CLIENT_REACTOR_REGISTRATION_HANDLE result = IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, 12345, TEST_POLL_INTERVAL_MS);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_006: [ If descriptor is not IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, IoTHubClientReactor_AddClient shall add it to the epoll instance for input readiness. ]
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_017: [ IoTHubClientReactor_RunOnce shall call IoTHubClientCore_LL_DoWork at most once per call on each client whose descriptor is readable or which was signaled ready. ]
+TEST_FUNCTION(IoTHubClientReactor_RunOnce_works_only_the_readable_client)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    ASSERT_IS_NOT_NULL(IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, g_pipe[0], TEST_POLL_INTERVAL_MS));
+    ASSERT_IS_NOT_NULL(IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_2, IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, TEST_POLL_INTERVAL_MS));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_RunOnce(reactor, 0));
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_1_work);
+    make_pipe_readable();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_RunOnce(reactor, TEST_LONG_WAIT_MS);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_client_1_work);
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_2_work);
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_012: [ IoTHubClientReactor_SignalClientReady shall add the registration to the ready list, unless it is already in it, and write to the eventfd of the reactor when it was added. ]
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_017: [ IoTHubClientReactor_RunOnce shall call IoTHubClientCore_LL_DoWork at most once per call on each client whose descriptor is readable or which was signaled ready. ]
+TEST_FUNCTION(IoTHubClientReactor_RunOnce_works_a_signaled_and_readable_client_once)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    CLIENT_REACTOR_REGISTRATION_HANDLE registration = IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, g_pipe[0], 0);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_SignalClientReady(reactor, registration));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_SignalClientReady(reactor, registration));
+    make_pipe_readable();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_RunOnce(reactor, TEST_LONG_WAIT_MS);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_client_1_work);
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_007: [ IoTHubClientReactor_AddClient shall add the registration to the reactor and, if pollIntervalMs is not 0, arm its poll timer for the current time plus pollIntervalMs. ]
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_015: [ IoTHubClientReactor_RunOnce shall call IoTHubClientCore_LL_DoWork on every client whose poll interval elapsed since it last did work. ]
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_016: [ IoTHubClientReactor_RunOnce shall wait with epoll_wait for at most maxWaitMs, and no longer than until the next poll timer is due. ]
+TEST_FUNCTION(IoTHubClientReactor_RunOnce_polls_a_client_when_its_interval_elapsed)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    ASSERT_IS_NOT_NULL(IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, TEST_POLL_INTERVAL_MS));
+    ASSERT_IS_NOT_NULL(IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_2, IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, 0));
+    g_now_ms += TEST_POLL_INTERVAL_MS - 1;
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_RunOnce(reactor, 0));
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_1_work);
+    g_now_ms += 1;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_RunOnce(reactor, TEST_LONG_WAIT_MS);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, g_client_1_work);
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_2_work);
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_009: [ If reactor or registration is NULL, IoTHubClientReactor_RemoveClient shall do nothing. ]
+TEST_FUNCTION(IoTHubClientReactor_RemoveClient_NULL_args_do_nothing)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubClientReactor_RemoveClient(reactor, NULL);
+    IoTHubClientReactor_RemoveClient(NULL, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_010: [ IoTHubClientReactor_RemoveClient shall remove the registration from the reactor and from the ready list, stop watching its descriptor, cancel its poll timer and free it. ]
+TEST_FUNCTION(IoTHubClientReactor_RemoveClient_of_a_signaled_client_stops_its_work)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    CLIENT_REACTOR_REGISTRATION_HANDLE registration = IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, g_pipe[0], TEST_POLL_INTERVAL_MS);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_SignalClientReady(reactor, registration));
+    make_pipe_readable();
+
+    // act
+    IoTHubClientReactor_RemoveClient(reactor, registration);
+
+    // assert
+    g_now_ms += TEST_POLL_INTERVAL_MS;
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientReactor_RunOnce(reactor, 0));
+    ASSERT_ARE_EQUAL(size_t, 0, g_client_1_work);
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_011: [ If reactor or registration is NULL, IoTHubClientReactor_SignalClientReady shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubClientReactor_SignalClientReady_NULL_args_fail)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClientReactor_SignalClientReady(NULL, NULL);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClientReactor_SignalClientReady(reactor, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_013: [ If Lock, VECTOR_push_back or the write to the eventfd fails, IoTHubClientReactor_SignalClientReady shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubClientReactor_SignalClientReady_Lock_fails)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    CLIENT_REACTOR_REGISTRATION_HANDLE registration = IoTHubClientReactor_AddClient(reactor, TEST_CLIENT_1, IOTHUB_CLIENT_REACTOR_NO_DESCRIPTOR, 0);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_SignalClientReady(reactor, registration);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_014: [ If reactor is NULL, IoTHubClientReactor_RunOnce shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubClientReactor_RunOnce_NULL_reactor_fails)
+{
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_RunOnce(NULL, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_REACTOR_10_018: [ If reading the tick counter or epoll_wait fails, IoTHubClientReactor_RunOnce shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubClientReactor_RunOnce_tickcounter_fails)
+{
+    // arrange
+    CLIENT_REACTOR_HANDLE reactor = IoTHubClientReactor_Create();
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .SetReturn(1);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientReactor_RunOnce(reactor, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientReactor_Destroy(reactor);
+}
+
+END_TEST_SUITE(iothub_client_reactor_ut)
@@ -0,0 +1,329 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_slab.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_ITEM_SIZE          24
+#define TEST_ITEMS_PER_BLOCK    3
+
+typedef struct TEST_RECORD_TAG
+{
+    char c;
+    double d;
+    void* p;
+} TEST_RECORD;
+
+
+BEGIN_TEST_SUITE(iothub_client_slab_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_001: [ If `item_size` or `items_per_block` are 0, or a block would not fit in a size_t, `slab_allocator_create` shall fail and return NULL. ]
+TEST_FUNCTION(slab_allocator_create_with_0_item_size_fails)
+{
+    // arrange
+
+    // act
+    SLAB_ALLOCATOR_HANDLE result = slab_allocator_create(0, TEST_ITEMS_PER_BLOCK);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_001: [ If `item_size` or `items_per_block` are 0, or a block would not fit in a size_t, `slab_allocator_create` shall fail and return NULL. ]
+TEST_FUNCTION(slab_allocator_create_with_0_items_per_block_fails)
+{
+    // arrange
+
+    // act
+    SLAB_ALLOCATOR_HANDLE result = slab_allocator_create(TEST_ITEM_SIZE, 0);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_001: [ If `item_size` or `items_per_block` are 0, or a block would not fit in a size_t, `slab_allocator_create` shall fail and return NULL. ]
+TEST_FUNCTION(slab_allocator_create_with_overflowing_block_size_fails)
+{
+    // arrange
+
+    // act
+    SLAB_ALLOCATOR_HANDLE result1 = slab_allocator_create(SIZE_MAX, 1);
+    SLAB_ALLOCATOR_HANDLE result2 = slab_allocator_create(TEST_ITEM_SIZE, SIZE_MAX / 2);
+
+    // assert
+    ASSERT_IS_NULL(result1);
+    ASSERT_IS_NULL(result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_002: [ If allocating the allocator fails, `slab_allocator_create` shall fail and return NULL. ]
+TEST_FUNCTION(slab_allocator_create_fails_when_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    SLAB_ALLOCATOR_HANDLE result = slab_allocator_create(TEST_ITEM_SIZE, TEST_ITEMS_PER_BLOCK);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_003: [ `slab_allocator_create` shall not allocate any block, the first one is allocated by the first call to `slab_allocator_alloc`. ]
+TEST_FUNCTION(slab_allocator_create_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    SLAB_ALLOCATOR_HANDLE result = slab_allocator_create(TEST_ITEM_SIZE, TEST_ITEMS_PER_BLOCK);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    slab_allocator_destroy(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_004: [ `slab_allocator_destroy` shall free all the blocks of `slab_allocator` and the allocator itself. ]
+TEST_FUNCTION(slab_allocator_destroy_frees_all_blocks)
+{
+    // arrange
+    SLAB_ALLOCATOR_HANDLE slab_allocator = slab_allocator_create(TEST_ITEM_SIZE, 1);
+    (void)slab_allocator_alloc(slab_allocator);
+    (void)slab_allocator_alloc(slab_allocator);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(slab_allocator));
+
+    // act
+    slab_allocator_destroy(slab_allocator);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(slab_allocator_destroy_with_NULL_does_nothing)
+{
+    // arrange
+
+    // act
+    slab_allocator_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_005: [ If `slab_allocator` is NULL, `slab_allocator_alloc` shall return NULL. ]
+TEST_FUNCTION(slab_allocator_alloc_with_NULL_handle_fails)
+{
+    // arrange
+
+    // act
+    void* result = slab_allocator_alloc(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_006: [ If there is no free record, `slab_allocator_alloc` shall allocate a new block of `items_per_block` records. ]
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_008: [ `slab_allocator_alloc` shall return a free record of at least `item_size` bytes, suitably aligned for any type. ]
+TEST_FUNCTION(slab_allocator_alloc_allocates_one_block_per_items_per_block_records)
+{
+    // arrange
+    SLAB_ALLOCATOR_HANDLE slab_allocator = slab_allocator_create(sizeof(TEST_RECORD), TEST_ITEMS_PER_BLOCK);
+    TEST_RECORD* records[TEST_ITEMS_PER_BLOCK + 1];
+    size_t i;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    // act
+    for (i = 0; i < TEST_ITEMS_PER_BLOCK + 1; i++)
+    {
+        records[i] = (TEST_RECORD*)slab_allocator_alloc(slab_allocator);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    for (i = 0; i < TEST_ITEMS_PER_BLOCK + 1; i++)
+    {
+        size_t j;
+        ASSERT_IS_NOT_NULL(records[i]);
+        records[i]->c = (char)i;
+        records[i]->d = (double)i;
+        records[i]->p = records[i];
+        for (j = 0; j < i; j++)
+        {
+            ASSERT_ARE_NOT_EQUAL(void_ptr, records[i], records[j]);
+        }
+    }
+    for (i = 0; i < TEST_ITEMS_PER_BLOCK + 1; i++)
+    {
+        ASSERT_ARE_EQUAL(int, (int)i, (int)records[i]->c);
+        ASSERT_ARE_EQUAL(void_ptr, records[i], records[i]->p);
+    }
+
+    // cleanup
+    for (i = 0; i < TEST_ITEMS_PER_BLOCK + 1; i++)
+    {
+        slab_allocator_free(slab_allocator, records[i]);
+    }
+    slab_allocator_destroy(slab_allocator);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_007: [ If allocating the block fails, `slab_allocator_alloc` shall return NULL. ]
+TEST_FUNCTION(slab_allocator_alloc_fails_when_block_allocation_fails)
+{
+    // arrange
+    SLAB_ALLOCATOR_HANDLE slab_allocator = slab_allocator_create(TEST_ITEM_SIZE, TEST_ITEMS_PER_BLOCK);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    void* result = slab_allocator_alloc(slab_allocator);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    slab_allocator_destroy(slab_allocator);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_010: [ `slab_allocator_free` shall return `item` to the free records of `slab_allocator`, to be reused by the next `slab_allocator_alloc`. ]
+TEST_FUNCTION(slab_allocator_free_recycles_the_record_without_allocating)
+{
+    // arrange
+    SLAB_ALLOCATOR_HANDLE slab_allocator = slab_allocator_create(TEST_ITEM_SIZE, 1);
+    void* record = slab_allocator_alloc(slab_allocator);
+    umock_c_reset_all_calls();
+
+    // act
+    slab_allocator_free(slab_allocator, record);
+    void* result = slab_allocator_alloc(slab_allocator);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, record, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    slab_allocator_free(slab_allocator, result);
+    slab_allocator_destroy(slab_allocator);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_SLAB_10_009: [ If `slab_allocator` or `item` are NULL, `slab_allocator_free` shall do nothing. ]
+TEST_FUNCTION(slab_allocator_free_with_NULL_arguments_does_nothing)
+{
+    // arrange
+    SLAB_ALLOCATOR_HANDLE slab_allocator = slab_allocator_create(TEST_ITEM_SIZE, 1);
+    void* record = slab_allocator_alloc(slab_allocator);
+    umock_c_reset_all_calls();
+
+    // act
+    slab_allocator_free(NULL, record);
+    slab_allocator_free(slab_allocator, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    slab_allocator_free(slab_allocator, record);
+    slab_allocator_destroy(slab_allocator);
+}
+
+END_TEST_SUITE(iothub_client_slab_ut)
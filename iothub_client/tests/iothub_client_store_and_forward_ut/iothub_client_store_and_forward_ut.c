@@ -0,0 +1,503 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/map.h"
+#include "iothub_message.h"
+#include "internal/iothub_client_journal.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_store_and_forward.h"
+
+#define ENABLE_MOCKS
+MOCKABLE_FUNCTION(, void, test_on_pending_message, uint64_t, sequence, void*, context);
+#undef ENABLE_MOCKS
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_DIRECTORY              "/var/lib/iothub"
+#define TEST_SEGMENT_SIZE           8192
+#define TEST_SYNC_BATCH             16
+#define TEST_JOURNAL_HANDLE         (MESSAGE_JOURNAL_HANDLE)0x4242
+#define TEST_MESSAGE_HANDLE         (IOTHUB_MESSAGE_HANDLE)0x4243
+#define TEST_LOADED_MESSAGE_HANDLE  (IOTHUB_MESSAGE_HANDLE)0x4244
+#define TEST_PROPERTIES_HANDLE      (MAP_HANDLE)0x4245
+#define TEST_SEQUENCE               42
+
+static const unsigned char TEST_BODY[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+static const char TEST_MESSAGE_ID[] = "message-id";
+static const char* const TEST_KEYS[] = { "key" };
+static const char* const TEST_VALUES[] = { "value" };
+
+static unsigned char* g_journal_record;
+static size_t g_journal_record_size;
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    (void)iotHubMessageHandle;
+    *buffer = TEST_BODY;
+    *size = sizeof(TEST_BODY);
+    return IOTHUB_MESSAGE_OK;
+}
+
+static MAP_RESULT my_Map_GetInternals(MAP_HANDLE handle, const char*const** keys, const char*const** values, size_t* count)
+{
+    (void)handle;
+    *keys = TEST_KEYS;
+    *values = TEST_VALUES;
+    *count = 1;
+    return MAP_OK;
+}
+
+static int my_message_journal_append(MESSAGE_JOURNAL_HANDLE journal, const unsigned char* data, size_t size, uint64_t* sequence)
+{
+    (void)journal;
+    free(g_journal_record);
+    g_journal_record = (unsigned char*)malloc(size);
+    (void)memcpy(g_journal_record, data, size);
+    g_journal_record_size = size;
+    *sequence = TEST_SEQUENCE;
+    return 0;
+}
+
+static int my_message_journal_read(MESSAGE_JOURNAL_HANDLE journal, uint64_t sequence, const unsigned char** data, size_t* size)
+{
+    (void)journal;
+    (void)sequence;
+    *data = g_journal_record;
+    *size = g_journal_record_size;
+    return 0;
+}
+
+static int my_message_journal_for_each_pending(MESSAGE_JOURNAL_HANDLE journal, MESSAGE_JOURNAL_ON_PENDING_RECORD on_pending_record, void* context)
+{
+    (void)journal;
+    on_pending_record(TEST_SEQUENCE, TEST_BODY, sizeof(TEST_BODY), context);
+    return 0;
+}
+
+static void set_expected_calls_for_save(void)
+{
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetMessageId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetCorrelationId(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_PROPERTIES_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+}
+
+BEGIN_TEST_SUITE(iothub_client_store_and_forward_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_JOURNAL_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_JOURNAL_ON_PENDING_RECORD, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_RETURN(message_journal_open, TEST_JOURNAL_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_journal_open, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(message_journal_append, my_message_journal_append);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_journal_append, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(message_journal_read, my_message_journal_read);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_journal_read, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(message_journal_for_each_pending, my_message_journal_for_each_pending);
+    REGISTER_GLOBAL_MOCK_RETURN(message_journal_sync, 0);
+
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentType, IOTHUBMESSAGE_BYTEARRAY);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetMessageId, TEST_MESSAGE_ID);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetCorrelationId, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentTypeSystemProperty, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentEncodingSystemProperty, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Properties, TEST_PROPERTIES_HANDLE);
+    REGISTER_GLOBAL_MOCK_HOOK(Map_GetInternals, my_Map_GetInternals);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromByteArray, TEST_LOADED_MESSAGE_HANDLE);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_SetMessageId, IOTHUB_MESSAGE_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_SetProperty, IOTHUB_MESSAGE_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_SetProperty, IOTHUB_MESSAGE_ERROR);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    g_journal_record = NULL;
+    g_journal_record_size = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    free(g_journal_record);
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_001: [ If `directory` is NULL, `store_and_forward_create` shall fail and return NULL. ]
+TEST_FUNCTION(store_and_forward_create_with_NULL_directory_fails)
+{
+    // arrange
+
+    // act
+    STORE_AND_FORWARD_HANDLE result = store_and_forward_create(NULL, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_003: [ `store_and_forward_create` shall open the message journal in `directory` with `segment_size` and `sync_batch`. ]
+TEST_FUNCTION(store_and_forward_create_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(message_journal_open(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH));
+
+    // act
+    STORE_AND_FORWARD_HANDLE result = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_002: [ If any failure occurs, `store_and_forward_create` shall fail and return NULL. ]
+TEST_FUNCTION(when_opening_the_journal_fails_store_and_forward_create_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(message_journal_open(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    STORE_AND_FORWARD_HANDLE result = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_004: [ `store_and_forward_destroy` shall close the message journal, keeping the pending messages, and free the store. ]
+TEST_FUNCTION(store_and_forward_destroy_closes_the_journal)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_close(TEST_JOURNAL_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(store));
+
+    // act
+    store_and_forward_destroy(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_005: [ If `store`, `message` or `sequence` are NULL, `store_and_forward_save` shall fail and return a non-zero value. ]
+TEST_FUNCTION(store_and_forward_save_with_NULL_message_fails)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence;
+    umock_c_reset_all_calls();
+
+    // act
+    int result = store_and_forward_save(store, NULL, &sequence);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_006: [ `store_and_forward_save` shall serialize the body, message id, correlation id, content type, content encoding and properties of `message`. ]
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_008: [ `store_and_forward_save` shall append the serialized message to the journal and return its sequence number in `sequence`. ]
+TEST_FUNCTION(store_and_forward_save_appends_the_message_to_the_journal)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence = 0;
+    umock_c_reset_all_calls();
+
+    set_expected_calls_for_save();
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(message_journal_append(TEST_JOURNAL_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, &sequence));
+
+    // act
+    int result = store_and_forward_save(store, TEST_MESSAGE_HANDLE, &sequence);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(uint64_t, TEST_SEQUENCE, sequence);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_007: [ If any failure occurs, `store_and_forward_save` shall fail and return a non-zero value. ]
+TEST_FUNCTION(when_appending_to_the_journal_fails_store_and_forward_save_fails)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence = 0;
+    umock_c_reset_all_calls();
+
+    set_expected_calls_for_save();
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(message_journal_append(TEST_JOURNAL_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, &sequence))
+        .SetReturn(__LINE__);
+
+    // act
+    int result = store_and_forward_save(store, TEST_MESSAGE_HANDLE, &sequence);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_011: [ `store_and_forward_load` shall create a new message with the body, message id, correlation id, content type, content encoding and properties of the record. ]
+TEST_FUNCTION(store_and_forward_load_restores_a_saved_message)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence;
+    (void)store_and_forward_save(store, TEST_MESSAGE_HANDLE, &sequence);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_read(TEST_JOURNAL_HANDLE, TEST_SEQUENCE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_BODY)))
+        .ValidateArgumentBuffer(1, TEST_BODY, sizeof(TEST_BODY));
+    STRICT_EXPECTED_CALL(IoTHubMessage_SetMessageId(TEST_LOADED_MESSAGE_HANDLE, TEST_MESSAGE_ID));
+    STRICT_EXPECTED_CALL(IoTHubMessage_SetProperty(TEST_LOADED_MESSAGE_HANDLE, "key", "value"));
+
+    // act
+    IOTHUB_MESSAGE_HANDLE result = store_and_forward_load(store, TEST_SEQUENCE);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, TEST_LOADED_MESSAGE_HANDLE, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_010: [ If reading the record `sequence` from the journal fails, `store_and_forward_load` shall fail and return NULL. ]
+TEST_FUNCTION(when_reading_the_journal_fails_store_and_forward_load_fails)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_read(TEST_JOURNAL_HANDLE, TEST_SEQUENCE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(__LINE__);
+
+    // act
+    IOTHUB_MESSAGE_HANDLE result = store_and_forward_load(store, TEST_SEQUENCE);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_012: [ If the record cannot be decoded or restoring the message fails, `store_and_forward_load` shall fail and return NULL. ]
+TEST_FUNCTION(when_restoring_a_property_fails_store_and_forward_load_fails)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    uint64_t sequence;
+    (void)store_and_forward_save(store, TEST_MESSAGE_HANDLE, &sequence);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_read(TEST_JOURNAL_HANDLE, TEST_SEQUENCE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, sizeof(TEST_BODY)));
+    STRICT_EXPECTED_CALL(IoTHubMessage_SetMessageId(TEST_LOADED_MESSAGE_HANDLE, TEST_MESSAGE_ID));
+    STRICT_EXPECTED_CALL(IoTHubMessage_SetProperty(TEST_LOADED_MESSAGE_HANDLE, "key", "value"))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_LOADED_MESSAGE_HANDLE));
+
+    // act
+    IOTHUB_MESSAGE_HANDLE result = store_and_forward_load(store, TEST_SEQUENCE);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_013: [ `store_and_forward_remove` shall acknowledge the record `sequence` in the journal. ]
+TEST_FUNCTION(store_and_forward_remove_acknowledges_the_record)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_acknowledge(TEST_JOURNAL_HANDLE, TEST_SEQUENCE));
+
+    // act
+    store_and_forward_remove(store, TEST_SEQUENCE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_014: [ If `store` or `on_pending_message` are NULL, `store_and_forward_get_pending` shall fail and return a non-zero value. ]
+TEST_FUNCTION(store_and_forward_get_pending_with_NULL_on_pending_message_fails)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = store_and_forward_get_pending(store, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_015: [ `store_and_forward_get_pending` shall call `on_pending_message` with the sequence number of every message in the journal not removed yet, oldest first. ]
+TEST_FUNCTION(store_and_forward_get_pending_reports_the_pending_records)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_for_each_pending(TEST_JOURNAL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_on_pending_message(TEST_SEQUENCE, (void*)0x11));
+
+    // act
+    int result = store_and_forward_get_pending(store, test_on_pending_message, (void*)0x11);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_STORE_AND_FORWARD_10_016: [ `store_and_forward_flush` shall sync the journal and return 0 on success, a non-zero value otherwise. ]
+TEST_FUNCTION(store_and_forward_flush_syncs_the_journal)
+{
+    // arrange
+    STORE_AND_FORWARD_HANDLE store = store_and_forward_create(TEST_DIRECTORY, TEST_SEGMENT_SIZE, TEST_SYNC_BATCH);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_journal_sync(TEST_JOURNAL_HANDLE));
+
+    // act
+    int result = store_and_forward_flush(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    store_and_forward_destroy(store);
+}
+
+END_TEST_SUITE(iothub_client_store_and_forward_ut)
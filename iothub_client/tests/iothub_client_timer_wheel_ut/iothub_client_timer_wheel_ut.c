@@ -0,0 +1,441 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#include "internal/iothub_client_timer_wheel.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_START_MS           ((tickcounter_ms_t)1000)
+#define TEST_TIMER_COUNT        4
+
+typedef struct TEST_TIMER_TAG
+{
+    TIMER_WHEEL_ENTRY timer;
+    size_t fired_count;
+    tickcounter_ms_t fired_at;
+    TIMER_WHEEL_ENTRY* cancel_on_fire;
+    tickcounter_ms_t restart_timeout_ms;
+} TEST_TIMER;
+
+static TIMER_WHEEL test_wheel;
+static TEST_TIMER test_timers[TEST_TIMER_COUNT];
+static tickcounter_ms_t test_now_ms;
+
+// Helpers
+
+static void on_test_timer_expired(void* context)
+{
+    TEST_TIMER* test_timer = (TEST_TIMER*)context;
+
+    test_timer->fired_count++;
+    test_timer->fired_at = test_now_ms;
+
+    if (test_timer->cancel_on_fire != NULL)
+    {
+        timer_wheel_cancel(&test_wheel, test_timer->cancel_on_fire);
+    }
+
+    if (test_timer->restart_timeout_ms != 0)
+    {
+        (void)timer_wheel_start(&test_wheel, &test_timer->timer, test_now_ms, test_timer->restart_timeout_ms);
+        test_timer->restart_timeout_ms = 0;
+    }
+}
+
+static size_t process_until(tickcounter_ms_t now_ms)
+{
+    test_now_ms = now_ms;
+    return timer_wheel_process(&test_wheel, now_ms);
+}
+
+static void reset_test_data()
+{
+    size_t i;
+
+    timer_wheel_init(&test_wheel);
+    test_now_ms = TEST_START_MS;
+
+    for (i = 0; i < TEST_TIMER_COUNT; i++)
+    {
+        test_timers[i].fired_count = 0;
+        test_timers[i].fired_at = 0;
+        test_timers[i].cancel_on_fire = NULL;
+        test_timers[i].restart_timeout_ms = 0;
+        timer_wheel_entry_init(&test_timers[i].timer, on_test_timer_expired, &test_timers[i]);
+    }
+}
+
+static void verify_timer_fires_at(tickcounter_ms_t timeout_ms)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, timeout_ms));
+
+    // act
+    size_t fired_before = process_until(TEST_START_MS + timeout_ms - 1);
+    size_t fired_after = process_until(TEST_START_MS + timeout_ms);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, fired_before);
+    ASSERT_ARE_EQUAL(size_t, 1, fired_after);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[0].fired_count);
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[0].timer));
+}
+
+
+BEGIN_TEST_SUITE(iothub_client_timer_wheel_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    reset_test_data();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_001: [ `timer_wheel_init` shall initialize all the slots of `timer_wheel` as empty. ]
+TEST_FUNCTION(process_empty_wheel_fires_nothing)
+{
+    // arrange
+
+    // act
+    size_t result = process_until(TEST_START_MS + 100000);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_003: [ `timer_wheel_entry_init` shall save `on_expired` and `context` into `timer` and mark it as not armed. ]
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_009: [ `timer_wheel_is_armed` shall return true if `timer` is armed and false otherwise. ]
+TEST_FUNCTION(entry_init_not_armed)
+{
+    // arrange
+    TIMER_WHEEL_ENTRY timer;
+
+    // act
+    timer_wheel_entry_init(&timer, on_test_timer_expired, &test_timers[0]);
+
+    // assert
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&timer));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)&test_timers[0], timer.context);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_004: [ If `timer_wheel`, `timer` or the callback of `timer` are NULL, `timer_wheel_start` shall fail and return a non-zero value. ]
+TEST_FUNCTION(start_NULL_timer_wheel_fails)
+{
+    // arrange
+
+    // act
+    int result = timer_wheel_start(NULL, &test_timers[0].timer, TEST_START_MS, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[0].timer));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_004: [ If `timer_wheel`, `timer` or the callback of `timer` are NULL, `timer_wheel_start` shall fail and return a non-zero value. ]
+TEST_FUNCTION(start_NULL_timer_fails)
+{
+    // arrange
+
+    // act
+    int result = timer_wheel_start(&test_wheel, NULL, TEST_START_MS, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_004: [ If `timer_wheel`, `timer` or the callback of `timer` are NULL, `timer_wheel_start` shall fail and return a non-zero value. ]
+TEST_FUNCTION(start_NULL_callback_fails)
+{
+    // arrange
+    TIMER_WHEEL_ENTRY timer;
+    timer_wheel_entry_init(&timer, NULL, NULL);
+
+    // act
+    int result = timer_wheel_start(&test_wheel, &timer, TEST_START_MS, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&timer));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_006: [ `timer_wheel_start` shall arm `timer` to expire at `now_ms` + `timeout_ms` and return 0. ]
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_012: [ `timer_wheel_process` shall return the number of callbacks invoked. ]
+TEST_FUNCTION(start_short_timeout_fires_on_expiry)
+{
+    verify_timer_fires_at(10);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+TEST_FUNCTION(start_second_level_timeout_fires_on_expiry)
+{
+    verify_timer_fires_at(5000);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+TEST_FUNCTION(start_last_level_timeout_fires_on_expiry)
+{
+    verify_timer_fires_at(3600000);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+TEST_FUNCTION(start_timeout_beyond_wheel_range_fires_on_expiry)
+{
+    verify_timer_fires_at(((tickcounter_ms_t)1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) + 12345);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+TEST_FUNCTION(start_zero_timeout_fires_on_next_process)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 0));
+
+    // act
+    size_t result = process_until(TEST_START_MS);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, result);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[0].fired_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_010: [ `timer_wheel_process` shall invoke the callback of every armed timer whose expiration time is less than or equal to `now_ms`, once. ]
+TEST_FUNCTION(process_late_fires_all_expired_timers_once)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 1));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 100));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[2].timer, TEST_START_MS, 70000));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[3].timer, TEST_START_MS, 70001));
+
+    // act
+    size_t result1 = process_until(TEST_START_MS + 70000);
+    size_t result2 = process_until(TEST_START_MS + 80000);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, result1);
+    ASSERT_ARE_EQUAL(size_t, 1, result2);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[0].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[1].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[2].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[3].fired_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_005: [ If `timer` is already armed, `timer_wheel_start` shall remove it from the wheel before re-arming it. ]
+TEST_FUNCTION(start_armed_timer_reschedules)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 10));
+
+    // act
+    int result = timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 2000);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, process_until(TEST_START_MS + 1999));
+    ASSERT_ARE_EQUAL(size_t, 1, process_until(TEST_START_MS + 2000));
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[0].fired_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_007: [ If `timer` is armed, `timer_wheel_cancel` shall remove it from `timer_wheel` so its callback is never invoked. ]
+TEST_FUNCTION(cancel_armed_timer_never_fires)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 10));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 10));
+
+    // act
+    timer_wheel_cancel(&test_wheel, &test_timers[0].timer);
+
+    // assert
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[0].timer));
+    ASSERT_ARE_EQUAL(size_t, 1, process_until(TEST_START_MS + 100));
+    ASSERT_ARE_EQUAL(size_t, 0, test_timers[0].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[1].fired_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_008: [ If `timer` is not armed, `timer_wheel_cancel` shall do nothing. ]
+TEST_FUNCTION(cancel_not_armed_timer_succeeds)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 10));
+
+    // act
+    timer_wheel_cancel(&test_wheel, &test_timers[0].timer);
+
+    // assert
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[0].timer));
+    ASSERT_IS_TRUE(timer_wheel_is_armed(&test_timers[1].timer));
+    ASSERT_ARE_EQUAL(size_t, 1, process_until(TEST_START_MS + 10));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_011: [ A timer shall be disarmed before its callback is invoked, callbacks may start or cancel any timer of `timer_wheel`. ]
+TEST_FUNCTION(callback_cancels_timer_expiring_in_same_batch)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 10));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 10));
+    test_timers[0].cancel_on_fire = &test_timers[1].timer;
+    test_timers[1].cancel_on_fire = &test_timers[0].timer;
+
+    // act
+    size_t result = process_until(TEST_START_MS + 10);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, result);
+    ASSERT_ARE_EQUAL(size_t, 1, test_timers[0].fired_count + test_timers[1].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 0, process_until(TEST_START_MS + 1000));
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_011: [ A timer shall be disarmed before its callback is invoked, callbacks may start or cancel any timer of `timer_wheel`. ]
+TEST_FUNCTION(callback_restarts_own_timer)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 10));
+    test_timers[0].restart_timeout_ms = 50;
+
+    // act
+    size_t result1 = process_until(TEST_START_MS + 10);
+    size_t result2 = process_until(TEST_START_MS + 59);
+    size_t result3 = process_until(TEST_START_MS + 60);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, result1);
+    ASSERT_ARE_EQUAL(size_t, 0, result2);
+    ASSERT_ARE_EQUAL(size_t, 1, result3);
+    ASSERT_ARE_EQUAL(size_t, 2, test_timers[0].fired_count);
+    ASSERT_ARE_EQUAL(uint64_t, (uint64_t)(TEST_START_MS + 60), (uint64_t)test_timers[0].fired_at);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_002: [ `timer_wheel_deinit` shall disarm all the timers still in `timer_wheel` without invoking their callbacks. ]
+TEST_FUNCTION(deinit_disarms_all_timers)
+{
+    // arrange
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 10));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 100000));
+
+    // act
+    timer_wheel_deinit(&test_wheel);
+
+    // assert
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[0].timer));
+    ASSERT_IS_FALSE(timer_wheel_is_armed(&test_timers[1].timer));
+    ASSERT_ARE_EQUAL(size_t, 0, test_timers[0].fired_count);
+    ASSERT_ARE_EQUAL(size_t, 0, test_timers[1].fired_count);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_013: [ If `timer_wheel` or `due_ms` is NULL, or no timer is armed, `timer_wheel_get_next_due` shall return false. ]
+TEST_FUNCTION(get_next_due_with_no_armed_timer_returns_false)
+{
+    // arrange
+    tickcounter_ms_t due_ms;
+
+    // act
+    bool result1 = timer_wheel_get_next_due(&test_wheel, &due_ms);
+    bool result2 = timer_wheel_get_next_due(NULL, &due_ms);
+    bool result3 = timer_wheel_get_next_due(&test_wheel, NULL);
+
+    // assert
+    ASSERT_IS_FALSE(result1);
+    ASSERT_IS_FALSE(result2);
+    ASSERT_IS_FALSE(result3);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_014: [ Otherwise `timer_wheel_get_next_due` shall set `due_ms` to a time no later than the expiration of the earliest armed timer and return true; it is the time of the first occupied level 0 slot, or the time of the next cascade if there is none before it. ]
+TEST_FUNCTION(get_next_due_returns_the_earliest_level_0_timer)
+{
+    // arrange
+    tickcounter_ms_t due_ms;
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 20));
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[1].timer, TEST_START_MS, 5));
+
+    // act
+    bool result = timer_wheel_get_next_due(&test_wheel, &due_ms);
+
+    // assert
+    ASSERT_IS_TRUE(result);
+    ASSERT_ARE_EQUAL(uint64_t, (uint64_t)(TEST_START_MS + 5), (uint64_t)due_ms);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_WHEEL_10_014: [ Otherwise `timer_wheel_get_next_due` shall set `due_ms` to a time no later than the expiration of the earliest armed timer and return true; it is the time of the first occupied level 0 slot, or the time of the next cascade if there is none before it. ]
+TEST_FUNCTION(get_next_due_never_passes_a_far_timer)
+{
+    // arrange
+    tickcounter_ms_t due_ms;
+    size_t fired = 0;
+    ASSERT_ARE_EQUAL(int, 0, timer_wheel_start(&test_wheel, &test_timers[0].timer, TEST_START_MS, 5000));
+
+    // act
+    while (fired == 0)
+    {
+        ASSERT_IS_TRUE(timer_wheel_get_next_due(&test_wheel, &due_ms));
+        ASSERT_IS_TRUE(due_ms <= TEST_START_MS + 5000);
+        fired = process_until(due_ms);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(uint64_t, (uint64_t)(TEST_START_MS + 5000), (uint64_t)test_timers[0].fired_at);
+    ASSERT_IS_FALSE(timer_wheel_get_next_due(&test_wheel, &due_ms));
+}
+
+END_TEST_SUITE(iothub_client_timer_wheel_ut)
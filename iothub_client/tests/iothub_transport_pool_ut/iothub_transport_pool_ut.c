@@ -0,0 +1,697 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/lock.h"
+#include "iothub_transport_ll.h"
+#undef ENABLE_MOCKS
+
+#include "iothub_transport_pool.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+TEST_DEFINE_ENUM_TYPE(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
+IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_RESULT_VALUES);
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+// Data definitions
+
+#define TEST_TRANSPORT_COUNT    3
+
+static const char* TEST_IOTHUB_NAME = "iothubname";
+static const char* TEST_IOTHUB_SUFFIX = "suffix";
+static size_t g_transports_created;
+
+static const TRANSPORT_PROVIDER* TEST_PROTOCOL(void)
+{
+    return NULL;
+}
+
+static TRANSPORT_HANDLE test_transport(size_t index)
+{
+    return (TRANSPORT_HANDLE)(uintptr_t)(0x4240 + index);
+}
+
+static TRANSPORT_HANDLE my_IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iotHubName, const char* iotHubSuffix)
+{
+    (void)protocol;
+    (void)iotHubName;
+    (void)iotHubSuffix;
+    return test_transport(g_transports_created++);
+}
+
+static LOCK_HANDLE my_Lock_Init(void)
+{
+    return (LOCK_HANDLE)my_gballoc_malloc(1);
+}
+
+static LOCK_RESULT my_Lock_Deinit(LOCK_HANDLE handle)
+{
+    my_gballoc_free(handle);
+    return LOCK_OK;
+}
+
+static TRANSPORT_POOL_HANDLE create_pool(void)
+{
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_TRANSPORT_COUNT);
+    umock_c_reset_all_calls();
+    return result;
+}
+
+
+BEGIN_TEST_SUITE(iothub_transport_pool_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(TRANSPORT_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(TRANSPORT_LL_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_TRANSPORT_PROVIDER, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Init, my_Lock_Init);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(Lock_Deinit, my_Lock_Deinit);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubTransport_Create, my_IoTHubTransport_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubTransport_Create, NULL);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    g_transports_created = 0;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_001: [ If protocol, iotHubName or iotHubSuffix is NULL, or transportCount is 0, IoTHubTransportPool_Create shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_Create_with_NULL_protocol_fails)
+{
+    // act
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(NULL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_TRANSPORT_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_001: [ If protocol, iotHubName or iotHubSuffix is NULL, or transportCount is 0, IoTHubTransportPool_Create shall fail and return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_Create_with_zero_transports_fails)
+{
+    // act
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, 0);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_002: [ IoTHubTransportPool_Create shall allocate the pool and its transportCount entries, and create the pool lock by calling Lock_Init. ]
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_003: [ IoTHubTransportPool_Create shall create transportCount shared transports by calling IoTHubTransport_Create, each starting with no device and marked as connected. ]
+TEST_FUNCTION(IoTHubTransportPool_Create_succeeds)
+{
+    // arrange
+    size_t index;
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        STRICT_EXPECTED_CALL(IoTHubTransport_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX));
+    }
+
+    // act
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_TRANSPORT_COUNT);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(result);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_004: [ If any allocation, Lock_Init or IoTHubTransport_Create fails, IoTHubTransportPool_Create shall release everything it created and return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_Create_fails_when_a_transport_is_not_created)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(IoTHubTransport_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX));
+    STRICT_EXPECTED_CALL(IoTHubTransport_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(IoTHubTransport_Destroy(test_transport(0)));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_TRANSPORT_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_004: [ If any allocation, Lock_Init or IoTHubTransport_Create fails, IoTHubTransportPool_Create shall release everything it created and return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_Create_fails_when_Lock_Init_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    TRANSPORT_POOL_HANDLE result = IoTHubTransportPool_Create(TEST_PROTOCOL, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_TRANSPORT_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_005: [ If transportPool is NULL, IoTHubTransportPool_Destroy shall do nothing. ]
+TEST_FUNCTION(IoTHubTransportPool_Destroy_NULL_does_nothing)
+{
+    // act
+    IoTHubTransportPool_Destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_006: [ IoTHubTransportPool_Destroy shall destroy every transport by calling IoTHubTransport_Destroy, then release the lock and the memory of the pool. ]
+TEST_FUNCTION(IoTHubTransportPool_Destroy_destroys_every_transport)
+{
+    // arrange
+    size_t index;
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        STRICT_EXPECTED_CALL(IoTHubTransport_Destroy(test_transport(index)));
+    }
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    // act
+    IoTHubTransportPool_Destroy(pool);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_007: [ If transportPool is NULL, IoTHubTransportPool_GetTransport shall return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_GetTransport_NULL_pool_fails)
+{
+    // act
+    TRANSPORT_HANDLE result = IoTHubTransportPool_GetTransport(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_008: [ IoTHubTransportPool_GetTransport shall return, under the pool lock, the transport with the fewest devices among the connected ones, or among all of them if none is connected. ]
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_009: [ IoTHubTransportPool_GetTransport shall count one more device on the returned transport. ]
+TEST_FUNCTION(IoTHubTransportPool_GetTransport_spreads_devices_evenly)
+{
+    // arrange
+    size_t index;
+    size_t counts[TEST_TRANSPORT_COUNT] = { 0 };
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    for (index = 0; index < 2 * TEST_TRANSPORT_COUNT; index++)
+    {
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    }
+
+    // act
+    for (index = 0; index < 2 * TEST_TRANSPORT_COUNT; index++)
+    {
+        TRANSPORT_HANDLE transport = IoTHubTransportPool_GetTransport(pool);
+        ASSERT_IS_NOT_NULL(transport);
+        counts[(uintptr_t)transport - (uintptr_t)test_transport(0)]++;
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(size_t, 2, counts[index]);
+    }
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_008: [ IoTHubTransportPool_GetTransport shall return, under the pool lock, the transport with the fewest devices among the connected ones, or among all of them if none is connected. ]
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_016: [ IoTHubTransportPool_SetConnectionStatus shall mark transportHandle as connected if connectionStatus is IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, and as disconnected if reason is IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR or IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED, and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportPool_GetTransport_skips_a_disconnected_transport)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_NO_NETWORK));
+    umock_c_reset_all_calls();
+
+    // act
+    TRANSPORT_HANDLE first = IoTHubTransportPool_GetTransport(pool);
+    TRANSPORT_HANDLE second = IoTHubTransportPool_GetTransport(pool);
+    TRANSPORT_HANDLE third = IoTHubTransportPool_GetTransport(pool);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(1), first);
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(2), second);
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(1), third);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_008: [ IoTHubTransportPool_GetTransport shall return, under the pool lock, the transport with the fewest devices among the connected ones, or among all of them if none is connected. ]
+TEST_FUNCTION(IoTHubTransportPool_GetTransport_returns_the_least_loaded_when_none_is_connected)
+{
+    // arrange
+    size_t index;
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    (void)IoTHubTransportPool_GetTransport(pool);
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        (void)IoTHubTransportPool_SetConnectionStatus(pool, test_transport(index), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    TRANSPORT_HANDLE result = IoTHubTransportPool_GetTransport(pool);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(1), result);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_010: [ If Lock fails, IoTHubTransportPool_GetTransport shall return NULL. ]
+TEST_FUNCTION(IoTHubTransportPool_GetTransport_Lock_fails)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    // act
+    TRANSPORT_HANDLE result = IoTHubTransportPool_GetTransport(pool);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_011: [ If transportPool or transportHandle is NULL, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_ReleaseTransport_NULL_args_fail)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransportPool_ReleaseTransport(NULL, test_transport(0));
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransportPool_ReleaseTransport(pool, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_012: [ IoTHubTransportPool_ReleaseTransport shall count one less device on transportHandle and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportPool_ReleaseTransport_makes_the_transport_least_loaded_again)
+{
+    // arrange
+    size_t index;
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        (void)IoTHubTransportPool_GetTransport(pool);
+    }
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_ReleaseTransport(pool, test_transport(2));
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(2), IoTHubTransportPool_GetTransport(pool));
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_013: [ If transportHandle does not belong to the pool or has no device, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_ReleaseTransport_unused_transport_fails)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransportPool_ReleaseTransport(pool, test_transport(0));
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransportPool_ReleaseTransport(pool, test_transport(TEST_TRANSPORT_COUNT));
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_014: [ If Lock fails, IoTHubTransportPool_ReleaseTransport shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportPool_ReleaseTransport_Lock_fails)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_ReleaseTransport(pool, test_transport(0));
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_015: [ If transportPool or transportHandle is NULL, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_SetConnectionStatus_NULL_args_fail)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransportPool_SetConnectionStatus(NULL, test_transport(0), IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransportPool_SetConnectionStatus(pool, NULL, IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_016: [ IoTHubTransportPool_SetConnectionStatus shall mark transportHandle as connected if connectionStatus is IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, and as disconnected if reason is IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR or IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED, and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportPool_SetConnectionStatus_authenticated_hands_the_transport_out_again)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    (void)IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(0), IoTHubTransportPool_GetTransport(pool));
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_017: [ If transportHandle does not belong to the pool, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_SetConnectionStatus_unknown_transport_fails)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_SetConnectionStatus(pool, test_transport(TEST_TRANSPORT_COUNT), IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_018: [ If Lock fails, IoTHubTransportPool_SetConnectionStatus shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportPool_SetConnectionStatus_Lock_fails)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_024: [ Any other reason is about the device reporting it (an expired SAS token, a disabled device, bad credentials), not the shared connection, and shall leave the status of transportHandle unchanged. ]
+TEST_FUNCTION(IoTHubTransportPool_SetConnectionStatus_device_level_reason_keeps_the_transport_connected)
+{
+    // arrange
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(0), IoTHubTransportPool_GetTransport(pool));
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_019: [ If transportPool, failedTransport or newTransports is NULL, or deviceCount is 0, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_RelocateDevices_NULL_args_fail)
+{
+    // arrange
+    TRANSPORT_HANDLE newTransports[1];
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransportPool_RelocateDevices(NULL, test_transport(0), newTransports, 1);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransportPool_RelocateDevices(pool, NULL, newTransports, 1);
+    IOTHUB_CLIENT_RESULT result3 = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), NULL, 1);
+    IOTHUB_CLIENT_RESULT result4 = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 0);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result4);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_020: [ If failedTransport does not belong to the pool or has fewer than deviceCount devices, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportPool_RelocateDevices_more_devices_than_the_transport_has_fails)
+{
+    // arrange
+    TRANSPORT_HANDLE newTransports[2];
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    (void)IoTHubTransportPool_GetTransport(pool);
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 2);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransportPool_RelocateDevices(pool, test_transport(TEST_TRANSPORT_COUNT), newTransports, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_021: [ If Lock fails, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportPool_RelocateDevices_Lock_fails)
+{
+    // arrange
+    TRANSPORT_HANDLE newTransports[1];
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    (void)IoTHubTransportPool_GetTransport(pool);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .SetReturn(LOCK_ERROR);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_022: [ IoTHubTransportPool_RelocateDevices shall, under the pool lock, move deviceCount devices one by one from failedTransport to the connected transport with the fewest devices, store in newTransports[i] the transport of the i-th device and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransportPool_RelocateDevices_spreads_the_devices_over_the_connected_transports)
+{
+    // arrange
+    size_t index;
+    TRANSPORT_HANDLE newTransports[3];
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    for (index = 0; index < 2 * TEST_TRANSPORT_COUNT; index++)
+    {
+        (void)IoTHubTransportPool_GetTransport(pool);
+    }
+    (void)IoTHubTransportPool_ReleaseTransport(pool, test_transport(1));
+    (void)IoTHubTransportPool_SetConnectionStatus(pool, test_transport(0), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 2);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(1), newTransports[0]);
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(1), newTransports[1]);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 1));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubTransportPool_RelocateDevices(pool, test_transport(1), newTransports, 3));
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(2), newTransports[0]);
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(2), newTransports[1]);
+    ASSERT_ARE_EQUAL(void_ptr, test_transport(2), newTransports[2]);
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_TRANSPORT_POOL_10_023: [ If no other transport of the pool is connected, IoTHubTransportPool_RelocateDevices shall return IOTHUB_CLIENT_ERROR and count nothing differently. ]
+TEST_FUNCTION(IoTHubTransportPool_RelocateDevices_without_another_connected_transport_fails)
+{
+    // arrange
+    size_t index;
+    TRANSPORT_HANDLE newTransports[1];
+    TRANSPORT_POOL_HANDLE pool = create_pool();
+    (void)IoTHubTransportPool_GetTransport(pool);
+    for (index = 0; index < TEST_TRANSPORT_COUNT; index++)
+    {
+        (void)IoTHubTransportPool_SetConnectionStatus(pool, test_transport(index), IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED);
+    }
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportPool_RelocateDevices(pool, test_transport(0), newTransports, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubTransportPool_ReleaseTransport(pool, test_transport(0)));
+
+    // cleanup
+    IoTHubTransportPool_Destroy(pool);
+}
+
+END_TEST_SUITE(iothub_transport_pool_ut)
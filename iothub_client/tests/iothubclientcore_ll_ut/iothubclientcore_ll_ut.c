@@ -47,6 +47,7 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 #include "iothub_message.h"
 #include "internal/iothub_client_authorization.h"
 #include "internal/iothub_client_diagnostic.h"
+#include "internal/iothub_client_slab.h"
 
 #undef ENABLE_MOCKS
 
@@ -61,6 +62,10 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 #include "internal/iothub_client_ll_uploadtoblob.h"
 #endif
 
+#ifdef USE_STORE_AND_FORWARD
+#include "internal/iothub_client_store_and_forward.h"
+#endif
+
 MOCKABLE_FUNCTION(, void, test_event_confirmation_callback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result, void*, userContextCallback);
 MOCKABLE_FUNCTION(, IOTHUBMESSAGE_DISPOSITION_RESULT, test_message_callback_async, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
 MOCKABLE_FUNCTION(, void, iothub_reported_state_callback, int, status_code, void*, userContextCallback);
@@ -90,6 +95,7 @@ MOCKABLE_FUNCTION(, void, connectionStatusCallback, IOTHUB_CLIENT_CONNECTION_STA
 MOCKABLE_FUNCTION(, IOTHUBMESSAGE_DISPOSITION_RESULT, messageCallback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
 MOCKABLE_FUNCTION(, bool, messageCallbackEx, MESSAGE_CALLBACK_INFO*, messageData, void*, userContextCallback);
 MOCKABLE_FUNCTION(, void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback);
+MOCKABLE_FUNCTION(, void, test_send_queue_watermark_callback, IOTHUB_CLIENT_SEND_QUEUE_WATERMARK, watermark, size_t, queuedMessages, size_t, queuedBytes, void*, userContextCallback);
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_DeviceMethod_Response, IOTHUB_DEVICE_HANDLE, handle, METHOD_HANDLE, methodId, const unsigned char*, response, size_t, resp_size, int, status_response);
 
 #undef ENABLE_MOCKS
@@ -168,6 +174,10 @@ static const char* TEST_STRING_VALUE = "Test string value";
 
 #define TEST_METHOD_ID                      (METHOD_HANDLE)0x61
 #define TEST_IOTHUB_AUTH_HANDLE        (IOTHUB_AUTHORIZATION_HANDLE)0x62
+#define TEST_SLAB_ALLOCATOR_HANDLE     (SLAB_ALLOCATOR_HANDLE)0x63
+#ifdef USE_STORE_AND_FORWARD
+#define TEST_STORE_AND_FORWARD_HANDLE  (STORE_AND_FORWARD_HANDLE)0x64
+#endif
 
 static const char* TEST_PROV_URI = "global.azure-devices-provisioning.net";
 
@@ -253,6 +263,28 @@ static IOTHUB_AUTHORIZATION_HANDLE my_IoTHubClient_Auth_CreateFromDeviceAuth(con
     return (IOTHUB_AUTHORIZATION_HANDLE)my_gballoc_malloc(1);
 }
 
+static void* my_slab_allocator_alloc(SLAB_ALLOCATOR_HANDLE slab_allocator)
+{
+    (void)slab_allocator;
+    return my_gballoc_malloc(sizeof(IOTHUB_MESSAGE_LIST));
+}
+
+static void my_slab_allocator_free(SLAB_ALLOCATOR_HANDLE slab_allocator, void* item)
+{
+    (void)slab_allocator;
+    my_gballoc_free(item);
+}
+
+static const unsigned char TEST_MESSAGE_BYTES[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 };
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const unsigned char** buffer, size_t* size)
+{
+    (void)iotHubMessageHandle;
+    *buffer = TEST_MESSAGE_BYTES;
+    *size = sizeof(TEST_MESSAGE_BYTES);
+    return IOTHUB_MESSAGE_OK;
+}
+
 static STRING_HANDLE my_STRING_new(void)
 {
     return (STRING_HANDLE)my_gballoc_malloc(1);
@@ -373,12 +405,14 @@ static void my_IoTHubClient_LL_UploadToBlob_Destroy(IOTHUB_CLIENT_LL_UPLOADTOBLO
 }
 #endif
 
+static PDLIST_ENTRY g_waitingToSend;
+
 static IOTHUB_DEVICE_HANDLE my_FAKE_IoTHubTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, PDLIST_ENTRY waitingToSend)
 {
     (void)handle;
     (void)device;
     (void)iotHubClientHandle;
-    (void)waitingToSend;
+    g_waitingToSend = waitingToSend;
     return (IOTHUB_DEVICE_HANDLE)my_gballoc_malloc(1);
 }
 
@@ -542,6 +576,12 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(STRING_TOKENIZER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(SLAB_ALLOCATOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_PRIORITY, int);
+#ifdef USE_STORE_AND_FORWARD
+    REGISTER_UMOCK_ALIAS_TYPE(STORE_AND_FORWARD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(STORE_AND_FORWARD_ON_PENDING_MESSAGE, void*);
+#endif
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(PDLIST_ENTRY, void*);
@@ -564,6 +604,9 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RETRY_POLICY, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_SEND_QUEUE_WATERMARK, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
 
 #ifndef DONT_USE_UPLOADTOBLOB
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE, void*);
@@ -614,10 +657,27 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromString, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Clone, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Clone, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentType, IOTHUBMESSAGE_BYTEARRAY);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetByteArray, my_IoTHubMessage_GetByteArray);
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_Diagnostic_AddIfNecessary, 0);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Diagnostic_AddIfNecessary, 100);
 
+    REGISTER_GLOBAL_MOCK_RETURN(slab_allocator_create, TEST_SLAB_ALLOCATOR_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(slab_allocator_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(slab_allocator_alloc, my_slab_allocator_alloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(slab_allocator_alloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(slab_allocator_free, my_slab_allocator_free);
+
+#ifdef USE_STORE_AND_FORWARD
+    REGISTER_GLOBAL_MOCK_RETURN(store_and_forward_create, TEST_STORE_AND_FORWARD_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(store_and_forward_create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(store_and_forward_save, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(store_and_forward_save, __LINE__);
+    REGISTER_GLOBAL_MOCK_RETURN(store_and_forward_get_pending, 0);
+    REGISTER_GLOBAL_MOCK_RETURN(store_and_forward_flush, 0);
+#endif
+
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClient_Auth_CreateFromDeviceAuth, my_IoTHubClient_Auth_CreateFromDeviceAuth);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Auth_CreateFromDeviceAuth, NULL);
 
@@ -739,6 +799,7 @@ static void setup_IoTHubClientCore_LL_create_mocks(bool use_device_config)
         STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Register(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetRetryPolicy(IGNORED_PTR_ARG, TEST_RETRY_POLICY, 0));
 }
@@ -1328,6 +1389,8 @@ TEST_FUNCTION(IoTHubClientCore_LL_CreateWithTransport_Succeeds)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Register(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetRetryPolicy(IGNORED_PTR_ARG, TEST_RETRY_POLICY, 0));
 
@@ -1556,6 +1619,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_CreateWithTransport_register_fails_shared_tran
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Register(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .SetReturn(NULL);
 
@@ -1609,6 +1673,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_CreateWithTransport_set_retry_policy_fails_sha
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Register(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetRetryPolicy(IGNORED_PTR_ARG, TEST_RETRY_POLICY, 0))
         .SetReturn(IOTHUB_CLIENT_ERROR);
@@ -1778,6 +1843,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_succeeds)
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
@@ -1856,6 +1922,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &thisIsNotZero); /*this forces _SendEventAsync to query the currentTime. If that fails, _SendEvent should fail as well*/
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
 
@@ -1877,7 +1944,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_snapshot();
 
     // act
-    size_t calls_cannot_fail[] = { 4 };
+    size_t calls_cannot_fail[] = { 0, 5 };
     size_t count = umock_c_negative_tests_call_count();
     for (size_t index = 0; index < count; index++)
     {
@@ -1903,6 +1970,303 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_deinit();
 }
 
+/*Tests_SRS_IoTHubClientCore_LL_10_039: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall validate its arguments and fail the same way IoTHubClientCore_LL_SendEventAsync does.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(NULL, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_039: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall validate its arguments and fail the same way IoTHubClientCore_LL_SendEventAsync does.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_messageHandle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, NULL, test_event_confirmation_callback, (void*)3);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_040: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_succeeds_without_cloning)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_040: [IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add to the DLIST waitingToSend a new record holding eventMessageHandle itself, without cloning it.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_Destroy_after_SendEventAsync_TakeOwnership_destroys_the_adopted_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG));
+#endif
+
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_041: [If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, the ownership of eventMessageHandle shall remain with the caller.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_diagnostic_fails_does_not_destroy_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE))
+        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_071: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, eventMessageCount is 0, any of the messages is NULL, or eventConfirmationCallback is NULL and userContextCallback is not. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[2] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(NULL, messages, 2, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_071: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, eventMessageCount is 0, any of the messages is NULL, or eventConfirmationCallback is NULL and userContextCallback is not. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_invalid_messages_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_HANDLE messages[2] = { TEST_MESSAGE_HANDLE, NULL };
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClientCore_LL_SendEventBatchAsync(handle, NULL, 2, test_event_confirmation_callback, (void*)3);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 0, test_event_confirmation_callback, (void*)3);
+    IOTHUB_CLIENT_RESULT result3 = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, test_event_confirmation_callback, (void*)3);
+    IOTHUB_CLIENT_RESULT result4 = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 1, NULL, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result3);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result4);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_073: [ IoTHubClientCore_LL_SendEventBatchAsync shall queue a clone of every message, in order, as IoTHubClientCore_LL_SendEventAsync does, all completing into a single batch record. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_queues_every_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_HANDLE messages[2] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    size_t index;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    for (index = 0; index < 2; index++)
+    {
+        STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_074: [ Once every message of the batch was completed, eventConfirmationCallback shall be invoked once, with IOTHUB_CLIENT_CONFIRMATION_OK if all of them were confirmed, otherwise with the result of the first message that was not. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_Destroy_after_SendEventBatchAsync_calls_the_batch_callback_once)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_HANDLE messages[2] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    (void)IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG));
+#endif
+
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_075: [ If queuing a message fails, IoTHubClientCore_LL_SendEventBatchAsync shall remove the messages of the batch already queued, so none of them is sent, return the error and not invoke eventConfirmationCallback for this batch. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_clone_fails_unqueues_the_batch)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_HANDLE messages[3] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 3, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(void_ptr, g_waitingToSend, g_waitingToSend->Flink);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_072: [ Without eventConfirmationCallback, IoTHubClientCore_LL_SendEventBatchAsync shall queue the messages the same way, and no callback shall be invoked for the batch. ]*/
+/*Tests_SRS_IoTHubClientCore_LL_10_075: [ If queuing a message fails, IoTHubClientCore_LL_SendEventBatchAsync shall remove the messages of the batch already queued, so none of them is sent, return the error and not invoke eventConfirmationCallback for this batch. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_without_callback_clone_fails_unqueues_the_batch)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_HANDLE messages[2] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, NULL, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(void_ptr, g_waitingToSend, g_waitingToSend->Flink);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_25_111: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_NULL_iotHubClientHandle_fails)
 {
@@ -3138,16 +3502,77 @@ TEST_FUNCTION(IoTHubClientCore_LL_GetSendStatus_HasEventToSend_Succeeds)
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_02_034: [If iotHubClientHandle is NULL then IoTHubClientCore_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SetOption_with_NULL_handle_fails)
+/*** IoTHubClientCore_LL_GetTimeUntilNextDue ***/
+
+/* Tests_SRS_IOTHUBCLIENT_LL_10_076: [ If `iotHubClientHandle` or `msUntilDue` is NULL, `IoTHubClientCore_LL_GetTimeUntilNextDue` shall return `IOTHUB_CLIENT_INVALID_ARG`. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetTimeUntilNextDue_with_NULL_handle_fails)
 {
-    //arrange
+    // arrange
+    size_t ms_until_due;
+    umock_c_reset_all_calls();
 
-    //act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(NULL, "a", "b");
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetTimeUntilNextDue(NULL, &ms_until_due);
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_LL_10_077: [ If no timer is pending, `IoTHubClientCore_LL_GetTimeUntilNextDue` shall return `IOTHUB_CLIENT_INDEFINITE_TIME`. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetTimeUntilNextDue_without_pending_timers_returns_INDEFINITE_TIME)
+{
+    // arrange
+    size_t ms_until_due;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetTimeUntilNextDue(handle, &ms_until_due);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_LL_10_078: [ Otherwise `IoTHubClientCore_LL_GetTimeUntilNextDue` shall set `msUntilDue` to the milliseconds left before `IoTHubClientCore_LL_DoWork` has to run for the earliest pending timer, 0 if it is already due, and return `IOTHUB_CLIENT_OK`. ] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetTimeUntilNextDue_with_a_message_timeout_pending_succeeds)
+{
+    // arrange
+    tickcounter_ms_t message_timeout = 5000;
+    size_t ms_until_due = (size_t)message_timeout + 1;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &message_timeout);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetTimeUntilNextDue(handle, &ms_until_due);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_IS_TRUE(ms_until_due <= message_timeout);
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_02_034: [If iotHubClientHandle is NULL then IoTHubClientCore_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_with_NULL_handle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(NULL, "a", "b");
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
 
     ///cleanup
 }
@@ -3586,6 +4011,56 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_2_messages_with_timeouts_at_11_and_1
     IoTHubClientCore_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IoTHubClientCore_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+/*Tests_SRS_IoTHubClientCore_LL_10_079: [ The messages of the lowest priority shall be inspected only up to the first one that has not timed out, unless a message of that priority was queued behind one that times out later. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_times_out_a_message_queued_behind_one_that_times_out_later)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t five = 5;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &five);
+
+    /*the first message times out at 15, the second one (queued behind it after the timeout was lowered) at 11*/
+    tickcounter_ms_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    tickcounter_ms_t one = 1;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &one);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)(TEST_DEVICEMESSAGE_HANDLE_2));
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t twelve = 12;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)) /*this is removing the second item from waitingToSend*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_039: [ "messageTimeout" - once IoTHubClientCore_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a tickcounter_ms_t. ]*/
 /*Tests_SRS_IoTHubClientCore_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
 /*Tests_SRS_IoTHubClientCore_LL_02_044: [ Messages already delivered to IoTHubClientCore_LL shall not have their timeouts modified by a new call to IoTHubClientCore_LL_SetOption. ]*/
@@ -5014,5 +5489,730 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_diag_sampling_percentage_fails)
     IoTHubClientCore_LL_Destroy(h);
 }
 
+/*Tests_SRS_IoTHubClientCore_LL_10_043: [ If the value of "message_record_pool_size" is not 0, IoTHubClientCore_LL_SetOption shall create a slab allocator of IOTHUB_MESSAGE_LIST records growing by that many records, and use it for all the messages sent afterwards. ]*/
+/*Tests_SRS_IoTHubClientCore_LL_10_046: [ "message_record_pool_size" shall also be passed to Transport_SetOption, so the transport can pool its own per-message records. If it fails, IoTHubClientCore_LL_SetOption shall keep the current allocator and return its result. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(slab_allocator_create(sizeof(IOTHUB_MESSAGE_LIST), poolSize));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize))
+        .IgnoreArgument_handle();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_046: [ "message_record_pool_size" shall also be passed to Transport_SetOption, so the transport can pool its own per-message records. If it fails, IoTHubClientCore_LL_SetOption shall keep the current allocator and return its result. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_fails_when_the_transport_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(slab_allocator_create(sizeof(IOTHUB_MESSAGE_LIST), poolSize));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize))
+        .IgnoreArgument_handle()
+        .SetReturn(IOTHUB_CLIENT_INVALID_ARG);
+    STRICT_EXPECTED_CALL(slab_allocator_destroy(TEST_SLAB_ALLOCATOR_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+    IOTHUB_CLIENT_RESULT sendResult = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, sendResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_044: [ If creating the slab allocator fails, IoTHubClientCore_LL_SetOption shall return `IOTHUB_CLIENT_ERROR` and keep the current allocator. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_fails_when_slab_allocator_create_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(slab_allocator_create(sizeof(IOTHUB_MESSAGE_LIST), poolSize))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_042: [ Calling IoTHubClientCore_LL_SetOption with "message_record_pool_size" while any message record is outstanding (waiting to be sent, in the transport, shed or spilled) shall return `IOTHUB_CLIENT_ERROR`. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_with_pending_messages_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_042: [ Calling IoTHubClientCore_LL_SetOption with "message_record_pool_size" while any message record is outstanding (waiting to be sent, in the transport, shed or spilled) shall return `IOTHUB_CLIENT_ERROR`. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_with_messages_in_the_transport_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    PDLIST_ENTRY inTransport;
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    inTransport = DList_RemoveHeadList(g_waitingToSend); /*the transport took the record, waitingToSend is empty*/
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    DList_InsertTailList(g_waitingToSend, inTransport);
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_045: [ Any previous slab allocator shall be destroyed, a value of 0 shall make IoTHubClientCore_LL allocate every record with malloc. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_record_pool_size_0_destroys_the_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+    poolSize = 0;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(slab_allocator_destroy(TEST_SLAB_ALLOCATOR_HANDLE));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+    IOTHUB_CLIENT_RESULT sendResult = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, sendResult);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_043: [ If the value of "message_record_pool_size" is not 0, IoTHubClientCore_LL_SetOption shall create a slab allocator of IOTHUB_MESSAGE_LIST records growing by that many records, and use it for all the messages sent afterwards. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_with_message_record_pool_allocates_from_the_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(slab_allocator_alloc(TEST_SLAB_ALLOCATOR_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_043: [ If the value of "message_record_pool_size" is not 0, IoTHubClientCore_LL_SetOption shall create a slab allocator of IOTHUB_MESSAGE_LIST records growing by that many records, and use it for all the messages sent afterwards. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_message_record_pool_returns_the_records_to_the_pool)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t poolSize = 32;
+    DLIST_ENTRY temp;
+    IOTHUB_MESSAGE_LIST* one;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_MESSAGE_RECORD_POOL_SIZE, &poolSize);
+    DList_InitializeListHead(&temp);
+    one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->callback = eventConfirmationCallback;
+    one->context = (void*)1;
+    DList_InsertTailList(&temp, &(one->entry));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+    STRICT_EXPECTED_CALL(slab_allocator_free(TEST_SLAB_ALLOCATOR_HANDLE, one));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClientCore_LL_SendComplete(h, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_048: [ If the send queue is at OPTION_SEND_QUEUE_MAX_MESSAGES messages or the message does not fit in OPTION_SEND_QUEUE_MAX_BYTES, and the shed policy is IOTHUB_CLIENT_SEND_QUEUE_REJECT, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_QUEUE_FULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_with_full_send_queue_returns_QUEUE_FULL)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxMessages = 1;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_MESSAGES, &maxMessages);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_047: [ "send_queue_max_messages", "send_queue_max_bytes", "send_queue_high_watermark" and "send_queue_low_watermark" shall be handled by IoTHubClientCore_LL, the value is a size_t* and 0 disables the corresponding limit. They apply to the messages sent afterwards. ]*/
+/*Tests_SRS_IoTHubClientCore_LL_10_048: [ If the send queue is at OPTION_SEND_QUEUE_MAX_MESSAGES messages or the message does not fit in OPTION_SEND_QUEUE_MAX_BYTES, and the shed policy is IOTHUB_CLIENT_SEND_QUEUE_REJECT, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_QUEUE_FULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_over_send_queue_max_bytes_returns_QUEUE_FULL)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxBytes = sizeof(TEST_MESSAGE_BYTES) + 1;
+    IOTHUB_CLIENT_RESULT optionResult = IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_BYTES, &maxBytes);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, optionResult);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_052: [ If the shed policy is IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST and the message does not fit, IoTHubClientCore_LL_SendEventAsync shall drop the message and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_with_full_send_queue_and_DROP_NEWEST_drops_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxMessages = 1;
+    IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY policy = IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_MESSAGES, &maxMessages);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_SHED_POLICY, &policy);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_049: [ If the shed policy is IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST, IoTHubClientCore_LL_SendEventAsync shall drop the oldest messages of waitingToSend until the new message fits. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_with_full_send_queue_and_DROP_OLDEST_drops_the_oldest_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxMessages = 1;
+    IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY policy = IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_MESSAGES, &maxMessages);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_SHED_POLICY, &policy);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)0x44));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_070: [ IoTHubClientCore_LL_SendEventAsync shall insert the message in waitingToSend after the messages of the same or a higher priority and before the messages of a lower priority, so the transports send the higher priorities first. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_queues_high_priority_messages_ahead_of_normal_ones)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_NORMAL);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_CRITICAL);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_NORMAL);
+
+    //act
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)4);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)5);
+
+    //assert
+    {
+        void* expectedOrder[] = { (void*)3, (void*)2, (void*)4, (void*)1, (void*)5 };
+        PDLIST_ENTRY current = g_waitingToSend->Flink;
+        size_t index;
+        for (index = 0; index < sizeof(expectedOrder) / sizeof(expectedOrder[0]); index++)
+        {
+            ASSERT_ARE_NOT_EQUAL(void_ptr, g_waitingToSend, current);
+            ASSERT_ARE_EQUAL(void_ptr, expectedOrder[index], containingRecord(current, IOTHUB_MESSAGE_LIST, entry)->context);
+            current = current->Flink;
+        }
+        ASSERT_ARE_EQUAL(void_ptr, g_waitingToSend, current);
+    }
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_069: [ Messages of a higher priority than the message being sent shall not be dropped to make room for it, the oldest messages of the lowest priority shall be dropped first. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_with_DROP_OLDEST_does_not_drop_higher_priority_messages)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxMessages = 1;
+    IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY policy = IOTHUB_CLIENT_SEND_QUEUE_DROP_OLDEST;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_MESSAGES, &maxMessages);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_SHED_POLICY, &policy);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_NORMAL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_051: [ The callbacks of the dropped messages shall be invoked with IOTHUB_CLIENT_CONFIRMATION_ERROR from the next call to IoTHubClientCore_LL_DoWork or from IoTHubClientCore_LL_Destroy. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_Destroy_completes_dropped_messages_with_ERROR)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t maxMessages = 1;
+    IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY policy = IOTHUB_CLIENT_SEND_QUEUE_DROP_NEWEST;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_MAX_MESSAGES, &maxMessages);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_SHED_POLICY, &policy);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_ERROR, (void*)2));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG));
+#endif
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_Destroy(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_053: [ When the number of queued messages reaches the high watermark, the send queue watermark callback shall be invoked once with IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK from the next IoTHubClientCore_LL_DoWork. ]*/
+/*Tests_SRS_IoTHubClientCore_LL_10_057: [ IoTHubClientCore_LL_SetSendQueueWatermarkCallback shall save watermarkCallback and userContextCallback and return IOTHUB_CLIENT_OK, a NULL watermarkCallback stops the notifications. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_reaching_the_high_watermark_calls_the_watermark_callback_from_DoWork)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t highWatermark = 2;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_HIGH_WATERMARK, &highWatermark);
+    IOTHUB_CLIENT_RESULT callbackResult = IoTHubClientCore_LL_SetSendQueueWatermarkCallback(h, test_send_queue_watermark_callback, (void*)3);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_send_queue_watermark_callback(IOTHUB_CLIENT_SEND_QUEUE_HIGH_WATERMARK, 3, 0, (void*)3));
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+    IoTHubClientCore_LL_DoWork(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, callbackResult);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_054: [ Once the high watermark has been reached, when the number of queued messages drops to the low watermark or below, the send queue watermark callback shall be invoked once with IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK from the next IoTHubClientCore_LL_DoWork. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_reaching_the_low_watermark_calls_the_watermark_callback_from_DoWork)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t highWatermark = 1;
+    DLIST_ENTRY temp;
+    IOTHUB_MESSAGE_LIST* one;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_HIGH_WATERMARK, &highWatermark);
+    (void)IoTHubClientCore_LL_SetSendQueueWatermarkCallback(h, test_send_queue_watermark_callback, (void*)3);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    IoTHubClientCore_LL_DoWork(h); /*reports the high watermark*/
+    DList_InitializeListHead(&temp);
+    one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is what the transport hands back for the message sent above*/
+    one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->callback = eventConfirmationCallback;
+    one->context = (void*)1;
+    one->message_size = 0;
+    DList_InsertTailList(&temp, &(one->entry));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy((IOTHUB_MESSAGE_HANDLE)1));
+    STRICT_EXPECTED_CALL(gballoc_free(one));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(test_send_queue_watermark_callback(IOTHUB_CLIENT_SEND_QUEUE_LOW_WATERMARK, 0, 0, (void*)3));
+
+    //act
+    IoTHubClientCore_LL_SendComplete(h, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+    IoTHubClientCore_LL_DoWork(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_081: [ If the number of queued messages crosses a watermark and crosses back before IoTHubClientCore_LL_DoWork runs, the send queue watermark callback shall not be invoked. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_does_not_call_the_watermark_callback_when_the_queue_crossed_back)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t highWatermark = 1;
+    DLIST_ENTRY temp;
+    IOTHUB_MESSAGE_LIST* one;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_HIGH_WATERMARK, &highWatermark);
+    (void)IoTHubClientCore_LL_SetSendQueueWatermarkCallback(h, test_send_queue_watermark_callback, (void*)3);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    DList_InitializeListHead(&temp);
+    one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is what the transport hands back for the message sent above*/
+    one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->callback = eventConfirmationCallback;
+    one->context = (void*)1;
+    one->message_size = 0;
+    DList_InsertTailList(&temp, &(one->entry));
+    IoTHubClientCore_LL_SendComplete(h, &temp, IOTHUB_CLIENT_CONFIRMATION_OK);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, h))
+        .IgnoreArgument(1);
+
+    //act
+    IoTHubClientCore_LL_DoWork(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_080: [ If the high watermark is not 0 and the low watermark would be greater than the high watermark, IoTHubClientCore_LL_SetOption shall fail, keep both watermarks and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_send_queue_low_watermark_greater_than_the_high_watermark_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t highWatermark = 2;
+    size_t lowWatermark = 3;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_HIGH_WATERMARK, &highWatermark);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_LOW_WATERMARK, &lowWatermark);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_080: [ If the high watermark is not 0 and the low watermark would be greater than the high watermark, IoTHubClientCore_LL_SetOption shall fail, keep both watermarks and return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_send_queue_high_watermark_lower_than_the_low_watermark_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t lowWatermark = 3;
+    size_t highWatermark = 2;
+    IOTHUB_CLIENT_RESULT lowResult = IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_LOW_WATERMARK, &lowWatermark);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_HIGH_WATERMARK, &highWatermark);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, lowResult);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_055: [ If "send_queue_shed_policy" is not a valid IOTHUB_CLIENT_SEND_QUEUE_SHED_POLICY, IoTHubClientCore_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_send_queue_shed_policy_with_invalid_value_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    int policy = 42;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_SEND_QUEUE_SHED_POLICY, &policy);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_056: [ IoTHubClientCore_LL_SetSendQueueWatermarkCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetSendQueueWatermarkCallback_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetSendQueueWatermarkCallback(NULL, test_send_queue_watermark_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+
+#ifndef USE_STORE_AND_FORWARD
+/*Tests_SRS_IoTHubClientCore_LL_10_058: [ "store_and_forward_path", "store_and_forward_segment_size" and "store_and_forward_sync_batch" shall be handled by IoTHubClientCore_LL, and fail with IOTHUB_CLIENT_ERROR when the SDK is built without use_store_and_forward. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_store_and_forward_path_fails_without_use_store_and_forward)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_PATH, "/var/lib/iothub");
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+#else
+/*Tests_SRS_IoTHubClientCore_LL_10_061: [ "store_and_forward_path" shall open the store in that directory with the current segment size and sync batch, an empty string closes the current store. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_store_and_forward_path_opens_the_store)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    size_t segmentSize = 65536;
+    size_t syncBatch = 8;
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_SEGMENT_SIZE, &segmentSize);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_SYNC_BATCH, &syncBatch);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(store_and_forward_create("/var/lib/iothub", segmentSize, syncBatch));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(store_and_forward_get_pending(TEST_STORE_AND_FORWARD_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_PATH, "/var/lib/iothub");
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_060: [ Calling IoTHubClientCore_LL_SetOption with "store_and_forward_path" while messages are pending shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_store_and_forward_path_with_pending_messages_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_PATH, "/var/lib/iothub");
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_064: [ If persisting the message fails, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails_when_persisting_the_message_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE h = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(h, OPTION_STORE_AND_FORWARD_PATH, "/var/lib/iothub");
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(store_and_forward_save(TEST_STORE_AND_FORWARD_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(__LINE__);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(h, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(h);
+}
+#endif /*USE_STORE_AND_FORWARD*/
 
 END_TEST_SUITE(iothubclientcore_ll_ut)
@@ -1420,6 +1420,180 @@ TEST_FUNCTION(IoTHubMessage_GetContentEncodingSystemProperty_Fails)
     IoTHubMessage_Destroy(h);
 }
 
+// Tests_SRS_IOTHUBMESSAGE_10_007: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY then IoTHubMessage_SetPriority shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+TEST_FUNCTION(IoTHubMessage_SetPriority_NULL_handle_Fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_007: [If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY then IoTHubMessage_SetPriority shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+TEST_FUNCTION(IoTHubMessage_SetPriority_invalid_priority_Fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, (IOTHUB_MESSAGE_PRIORITY)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)IoTHubMessage_GetPriority(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_008: [IoTHubMessage_SetPriority shall save priority and return IOTHUB_MESSAGE_OK.]
+// Tests_SRS_IOTHUBMESSAGE_10_010: [IoTHubMessage_GetPriority shall return the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL unless IoTHubMessage_SetPriority was called.]
+TEST_FUNCTION(IoTHubMessage_SetPriority_SUCCEED)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_PRIORITY before = IoTHubMessage_GetPriority(h);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_CRITICAL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)before);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_CRITICAL, (int)IoTHubMessage_GetPriority(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_009: [If iotHubMessageHandle is NULL then IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL.]
+TEST_FUNCTION(IoTHubMessage_GetPriority_NULL_handle_returns_NORMAL)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_NORMAL, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_011: [IoTHubMessage_Clone shall copy the priority of iotHubMessageHandle.]
+TEST_FUNCTION(IoTHubMessage_Clone_copies_the_priority)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NOT_NULL(r);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_PRIORITY_HIGH, (int)IoTHubMessage_GetPriority(r));
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_012: [If iotHubMessageHandle is NULL or delivery is not a valid IOTHUB_MESSAGE_DELIVERY then IoTHubMessage_SetDelivery shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+TEST_FUNCTION(IoTHubMessage_SetDelivery_NULL_handle_Fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetDelivery(NULL, IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_012: [If iotHubMessageHandle is NULL or delivery is not a valid IOTHUB_MESSAGE_DELIVERY then IoTHubMessage_SetDelivery shall return a IOTHUB_MESSAGE_INVALID_ARG value.]
+TEST_FUNCTION(IoTHubMessage_SetDelivery_invalid_delivery_Fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetDelivery(h, (IOTHUB_MESSAGE_DELIVERY)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_DELIVERY_DEFAULT, (int)IoTHubMessage_GetDelivery(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_013: [IoTHubMessage_SetDelivery shall save delivery and return IOTHUB_MESSAGE_OK.]
+// Tests_SRS_IOTHUBMESSAGE_10_015: [IoTHubMessage_GetDelivery shall return the delivery of the message, IOTHUB_MESSAGE_DELIVERY_DEFAULT unless IoTHubMessage_SetDelivery was called.]
+TEST_FUNCTION(IoTHubMessage_SetDelivery_SUCCEED)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_DELIVERY before = IoTHubMessage_GetDelivery(h);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetDelivery(h, IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_DELIVERY_DEFAULT, (int)before);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE, (int)IoTHubMessage_GetDelivery(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_014: [If iotHubMessageHandle is NULL then IoTHubMessage_GetDelivery shall return IOTHUB_MESSAGE_DELIVERY_DEFAULT.]
+TEST_FUNCTION(IoTHubMessage_GetDelivery_NULL_handle_returns_DEFAULT)
+{
+    //arrange
+
+    //act
+    IOTHUB_MESSAGE_DELIVERY result = IoTHubMessage_GetDelivery(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_DELIVERY_DEFAULT, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUBMESSAGE_10_016: [IoTHubMessage_Clone shall copy the delivery of iotHubMessageHandle.]
+TEST_FUNCTION(IoTHubMessage_Clone_copies_the_delivery)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_SetDelivery(h, IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NOT_NULL(r);
+    ASSERT_ARE_EQUAL(int, (int)IOTHUB_MESSAGE_DELIVERY_AT_MOST_ONCE, (int)IoTHubMessage_GetDelivery(r));
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
 // Tests_SRS_IOTHUBMESSAGE_10_001: [If any of the parameters are NULL then IoTHubMessage_GetDiagnosticPropertyData shall return a NULL value.] 
 TEST_FUNCTION(IoTHubMessage_GetDiagnosticPropertyData_NULL_handle_Fails)
 {
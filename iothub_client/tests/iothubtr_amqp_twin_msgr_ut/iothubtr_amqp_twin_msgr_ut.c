@@ -44,7 +44,7 @@ void real_free(void* ptr)
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/gballoc.h"
-#include "azure_c_shared_utility/agenttime.h" 
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/uniqueid.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
@@ -119,7 +119,8 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 #define TEST_MSG_ANNOTATIONS_AMQP_VALUE                      (AMQP_VALUE)0x4491
 #define TEST_PROPERTIES_HANDLE                               (PROPERTIES_HANDLE)0x4492
 
-#define INDEFINITE_TIME                                      ((time_t)-1)
+#define TEST_TICK_COUNTER_HANDLE                             (TICK_COUNTER_HANDLE)0x4493
+#define TEST_BASE_TIME_MS                                    ((tickcounter_ms_t)1234567)
 #define DEFAULT_TWIN_SEND_LINK_SOURCE_NAME                   "twin"
 #define DEFAULT_TWIN_RECEIVE_LINK_TARGET_NAME                "twin"
 
@@ -147,11 +148,11 @@ static const char* TWIN_OPERATION_DELETE = "DELETE";
 static const unsigned char* TWIN_REPORTED_PROPERTIES = (const unsigned char*)"{ \"reportedStateProperty0\": \"reportedStateProperty0\", \"reportedStateProperty1\": \"reportedStateProperty1\" }";
 static int TWIN_REPORTED_PROPERTIES_LENGTH = 117;
 
-static time_t g_initial_time;
-static time_t g_initial_time_plus_30_secs;
-static time_t g_initial_time_plus_60_secs;
-static time_t g_initial_time_plus_90_secs;
-static time_t g_initial_time_plus_300_secs;
+static tickcounter_ms_t g_initial_time;
+static tickcounter_ms_t g_initial_time_plus_30_secs;
+static tickcounter_ms_t g_initial_time_plus_60_secs;
+static tickcounter_ms_t g_initial_time_plus_90_secs;
+static tickcounter_ms_t g_initial_time_plus_300_secs;
 
 static CONSTBUFFER TEST_CONSTBUFFER;
 
@@ -274,22 +275,9 @@ extern "C"
 #endif
 
 
-static time_t add_seconds(time_t base_time, int seconds)
+static tickcounter_ms_t add_seconds(tickcounter_ms_t base_time, int seconds)
 {
-    time_t new_time;
-    struct tm *bd_new_time;
-
-    if ((bd_new_time = localtime(&base_time)) == NULL)
-    {
-        new_time = INDEFINITE_TIME;
-    }
-    else
-    {
-        bd_new_time->tm_sec += seconds;
-        new_time = mktime(bd_new_time);
-    }
-
-    return new_time;
+    return base_time + (tickcounter_ms_t)seconds * 1000;
 }
 
 // ---------- Callbacks ---------- //
@@ -366,7 +354,7 @@ static void TEST_on_report_state_complete_callback(TWIN_REPORT_STATE_RESULT resu
 
 typedef struct DOWORK_TEST_PROFILE_TAG
 {
-    time_t current_time;
+    tickcounter_ms_t current_time;
     TWIN_MESSENGER_STATE current_state;
     TWIN_SUBSCRIPTION_STATE subscription_state;
     size_t number_of_pending_patches;
@@ -431,6 +419,7 @@ static void set_expected_calls_for_twin_messenger_create(TWIN_MESSENGER_CONFIG*
         .CopyOutArgumentBuffer(1, &config->iothub_host_fqdn, sizeof(config->iothub_host_fqdn));
     STRICT_EXPECTED_CALL(singlylinkedlist_create());
     STRICT_EXPECTED_CALL(singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(tickcounter_create());
 
     set_create_link_attach_properties_expected_calls(config);
 
@@ -440,12 +429,12 @@ static void set_expected_calls_for_twin_messenger_create(TWIN_MESSENGER_CONFIG*
     set_destroy_link_attach_properties_expected_calls();
 }
 
-static void set_twin_messenger_report_state_async_expected_calls(CONSTBUFFER_HANDLE report, time_t current_time)
+static void set_twin_messenger_report_state_async_expected_calls(CONSTBUFFER_HANDLE report, tickcounter_ms_t current_time)
 {
     STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(report));
-    STRICT_EXPECTED_CALL(get_time(NULL))
-        .SetReturn(current_time);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
     STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 }
 
@@ -464,41 +453,27 @@ static void set_twin_messenger_retrieve_options_expected_calls()
     STRICT_EXPECTED_CALL(amqp_messenger_retrieve_options(TEST_AMQP_MESSENGER_HANDLE));
 }
 
-static void set_process_timeouts_expected_calls(time_t current_time, size_t number_of_pending_patches, size_t number_of_expired_pending_patches, size_t number_of_pending_operations, size_t number_of_expired_pending_operations)
+static void set_process_timeouts_expected_calls(tickcounter_ms_t current_time, size_t number_of_expired_pending_patches, size_t number_of_expired_pending_operations)
 {
     size_t i;
 
-    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
     STRICT_EXPECTED_CALL(singlylinkedlist_remove_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     for (i = 0; i < number_of_expired_pending_patches; i++)
     {
-        STRICT_EXPECTED_CALL(get_difftime(current_time, IGNORED_NUM_ARG)).SetReturn(10000000); // Simulate it's expired for sure.
         STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
     }
 
-    if (number_of_pending_patches > number_of_expired_pending_patches)
-    {
-        STRICT_EXPECTED_CALL(get_difftime(current_time, IGNORED_NUM_ARG)).SetReturn(0); // Simulate it's not expired.
-    }
-
-
     STRICT_EXPECTED_CALL(singlylinkedlist_remove_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     for (i = 0; i < number_of_expired_pending_operations; i++)
     {
-        STRICT_EXPECTED_CALL(get_difftime(current_time, IGNORED_NUM_ARG)).SetReturn(10000000); // Simulate it's expired for sure.
         STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG)); // correlation id
         STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
     }
-
-    if (number_of_pending_operations > number_of_expired_pending_operations)
-    {
-        STRICT_EXPECTED_CALL(get_difftime(current_time, IGNORED_NUM_ARG)).SetReturn(0); // Simulate it's not expired.
-    }
-
-
 }
 
 static void set_create_twin_operation_context_expected_calls()
@@ -592,10 +567,11 @@ static void set_create_amqp_message_for_twin_operation_expected_calls(TWIN_OPERA
     STRICT_EXPECTED_CALL(amqpvalue_destroy(IGNORED_PTR_ARG));
 }
 
-static void set_send_twin_operation_request_expected_calls(time_t current_time)
+static void set_send_twin_operation_request_expected_calls(tickcounter_ms_t current_time)
 {
     set_create_amqp_message_for_twin_operation_expected_calls(TWIN_OPERATION_TYPE_PATCH);
-    STRICT_EXPECTED_CALL(get_time(IGNORED_PTR_ARG)).SetReturn(current_time);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
     STRICT_EXPECTED_CALL(amqp_messenger_send_async(TEST_AMQP_MESSENGER_HANDLE, TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(message_destroy(IGNORED_PTR_ARG));
 }
@@ -622,7 +598,7 @@ static void set_twin_messenger_do_work_expected_calls(DOWORK_TEST_PROFILE* dwtp)
         }
     }
 
-    set_process_timeouts_expected_calls(dwtp->current_time, dwtp->number_of_pending_patches, dwtp->number_of_expired_pending_patches, dwtp->number_of_pending_operations, dwtp->number_of_expired_pending_operations);
+    set_process_timeouts_expected_calls(dwtp->current_time, dwtp->number_of_expired_pending_patches, dwtp->number_of_expired_pending_operations);
 
     STRICT_EXPECTED_CALL(amqp_messenger_do_work(TEST_AMQP_MESSENGER_HANDLE));
 }
@@ -649,7 +625,7 @@ static TWIN_MESSENGER_HANDLE create_twin_messenger(TWIN_MESSENGER_CONFIG* config
     return twin_messenger_create(config);
 }
 
-static void send_one_report_patch(TWIN_MESSENGER_HANDLE handle, time_t current_time)
+static void send_one_report_patch(TWIN_MESSENGER_HANDLE handle, tickcounter_ms_t current_time)
 {
     const unsigned char* buffer = (unsigned char*)TWIN_REPORTED_PROPERTIES;
     size_t size = TWIN_REPORTED_PROPERTIES_LENGTH;
@@ -735,7 +711,7 @@ static void register_global_mock_aliases()
     REGISTER_UMOCK_ALIAS_TYPE(pfCloneOption, void*);
     REGISTER_UMOCK_ALIAS_TYPE(pfDestroyOption, void*);
     REGISTER_UMOCK_ALIAS_TYPE(pfSetOption, void*);
-    REGISTER_UMOCK_ALIAS_TYPE(time_t, long long);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(MAP_FILTER_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(AMQP_MESSENGER_HANDLE, void*);
@@ -832,8 +808,12 @@ static void register_global_mock_returns()
     REGISTER_GLOBAL_MOCK_RETURN(UniqueId_Generate, UNIQUEID_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(UniqueId_Generate, UNIQUEID_ERROR);
 
-    // AgentTime
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(get_time, INDEFINITE_TIME);
+    // tickcounter
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_get_current_ms, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_get_current_ms, 1);
 }
 
 static void reset_test_data()
@@ -890,7 +870,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     register_global_mock_hooks();
     register_global_mock_returns();
 
-    g_initial_time = time(NULL);
+    g_initial_time = TEST_BASE_TIME_MS;
     g_initial_time_plus_30_secs = add_seconds(g_initial_time, 30);
     g_initial_time_plus_60_secs = add_seconds(g_initial_time, 60);
     g_initial_time_plus_90_secs = add_seconds(g_initial_time, 90);
@@ -963,6 +943,7 @@ TEST_FUNCTION(twin_msgr_create_NULL_device_id)
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_005: [twin_messenger_create() shall save a copy of `messenger_config` info into `twin_msgr`]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_007: [`twin_msgr->pending_patches` shall be set using singlylinkedlist_create()]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_009: [`twin_msgr->operations` shall be set using singlylinkedlist_create()]  
+// Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_109: [`twin_msgr->tick_counter` shall be set using tickcounter_create()]
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_011: [`twin_msgr->amqp_msgr` shall be set using amqp_messenger_create(), passing a AMQP_MESSENGER_CONFIG instance `amqp_msgr_config`]
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_012: [`amqp_msgr_config->client_version` shall be set with `twin_msgr->client_version`]
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_013: [`amqp_msgr_config->device_id` shall be set with `twin_msgr->device_id`]
@@ -1004,6 +985,7 @@ TEST_FUNCTION(twin_msgr_create_success)
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_006: [If any `messenger_config` info fails to be copied, twin_messenger_create() shall fail and return NULL]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_008: [If singlylinkedlist_create() fails, twin_messenger_create() shall fail and return NULL]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_010: [If singlylinkedlist_create() fails, twin_messenger_create() shall fail and return NULL]  
+// Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_110: [If tickcounter_create() fails, twin_messenger_create() shall fail and return NULL]
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_018: [If amqp_messenger_create() fails, twin_messenger_create() shall fail and return NULL]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_020: [If amqp_messenger_subscribe_for_messages() fails, twin_messenger_create() shall fail and return NULL] 
 TEST_FUNCTION(twin_msgr_create_failure_checks)
@@ -1021,7 +1003,7 @@ TEST_FUNCTION(twin_msgr_create_failure_checks)
     size_t i;
     for (i = 0; i < umock_c_negative_tests_call_count(); i++)
     {
-        if (i == 10 || i == 14 || i == 17)
+        if (i == 11 || i == 15 || i == 18)
         {
             // These expected calls do not cause the API to fail.
             continue;
@@ -1087,7 +1069,7 @@ TEST_FUNCTION(twin_msgr_report_state_async_NULL_data)
 
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_023: [twin_messenger_report_state_async() shall allocate memory for a TWIN_PATCH_OPERATION_CONTEXT structure (aka `twin_op_ctx`)]  
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_025: [`twin_op_ctx` shall have a copy of `data`]  
-// Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_027: [`twin_op_ctx->time_enqueued` shall be set using get_time]    
+// Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_027: [`twin_op_ctx->time_enqueued` shall be set using tickcounter_get_current_ms]    
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_029: [`twin_op_ctx` shall be added to `twin_msgr->pending_patches` using singlylinkedlist_add()]    
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_032: [If no failures occur, twin_messenger_report_state_async() shall return zero]  
 TEST_FUNCTION(twin_msgr_report_state_async_success)
@@ -1520,6 +1502,7 @@ TEST_FUNCTION(twin_msgr_do_work_not_started_with_EXPIRED_pending_patches_success
 
     DOWORK_TEST_PROFILE dwtp;
     reset_dowork_test_profile(&dwtp);
+    dwtp.current_time = g_initial_time_plus_300_secs;
     dwtp.number_of_pending_patches = 2;
     dwtp.number_of_expired_pending_patches = 2;
 
@@ -1592,6 +1575,37 @@ TEST_FUNCTION(twin_msgr_do_work_started_with_EXPIRED_in_progress_patches_success
     twin_messenger_destroy(handle);
 }
 
+// Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_080: [twin_messenger_do_work() shall remove and destroy any timed out items from `twin_msgr->pending_patches` and `twin_msgr->operations`]  
+TEST_FUNCTION(twin_msgr_do_work_not_started_times_out_only_the_pending_patches_that_are_due)
+{
+    // arrange
+    TWIN_MESSENGER_CONFIG* config = get_twin_messenger_config();
+    TWIN_MESSENGER_HANDLE handle = create_twin_messenger(config);
+
+    send_one_report_patch(handle, g_initial_time);
+    send_one_report_patch(handle, g_initial_time_plus_60_secs);
+
+    DOWORK_TEST_PROFILE dwtp;
+    reset_dowork_test_profile(&dwtp);
+    dwtp.current_time = g_initial_time_plus_300_secs;
+    dwtp.number_of_pending_patches = 2;
+    dwtp.number_of_expired_pending_patches = 1;
+
+    umock_c_reset_all_calls();
+    set_twin_messenger_do_work_expected_calls(&dwtp);
+
+    // act
+    twin_messenger_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, TEST_on_report_state_complete_callback_result_ERROR_count);
+    ASSERT_ARE_EQUAL(size_t, 1, TEST_on_report_state_complete_callback_reason_TIMEOUT_count);
+
+    // cleanup
+    twin_messenger_destroy(handle);
+}
+
 // Tests_IOTHUBTRANSPORT_AMQP_TWIN_MESSENGER_09_082: [If any failure occurs while verifying/removing timed-out items `twin_msgr->state` shall be set to TWIN_MESSENGER_STATE_ERROR and user informed]  
 
 
@@ -308,6 +308,30 @@ extern "C"
         return TEST_device_subscribe_message_return;
     }
 
+    static ON_DEVICE_D2C_EVENT_SEND_COMPLETE TEST_device_send_event_async_saved_callback;
+    static void* TEST_device_send_event_async_saved_context;
+    static IOTHUB_MESSAGE_LIST* TEST_device_send_event_async_saved_message;
+    static int TEST_device_send_event_async_return;
+    static int TEST_device_send_event_async(AMQP_DEVICE_HANDLE handle, IOTHUB_MESSAGE_LIST* message, ON_DEVICE_D2C_EVENT_SEND_COMPLETE on_device_d2c_event_send_complete_callback, void* context)
+    {
+        (void)handle;
+        TEST_device_send_event_async_saved_message = message;
+        TEST_device_send_event_async_saved_callback = on_device_d2c_event_send_complete_callback;
+        TEST_device_send_event_async_saved_context = context;
+        return TEST_device_send_event_async_return;
+    }
+
+    static PDLIST_ENTRY TEST_IoTHubClientCore_LL_SendComplete_saved_entry;
+    static IOTHUB_CLIENT_CONFIRMATION_RESULT TEST_IoTHubClientCore_LL_SendComplete_saved_result;
+    static size_t TEST_IoTHubClientCore_LL_SendComplete_calls;
+    static void TEST_IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+    {
+        (void)handle;
+        TEST_IoTHubClientCore_LL_SendComplete_saved_entry = completed->Flink;
+        TEST_IoTHubClientCore_LL_SendComplete_saved_result = result;
+        TEST_IoTHubClientCore_LL_SendComplete_calls++;
+    }
+
     static IOTHUB_CLIENT_RESULT TEST_IoTHubClientCore_LL_GetOption(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, const char* optionName, void** value)
     {
         (void)iotHubClientHandle;
@@ -1075,6 +1099,7 @@ static void register_umock_alias_types()
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_DISPOSITION_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUBTRANSPORT_AMQP_METHOD_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LIST_ACTION_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LIST_MATCH_FUNCTION, void*);
@@ -1142,9 +1167,11 @@ static void register_global_mock_hooks()
 
     REGISTER_GLOBAL_MOCK_HOOK(device_create, TEST_device_create);
     REGISTER_GLOBAL_MOCK_HOOK(device_subscribe_message, TEST_device_subscribe_message);
+    REGISTER_GLOBAL_MOCK_HOOK(device_send_event_async, TEST_device_send_event_async);
 
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_MessageCallback, TEST_IoTHubClientCore_LL_MessageCallback);
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_GetOption, TEST_IoTHubClientCore_LL_GetOption);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendComplete, TEST_IoTHubClientCore_LL_SendComplete);
     REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, TEST_mallocAndStrcpy_s);
 }
 
@@ -1221,6 +1248,14 @@ static void reset_test_data()
     TEST_device_subscribe_message_saved_context = NULL;
     TEST_device_subscribe_message_return = 0;
 
+    TEST_device_send_event_async_saved_callback = NULL;
+    TEST_device_send_event_async_saved_context = NULL;
+    TEST_device_send_event_async_saved_message = NULL;
+    TEST_device_send_event_async_return = 0;
+    TEST_IoTHubClientCore_LL_SendComplete_saved_entry = NULL;
+    TEST_IoTHubClientCore_LL_SendComplete_saved_result = IOTHUB_CLIENT_CONFIRMATION_OK;
+    TEST_IoTHubClientCore_LL_SendComplete_calls = 0;
+
     TEST_MESSAGE_ID = 1234;
     TEST_mallocAndStrcpy_s_return = 0;
 
@@ -2757,6 +2792,183 @@ TEST_FUNCTION(SetOption_device_specific_failure_check)
     destroy_transport(handle, device_handle, NULL);
 }
 
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_10_005: [If `option` is `message_record_pool_size`, IoTHubTransport_AMQP_Common_SetOption shall ignore it and return IOTHUB_CLIENT_OK.]
+TEST_FUNCTION(SetOption_message_record_pool_size_succeeds)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    size_t value = 32;
+
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_MESSAGE_RECORD_POOL_SIZE, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_10_006: [`message` shall be completed by calling IoTHubClientCore_LL_SendComplete with a list holding only `message` and `iothub_send_result`]
+TEST_FUNCTION(on_event_send_complete_with_message_record_pool_completes_through_IoTHubClientCore_LL_SendComplete)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    size_t pool_size = 32;
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_MESSAGE_RECORD_POOL_SIZE, &pool_size));
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    IOTHUB_MESSAGE_LIST message;
+    memset(&message, 0, sizeof(message));
+    message.messageHandle = TEST_IOTHUB_MESSAGE_HANDLE;
+    real_DList_InsertTailList(&TEST_waitingToSend, &message.entry);
+
+    umock_c_reset_all_calls();
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    ASSERT_IS_NOT_NULL(TEST_device_send_event_async_saved_callback);
+    ASSERT_ARE_EQUAL(void_ptr, &message, TEST_device_send_event_async_saved_message);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, &message.entry));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendComplete(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK));
+
+    // act
+    TEST_device_send_event_async_saved_callback(&message, D2C_EVENT_SEND_COMPLETE_RESULT_OK, TEST_device_send_event_async_saved_context);
+
+    // assert
+    // the pooled record is handed back to IoTHubClientCore_LL, neither it nor the message are freed by the transport
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &message.entry, TEST_IoTHubClientCore_LL_SendComplete_saved_entry);
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_049: [If device_send_event_async() fails, `on_event_send_complete` shall be invoked passing EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING and return]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_052: [If result is D2C_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING, `iothub_send_result` shall be set using IOTHUB_CLIENT_CONFIRMATION_ERROR]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_10_006: [`message` shall be completed by calling IoTHubClientCore_LL_SendComplete with a list holding only `message` and `iothub_send_result`]
+TEST_FUNCTION(DoWork_device_send_event_async_fails_completes_through_IoTHubClientCore_LL_SendComplete)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    IOTHUB_MESSAGE_LIST message;
+    memset(&message, 0, sizeof(message));
+    message.messageHandle = TEST_IOTHUB_MESSAGE_HANDLE;
+    real_DList_InsertTailList(&TEST_waitingToSend, &message.entry);
+
+    TEST_device_send_event_async_return = 1;
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    // IoTHubClientCore_LL_SendComplete takes the message off the send queue, so its counters and watermarks go back down
+    ASSERT_ARE_EQUAL(size_t, 1, TEST_IoTHubClientCore_LL_SendComplete_calls);
+    ASSERT_ARE_EQUAL(void_ptr, &message.entry, TEST_IoTHubClientCore_LL_SendComplete_saved_entry);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_ERROR, TEST_IoTHubClientCore_LL_SendComplete_saved_result);
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_053: [If result is D2C_EVENT_SEND_COMPLETE_RESULT_ERROR_TIMEOUT, `iothub_send_result` shall be set using IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_10_006: [`message` shall be completed by calling IoTHubClientCore_LL_SendComplete with a list holding only `message` and `iothub_send_result`]
+TEST_FUNCTION(on_event_send_complete_timeout_completes_through_IoTHubClientCore_LL_SendComplete)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    IOTHUB_MESSAGE_LIST message;
+    memset(&message, 0, sizeof(message));
+    message.messageHandle = TEST_IOTHUB_MESSAGE_HANDLE;
+    real_DList_InsertTailList(&TEST_waitingToSend, &message.entry);
+
+    umock_c_reset_all_calls();
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    ASSERT_IS_NOT_NULL(TEST_device_send_event_async_saved_callback);
+    ASSERT_ARE_EQUAL(size_t, 0, TEST_IoTHubClientCore_LL_SendComplete_calls);
+
+    // act
+    TEST_device_send_event_async_saved_callback(&message, D2C_EVENT_SEND_COMPLETE_RESULT_ERROR_TIMEOUT, TEST_device_send_event_async_saved_context);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, TEST_IoTHubClientCore_LL_SendComplete_calls);
+    ASSERT_ARE_EQUAL(void_ptr, &message.entry, TEST_IoTHubClientCore_LL_SendComplete_saved_entry);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, TEST_IoTHubClientCore_LL_SendComplete_saved_result);
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_054: [If result is D2C_EVENT_SEND_COMPLETE_RESULT_DEVICE_DESTROYED, `iothub_send_result` shall be set using IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_10_006: [`message` shall be completed by calling IoTHubClientCore_LL_SendComplete with a list holding only `message` and `iothub_send_result`]
+TEST_FUNCTION(on_event_send_complete_device_destroyed_completes_with_BECAUSE_DESTROY)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+
+    IOTHUB_MESSAGE_LIST message;
+    memset(&message, 0, sizeof(message));
+    message.messageHandle = TEST_IOTHUB_MESSAGE_HANDLE;
+    real_DList_InsertTailList(&TEST_waitingToSend, &message.entry);
+
+    umock_c_reset_all_calls();
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    ASSERT_IS_NOT_NULL(TEST_device_send_event_async_saved_callback);
+
+    // act
+    TEST_device_send_event_async_saved_callback(&message, D2C_EVENT_SEND_COMPLETE_RESULT_DEVICE_DESTROYED, TEST_device_send_event_async_saved_context);
+
+    // assert
+    // IoTHubClientCore_LL_SendComplete keeps journaled messages completed with BECAUSE_DESTROY and removes all the others from the store
+    ASSERT_ARE_EQUAL(size_t, 1, TEST_IoTHubClientCore_LL_SendComplete_calls);
+    ASSERT_ARE_EQUAL(void_ptr, &message.entry, TEST_IoTHubClientCore_LL_SendComplete_saved_entry);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, TEST_IoTHubClientCore_LL_SendComplete_saved_result);
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_02_007: [ If `option` is `x509certificate` and the transport preferred authentication method is not x509 then IoTHubTransport_AMQP_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
 TEST_FUNCTION(SetOption_CBS_transport_option_x509certificate)
 {
@@ -136,6 +136,8 @@ static void* threadFuncArg = NULL;
 static size_t g_num_of_calls = 0;
 static size_t g_how_many_dowork_calls = 0;
 static TRANSPORT_HANDLE g_transport_handle = NULL;
+static bool g_ready_queued1 = false;
+static bool g_ready_queued2 = false;
 
 static const TRANSPORT_PROVIDER* provideFAKE(void);
 
@@ -206,9 +208,11 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 }
 
 static size_t clientDoWork_calls = 0;
+static bool clientDoWork_saw_queued = false;
 static void clientDoWork(void* clientHandle)
 {
     (void)clientHandle;
+    clientDoWork_saw_queued = g_ready_queued1;
     clientDoWork_calls++;
 }
 
@@ -261,7 +265,7 @@ static void my_FAKE_IoTHubTransport_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CL
     (void)handle;
     if ((g_transport_handle != NULL) && (g_num_of_calls >= g_how_many_dowork_calls))
     {
-        (void)IoTHubTransport_SignalEndWorkerThread(g_transport_handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+        (void)IoTHubTransport_SignalEndWorkerThread(g_transport_handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
     }
     g_num_of_calls++;
 }
@@ -343,12 +347,14 @@ TEST_FUNCTION_INITIALIZE(method_init)
     umock_c_reset_all_calls();
 
     clientDoWork_calls = 0;
+    clientDoWork_saw_queued = false;
     threadFunc = NULL;
     threadFuncArg = NULL;
     g_num_of_calls = 0;
     g_how_many_dowork_calls = 0;
     g_transport_handle = NULL;
-
+    g_ready_queued1 = false;
+    g_ready_queued2 = false;
 }
 
 TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -377,6 +383,8 @@ static void setup_IoTHubTransport_Create(void)
     STRICT_EXPECTED_CALL(Lock_Init());
     STRICT_EXPECTED_CALL(Lock_Init());
     STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
 }
 
 TEST_FUNCTION(IoTHubTransport_Create_provider_NULL_fail)
@@ -447,6 +455,7 @@ TEST_FUNCTION(IoTHubTransport_Create_success)
 
 //Tests_SRS_IOTHUBTRANSPORT_17_009: [ IoTHubTransport_Create shall clean up any resources it creates if the function does not succeed. ]
 //Tests_SRS_IOTHUBTRANSPORT_17_039: [ If the Vector creation fails, IoTHubTransport_Create shall return NULL. ]
+//Tests_SRS_IOTHUBTRANSPORT_10_001: [ IoTHubTransport_Create shall create the ready set of clients, and the lock protecting it, by calling VECTOR_create and Lock_Init. ]
 TEST_FUNCTION(IoTHubTransport_Create_fails)
 {
     int negativeTestsInitResult = umock_c_negative_tests_init();
@@ -504,6 +513,8 @@ TEST_FUNCTION(IoTHubTransport_Destroy_success)
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
@@ -530,6 +541,8 @@ TEST_FUNCTION(IoTHubTransport_Destroy_worker_thread_success)
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
@@ -555,6 +568,8 @@ TEST_FUNCTION(IoTHubTransport_Destroy_fails)
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(TEST_TRANSPORT_LL_HANDLE));
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     //act
@@ -711,11 +726,13 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_success)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     //act
-    bool result = IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    bool result = IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
 
     //assert
     ASSERT_IS_TRUE(result);
@@ -737,18 +754,20 @@ TEST_FUNCTION(IoTHubTransport_SignalEndWorkerThread_2_clients_success)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_CORE_HANDLE1));
     STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     //act
-    bool result = IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    bool result = IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
 
     //assert
     ASSERT_IS_FALSE(result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
-    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2);
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, &g_ready_queued2);
     IoTHubTransport_Destroy(handle);
 }
 
@@ -805,16 +824,16 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
             STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+            STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
             STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         }
         STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
-        if (index != g_how_many_dowork_calls)
-        {
-            STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-        }
+        STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
     }
@@ -830,8 +849,175 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
-    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
-    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2);
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, &g_ready_queued2);
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_10_002: [ After the lower layer transport DoWork, the thread shall take the whole ready set and call the client DoWork once for each client in it. ]
+//Tests_SRS_IOTHUBTRANSPORT_10_005: [ Taking the ready set shall clear the queued flag of each client in it, so they can signal again while being visited. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_visits_a_ready_client_once)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    g_transport_handle = handle;
+    g_how_many_dowork_calls = 1;
+    umock_c_reset_all_calls();
+
+    // first pass visits the ready client
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+
+    // second pass finds the ready set empty
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(IGNORED_NUM_ARG));
+
+    //act
+    threadFunc(threadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, clientDoWork_calls);
+    ASSERT_IS_FALSE(clientDoWork_saw_queued);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_10_006: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandle from the ready set and leave its queued flag set, so later calls to IoTHubTransport_SignalClientReady for it do nothing. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_skips_a_ready_client_that_ended)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, clientDoWork);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, &g_ready_queued2);
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE2, &g_ready_queued2);
+    g_transport_handle = handle;
+    g_how_many_dowork_calls = 0;
+    umock_c_reset_all_calls();
+
+    //act
+    threadFunc(threadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, clientDoWork_calls);
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_10_006: [ IoTHubTransport_SignalEndWorkerThread shall remove clientHandle from the ready set and leave its queued flag set, so later calls to IoTHubTransport_SignalClientReady for it do nothing. ]
+TEST_FUNCTION(IoTHubTransport_SignalClientReady_after_SignalEndWorkerThread_does_nothing)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_CORE_HANDLE1));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, TEST_IOTHUB_CLIENT_CORE_HANDLE1));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+
+    //assert
+    ASSERT_IS_TRUE(g_ready_queued1);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_10_003: [ If transportHandle, clientHandle or readyQueued is NULL, IoTHubTransport_SignalClientReady shall do nothing. ]
+TEST_FUNCTION(IoTHubTransport_SignalClientReady_NULL_args_do_nothing)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransport_SignalClientReady(NULL, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    IoTHubTransport_SignalClientReady(handle, NULL, &g_ready_queued1);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_10_004: [ Unless readyQueued is already true, IoTHubTransport_SignalClientReady shall add clientHandle to the ready set and set readyQueued to true. ]
+TEST_FUNCTION(IoTHubTransport_SignalClientReady_adds_the_client_once)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+    IoTHubTransport_SignalClientReady(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, &g_ready_queued1);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
     IoTHubTransport_Destroy(handle);
 }
 
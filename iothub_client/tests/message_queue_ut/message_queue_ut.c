@@ -41,7 +41,7 @@ void real_free(void* ptr)
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/optionhandler.h"
-#include "azure_c_shared_utility/agenttime.h" 
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #undef ENABLE_MOCKS
 
@@ -62,7 +62,6 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 
 // Data definitions
 
-#define INDEFINITE_TIME                     ((time_t)-1)
 #define TEST_OPTIONHANDLER_HANDLE           (OPTIONHANDLER_HANDLE)0x7771
 #define TEST_PROCESS_MESSAGE_CONTEXT        (void*)0x7772
 #define TEST_PROCESS_COMPLETE_CONTEXT       (void*)0x7773
@@ -73,16 +72,16 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 #define TEST_LIST_ITEM_HANDLE               (LIST_ITEM_HANDLE)0x7779
 #define TEST_LIST_ITEM_VALUE                (void*)0x7780
 #define TEST_REASON                         (void*)0x7781
+#define TEST_TICK_COUNTER_HANDLE            (TICK_COUNTER_HANDLE)0x7782
+#define TEST_BASE_TIME_MS                   ((tickcounter_ms_t)1234567)
 
 
 static MQ_MESSAGE_HANDLE TEST_BASE_MQ_MESSAGE_HANDLE[10];
-static time_t TEST_current_time;
+static tickcounter_ms_t TEST_current_time;
 
 
 typedef struct TEST_MESSAGE_EXPIRATION_PROFILE_TAG
 {
-    double max_message_enqueued_time_secs;
-    double max_message_processing_time_secs;
     size_t* expired_pending_messages;
     size_t expired_pending_messages_size;
     size_t* expired_enqueued_in_progress_messages;
@@ -120,6 +119,13 @@ static void TEST_free(void* ptr)
 }
 
 
+static int TEST_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
+{
+    (void)tick_counter;
+    *current_ms = TEST_current_time;
+    return 0;
+}
+
 static unsigned int TEST_OptionHandler_AddOption_saved_value;
 static OPTIONHANDLER_RESULT TEST_OptionHandler_AddOption_result;
 static OPTIONHANDLER_RESULT TEST_OptionHandler_AddOption(OPTIONHANDLER_HANDLE handle, const char* name, const void* value)
@@ -148,24 +154,6 @@ extern "C"
 }
 #endif
 
-static time_t add_seconds(time_t base_time, int seconds)
-{
-    time_t new_time;
-    struct tm *bd_new_time;
-
-    if ((bd_new_time = localtime(&base_time)) == NULL)
-    {
-        new_time = INDEFINITE_TIME;
-    }
-    else
-    {
-        bd_new_time->tm_sec += seconds;
-        new_time = mktime(bd_new_time);
-    }
-
-    return new_time;
-}
-
 static MESSAGE_QUEUE_HANDLE TEST_on_process_message_callback_message_queue;
 static MQ_MESSAGE_HANDLE TEST_on_process_message_callback_message;
 static PROCESS_MESSAGE_COMPLETED_CALLBACK TEST_on_process_message_callback_on_process_message_completed_callback;
@@ -227,11 +215,11 @@ static void set_message_queue_create_expected_calls()
     STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(singlylinkedlist_create());
     STRICT_EXPECTED_CALL(singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(tickcounter_create());
 }
 
 static void set_dequeue_message_and_fire_callback_expected_calls()
 {
-    STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
 }
@@ -280,6 +268,7 @@ static void set_message_queue_remove_all_expected_calls(size_t number_of_message
 
     for (i = 0; i < number_of_messages_pending; i++)
     {
+        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
         set_dequeue_message_and_fire_callback_expected_calls();
         STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
     }
@@ -288,6 +277,7 @@ static void set_message_queue_remove_all_expected_calls(size_t number_of_message
 
     for (i = 0; i < number_of_messages_in_progress; i++)
     {
+        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
         set_dequeue_message_and_fire_callback_expected_calls();
         STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
     }
@@ -299,17 +289,19 @@ static void set_message_queue_destroy_expected_calls(size_t number_of_messages_p
 
     STRICT_EXPECTED_CALL(singlylinkedlist_destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(singlylinkedlist_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
 }
 
-static void set_message_queue_add_expected_calls(time_t current_time)
+static void set_message_queue_add_expected_calls(tickcounter_ms_t current_time)
 {
     STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
     STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 }
 
-static void add_messages(MESSAGE_QUEUE_HANDLE mq, size_t number_of_messages, time_t current_time)
+static void add_messages(MESSAGE_QUEUE_HANDLE mq, size_t number_of_messages, tickcounter_ms_t current_time)
 {
     size_t i;
     for (i = 0; i < number_of_messages; i++)
@@ -334,92 +326,31 @@ static MESSAGE_QUEUE_HANDLE create_message_queue(MESSAGE_QUEUE_CONFIG* config)
     return message_queue_create(config);
 }
 
-static void set_process_timeouts_expected_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time,
+static void set_process_timeouts_expected_calls(MESSAGE_QUEUE_HANDLE mq, tickcounter_ms_t current_time,
     size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
     TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile
     )
 {
-    (void)mq;
-    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
-
-    if (expiration_profile->max_message_enqueued_time_secs > 0)
-    {
-        size_t i, j;
-
-        // pending messages, max queued time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
-        for (i = 0, j = 0; i < number_of_messages_pending; i++)
-        {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_pending_messages_size && i == expiration_profile->expired_pending_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_enqueued_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                number_of_messages_pending--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-                break;
-            }
-        }
-
-        // in progress messages, max queued time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    size_t i;
+    size_t number_of_expired_messages = 
+        expiration_profile->expired_pending_messages_size + 
+        expiration_profile->expired_enqueued_in_progress_messages_size + 
+        expiration_profile->expired_in_progress_messages_size;
 
-        for (i = 0, j = 0; i < number_of_messages_in_progress; i++)
-        {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_enqueued_in_progress_messages_size && i == expiration_profile->expired_enqueued_in_progress_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_enqueued_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                //set_dequeue_message_and_fire_callback_expected_calls(number_of_messages_in_progress, expiration_profile->expired_enqueued_in_progress_messages[j] - i, false);
-                number_of_messages_in_progress--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-            }
-        }
-    }
+    (void)mq;
+    (void)number_of_messages_pending;
+    (void)number_of_messages_in_progress;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
 
-    if (expiration_profile->max_message_processing_time_secs > 0)
+    // Only the messages that timed out are visited, each through its own timer.
+    for (i = 0; i < number_of_expired_messages; i++)
     {
-        size_t i, j;
-
-        // in progress messages, max in progress time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
-        for (i = 0, j = 0; i < number_of_messages_in_progress; i++)
-        {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_in_progress_messages_size && i == expiration_profile->expired_in_progress_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_processing_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                number_of_messages_in_progress--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-                break;
-            }
-        }
+        set_dequeue_message_and_fire_callback_expected_calls();
     }
 }
 
-static void set_process_pending_messages_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time, size_t number_of_messages_pending)
+static void set_process_pending_messages_calls(MESSAGE_QUEUE_HANDLE mq, tickcounter_ms_t current_time, size_t number_of_messages_pending)
 {
     (void)mq;
     STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
@@ -430,14 +361,15 @@ static void set_process_pending_messages_calls(MESSAGE_QUEUE_HANDLE mq, time_t c
     {
         STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
         STRICT_EXPECTED_CALL(singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
+        STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(2, &current_time, sizeof(current_time));
         STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         
         STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
     }
 }
 
-static void set_message_queue_do_work_expected_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time, 
+static void set_message_queue_do_work_expected_calls(MESSAGE_QUEUE_HANDLE mq, tickcounter_ms_t current_time, 
     size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
     TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile)
 {
@@ -445,7 +377,7 @@ static void set_message_queue_do_work_expected_calls(MESSAGE_QUEUE_HANDLE mq, ti
     set_process_pending_messages_calls(mq, current_time, number_of_messages_pending);
 }
 
-static void crank_message_queue(MESSAGE_QUEUE_HANDLE mq, time_t current_time, 
+static void crank_message_queue(MESSAGE_QUEUE_HANDLE mq, tickcounter_ms_t current_time, 
     size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
     TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile)
 {
@@ -471,6 +403,27 @@ static void set_message_queue_is_empty_expected_calls(size_t number_of_messages_
     }
 }
 
+static void set_rearm_timeout_timers_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
+{
+    size_t i;
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    for (i = 0; i < number_of_messages_pending; i++)
+    {
+        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
+    }
+
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    for (i = 0; i < number_of_messages_in_progress; i++)
+    {
+        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
+    }
+}
+
 static void set_message_queue_retrieve_options_expected_calls()
 {
     STRICT_EXPECTED_CALL(OptionHandler_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -481,7 +434,7 @@ static void set_message_queue_retrieve_options_expected_calls()
 
 static void reset_test_data()
 {    
-    TEST_current_time = time(NULL);
+    TEST_current_time = TEST_BASE_TIME_MS;
 
     saved_malloc_returns_count = 0;
     memset(saved_malloc_returns, 0, sizeof(saved_malloc_returns));
@@ -509,13 +462,11 @@ static void reset_test_data()
     TEST_test_message_expiration_profile.expired_in_progress_messages_size = 0;
     TEST_test_message_expiration_profile.expired_pending_messages = NULL;
     TEST_test_message_expiration_profile.expired_pending_messages_size = 0;
-    TEST_test_message_expiration_profile.max_message_enqueued_time_secs = 0;
-    TEST_test_message_expiration_profile.max_message_processing_time_secs = 0;
 }
 
 static void register_umock_alias_types() 
 {
-    REGISTER_UMOCK_ALIAS_TYPE(time_t, long long);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(pfCloneOption, void*);
@@ -540,6 +491,7 @@ static void register_global_mock_hooks()
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_next_item, real_singlylinkedlist_get_next_item);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_find, real_singlylinkedlist_find);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_item_get_value, real_singlylinkedlist_item_get_value);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, TEST_tickcounter_get_current_ms);
 }
 
 static void register_global_mock_returns() 
@@ -565,7 +517,10 @@ static void register_global_mock_returns()
     REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_item_get_value, TEST_LIST_ITEM_VALUE);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_item_get_value, NULL);
 
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(get_time, INDEFINITE_TIME);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_get_current_ms, 1);
 }
 
 
@@ -674,6 +629,7 @@ TEST_FUNCTION(create_NULL_on_process_message_callback)
 // Tests_SRS_MESSAGE_QUEUE_09_005: [If `instance` cannot be allocated, message_queue_create shall fail and return NULL]
 // Tests_SRS_MESSAGE_QUEUE_09_007: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
 // Tests_SRS_MESSAGE_QUEUE_09_009: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
+// Tests_SRS_MESSAGE_QUEUE_09_072: [If tickcounter_create fails, message_queue_create shall fail and return NULL]
 // Tests_SRS_MESSAGE_QUEUE_09_011: [If any failures occur, message_queue_create shall release all memory it has allocated]
 TEST_FUNCTION(create_failure_checks)
 {
@@ -710,6 +666,7 @@ TEST_FUNCTION(create_failure_checks)
 // Tests_SRS_MESSAGE_QUEUE_09_004: [Memory shall be allocated for the MESSAGE_QUEUE data structure (aka `message_queue`)]
 // Tests_SRS_MESSAGE_QUEUE_09_006: [`message_queue->pending` shall be set using singlylinkedlist_create()]
 // Tests_SRS_MESSAGE_QUEUE_09_008: [`message_queue->in_progress` shall be set using singlylinkedlist_create()]
+// Tests_SRS_MESSAGE_QUEUE_09_071: [`message_queue->tick_counter` shall be set using tickcounter_create()]
 // Tests_SRS_MESSAGE_QUEUE_09_010: [All arguments in `config` shall be saved into `message_queue`]
 // Tests_SRS_MESSAGE_QUEUE_09_012: [If no failures occur, message_queue_create shall return the `message_queue` pointer]
 TEST_FUNCTION(create_success)
@@ -846,7 +803,7 @@ TEST_FUNCTION(add_NULL_message_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_017: [message_queue_add shall allocate a structure (aka `mq_item`) to save the `message`]
-// Tests_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using get_time()]
+// Tests_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using tickcounter_get_current_ms()]
 // Tests_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to `message_queue->pending` list]
 // Tests_SRS_MESSAGE_QUEUE_09_023: [`message` shall be saved into `mq_item->message`]
 // Tests_SRS_MESSAGE_QUEUE_09_025: [If no failures occur, message_queue_add shall return 0]
@@ -870,7 +827,7 @@ TEST_FUNCTION(add_success)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_018: [If `mq_item` cannot be allocated, message_queue_add shall fail and return non-zero]
-// Tests_SRS_MESSAGE_QUEUE_09_020: [If get_time fails, message_queue_add shall fail and return non-zero]
+// Tests_SRS_MESSAGE_QUEUE_09_020: [If tickcounter_get_current_ms fails, message_queue_add shall fail and return non-zero]
 // Tests_SRS_MESSAGE_QUEUE_09_022: [`mq_item` fails to be added to `message_queue->pending`, message_queue_add shall fail and return non-zero]
 // Tests_SRS_MESSAGE_QUEUE_09_024: [If any failures occur, message_queue_add shall release all memory it has allocated]
 TEST_FUNCTION(add_failure_checks)
@@ -1059,7 +1016,7 @@ TEST_FUNCTION(do_work_NULL_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_039: [Each `mq_item` in `message_queue->pending` shall be moved to `message_queue->in_progress`]
-// Tests_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using get_time()]
+// Tests_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using tickcounter_get_current_ms()]
 // Tests_SRS_MESSAGE_QUEUE_09_043: [If no failures occur, `message_queue->on_process_message_callback` shall be invoked passing `mq_item->message` and `on_process_message_completed_callback`]
 TEST_FUNCTION(do_work_NO_EXPIRATION_success)
 {
@@ -1084,7 +1041,7 @@ TEST_FUNCTION(do_work_NO_EXPIRATION_success)
     message_queue_destroy(mq);
 }
 
-// Tests_SRS_MESSAGE_QUEUE_09_041: [If get_time() fails, `mq_item` shall be removed from `message_queue->in_progress`]
+// Tests_SRS_MESSAGE_QUEUE_09_041: [If tickcounter_get_current_ms() fails, `mq_item` shall be removed from `message_queue->in_progress`]
 // Tests_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
 TEST_FUNCTION(do_work_NO_EXPIRATION_failure_checks)
 {
@@ -1197,6 +1154,7 @@ TEST_FUNCTION(message_queue_set_max_message_processing_time_secs_NULL_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_057: [`seconds` shall be saved into `message_queue->max_message_processing_time_secs`]
+// Tests_SRS_MESSAGE_QUEUE_09_073: [The timeout timers of the messages in `message_queue` shall be armed again for the new time limit]
 // Tests_SRS_MESSAGE_QUEUE_09_058: [If no failures occur, message_queue_set_max_message_processing_time_secs shall return 0]
 TEST_FUNCTION(message_queue_set_max_message_processing_time_secs_success)
 {
@@ -1204,6 +1162,7 @@ TEST_FUNCTION(message_queue_set_max_message_processing_time_secs_success)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
     umock_c_reset_all_calls();
+    set_rearm_timeout_timers_expected_calls(0, 0);
 
     // act
     int result = message_queue_set_max_message_processing_time_secs(mq, 60);
@@ -1233,6 +1192,7 @@ TEST_FUNCTION(message_queue_set_max_message_enqueued_time_secs_NULL_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_053: [`seconds` shall be saved into `message_queue->max_message_enqueued_time_secs`]
+// Tests_SRS_MESSAGE_QUEUE_09_073: [The timeout timers of the messages in `message_queue` shall be armed again for the new time limit]
 // Tests_SRS_MESSAGE_QUEUE_09_054: [If no failures occur, message_queue_set_max_message_enqueued_time_secs shall return 0]
 TEST_FUNCTION(message_queue_set_max_message_enqueued_time_secs_success)
 {
@@ -1240,6 +1200,7 @@ TEST_FUNCTION(message_queue_set_max_message_enqueued_time_secs_success)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
     umock_c_reset_all_calls();
+    set_rearm_timeout_timers_expected_calls(0, 0);
 
     // act
     int result = message_queue_set_max_message_enqueued_time_secs(mq, 60);
@@ -1489,11 +1450,9 @@ TEST_FUNCTION(do_work_pending_queue_timeout)
 
     add_messages(mq, 1, TEST_current_time);
 
-    time_t t1 = add_seconds(TEST_current_time, 10);
+    tickcounter_ms_t t1 = TEST_current_time + 10 * 1000;
 
     TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 10;
-    exp_prof.max_message_processing_time_secs = 0;
     size_t expired_pending_messages[] = { 0 };
     exp_prof.expired_pending_messages = expired_pending_messages;
     exp_prof.expired_pending_messages_size = 1;
@@ -1532,11 +1491,9 @@ TEST_FUNCTION(do_work_in_progress_processing_timeout)
 
     (void)message_queue_set_max_message_processing_time_secs(mq, 10);
 
-    time_t t1 = add_seconds(TEST_current_time, 10);
+    tickcounter_ms_t t1 = TEST_current_time + 10 * 1000;
 
     TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 0;
-    exp_prof.max_message_processing_time_secs = 10;
     exp_prof.expired_pending_messages = NULL;
     exp_prof.expired_pending_messages_size = 0;
     size_t expired_in_progress_messages[] = { 0 };
@@ -1575,11 +1532,9 @@ TEST_FUNCTION(do_work_in_progress_queue_timeout)
 
     (void)message_queue_set_max_message_enqueued_time_secs(mq, 10);
 
-    time_t t1 = add_seconds(TEST_current_time, 10);
+    tickcounter_ms_t t1 = TEST_current_time + 10 * 1000;
 
     TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 10;
-    exp_prof.max_message_processing_time_secs = 0;
     exp_prof.expired_pending_messages = NULL;
     exp_prof.expired_pending_messages_size = 0;
     exp_prof.expired_in_progress_messages = NULL;
@@ -1606,4 +1561,93 @@ TEST_FUNCTION(do_work_in_progress_queue_timeout)
     message_queue_destroy(mq);
 }
 
+// Tests_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
+// Tests_SRS_MESSAGE_QUEUE_09_070: [The timeout timer of `mq_item` shall be armed for the earliest of its enqueued and processing time limits]
+TEST_FUNCTION(do_work_times_out_only_the_messages_that_are_due)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+    (void)message_queue_set_max_message_enqueued_time_secs(mq, 10);
+
+    add_messages(mq, 1, TEST_current_time);
+
+    umock_c_reset_all_calls();
+    set_message_queue_add_expected_calls(TEST_current_time + 5 * 1000);
+    ASSERT_ARE_EQUAL(int, 0, message_queue_add(mq, TEST_BASE_MQ_MESSAGE_HANDLE[1], TEST_on_message_processing_completed_callback, TEST_USER_CONTEXT));
+
+    tickcounter_ms_t t1 = TEST_current_time + 10 * 1000;
+
+    size_t expired_pending_messages[] = { 0 };
+    TEST_test_message_expiration_profile.expired_pending_messages = expired_pending_messages;
+    TEST_test_message_expiration_profile.expired_pending_messages_size = 1;
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(mq, t1, 2, 0, &TEST_test_message_expiration_profile);
+    set_process_pending_messages_calls(mq, t1, 1);
+
+    // act
+    message_queue_do_work(mq);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_BASE_MQ_MESSAGE_HANDLE[0], (void*)TEST_on_message_processing_completed_callback_message);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_BASE_MQ_MESSAGE_HANDLE[1], (void*)TEST_on_process_message_callback_message);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
+// Tests_SRS_MESSAGE_QUEUE_09_037: [If `message_queue->max_message_processing_time_secs` is greater than zero, `message_queue->in_progress` items shall be checked for timeout]
+TEST_FUNCTION(do_work_does_not_apply_the_processing_timeout_to_a_message_sent_back_to_pending)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+    (void)message_queue_set_max_retry_count(mq, 1);
+    (void)message_queue_set_max_message_enqueued_time_secs(mq, 60);
+    (void)message_queue_set_max_message_processing_time_secs(mq, 10);
+
+    add_messages(mq, 1, TEST_current_time);
+    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    TEST_on_process_message_callback_on_process_message_completed_callback(mq, TEST_on_process_message_callback_message, MESSAGE_QUEUE_RETRYABLE_ERROR, NULL);
+
+    tickcounter_ms_t t1 = TEST_current_time + 10 * 1000;
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(mq, t1, 1, 0, &TEST_test_message_expiration_profile);
+    set_process_pending_messages_calls(mq, t1, 1);
+
+    // act
+    message_queue_do_work(mq);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+    ASSERT_ARE_EQUAL(int, 0, (int)TEST_on_message_processing_completed_callback_ERROR_result_count);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
+// Tests_SRS_MESSAGE_QUEUE_09_074: [If the timeout timers cannot be armed again, the function shall fail and return non-zero]
+TEST_FUNCTION(message_queue_set_max_message_enqueued_time_secs_tickcounter_fails)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG))
+        .SetReturn(1);
+
+    // act
+    int result = message_queue_set_max_message_enqueued_time_secs(mq, 60);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
 END_TEST_SUITE(message_queue_ut)
@@ -29,6 +29,7 @@
 #include "multitree.h"
 
 #include "azure_c_shared_utility/xlogging.h"
+#include "iothub_client_base64.h"
 
 #define NaN_STRING "NaN"
 #define MINUSINF_STRING "-INF"
@@ -86,34 +87,6 @@ static void NoFreeFunction(void* value)
 #define splitInt(intVal, bytePos)   (char)((intVal >> (bytePos << 3)) & 0xFF)
 #define joinChars(a, b, c, d) (uint32_t)( (uint32_t)a + ((uint32_t)b << 8) + ((uint32_t)c << 16) + ((uint32_t)d << 24))
 
-static char base64char(unsigned char val)
-{
-    char result;
-
-    if (val < 26)
-    {
-        result = 'A' + (char)val;
-    }
-    else if (val < 52)
-    {
-        result = 'a' + ((char)val - 26);
-    }
-    else if (val < 62)
-    {
-        result = '0' + ((char)val - 52);
-    }
-    else if (val == 62)
-    {
-        result = '-';
-    }
-    else
-    {
-        result = '_';
-    }
-
-    return result;
-}
-
 static char base64b16(unsigned char val)
 {
     const uint32_t base64b16values[4] = {
@@ -546,38 +519,6 @@ static int base64toValue(char base64charSource, unsigned char* value)
     return result;
 }
 
-/*returns 0 if everything went ok*/
-/*scans 4 base64 characters and returns 3 usual bytes*/
-static int scan4base64char(const char* source, size_t sourceSize, unsigned char *destination0, unsigned char* destination1, unsigned char* destination2)
-{
-    int result;
-    if (sourceSize < 4)
-    {
-        result = 1;
-    }
-    else
-    {
-        unsigned char b0, b1, b2, b3;
-        if (
-            (base64toValue(source[0], &b0) == 0) &&
-            (base64toValue(source[1], &b1) == 0) &&
-            (base64toValue(source[2], &b2) == 0) &&
-            (base64toValue(source[3], &b3) == 0)
-            )
-        {
-            *destination0 = (b0 << 2) | ((b1 & 0x30) >> 4);
-            *destination1 = ((b1 & 0x0F)<<4) | ((b2 & 0x3C) >>2 );
-            *destination2 = ((b2 & 0x03) << 6) | (b3);
-            result = 0;
-        }
-        else
-        {
-            result = 2;
-        }
-    }
-    return result;
-}
-
 /*return 0 if the character is one of ( 'A' / 'E' / 'I' / 'M' / 'Q' / 'U' / 'Y' / 'c' / 'g' / 'k' / 'o' / 's' / 'w' / '0' / '4' / '8' )*/
 static int base64b16toValue(unsigned char source, unsigned char* destination)
 {
@@ -2217,7 +2158,6 @@ AGENT_DATA_TYPES_RESULT AgentDataTypes_ToString(STRING_HANDLE destination, const
             }
             case EDM_BINARY_TYPE:
             {
-                size_t currentPosition = 0;
                 char* temp;
                 /*binary types */
                 /*Codes_SRS_AGENT_TYPE_SYSTEM_99_099:[EDM_BINARY:= *(4base64char)[base64b16 / base64b8]]*/
@@ -2243,50 +2183,8 @@ AGENT_DATA_TYPES_RESULT AgentDataTypes_ToString(STRING_HANDLE destination, const
 
                     size_t destinationPointer = 0;
                     temp[destinationPointer++] = '"';
-                    while (value->value.edmBinary.size - currentPosition >= 3)
-                    {
-                        char c1 = base64char(value->value.edmBinary.data[currentPosition] >> 2);
-                        char c2 = base64char(
-                            ((value->value.edmBinary.data[currentPosition] & 3) << 4) |
-                                (value->value.edmBinary.data[currentPosition + 1] >> 4)
-                        );
-                        char c3 = base64char(
-                            ((value->value.edmBinary.data[currentPosition + 1] & 0x0F) << 2) |
-                                ((value->value.edmBinary.data[currentPosition + 2] >> 6) & 3)
-                        );
-                        char c4 = base64char(
-                            value->value.edmBinary.data[currentPosition + 2] & 0x3F
-                        );
-                        currentPosition += 3;
-                        temp[destinationPointer++] = c1;
-                        temp[destinationPointer++] = c2;
-                        temp[destinationPointer++] = c3;
-                        temp[destinationPointer++] = c4;
-
-                    }
-                    if (value->value.edmBinary.size - currentPosition == 2)
-                    {
-                        char c1 = base64char(value->value.edmBinary.data[currentPosition] >> 2);
-                        char c2 = base64char(
-                            ((value->value.edmBinary.data[currentPosition] & 0x03) << 4) |
-                                (value->value.edmBinary.data[currentPosition + 1] >> 4)
-                        );
-                        char c3 = base64b16(value->value.edmBinary.data[currentPosition + 1] & 0x0F);
-                        temp[destinationPointer++] = c1;
-                        temp[destinationPointer++] = c2;
-                        temp[destinationPointer++] = c3;
-                        temp[destinationPointer++] = '=';
-                    }
-                    else if (value->value.edmBinary.size - currentPosition == 1)
-                    {
-                        char c1 = base64char(value->value.edmBinary.data[currentPosition] >> 2);
-                        char c2 = base64b8(value->value.edmBinary.data[currentPosition] & 0x03);
-                        temp[destinationPointer++] = c1;
-                        temp[destinationPointer++] = c2;
-                        temp[destinationPointer++] = '=';
-                        temp[destinationPointer++] = '=';
-                    }
-                    
+                    destinationPointer += iothub_base64_encode(temp + destinationPointer, value->value.edmBinary.data, value->value.edmBinary.size, IOTHUB_BASE64_ALPHABET_URL);
+
                     /*closing quote*/
                     temp[destinationPointer++] = '"';
                     /*null terminating the string*/
@@ -3912,11 +3810,9 @@ result = AGENT_DATA_TYPES_OK;
                             size_t destinationPosition = 0;
                             size_t consumed;
                             /*read and store "solid" groups of 4 base64 chars*/
-                            while (scan4base64char(source + sourcePosition, sourceLength - sourcePosition, agentData->value.edmBinary.data + destinationPosition, agentData->value.edmBinary.data + destinationPosition + 1, agentData->value.edmBinary.data + destinationPosition + 2) == 0)
-                            {
-                                sourcePosition += 4;
-                                destinationPosition += 3;
-                            }
+                            consumed = iothub_base64_decode_groups(agentData->value.edmBinary.data, source + sourcePosition, sourceLength - sourcePosition, IOTHUB_BASE64_ALPHABET_URL);
+                            sourcePosition += consumed;
+                            destinationPosition += (consumed / 4) * 3;
 
                             if (scanbase64b16(source + sourcePosition, sourceLength - sourcePosition, &consumed, agentData->value.edmBinary.data + destinationPosition, agentData->value.edmBinary.data + destinationPosition + 1) == 0)
                             {